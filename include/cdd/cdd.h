@@ -110,6 +110,11 @@
  * After use, all resources allocated by the library can be
  * released by calling \c cdd_done().
  *
+ * \c cdd_init() creates a manager holding all state of the library
+ * and makes it current on the calling thread. Several independent
+ * managers can be created with \c cdd_manager_create() and selected
+ * with \c cdd_manager_select(), e.g. one per thread.
+ *
  * @subsection operations Operations
  *
  * The library only supports a limited number of operations on
@@ -152,7 +157,9 @@
  * invoke it manually by calling \c cdd_gbc(), but notice that this is
  * rather expensive: It takes time to run the garbage collector, and
  * even worse is that the internal operation cache is cleared on each
- * invocation. You can add hooks to the garbage collector.
+ * invocation. You can add hooks to the garbage collector. Nodes
+ * which die young are reclaimed by cheaper minor collections, see \c
+ * cdd_setnurserysize().
  */
 
 /**
@@ -186,8 +193,11 @@ extern "C" {
 
 #define cdd_neg(node) ((ddNode*)((size_t)(node) ^ 0x1))
 
-#define cddop_and 0 /**< AND operation. @see cdd_apply() */
-#define cddop_xor 1 /**< XOR operation. @see cdd_apply() */
+#define cddop_and     0 /**< AND operation. @see cdd_apply() */
+#define cddop_xor     1 /**< XOR operation. @see cdd_apply() */
+#define cddop_or      2 /**< OR operation. @see cdd_apply() */
+#define cddop_diff    3 /**< Set minus, AND with the negated right operand. @see cdd_apply() */
+#define cddop_implies 4 /**< Implication, OR with the negated left operand. @see cdd_apply() */
 
 #define TYPE_CDD 0
 #define TYPE_BDD 1
@@ -195,16 +205,33 @@ extern "C" {
 /** Base type for decision diagram nodes. */
 typedef struct node_ ddNode;
 
+/** A self-contained instance of the library. @see cdd_manager_create() */
+typedef struct cdd_manager_ cdd_manager;
+
 /** Structure with information about garbage collection runs. */
 typedef struct s_CddGbcStat
 {
-    int32_t nodes;     /**< Number of allocated nodes. */
-    int32_t freenodes; /**< Number of free nodes */
-    int64_t time;      /**< Time used for garbage collection */
-    int64_t sumtime;   /**< Accumulated time for garbage collection */
-    int32_t num;       /**< Number of times garbage collection was done */
+    int32_t nodes;      /**< Number of allocated nodes. */
+    int32_t freenodes;  /**< Number of free nodes */
+    int64_t time;       /**< Time used for garbage collection */
+    int64_t sumtime;    /**< Accumulated time for garbage collection */
+    int32_t num;        /**< Number of times garbage collection was done */
+    int32_t saturated;  /**< Number of nodes kept because of a saturated reference count */
+    int64_t freedbytes; /**< Bytes of free nodes returned to the operating system */
+    int32_t young;      /**< Number of young nodes examined by a minor collection, or 0 */
 } CddGbcStat;
 
+/** Structure with statistics of an operation cache. @see cdd_cachestats() */
+typedef struct s_CddCacheStat
+{
+    size_t size;       /**< Number of entries */
+    size_t maxsize;    /**< Number of entries the cache may grow to */
+    size_t lookups;    /**< Number of lookups */
+    size_t hits;       /**< Number of lookups which found the result */
+    size_t overwrites; /**< Number of entries replaced by newer results */
+    int32_t resizes;   /**< Number of times the cache has grown */
+} CddCacheStat;
+
 /** Structure with information about rehashing */
 typedef struct s_CddRehashStat
 {
@@ -243,8 +270,8 @@ typedef struct
 /**
  * Initialise CDD library.
  * @param maxsize   the maximum arity of a decision diagram node.
- * @param cs        number of entries in operation cache.
- * @param stacksize size of stack used to keep temporary references.
+ * @param cs        initial number of entries in each operation cache, see \c cdd_setcachesize().
+ * @param stacksize initial size of the stack used to keep temporary references, which grows on demand.
  * @return 0 on success, or a non-zero error code on failure
  */
 extern int32_t cdd_init(int32_t maxsize, int32_t cs, size_t stacksize);
@@ -261,6 +288,73 @@ extern void cdd_done();
  */
 extern void cdd_ensure_running();
 
+/**
+ * Creates a new manager. A manager is a complete and independent
+ * instance of the library with its own nodes, levels, caches and
+ * statistics. The manager is not made current.
+ * @param maxsize   the maximum arity of a decision diagram node.
+ * @param cs        initial number of entries in each operation cache, see \c cdd_setcachesize().
+ * @param stacksize initial size of the stack used to keep temporary references, which grows on demand.
+ * @return a new manager, or NULL if out of memory
+ * @see cdd_manager_select
+ */
+extern cdd_manager* cdd_manager_create(int32_t maxsize, int32_t cs, size_t stacksize);
+
+/**
+ * Releases all resources allocated by \a man. Nodes of \a man must
+ * not be used afterwards. If \a man is current on the calling
+ * thread, the thread is left without a current manager.
+ * @param man a manager
+ */
+extern void cdd_manager_destroy(cdd_manager* man);
+
+/**
+ * Makes \a man the current manager of the calling thread. All
+ * subsequent operations on this thread use \a man. A manager must
+ * only be current on one thread at a time, and decision diagrams
+ * must only be passed to operations while their manager is current.
+ * @param man a manager or NULL
+ * @return the previous current manager
+ */
+extern cdd_manager* cdd_manager_select(cdd_manager* man);
+
+/**
+ * Returns the current manager of the calling thread.
+ * @return the current manager or NULL
+ */
+extern cdd_manager* cdd_manager_current();
+
+/**
+ * Attaches the calling thread to \a man, which is then shared between
+ * the thread owning it and all attached threads. The thread gets its
+ * own reference stack of initially \a stacksize entries and \a man
+ * becomes its current manager.
+ *
+ * While a manager is shared, \c cdd_apply(), \c cdd_apply_reduce(),
+ * \c cdd_reduce(), the node constructors and reference counting may
+ * be used concurrently from all threads using it. Other operations
+ * (quantification, substitution, printing, adding variables) require
+ * that no other thread uses the manager. Garbage collection and
+ * resizing of the node tables are postponed until the last thread has
+ * detached. Threads must attach before and detach after the
+ * concurrent phase, i.e. not while the owner runs an operation, and
+ * nodes created while shared must be referenced before the last thread
+ * detaches.
+ *
+ * @param man a manager
+ * @param stacksize initial size of the reference stack of the thread
+ * @return 0 on success, or a non-zero error code on failure
+ * @see cdd_manager_detach
+ */
+extern int32_t cdd_manager_attach(cdd_manager* man, size_t stacksize);
+
+/**
+ * Detaches the calling thread from the manager it was attached to
+ * with \c cdd_manager_attach() and restores the manager which was
+ * current before.
+ */
+extern void cdd_manager_detach();
+
 /**
  * Declares a number of BDD variables. The library maintains a list of
  * boolean and clock variables. This function adds more BDD variable
@@ -353,9 +447,18 @@ extern int32_t cdd_get_bdd_level_count();
  */
 extern int32_t cdd_getclocks();
 
+/**
+ * Returns the number of nodes whose reference count has saturated.
+ * Such nodes are never garbage collected and are only released by \c
+ * cdd_done(). Reference counts saturate at 1023 unless the library is
+ * built with the \c WIDEREF option.
+ * @return the number of saturated nodes of the current manager.
+ */
+extern int32_t cdd_getsaturated();
+
 /**
  * Returns true if the library has been initialised.
- * @return true if cdd_init() has been called one more time than cdd_done()
+ * @return true if the calling thread has a current manager
  */
 extern int32_t cdd_isrunning();
 
@@ -429,7 +532,8 @@ extern void cdd_prerehash_hook(void (*func)(void));
 extern void cdd_postrehash_hook(void (*func)(CddRehashStat*));
 
 /**
- * The default post GBC hook. It will print the GBC information to stderr.
+ * The default post GBC hook. It will print the GBC information of
+ * full collections to stderr; minor collections are not printed.
  * @param info pointer to a GBC statistics structure.
  * @see cdd_postgbc_hook
  */
@@ -445,14 +549,213 @@ extern void cdd_default_rehashhandler(CddRehashStat* info);
 /**
  * Trigger a garbage collector. The library will automatically run
  * the garbage collector when needed, but it can be triggered manually with
- * this function.
+ * this function. The variables are reordered instead if more BDD nodes
+ * are in use than the threshold set by \c cdd_setreorderthreshold().
  */
 extern void cdd_gbc();
 
+/**
+ * Sets the size of the nursery of each node manager. The nursery
+ * records the nodes added since the last garbage collection. When no
+ * free nodes are left, or when it is full while few are, a minor
+ * collection frees the dead nodes among them without sweeping the
+ * node tables. A nursery which fills up while free nodes are plenty
+ * is emptied without a collection. The tables are only swept when
+ * the minor collection does not provide free nodes. The memory of
+ * temporary results is thus reused while it is still in the
+ * processor cache. A size of 0 disables the nurseries. A nursery
+ * which is made smaller than the nodes it holds is only used again
+ * once the nurseries are emptied.
+ * @param size the number of nodes tracked per node manager
+ * @return the previous size, or a negative error code
+ */
+extern int32_t cdd_setnurserysize(int32_t size);
+
+/**
+ * Returns memory to the operating system. All chunks in which every
+ * node is free are released, which is most effective right after a
+ * garbage collection. The garbage collector itself only releases
+ * chunks while enough free nodes remain for the nodes in use. Cache
+ * entries with dead nodes are dropped when memory is released, the
+ * others are kept. Does nothing while the manager is shared.
+ * @return the number of bytes released
+ * @see CddGbcStat
+ */
+extern int64_t cdd_trim();
+
+/** @} */
+
+/**
+ * @name Variable reordering
+ * The size of a decision diagram depends on the order of its levels,
+ * which is the order in which the variables were declared. The BDD
+ * variables can be reordered by swapping adjacent levels, which
+ * rebuilds the nodes of the two levels in place, so diagrams held by
+ * the user keep their meaning.
+ *
+ * Only BDD levels are swapped: a CDD node has as many children as its
+ * constraint has intervals, so it cannot be rebuilt in place on
+ * another level. A BDD variable therefore only moves within its run
+ * of consecutive BDD levels, and clock differences keep their levels.
+ *
+ * BDD variables are still identified by the level they were declared
+ * at, which is what \c cdd_bddvar(), \c cdd_exist(), \c cdd_replace()
+ * and \c cdd_eval_point() expect. The level of a node, as used by \c
+ * cdd_get_levelinfo(), is its current position.
+ * @{
+ */
+
+/**
+ * Swaps the BDD levels \a level and \a level + 1. Nodes of the upper
+ * level which depend on the lower one are rebuilt in place, while the
+ * other nodes just move to the other level.
+ * @param level a BDD level followed by a BDD level
+ * @return 0 on success, or a negative error code
+ */
+extern int32_t cdd_swap_levels(int32_t level);
+
+/**
+ * Reorders the BDD variables by sifting: each variable, those with
+ * the most nodes first, is moved to every position in its run of BDD
+ * levels, or until the diagrams grow too much, and left where the
+ * number of nodes was smallest. Garbage is collected after each
+ * variable. Does nothing while the manager is shared.
+ * @return the number of BDD nodes in use afterwards, or a negative error code
+ */
+extern int32_t cdd_reorder();
+
+/**
+ * Sets the number of BDD nodes in use above which \c cdd_gbc()
+ * reorders the variables. After reordering the threshold is raised to
+ * twice the nodes left, so a good order is not searched again until
+ * the diagrams have grown. Operations never reorder on their own, as
+ * the levels of their operands must not change while they run. A
+ * threshold of 0, the default, disables automatic reordering.
+ * @param nodes the number of nodes
+ * @return the previous threshold, or a negative error code
+ */
+extern int32_t cdd_setreorderthreshold(int32_t nodes);
+
+/**
+ * Returns the current level of the BDD variable declared at \a var.
+ * @param var the level the variable was declared at
+ * @return the level of the variable
+ */
+extern int32_t cdd_get_var_level(int32_t var);
+
+/**
+ * Returns the level the BDD variable at \a level was declared at.
+ * @param level a BDD level
+ * @return the level the variable was declared at
+ */
+extern int32_t cdd_get_level_var(int32_t level);
+
+/** @} */
+
+/**
+ * @name Operation caches
+ * Each manager has a cache for each kind of operation. The caches
+ * are 2-way set-associative and replace the least recently used entry
+ * of a set. A cache starts with the size given to \c cdd_init() and
+ * doubles, up to 8 times that size, when it thrashes, i.e. when the
+ * hit rate drops while entries are overwritten. Growth is checked at
+ * the start of operations; the cache is cleared when it grows.
+ * Statistics are not updated while the manager is shared.
+ * @{
+ */
+
+#define CDD_APPLYCACHE   0 /**< Cache of \c cdd_apply() and \c cdd_apply_reduce() */
+#define CDD_QUANTCACHE   1 /**< Cache of \c cdd_exist() */
+#define CDD_REPLACECACHE 2 /**< Cache of \c cdd_replace() */
+
+/**
+ * Replaces an operation cache by an empty cache of \a size entries,
+ * which may grow to \a maxsize entries.
+ * @param cache one of \c CDD_APPLYCACHE, \c CDD_QUANTCACHE and \c
+ *        CDD_REPLACECACHE
+ * @param size the initial number of entries
+ * @param maxsize the maximum number of entries; no growth if not
+ *        larger than \a size
+ * @return 0 on success, or a negative error code
+ */
+extern int32_t cdd_setcachesize(int32_t cache, size_t size, size_t maxsize);
+
+/**
+ * Reads the statistics of an operation cache.
+ * @param cache one of \c CDD_APPLYCACHE, \c CDD_QUANTCACHE and \c
+ *        CDD_REPLACECACHE
+ * @param stat receives the statistics
+ * @return 0 on success, or a negative error code
+ */
+extern int32_t cdd_cachestats(int32_t cache, CddCacheStat* stat);
+
+/** @} */
+
+/**
+ * @name Memory limits
+ * The memory of a manager may be limited by a number of nodes and by
+ * a budget of bytes for nodes and operation caches. Before a limit
+ * would be exceeded, all node managers are garbage collected and free
+ * chunks are returned with \c cdd_trim(). If that does not help, the
+ * error \c CDD_NODENUM or \c CDD_MEMORY is stored in the error
+ * condition of the calling thread. The operations built on \c
+ * cdd_apply() then back off: they return NULL without computing
+ * anything until the error is cleared with \c cdd_clearerror(). An
+ * operation which reaches the limit returns NULL as well. This covers
+ * \c cdd_apply(), \c cdd_apply_reduce(), \c cdd_apply_n(), \c
+ * cdd_apply_par(), \c cdd_ite(), \c cdd_exist(), \c cdd_and_exist(), \c
+ * cdd_replace(), \c cdd_reduce(), \c cdd_reduce2(), \c
+ * cdd_from_dbms(), \c cdd_remove_negative() and \c cdd_extract_dbm();
+ * the cdd class throws \c std::bad_alloc instead. Constructors such as
+ * \c cdd_interval(), \c cdd_upper(), \c cdd_bddvar() and \c
+ * cdd_from_dbm() return the false terminal in place of a node which
+ * cannot be allocated, so only the error condition tells it apart.
+ * While the error is raised the manager grows by at most 256 KiB of
+ * nodes for backing off, after which no more nodes are allocated.
+ * Limits are not checked while the manager is shared.
+ * @{
+ */
+
+/**
+ * Limits the number of nodes allocated.
+ * @param size the maximum number of nodes, or 0 for no limit
+ * @return the previous limit, or a negative error code
+ */
+extern int32_t cdd_setmaxnodenum(int32_t size);
+
+/**
+ * Sets the percentage of nodes which must be dead for the garbage
+ * collector to run before more memory is allocated. The default is
+ * 20.
+ * @param mf a percentage between 0 and 100
+ * @return the previous percentage, or a negative error code
+ */
+extern int32_t cdd_setminfreenodes(int32_t mf);
+
+/**
+ * Limits the memory used for nodes and operation caches. The caches
+ * are limited to a quarter of the budget, and are shrunk if they are
+ * larger.
+ * @param bytes the budget in bytes, or 0 for no limit
+ * @return the previous budget, or a negative error code
+ */
+extern int64_t cdd_setmemorybudget(int64_t bytes);
+
+/**
+ * Returns the memory used for nodes and operation caches.
+ * @return a number of bytes
+ */
+extern int64_t cdd_getmemoryused();
+
+/**
+ * Clears the error condition of the calling thread, e.g. after a
+ * memory limit was reached and raised.
+ * @return the error which was cleared, or 0
+ */
+extern int32_t cdd_clearerror();
+
 /** @} */
 
-// extern int32_t         cdd_setmaxnodenum(int);
-// extern int32_t         cdd_setminfreenodes(int);
 
 // extern int32_t         cdd_getnodenum();
 
@@ -482,20 +785,28 @@ extern ddNode* cdd_upper(int32_t i, int32_t j, raw_t bound);
 extern ddNode* cdd_interval(int32_t i, int32_t j, raw_t lower, raw_t upper);
 
 /**
- * Creates a BDD node. The boolean variable is identified by the node
- * level. The level must correspond to a BDD variable (as opposed to
- * a clock difference).
- * @param level a node level
+ * Creates a BDD node. The boolean variable is identified by the level
+ * it was declared at, which is its node level unless the variables
+ * have been reordered. The level must correspond to a BDD variable
+ * (as opposed to a clock difference).
+ * @param level the level the variable was declared at
  * @return a BDD node
+ * @see cdd_reorder
  */
 extern ddNode* cdd_bddvar(int32_t level);
 
 /**
- * Performs a binary operation on two decision diagrams.
+ * Performs a binary operation on two decision diagrams. The
+ * operations \c cddop_or, \c cddop_diff and \c cddop_implies are
+ * computed as conjunctions of possibly negated operands and share
+ * their cache entries with \c cddop_and. Any other operation than
+ * these and \c cddop_xor is reported as \c CDD_OP and yields \c
+ * cddfalse.
  * @param left  the left argument to the operation
  * @param right the right argument to the operation
  * @param op    the binary operation to perform
- * @return the resulting decision diagram
+ * @return the resulting decision diagram, or NULL if a memory limit
+ *         was reached, see \c cdd_setmemorybudget()
  */
 extern ddNode* cdd_apply(ddNode* left, ddNode* right, int32_t op);
 
@@ -505,10 +816,97 @@ extern ddNode* cdd_apply(ddNode* left, ddNode* right, int32_t op);
  * @param left  the left argument to the operation
  * @param right the right argument to the operation
  * @param op    the binary operation to perform
- * @return the resulting decision diagram
+ * @return the resulting decision diagram, or NULL if a memory limit
+ *         was reached, see \c cdd_setmemorybudget()
  */
 extern ddNode* cdd_apply_reduce(ddNode* left, ddNode* right, int32_t op);
 
+/**
+ * Performs a binary operation on all of \a n decision diagrams, e.g.
+ * the conjunction of the constraints of a guard. For \c cddop_and and
+ * \c cddop_or the operands are merged level by level in one
+ * recursion, so no intermediate diagram is built for the prefixes of
+ * the operands. Sets of more than two operands are only reused within
+ * the call; they do not enter the apply cache. Other operations are
+ * applied from left to right.
+ * @param args the operands
+ * @param n    the number of operands
+ * @param op   the binary operation to perform
+ * @return the resulting decision diagram; \c cddtrue for no
+ *         operands of \c cddop_and and \c cddfalse otherwise, or
+ *         NULL if a memory limit was reached
+ */
+extern ddNode* cdd_apply_n(ddNode* const* args, size_t n, int32_t op);
+
+/**
+ * Performs a binary operation on two decision diagrams using \a
+ * nthreads threads, including the calling thread. The recursion of \c
+ * cdd_apply() is unfolded into tasks down to the depth set with \c
+ * cdd_setparcutoff(); below it the tasks run \c cdd_apply() on the
+ * current manager, which is shared with the other threads for the
+ * duration of the call. Idle threads steal tasks from busy ones. The
+ * result is the same as that of \c cdd_apply().
+ * @param left     the left argument to the operation
+ * @param right    the right argument to the operation
+ * @param op       the binary operation to perform
+ * @param nthreads the number of threads to use
+ * @return the resulting decision diagram, or NULL if a memory limit
+ *         was reached by any of the threads
+ * @see cdd_manager_attach
+ */
+extern ddNode* cdd_apply_par(ddNode* left, ddNode* right, int32_t op, int32_t nthreads);
+
+/**
+ * Sets the depth down to which \c cdd_apply_par() unfolds the
+ * recursion into tasks. Each level of depth multiplies the number of
+ * tasks by the number of children of the nodes.
+ * @param depth the new depth
+ * @return the previous depth
+ */
+extern int32_t cdd_setparcutoff(int32_t depth);
+
+/**
+ * @name Relational queries
+ * The queries compare the sets represented by two decision diagrams
+ * without building any node. They follow the recursion of \c
+ * cdd_apply_reduce() and stop at the first pair of paths which decides
+ * the answer, so diagrams are compared as if reduced. Answers for
+ * pairs of nodes, ignoring the constraints above them, are kept in a
+ * cache of the manager, which is sized relative to the operation
+ * caches.
+ * @{
+ */
+
+/**
+ * Tests whether two decision diagrams intersect. Equivalent to
+ * <tt>cdd_reduce(cdd_apply(left, right, cddop_and)) != cddfalse</tt>.
+ * @param left  a decision diagram
+ * @param right a decision diagram
+ * @return true if \a left and \a right have a common valuation
+ */
+extern int32_t cdd_intersects(ddNode* left, ddNode* right);
+
+/**
+ * Tests whether a decision diagram is included in another.
+ * Equivalent to <tt>!cdd_intersects(left, cdd_neg(right))</tt>.
+ * @param left  a decision diagram
+ * @param right a decision diagram
+ * @return true if every valuation of \a left is one of \a right
+ */
+extern int32_t cdd_subset(ddNode* left, ddNode* right);
+
+/**
+ * Tests whether two decision diagrams represent the same set.
+ * Equivalent to <tt>cdd_reduce(cdd_apply(left, right, cddop_xor)) ==
+ * cddfalse</tt>.
+ * @param left  a decision diagram
+ * @param right a decision diagram
+ * @return true if \a left and \a right are equivalent under reduction
+ */
+extern int32_t cdd_equiv(ddNode* left, ddNode* right);
+
+/** @} */
+
 /**
  * Brings a CDD into reduced form. The reduced form is pseudo
  * canonical in the sense that a tautology is represented by \c
@@ -540,6 +938,19 @@ extern int32_t cdd_edgecount(ddNode* dd);
  */
 extern ddNode* cdd_exist(ddNode*, int32_t*, int32_t*);
 
+/**
+ * Existential quantification of a conjunction. Equivalent to
+ * <tt>cdd_exist(cdd_apply(left, right, cddop_and), levels,
+ * clocks)</tt>, but quantifies during the recursion of the
+ * conjunction, so the conjunction itself is never built.
+ * @param left   a decision diagram
+ * @param right  a decision diagram
+ * @param levels the BDD levels to quantify, indexed by level
+ * @param clocks the clocks to quantify, indexed by clock
+ * @return the quantified conjunction of \a left and \a right
+ */
+extern ddNode* cdd_and_exist(ddNode* left, ddNode* right, int32_t* levels, int32_t* clocks);
+
 /**
  * Variable substitution. @todo
  */
@@ -569,6 +980,69 @@ extern ddNode* cdd_reduce2(ddNode*);
  */
 extern int32_t cdd_contains(ddNode* cdd, raw_t* dbm, int32_t dim);
 
+/**
+ * Returns true if all of \a dbms are included in the CDD. The zones
+ * are tested in one pass which shares the results for equal parts of
+ * the zones, so testing a federation is cheaper than testing each
+ * zone with \c cdd_contains().
+ * @param cdd a cdd
+ * @param dbms an array of \a n DBMs of dimension \a dim
+ * @param n the number of DBMs
+ * @param dim the dimension of the DBMs
+ * @return true if all of \a dbms are included in \a cdd, false
+ *         otherwise or if memory is short
+ * @see cdd_contains
+ */
+extern int32_t cdd_contains_many(ddNode* cdd, const raw_t* const* dbms, size_t n, int32_t dim);
+
+/**
+ * Evaluates the CDD at a point. Only the nodes of one path are
+ * visited, so no zone is built.
+ * @param cdd a cdd
+ * @param clocks the value of each clock, where clock 0 is 0
+ * @param vars the value of each boolean variable, indexed by level
+ * @return true if the point satisfies \a cdd
+ * @see cdd_frozen_eval
+ */
+extern int32_t cdd_eval_point(ddNode* cdd, const int32_t* clocks, const bool* vars);
+
+/**
+ * A CDD flattened into one block of memory with the levels, bounds
+ * and child indices of its nodes. It has no pointers, so it can be
+ * copied as it is, and does not change when nodes are collected.
+ * @see cdd_freeze
+ */
+typedef struct cdd_frozen_ cdd_frozen;
+
+/**
+ * Freezes \a cdd for fast evaluation at points.
+ * @param cdd a cdd
+ * @return the frozen CDD, or NULL if out of memory
+ * @see cdd_frozen_eval
+ */
+extern cdd_frozen* cdd_freeze(ddNode* cdd);
+
+/**
+ * Returns the size in bytes of the block of a frozen CDD.
+ * @param f a frozen CDD
+ */
+extern size_t cdd_frozen_size(const cdd_frozen* f);
+
+/**
+ * Evaluates a frozen CDD at a point, like \c cdd_eval_point().
+ * @param f a frozen CDD
+ * @param clocks the value of each clock, where clock 0 is 0
+ * @param vars the value of each boolean variable, indexed by level
+ * @return true if the point satisfies \a f
+ */
+extern int32_t cdd_frozen_eval(const cdd_frozen* f, const int32_t* clocks, const bool* vars);
+
+/**
+ * Destroys a frozen CDD.
+ * @param f a frozen CDD, or NULL
+ */
+extern void cdd_frozen_destroy(cdd_frozen* f);
+
 /**
  * Convert a DBM to a CDD. It is important that the indexes of the DBM
  * correspond to clocks in the CDD library.
@@ -577,6 +1051,19 @@ extern int32_t cdd_contains(ddNode* cdd, raw_t* dbm, int32_t dim);
  */
 extern ddNode* cdd_from_dbm(const raw_t* dbm, int32_t dim);
 
+/**
+ * Convert a set of DBMs to a CDD of their union. The zones are
+ * converted one at a time and merged in a balanced tree of unions, so
+ * each union combines results of similar size rather than adding
+ * every zone to one growing CDD.
+ * @param dbms an array of \a n DBMs of dimension \a dim
+ * @param n the number of DBMs
+ * @param dim the dimension of the DBMs
+ * @return a CDD equivalent to the union of \a dbms
+ * @see cdd_from_dbm
+ */
+extern ddNode* cdd_from_dbms(const raw_t* const* dbms, size_t n, int32_t dim);
+
 /**
  * Extract a zone from a CDD.  This function will extract a zone from
  * \a cdd and write it to \a dbm.  It will return a CDD equivalent to
@@ -587,6 +1074,54 @@ extern ddNode* cdd_from_dbm(const raw_t* dbm, int32_t dim);
  */
 extern ddNode* cdd_extract_dbm(ddNode* cdd, raw_t* dbm, int32_t dim);
 
+/**
+ * State of an enumeration of the zones of a CDD.
+ * @see cdd_enumerator_create
+ */
+typedef struct cdd_enumerator_ cdd_enumerator;
+
+/**
+ * Starts an enumeration of the zones of \a cdd. The zones are those
+ * of the paths to true, which are disjoint and together equal \a
+ * cdd. They are found in a single traversal which constrains a DBM
+ * along the path, so no diagrams are built. Paths which turn out to
+ * be inconsistent are skipped; a reduced CDD has none. Both branches
+ * of BDD nodes are followed. The CDD must stay referenced, and no
+ * nodes may be created in a shared manager, until the enumeration is
+ * destroyed.
+ * @param cdd a cdd
+ * @param dim the dimension of the zones
+ * @return the enumeration, or NULL if out of memory
+ * @see cdd_enumerator_next
+ */
+extern cdd_enumerator* cdd_enumerator_create(ddNode* cdd, int32_t dim);
+
+/**
+ * Returns the next zone of an enumeration.
+ * @param e an enumeration
+ * @return a closed DBM, valid until the next call, or NULL if all
+ *         zones were visited
+ */
+extern const raw_t* cdd_enumerator_next(cdd_enumerator* e);
+
+/**
+ * Destroys an enumeration.
+ * @param e an enumeration, or NULL
+ */
+extern void cdd_enumerator_destroy(cdd_enumerator* e);
+
+/**
+ * Calls \a func for each zone of \a cdd, until it returns nonzero.
+ * @param cdd a cdd
+ * @param dim the dimension of the zones
+ * @param func receives a closed DBM of each zone and \a arg
+ * @param arg passed to \a func
+ * @return the number of zones visited, or a negative error code
+ * @see cdd_enumerator_create
+ */
+extern int32_t cdd_foreach_zone(ddNode* cdd, int32_t dim, int32_t (*func)(const raw_t* dbm, int32_t dim, void* arg),
+                                void* arg);
+
 /**
  * Print a CDD \a r as a dot input file \a ofile.\n\n
  *
@@ -618,6 +1153,19 @@ extern ddNode* cdd_extract_dbm(ddNode* cdd, raw_t* dbm, int32_t dim);
  */
 extern void cdd_fprintdot(FILE* ofile, ddNode* cdd, bool push_negate);
 
+/**
+ * Print at most \a maxnodes nodes of a CDD in dot format, like \c
+ * cdd_fprintdot(). Nodes are printed breadth first from the root, and
+ * the nodes beyond the limit are printed as "..." without their
+ * children, so the top of a large diagram can be dumped quickly.
+ *
+ * @param ofile the file to write to.
+ * @param cdd   a CDD.
+ * @param push_negate see \c cdd_fprintdot().
+ * @param maxnodes the maximum number of nodes printed, or 0 for all.
+ */
+extern void cdd_fprintdot_limit(FILE* ofile, ddNode* cdd, bool push_negate, size_t maxnodes);
+
 /**
  * Print a CDD \a r as a dot input file to stdout.
  * @see cdd_fprintdot
@@ -648,6 +1196,80 @@ extern void cdd_fprint_graph(FILE* ofile, ddNode* cdd, cdd_print_varloc_f printe
 
 /** @} */
 
+/**
+ * @name Saving and loading
+ * Decision diagrams are saved in a compact binary format: a table of
+ * the declared levels followed by the nodes, each after its children,
+ * with varint encoded bounds and relative child numbers. Levels are
+ * identified by their clocks or the level at which they were
+ * declared, so a file can be loaded into another manager declaring
+ * the same variables, in any variable order.
+ * @{
+ */
+
+/**
+ * A writer saving diagrams to a file one at a time. Nodes shared
+ * with diagrams saved before are not saved again.
+ */
+typedef struct cdd_writer_ cdd_writer;
+
+/**
+ * Creates a writer and writes the table of the levels declared so
+ * far to \a ofile.
+ * @param ofile the file to write to
+ * @return the writer, or NULL if out of memory
+ */
+extern cdd_writer* cdd_writer_create(FILE* ofile);
+
+/**
+ * Writes the nodes of \a cdd not written before, and \a cdd as the
+ * next root. The roots are referenced until the writer is closed.
+ * @param w a writer
+ * @param cdd a cdd
+ * @return 0 on success, \c CDD_VAR if \a cdd has a level declared
+ * after the writer was created, \c CDD_FILE if writing failed, or
+ * \c CDD_MEMORY. The writer keeps failing after an error.
+ */
+extern int32_t cdd_writer_add(cdd_writer* w, ddNode* cdd);
+
+/**
+ * Ends the file and destroys the writer. The file is not closed.
+ * @param w a writer
+ * @return 0 on success, or the first error of the writer
+ */
+extern int32_t cdd_writer_close(cdd_writer* w);
+
+/**
+ * Saves the \a n diagrams \a roots to \a ofile.
+ * @return 0 on success, or an error of \c cdd_writer_add()
+ */
+extern int32_t cdd_save(FILE* ofile, ddNode* const* roots, int32_t n);
+
+/**
+ * Loads the diagrams saved in the \a size bytes at \a data. The file
+ * is checked before any node is created. Nodes are created directly
+ * where the variable order allows it, with the free nodes and the BDD
+ * subtables sized beforehand, and else with operations.
+ * @param data the contents of a file
+ * @param size the size of the file
+ * @param roots set to an array of the referenced roots in the order
+ * they were saved, to be freed with free(), or NULL on error
+ * @return the number of roots, \c CDD_FORMAT if the file is malformed,
+ * \c CDD_VAR if a level of the file is not declared, \c CDD_MAXSIZE,
+ * or \c CDD_MEMORY
+ */
+extern int32_t cdd_load(const void* data, size_t size, ddNode*** roots);
+
+/**
+ * Loads the diagrams saved in the file \a filename like \c cdd_load(),
+ * mapping the file into memory.
+ * @return the number of roots, \c CDD_FILE if the file cannot be
+ * read, or an error of \c cdd_load()
+ */
+extern int32_t cdd_fnload(const char* filename, ddNode*** roots);
+
+/** @} */
+
 /**
  * The empty decision diagram.
  */
@@ -689,8 +1311,9 @@ extern ddNode* cddtrue;
 #define CDD_STACKOVERFLOW (-19) /**< Reference stack overflow */
 #define CDD_NODE          (-20) /**< Invalid node type */
 #define CDD_MAXSIZE       (-21) /**< CDD Node larger than maximum allowed */
+#define CDD_SHARED        (-22) /**< Not allowed while the manager is shared */
 
-#define CDD_ERRNUM 21
+#define CDD_ERRNUM 22
 
 /** @} error codes */
 
@@ -698,6 +1321,12 @@ extern ddNode* cddtrue;
 
 #ifdef __cplusplus
 
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+
 /**
  * @defgroup cplusplus The C++ interface
  *
@@ -723,6 +1352,67 @@ extern ddNode* cddtrue;
  * @{
  */
 
+namespace dbm {
+class fed_t;
+}
+
+/**
+ * Scoped ownership of a \c cdd_manager. The constructor creates a new
+ * manager and makes it current on the calling thread; the destructor
+ * destroys it and restores the manager which was current before.
+ * All cdd objects created while the context is current belong to it
+ * and must be destroyed before the context is.
+ */
+class cdd_context
+{
+public:
+    /**
+     * Creates and selects a new manager.
+     * @see cdd_manager_create
+     * @throw std::bad_alloc if the manager cannot be allocated
+     */
+    cdd_context(int32_t maxsize, int32_t cs, size_t stacksize);
+
+    /**
+     * Destroys the manager and restores the previous one.
+     */
+    ~cdd_context();
+
+    cdd_context(const cdd_context&) = delete;
+    cdd_context& operator=(const cdd_context&) = delete;
+
+    /**
+     * Returns the manager owned by this context.
+     */
+    [[nodiscard]] cdd_manager* handle() const { return man; }
+
+private:
+    cdd_manager* man;
+    cdd_manager* prev;
+};
+
+/**
+ * Scoped attachment of the calling thread to a shared manager.
+ * @see cdd_manager_attach
+ */
+class cdd_worker
+{
+public:
+    /**
+     * Attaches the calling thread to \a man.
+     * @throw std::bad_alloc if the thread state cannot be allocated
+     */
+    cdd_worker(cdd_manager* man, size_t stacksize);
+
+    /**
+     * Detaches the calling thread again.
+     */
+    ~cdd_worker();
+
+    cdd_worker(const cdd_worker&) = delete;
+    cdd_worker& operator=(const cdd_worker&) = delete;
+};
+
 /**
  * C++ encapsulation of a decision diagram node (a ddNode). The class
  * maintains a reference to the node throughout its lifetime.
@@ -741,14 +1431,29 @@ public:
      */
     cdd(const cdd& r);
 
+    /**
+     * Move constructor. The reference of \a r is taken over, and \a r
+     * is left as the empty CDD.
+     * @param r another cdd
+     */
+    cdd(cdd&& r) noexcept: root(r.root) { r.root = cddfalse; }
+
     /**
      * Construct from DBM.
      */
     cdd(const raw_t* dbm, uint32_t dim);
 
+    /**
+     * Construct from the union of the zones of a federation.
+     * @see cdd_from_dbms
+     */
+    explicit cdd(const dbm::fed_t& fed);
+
     /**
      * Construct cdd object by wrapping a ddNode pointer.
      * @param r a ddNode
+     * @throw std::bad_alloc if \a r is NULL, i.e. the operation which
+     *        built it reached a memory limit
      */
     explicit cdd(ddNode* r);
 
@@ -772,41 +1477,68 @@ public:
      */
     cdd& operator=(const cdd& r);
 
+    /**
+     * Move assignment operator. The references are exchanged, so the
+     * old node is released when \a r is destroyed.
+     * @param r a cdd
+     * @return this
+     */
+    cdd& operator=(cdd&& r) noexcept
+    {
+        std::swap(root, r.root);
+        return *this;
+    }
+
     /**
      * Assignment operator for conjunction.
      */
-    cdd operator&=(const cdd& r);
+    cdd& operator&=(const cdd& r);
 
     /**
      * Disjunction operator.
      */
-    cdd operator|(const cdd& r) const;
+    cdd operator|(const cdd& r) const&;
+
+    /**
+     * Disjunction operator, which reuses this temporary for the result.
+     */
+    cdd operator|(const cdd& r) &&;
 
     /**
      * Assignment operator for disjunction.
      */
-    cdd operator|=(const cdd& r);
+    cdd& operator|=(const cdd& r);
 
     /**
      * Set minus operator. The result is the set minus between the
      * left and the right operand.
      */
-    cdd operator-(const cdd& r) const;
+    cdd operator-(const cdd& r) const&;
+
+    /**
+     * Set minus operator, which reuses this temporary for the result.
+     */
+    cdd operator-(const cdd& r) &&;
 
     /**
      * Assignment operator for set minus.
      */
-    cdd operator-=(const cdd& r);
+    cdd& operator-=(const cdd& r);
 
     /**
      * XOR operator.
      */
-    cdd operator^(const cdd& r) const;
+    cdd operator^(const cdd& r) const&;
+
+    /**
+     * XOR operator, which reuses this temporary for the result.
+     */
+    cdd operator^(const cdd& r) &&;
 
     /**
      * Assignment operator for XOR.
      */
-    cdd operator^=(const cdd& r);
+    cdd& operator^=(const cdd& r);
 
     /**
      * Unary negation. This computes the complement of the decision diagram.
@@ -834,7 +1566,7 @@ public:
 private:
     ddNode* root{cddfalse};
 
-    cdd operator=(ddNode* r);
+    cdd& operator=(ddNode* r);
 
     friend cdd cdd_true();
     friend cdd cdd_false();
@@ -849,6 +1581,7 @@ private:
     friend int32_t cdd_nodecount(const cdd&);
     friend cdd cdd_apply(const cdd&, const cdd&, int);
     friend cdd cdd_apply_reduce(const cdd&, const cdd&, int);
+    friend cdd cdd_apply_par(const cdd&, const cdd&, int, int);
     friend cdd cdd_ite(const cdd&, const cdd&, const cdd&);
     friend cdd cdd_reduce(const cdd&);
     friend cdd cdd_reduce2(const cdd&);
@@ -868,6 +1601,65 @@ private:
 #endif
 };
 
+/**
+ * Input iterator over the zones of a cdd. A default constructed
+ * iterator marks the end.
+ * @see cdd_enumerator_create
+ */
+class cdd_zone_iterator
+{
+public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = const raw_t*;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const raw_t* const*;
+    using reference = const raw_t*;
+
+    cdd_zone_iterator() = default;
+
+    /**
+     * Starts at the first zone of \a c.
+     * @throw std::bad_alloc if the enumeration cannot be allocated
+     */
+    cdd_zone_iterator(const cdd& c, int32_t dim);
+
+    /** Returns the closed DBM of the zone, valid until the iterator is advanced. */
+    const raw_t* operator*() const { return dbm; }
+
+    cdd_zone_iterator& operator++()
+    {
+        dbm = cdd_enumerator_next(zones.get());
+        return *this;
+    }
+
+    bool operator==(const cdd_zone_iterator& r) const { return dbm == r.dbm; }
+    bool operator!=(const cdd_zone_iterator& r) const { return dbm != r.dbm; }
+
+private:
+    cdd root;
+    std::shared_ptr<cdd_enumerator> zones;
+    const raw_t* dbm{nullptr};
+};
+
+/** The zones of a cdd, as returned by \c cdd_zones(). */
+class cdd_zone_range
+{
+public:
+    cdd_zone_range(const cdd& c, int32_t dim): root(c), dim(dim) {}
+    cdd_zone_iterator begin() const { return cdd_zone_iterator(root, dim); }
+    cdd_zone_iterator end() const { return cdd_zone_iterator(); }
+
+private:
+    cdd root;
+    int32_t dim;
+};
+
+/**
+ * Returns the zones of \a c for use in a range-based for loop.
+ * @see cdd_enumerator_create
+ */
+inline cdd_zone_range cdd_zones(const cdd& c, int32_t dim) { return cdd_zone_range(c, dim); }
+
 /*=== Inline C++ interface ============================================*/
 
 /**
@@ -878,11 +1670,37 @@ private:
  */
 inline bool cdd_contains(const cdd& c, raw_t* dbm, int32_t dim) { return cdd_contains(c.root, dbm, dim); }
 
+/**
+ * Returns true if all zones of \a fed are included in the CDD.
+ * @see cdd_contains_many
+ */
+bool cdd_contains(const cdd& c, const dbm::fed_t& fed);
+
+/**
+ * Evaluates the CDD at a point.
+ * @see cdd_eval_point
+ */
+inline bool cdd_eval_point(const cdd& c, const int32_t* clocks, const bool* vars)
+{
+    return cdd_eval_point(c.handle(), clocks, vars);
+}
+
+/**
+ * Freezes the CDD for fast evaluation at points.
+ * @see cdd_freeze
+ */
+inline cdd_frozen* cdd_freeze(const cdd& c) { return cdd_freeze(c.handle()); }
+
 /**
  * AND operator. Computes the conjunction of the two operands.
  */
 inline cdd operator&(const cdd& l, const cdd& r) { return cdd_apply(l, r, cddop_and); }
 
+/**
+ * AND operator, which reuses the temporary \a l for the result.
+ */
+inline cdd operator&(cdd&& l, const cdd& r) { return std::move(l &= r); }
+
 /**
  * If-then-else operator.
  */
@@ -967,6 +1785,15 @@ inline cdd cdd_false() { return cdd(cddfalse); }
  */
 inline cdd cdd_exist(const cdd& r, int32_t* levels, int32_t* clocks) { return cdd(cdd_exist(r.root, levels, clocks)); }
 
+/**
+ * Existential quantification of a conjunction.
+ * @see cdd_and_exist(ddNode*, ddNode*, int32_t*, int32_t*)
+ */
+inline cdd cdd_and_exist(const cdd& l, const cdd& r, int32_t* levels, int32_t* clocks)
+{
+    return cdd(cdd_and_exist(l.handle(), r.handle(), levels, clocks));
+}
+
 /**
  * Variable substitution.
  * @todo
@@ -1005,6 +1832,51 @@ inline cdd cdd_apply_reduce(const cdd& left, const cdd& right, int32_t op)
     return cdd(cdd_apply_reduce(left.root, right.root, op));
 }
 
+/**
+ * Performs a binary operation on two decision diagrams in parallel.
+ * @param left     the left argument to the operation
+ * @param right    the right argument to the operation
+ * @param op       the binary operation to perform
+ * @param nthreads the number of threads to use
+ * @return the resulting decision diagram
+ * @see cdd_apply_par(ddNode*, ddNode*, int32_t, int32_t)
+ */
+inline cdd cdd_apply_par(const cdd& left, const cdd& right, int32_t op, int32_t nthreads)
+{
+    return cdd(cdd_apply_par(left.root, right.root, op, nthreads));
+}
+
+/**
+ * Performs a binary operation on all CDDs of a range.
+ * @param args a range of cdds
+ * @param op   the binary operation to perform
+ * @return the resulting decision diagram
+ * @see cdd_apply_n(ddNode* const*, size_t, int32_t)
+ */
+template <typename Range>
+cdd cdd_apply_n(const Range& args, int32_t op)
+{
+    std::vector<ddNode*> nodes;
+    for (const cdd& c : args)
+        nodes.push_back(c.handle());
+    return cdd(cdd_apply_n(nodes.data(), nodes.size(), op));
+}
+
+/** Performs a binary operation on a list of CDDs, e.g. <tt>cdd_apply_n({a, b, c}, cddop_and)</tt>. */
+inline cdd cdd_apply_n(std::initializer_list<cdd> args, int32_t op)
+{
+    return cdd_apply_n<std::initializer_list<cdd>>(args, op);
+}
+
+/** Tests whether two CDDs intersect, see \c cdd_intersects(ddNode*, ddNode*). */
+inline bool cdd_intersects(const cdd& left, const cdd& right) { return cdd_intersects(left.handle(), right.handle()); }
+
+/** Tests whether \a left is included in \a right, see \c cdd_subset(ddNode*, ddNode*). */
+inline bool cdd_subset(const cdd& left, const cdd& right) { return cdd_subset(left.handle(), right.handle()); }
+
+/** Tests whether two CDDs are equivalent, see \c cdd_equiv(ddNode*, ddNode*). */
+inline bool cdd_equiv(const cdd& left, const cdd& right) { return cdd_equiv(left.handle(), right.handle()); }
+
 /**
  * Brings a CDD into reduced form. The reduced form is pseudo
  * canonical in the sense that a tautology is represented by \c
@@ -1043,6 +1915,15 @@ inline void cdd_fprintdot(FILE* ofile, const cdd& cdd, bool push_negate)
     cdd_fprintdot(ofile, cdd.root, push_negate);
 }
 
+/**
+ * Print at most \a maxnodes nodes of a CDD as a dot input file \a ofile.
+ * @see cdd_fprintdot_limit(FILE*, ddNode*, bool, size_t)
+ */
+inline void cdd_fprintdot_limit(FILE* ofile, const cdd& cdd, bool push_negate, size_t maxnodes)
+{
+    cdd_fprintdot_limit(ofile, cdd.handle(), push_negate, maxnodes);
+}
+
 /**
  * Print a CDD \a r as a dot input file to stdout.
  * @see cdd_fprintdot
@@ -1066,6 +1947,16 @@ inline void cdd_fprint_graph(FILE* ofile, const cdd& cdd, cdd_print_varloc_f pri
     cdd_fprint_graph(ofile, cdd.root, printer1, printer2, data);
 }
 
+/** Writes \a cdd as the next root of \a w, see cdd_writer_add(ddNode*). */
+inline int32_t cdd_writer_add(cdd_writer* w, const cdd& cdd) { return cdd_writer_add(w, cdd.handle()); }
+
+/**
+ * Loads the diagrams saved in the file \a filename and appends them to
+ * \a roots.
+ * @return the number of roots, or an error of \c cdd_fnload()
+ */
+int32_t cdd_fnload(const char* filename, std::vector<cdd>& roots);
+
 #ifdef MULTI_TERMINAL
 inline cdd cdd_apply_tautology(const cdd& dd, int32_t t_id) { return cdd(cdd_apply_tautology(dd.root, t_id)); }
 
@@ -1096,19 +1987,28 @@ inline cdd cdd::operator&(const cdd &r) const
 { return cdd_apply(*this, r, cddop_and); }
 */
 
-inline cdd cdd::operator&=(const cdd& r) { return (*this = *this & r); }
+// The operators apply the C interface to the nodes directly, so that
+// only the result is referenced.
+
+inline cdd& cdd::operator&=(const cdd& r) { return *this = cdd_apply(root, r.root, cddop_and); }
+
+inline cdd cdd::operator|(const cdd& r) const& { return cdd(cdd_apply(root, r.root, cddop_or)); }
+
+inline cdd cdd::operator|(const cdd& r) && { return std::move(*this |= r); }
+
+inline cdd& cdd::operator|=(const cdd& r) { return *this = cdd_apply(root, r.root, cddop_or); }
 
-inline cdd cdd::operator|(const cdd& r) const { return !cdd_apply(!*this, !r, cddop_and); }
+inline cdd cdd::operator-(const cdd& r) const& { return cdd(cdd_apply(root, cdd_neg(r.root), cddop_and)); }
 
-inline cdd cdd::operator|=(const cdd& r) { return (*this = *this | r); }
+inline cdd cdd::operator-(const cdd& r) && { return std::move(*this -= r); }
 
-inline cdd cdd::operator-(const cdd& r) const { return cdd_apply(*this, !r, cddop_and); }
+inline cdd& cdd::operator-=(const cdd& r) { return *this = cdd_apply(root, cdd_neg(r.root), cddop_and); }
 
-inline cdd cdd::operator-=(const cdd& r) { return (*this = *this - r); }
+inline cdd cdd::operator^(const cdd& r) const& { return cdd(cdd_apply(root, r.root, cddop_xor)); }
 
-inline cdd cdd::operator^(const cdd& r) const { return cdd_apply(*this, r, cddop_xor); }
+inline cdd cdd::operator^(const cdd& r) && { return std::move(*this ^= r); }
 
-inline cdd cdd::operator^=(const cdd& r) { return (*this = *this ^ r); }
+inline cdd& cdd::operator^=(const cdd& r) { return *this = cdd_apply(root, r.root, cddop_xor); }
 
 inline cdd cdd::operator!() const { return cdd(cdd_neg(root)); }
 
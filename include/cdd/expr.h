@@ -0,0 +1,232 @@
+// -*- mode: C++; c-file-style: "stroustrup"; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+///////////////////////////////////////////////////////////////////////////////
+//
+// This file is a part of the UPPAAL toolkit.
+// Copyright (c) 1995 - 2004, Uppsala University and Aalborg University.
+// All right reserved.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef CDD_EXPR_H
+#define CDD_EXPR_H
+
+#include "cdd/cdd.h"
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+/**
+ * @defgroup lazy Lazy formulas
+ *
+ * The operators of the cdd class apply one operation at a time, so
+ * <tt>(a & b & c) | (d - e)</tt> builds a diagram for each operator.
+ * Wrapping an operand in \c cdd_lazy() instead builds the operator
+ * tree of the formula as a type, which is evaluated when it is
+ * converted to a cdd:
+ *
+ * <pre>
+ * cdd guard = (cdd_lazy(a) & b & c) | (d - e);
+ * </pre>
+ *
+ * Negations are pushed to the operands, where they are free, and
+ * nested conjunctions and disjunctions of the same kind are merged
+ * into one call of \c cdd_apply_n(). Only a subformula of the other
+ * kind, or of an exclusive or, is built as a diagram of its own.
+ *
+ * A formula refers to its operands, so it must be converted in the
+ * expression that creates it, or its operands must outlive it.
+ *
+ * @{
+ */
+
+template <typename E>
+struct cdd_is_expr : std::false_type
+{};
+
+/** The operands of one n-ary operation of a formula, and the subformulas built for it. */
+template <size_t N>
+struct cdd_expr_args
+{
+    ddNode* nodes[N];
+    cdd keep[N];
+    size_t n = 0;
+    size_t kept = 0;
+
+    void push(ddNode* node) { nodes[n++] = node; }
+
+    void push(cdd&& c)
+    {
+        nodes[n++] = c.handle();
+        keep[kept++] = std::move(c);
+    }
+};
+
+/** A cdd operand of a formula. */
+class cdd_expr_leaf
+{
+public:
+    static constexpr size_t leaves = 1;
+
+    explicit cdd_expr_leaf(const cdd& c): c(c) {}
+
+    template <size_t N>
+    void collect(cdd_expr_args<N>& args, int32_t, bool neg) const
+    {
+        args.push(neg ? cdd_neg(c.handle()) : c.handle());
+    }
+
+    [[nodiscard]] cdd eval(bool neg) const { return neg ? !c : c; }
+
+    operator cdd() const { return c; }
+
+private:
+    const cdd& c;
+};
+
+/** The negation of a formula. */
+template <typename E>
+class cdd_expr_not
+{
+public:
+    static constexpr size_t leaves = E::leaves;
+
+    explicit cdd_expr_not(const E& e): e(e) {}
+
+    template <size_t N>
+    void collect(cdd_expr_args<N>& args, int32_t op, bool neg) const
+    {
+        e.collect(args, op, !neg);
+    }
+
+    [[nodiscard]] cdd eval(bool neg) const { return e.eval(!neg); }
+
+    operator cdd() const { return eval(false); }
+
+private:
+    E e;
+};
+
+/** A binary operation \a Op of \c cddop_and, \c cddop_or and \c cddop_xor. */
+template <int32_t Op, typename L, typename R>
+class cdd_expr_binary
+{
+public:
+    static constexpr size_t leaves = L::leaves + R::leaves;
+
+    cdd_expr_binary(const L& l, const R& r): l(l), r(r) {}
+
+    /** Returns the operation of this formula when it is negated, by De Morgan's laws. */
+    static constexpr int32_t effective(bool neg) { return Op == cddop_xor || !neg ? Op : cddop_and + cddop_or - Op; }
+
+    /** Adds the operands of \a op; a formula of another operation is built as a diagram. */
+    template <size_t N>
+    void collect(cdd_expr_args<N>& args, int32_t op, bool neg) const
+    {
+        if (Op != cddop_xor && op == effective(neg)) {
+            l.collect(args, op, neg);
+            r.collect(args, op, neg);
+        } else {
+            args.push(eval(neg));
+        }
+    }
+
+    [[nodiscard]] cdd eval(bool neg) const
+    {
+        if constexpr (Op == cddop_xor) {
+            // Negating one operand negates an exclusive or
+            return cdd(cdd_apply(l.eval(false).handle(), r.eval(neg).handle(), cddop_xor));
+        } else {
+            cdd_expr_args<leaves> args;
+            int32_t op = effective(neg);
+            l.collect(args, op, neg);
+            r.collect(args, op, neg);
+            if (args.n == 2) {
+                return cdd(cdd_apply(args.nodes[0], args.nodes[1], op));
+            }
+            return cdd(cdd_apply_n(args.nodes, args.n, op));
+        }
+    }
+
+    operator cdd() const { return eval(false); }
+
+private:
+    L l;
+    R r;
+};
+
+template <>
+struct cdd_is_expr<cdd_expr_leaf> : std::true_type
+{};
+
+template <typename E>
+struct cdd_is_expr<cdd_expr_not<E>> : std::true_type
+{};
+
+template <int32_t Op, typename L, typename R>
+struct cdd_is_expr<cdd_expr_binary<Op, L, R>> : std::true_type
+{};
+
+/** Starts a lazy formula with the operand \a c. */
+inline cdd_expr_leaf cdd_lazy(const cdd& c) { return cdd_expr_leaf(c); }
+
+/** Returns \a c as an operand of a formula. */
+inline cdd_expr_leaf cdd_expr_operand(const cdd& c) { return cdd_expr_leaf(c); }
+
+/** Returns the formula \a e as an operand of a formula. */
+template <typename E, typename = std::enable_if_t<cdd_is_expr<E>::value>>
+const E& cdd_expr_operand(const E& e)
+{
+    return e;
+}
+
+/** Enables the operators of formulas if one operand is a formula and the other a formula or a cdd. */
+template <typename L, typename R>
+using cdd_expr_enable = std::enable_if_t<(cdd_is_expr<L>::value || cdd_is_expr<R>::value) &&
+                                         (cdd_is_expr<L>::value || std::is_same_v<L, cdd>) &&
+                                         (cdd_is_expr<R>::value || std::is_same_v<R, cdd>)>;
+
+template <int32_t Op, typename L, typename R>
+using cdd_expr_of = cdd_expr_binary<Op, std::decay_t<decltype(cdd_expr_operand(std::declval<const L&>()))>,
+                                    std::decay_t<decltype(cdd_expr_operand(std::declval<const R&>()))>>;
+
+/** Lazy conjunction. */
+template <typename L, typename R, typename = cdd_expr_enable<L, R>>
+cdd_expr_of<cddop_and, L, R> operator&(const L& l, const R& r)
+{
+    return {cdd_expr_operand(l), cdd_expr_operand(r)};
+}
+
+/** Lazy disjunction. */
+template <typename L, typename R, typename = cdd_expr_enable<L, R>>
+cdd_expr_of<cddop_or, L, R> operator|(const L& l, const R& r)
+{
+    return {cdd_expr_operand(l), cdd_expr_operand(r)};
+}
+
+/** Lazy exclusive or. */
+template <typename L, typename R, typename = cdd_expr_enable<L, R>>
+cdd_expr_of<cddop_xor, L, R> operator^(const L& l, const R& r)
+{
+    return {cdd_expr_operand(l), cdd_expr_operand(r)};
+}
+
+/** Lazy negation. */
+template <typename E, typename = std::enable_if_t<cdd_is_expr<E>::value>>
+cdd_expr_not<E> operator!(const E& e)
+{
+    return cdd_expr_not<E>(e);
+}
+
+/** Lazy set minus, the conjunction with the negated right operand. */
+template <typename L, typename R, typename = cdd_expr_enable<L, R>>
+auto operator-(const L& l, const R& r)
+{
+    using Right = std::decay_t<decltype(cdd_expr_operand(r))>;
+    return cdd_expr_binary<cddop_and, std::decay_t<decltype(cdd_expr_operand(l))>, cdd_expr_not<Right>>(
+        cdd_expr_operand(l), cdd_expr_not<Right>(cdd_expr_operand(r)));
+}
+
+/** @} lazy */
+
+#endif /* CDD_EXPR_H */
@@ -84,21 +84,78 @@ extern "C" {
 
 /** @} */
 
+///////////////////////////////////////////////////////////////////////////
+/// @defgroup handle Node handles
+///
+/// Nodes refer to their children by handles. Normally a handle is
+/// the pointer itself. When the library is built with \c COMPACT, a
+/// handle is a 32-bit offset into a region reserved for all nodes,
+/// which halves the size of CDD elements and shrinks BDD nodes by a
+/// quarter on 64-bit targets. The negation bit is kept in the least
+/// significant bit of the handle, so handles of equal nodes are equal.
+///
+/// @{
+///
+
+#ifdef COMPACT
+typedef uint32_t ddHandle;
+
+/** Start of the region all nodes are allocated in. */
+extern char* cdd_nodebase;
+
+/** Returns the handle of \a node; nodes are aligned to 8 bytes */
+#define cdd_tohandle(node) ((ddHandle)((((uintptr_t)(node) - (uintptr_t)cdd_nodebase) >> 2) | cdd_mask(node)))
+
+/** Returns the node with the handle \a h */
+#define cdd_fromhandle(h) ((ddNode*)(cdd_nodebase + ((uintptr_t)((h) >> 1) << 3) + ((h)&1)))
+#else
+typedef ddNode* ddHandle;
+
+/** Returns the handle of \a node */
+#define cdd_tohandle(node) (node)
+
+/** Returns the node with the handle \a h */
+#define cdd_fromhandle(h) (h)
+#endif
+
+/** Returns the child of the element \a e */
+#define cdd_elem_child(e) cdd_fromhandle((e)->child)
+
+/** Returns the low child of the bddnode_ structure of \a node, ignoring the negation of \a node */
+#define bdd_node_low(node) cdd_fromhandle(bdd_node(node)->low)
+
+/** Returns the high child of the bddnode_ structure of \a node, ignoring the negation of \a node */
+#define bdd_node_high(node) cdd_fromhandle(bdd_node(node)->high)
+
+/** @} */
+
 ///////////////////////////////////////////////////////////////////////////
 /// @defgroup refcount Reference counting
 ///
-/// Each node has a 10-bit reference counter. Since this is a rather
-/// limited size, the library detects when the maximum number of
-/// references is reached and from that point onward the reference
-/// count is never modified. As a consequence the node is never
-/// deallocated (until \c cdd_done() is called). This does not happen
-/// very often and thus the leakage is negligible.
+/// Each node has a reference counter which saturates at \c MAXREF:
+/// the library detects when the maximum number of references is
+/// reached and from that point onward the reference count is never
+/// modified. As a consequence the node is never deallocated (until \c
+/// cdd_done() is called). This does not happen very often and thus
+/// the leakage is negligible.
+///
+/// The counter is a separate 32-bit word rather than a bit field, so
+/// that it can be updated atomically when the manager is shared
+/// between threads. On 64-bit targets it occupies what used to be
+/// padding. The counter saturates at 1023 references unless the
+/// library is built with \c WIDEREF, in which case the full word is
+/// used. The number of saturated nodes is returned by \c
+/// cdd_getsaturated().
 ///
 /// @{
 ///
 
 /** Max number of references */
+#ifdef WIDEREF
+#define MAXREF 0xFFFFFFFFu
+#else
 #define MAXREF 0x3FF
+#endif
 
 /** Max number of levels.
  *  The allowed number of variables (BDD+CDD) must
@@ -107,16 +164,18 @@ extern "C" {
 #define MAXLEVEL ((1 << 20) - 1)
 
 /** Increment references on \a node */
-#define cdd_ref(node) (cdd_satinc(cdd_rglr(node)->ref))
+#define cdd_ref(node) ((void)cdd_refinc(node))
 
 /** Decrement reference on \a node */
-#define cdd_deref(node) (cdd_satdec(cdd_rglr(node)->ref))
+#define cdd_deref(node) ((void)cdd_refdec(node))
 
-/** Increments \a ref if it is not equal to MAXREF */
-#define cdd_satinc(ref) ((ref) += ((ref) != MAXREF))
+/** Increments \a ref if it is not equal to MAXREF. Saturated
+ *  counters are never written, which keeps the shared terminal
+ *  untouched by concurrently running managers. */
+#define cdd_satinc(ref) ((ref) != MAXREF ? (void)(ref)++ : (void)0)
 
 /** Decrements \a ref if it is not equal to MAXREF */
-#define cdd_satdec(ref) ((ref) -= ((ref) != MAXREF))
+#define cdd_satdec(ref) ((ref) != MAXREF ? (void)(ref)-- : (void)0)
 
 #ifdef MULTI_TERMINAL
 int32_t cdd_isterminal(ddNode*);
@@ -155,6 +214,7 @@ extern void cdd_rec_deref(ddNode* node);
 #define MARKON   0x1 /**< Bit used to mark a node (1) */
 #define MARKOFF  0x2 /**< Mask used to unmark a node */
 #define MARKHIDE 0x2
+#define REDUCED  0x2 /**< Bit set on nodes whose paths are all consistent */
 
 /** Mark node \a n */
 #define cdd_setmark(n) (cdd_rglr(n)->flag) |= MARKON
@@ -165,6 +225,15 @@ extern void cdd_rec_deref(ddNode* node);
 /** Returns true if \a n is marked. */
 #define cdd_ismarked(n) ((cdd_rglr(n)->flag) & MARKON)
 
+/**
+ * Flag node \a n as reduced. The flag is kept by marking and cleared
+ * when the node is allocated again.
+ */
+#define cdd_setreduced(n) (cdd_rglr(n)->flag) |= REDUCED
+
+/** Returns true if \a n is known to be reduced. */
+#define cdd_isreduced(n) ((cdd_rglr(n)->flag) & REDUCED)
+
 /**
  * Recursively marks all nodes of \a node. Does not recurse into a
  * node which is already marked.
@@ -213,8 +282,11 @@ void cdd_force_unmark(ddNode* node);
 /// BDD nodes and variable size CDD nodes.
 ///
 /// Each type/size of node is managed by a different node manager. A
-/// node manager allocates memory in 64KB chunks which is divided into
-/// equally sized nodes. It maintains a free list of unused nodes and
+/// node manager allocates memory in chunks of \c CHUNKSIZE bytes
+/// (64KB unless configured otherwise) which are divided into equally
+/// sized nodes. Chunks are carved from large arenas mapped from the
+/// operating system, which keeps the number of mappings and TLB
+/// entries low. It maintains a free list of unused nodes and
 /// some statistical information about the nodes, which are used by
 /// the garbage collector.
 ///
@@ -228,6 +300,12 @@ void cdd_force_unmark(ddNode* node);
 /// level, searching for existing nodes in a subtable is relatively
 /// simple.
 ///
+/// New nodes are prepended to their collision list with a single
+/// compare-and-swap on the bucket, so several threads can look up and
+/// insert nodes concurrently. Nodes are only ever removed from the
+/// lists by the garbage collector and the lists are only reorganised
+/// by rehashing; both are postponed while the manager is shared.
+///
 /// @{
 ///
 
@@ -238,6 +316,7 @@ typedef struct cddnode_ cddNode;
 typedef struct bddnode_ bddNode;
 typedef struct xtermnode_ xtermNode;
 typedef struct chunk_ Chunk;
+typedef struct arena_ Arena;
 typedef uint32_t (*NodeHashFunc)(NodeManager*, ddNode*);
 
 /**
@@ -247,8 +326,9 @@ struct node_
 {
     ddNode* next;         ///< Pointer to next element in hash table
     uint32_t level : 20;  ///< Level of the node
-    uint32_t ref : 10;    ///< Reference count
     uint32_t flag : 2;    ///< Flag used when marking nodes
+    uint32_t epoch : 8;   ///< GC epoch in which the node was allocated or freed
+    uint32_t ref;         ///< Reference count
 };
 
 /**
@@ -258,8 +338,9 @@ struct xtermnode_
 {
     ddNode* next;         ///< Pointer to next element in hash table
     uint32_t level : 20;  ///< Level of the node
-    uint32_t ref : 10;    ///< Reference count
     uint32_t flag : 2;    ///< Flag used when marking nodes
+    uint32_t epoch : 8;   ///< GC epoch in which the node was allocated or freed
+    uint32_t ref;         ///< Reference count
     int32_t id;
 };
 
@@ -270,8 +351,8 @@ struct xtermnode_
 
 struct elem_
 {
-    ddNode* child;  ///< Pointer to a DD node
-    raw_t bnd;      ///< Upper bound
+    ddHandle child;  ///< Handle of a DD node
+    raw_t bnd;       ///< Upper bound
 };
 
 /**
@@ -282,8 +363,10 @@ struct cddnode_
 {
     ddNode* next;         ///< Pointer to next element in hash table
     uint32_t level : 20;  ///< Level of the node
-    uint32_t ref : 10;    ///< Reference count
     uint32_t flag : 2;    ///< Flag used when marking nodes
+    uint32_t epoch : 8;   ///< GC epoch in which the node was allocated or freed
+    uint32_t ref;         ///< Reference count
+    uint32_t hash;        ///< Hash of the elements, kept for rehashing
     Elem elem[];          ///< NULL terminated array of elements
 };
 
@@ -295,23 +378,47 @@ struct bddnode_
 {
     ddNode* next;         ///< Pointer to next element in hash table
     uint32_t level : 20;  ///< Level of the node
-    uint32_t ref : 10;    ///< Reference count
     uint32_t flag : 2;    ///< Flag used when marking nodes
-    ddNode* low;          ///< Low child node
-    ddNode* high;         ///< High child node
+    uint32_t epoch : 8;   ///< GC epoch in which the node was allocated or freed
+    uint32_t ref;         ///< Reference count
+    ddHandle low;         ///< Low child node
+    ddHandle high;        ///< High child node
 };
 
 /**
- * A 64KB chunk of memory. A chunk is allocated by a node manager and
- * is divided into nodes. Chunks are kept on a single linked
- * list. Notice that chunks are always allocated on 64KB boundaries;
- * this makes it easy to find the chunk in which a node is allocated.
+ * A chunk of \c CHUNKSIZE bytes. A chunk is allocated by a node
+ * manager and is divided into nodes. Chunks are kept on a single
+ * linked list. Notice that chunks are always allocated on \c
+ * CHUNKSIZE boundaries; this makes it easy to find the chunk in which
+ * a node is allocated.
  */
 struct chunk_
 {
     Chunk* next;       ///< Pointer to next chunk
     NodeManager* man;  ///< Pointer to owning node manager
-    ddNode* nodes[];   ///< Array of nodes (64Kb - 8 byte)
+    Arena* arena;      ///< Arena the chunk was carved from
+    int32_t freecnt;   ///< Number of free nodes, counted by cdd_trim()
+    ddNode* nodes[];   ///< Array of nodes
+};
+
+/**
+ * An arena is a large aligned mapping from which chunks are
+ * carved. The arenas of a manager are kept on a circular list, with
+ * the arenas which have chunks left before the full ones. The pages
+ * of a freed chunk are returned to the operating system at once, and
+ * the arena itself when its last chunk is freed. Freed chunks are
+ * recorded outside of the mapping.
+ */
+struct arena_
+{
+    Arena* next;         ///< Next arena in the list
+    Arena* prev;         ///< Previous arena in the list
+    void* mem;           ///< Start of the mapping
+    char* base;          ///< First chunk, aligned to the arena size
+    int32_t carved;      ///< Number of chunks carved so far
+    int32_t used;        ///< Number of chunks in use
+    int32_t freecnt;     ///< Number of freed chunks
+    uint16_t freeidx[];  ///< Indices of the freed chunks
 };
 
 /**
@@ -322,17 +429,22 @@ struct chunk_
  * The hash table size is always a power of 2. This makes it easy to
  * map a 32-bit hash value to an entry in the table. It also makes
  * resizing much simpler, since each entry in the old table will
- * be placed in one of two entries in the new table.
+ * be placed in one of two entries in the new table. Resizing is
+ * incremental: the old table is kept while its entries are migrated
+ * a few at a time as nodes are added, and a hash value maps to the
+ * old table until its entry has been migrated.
  */
 struct subtable_
 {
-    int32_t level;    ///< The level
-    int32_t deadcnt;  ///< Number of dead nodes
-    int32_t keys;     ///< Number of nodes in this sub table
-    int32_t maxkeys;  ///< Max number of nodes before resizing occurs
-    int32_t shift;    ///< Shift for hash
-    int32_t buckets;  ///< Size of hash table
-    ddNode** hash;    ///< Hash table
+    int32_t level;      ///< The level
+    int32_t deadcnt;    ///< Number of dead nodes
+    int32_t keys;       ///< Number of nodes in this sub table
+    int32_t maxkeys;    ///< Max number of nodes before resizing occurs
+    int32_t shift;      ///< Shift for hash
+    int32_t buckets;    ///< Size of hash table
+    ddNode** hash;      ///< Hash table
+    ddNode** oldhash;   ///< Table of half the size being migrated, or NULL
+    int32_t migrated;   ///< Number of entries of oldhash migrated
 };
 
 /**
@@ -357,9 +469,12 @@ struct nodemanager_
     int32_t usedcnt;   ///< Number of used nodes
     int32_t gbccnt;    ///< Number of garbage collection runs on this manager
     int32_t gbcclock;  ///< Time used for garbage collection
+    int32_t lock;      ///< Protects the free list while shared
     // int32_t gbcwatch;      ///< True if scheduled for garbage collection
     ddNode* free;      ///< Free list
     Chunk* nodes;      ///< Chunk list
+    ddNode** nursery;  ///< Nodes added since the last garbage collection
+    int32_t youngcnt;  ///< Number of nodes in the nursery, or -1 if some are missing
     ddNode* sentinel;  ///< "End of list" mark
     NodeHashFunc hashfunc;
     SubTable** subtables;
@@ -387,6 +502,10 @@ void cdd_reclaim(ddNode*);
  * takes care to normalise the node. As a consequence the pointer
  * returned might be marked.
  *
+ * If no node can be allocated, because the chunks for backing off a
+ * memory limit are used up, the error is stored in \c cdd_errorcond
+ * and the false terminal is returned in place of the node.
+ *
  * @param level a level (has to be a boolean variable) @param low low
  * child of new node @param high high child of new node @return new
  * BDD node
@@ -413,21 +532,294 @@ ddNode* cdd_make_cdd_node(int32_t level, Elem* children, int32_t len);
 
 #define cdd_info(node) (cdd_levelinfo + cdd_rglr(node)->level)
 
-extern int32_t cdd_errorcond;
-extern int32_t* cdd_diff2level;
-extern Elem* cdd_refstack;
-extern Elem* cdd_refstacktop;  ///< Reference stack
-extern size_t cdd_refstacksize;
-extern int32_t cdd_clocknum;  ///< Number of clocks
-extern int32_t cdd_varnum;    ///< Number of BDD variables
-extern int32_t cdd_levelcnt;  ///< Number of levels
-extern LevelInfo* cdd_levelinfo;
-
-#define cdd_push(node, bound)            \
-    do {                                 \
-        cdd_refstacktop->child = (node); \
-        cdd_refstacktop->bnd = (bound);  \
-        cdd_refstacktop++;               \
+///////////////////////////////////////////////////////////////////////////
+/// @defgroup manager Managers
+///
+/// All state of the library -- node managers, level layout, operator
+/// caches, the reference stack and statistics -- is kept in a \c
+/// cdd_manager. Each thread has a current manager, which is the one
+/// used by all operations on that thread. The kernel variables below
+/// are macros referring to fields of the current manager, so the code
+/// reads as if they were plain globals.
+///
+/// The reference stack and the state of the running operation are
+/// kept per thread in a \c CddThread. A manager embeds the thread
+/// state of the thread it is selected on; further threads attached
+/// with \c cdd_manager_attach() each get their own. While at least one
+/// thread is attached the manager is \b shared: reference counts,
+/// node allocation, the unique table and the operator caches are then
+/// updated atomically, and garbage collection and rehashing are
+/// postponed until the manager is no longer shared.
+///
+/// @{
+///
+
+#if defined(_MSC_VER)
+#define CDD_THREAD_LOCAL __declspec(thread)
+#else
+#define CDD_THREAD_LOCAL __thread
+#endif
+
+/** Operator caches and state, defined in cddop.c. */
+typedef struct cdd_opstate_ CddOpState;
+
+typedef struct cdd_thread_ CddThread;
+
+typedef struct cdd_refchunk_ RefChunk;
+
+/**
+ * A chunk of the reference stack. The stack grows by chaining
+ * chunks, so elements never move while they are on the stack. The
+ * elements of a chunk follow its header.
+ */
+struct cdd_refchunk_
+{
+    RefChunk* prev;  ///< Chunk below, or NULL
+    RefChunk* next;  ///< Free chunk above, or NULL
+    Elem* end;       ///< End of the elements of the chunk
+};
+
+/** The first element of the reference stack chunk \a c. */
+#define cdd_refchunk_base(c) ((Elem*)((c) + 1))
+
+/**
+ * State of a thread using a manager.
+ */
+struct cdd_thread_
+{
+    cdd_manager* man;       ///< Manager used by the thread
+    RefChunk* refchunk;     ///< Chunk of the reference stack holding its top
+    Elem* refstacktop;      ///< Top of reference stack
+    size_t refstacksize;    ///< Size of the first reference stack chunk
+    ddNode** nodestack;     ///< Work list of cdd_release() and cdd_revive()
+    size_t nodestacksize;   ///< Capacity of nodestack
+    void* framestack;       ///< Frames of the iterative apply, see cddop.c
+    size_t framestacksize;  ///< Capacity of framestack in frames
+    size_t framedepth;      ///< Frames in use
+    int32_t errorcond;      ///< Last error code
+    int32_t backoffcnt;     ///< Chunks up to which the manager may grow while errorcond backs off
+    cdd_manager* prevman;   ///< Manager to restore on detach
+    CddThread* prevthread;  ///< Thread state to restore on detach
+};
+
+struct cdd_manager_
+{
+    NodeManager* bddmanager;   ///< BDD node manager
+    NodeManager** cddmanager;  ///< CDD node managers indexed by arity
+    int32_t levelcnt;          ///< Number of levels allocated
+    int32_t gbcclock;          ///< Acc. time used for garbage collection
+    int32_t gbccnt;            ///< Number of times we have run GBC
+    int32_t rehashclock;       ///< Acc. time used for rehashing
+    int32_t rehashcnt;         ///< Number of times we have rehashed
+    int32_t maxcddsize;        ///< Max. arity of a node
+    int32_t maxcddused;        ///< Max. arity of an allocated node
+    int32_t chunkcnt;          ///< Total number of chunks allocated
+    int32_t arenacnt;          ///< Number of arenas mapped
+    int32_t arenalock;         ///< Protects the arenas
+    Arena* arenas;             ///< Arenas, those with free chunks first
+    int32_t nodecnt;           ///< Number of nodes in allocated chunks
+    int32_t maxnodenum;        ///< Max. number of nodes, or 0 if unlimited
+    int32_t minfree;           ///< Minimum free nodes after GBC in percent
+    int64_t membudget;         ///< Max. bytes of nodes and caches, or 0 if unlimited
+    int32_t nurserysize;       ///< Max. number of young nodes per node manager
+    int32_t clocknum;          ///< Number of clocks allocated
+    int32_t varnum;            ///< Number of BDD variables allocated
+    int32_t shared;            ///< Number of attached threads
+    int32_t parcutoff;         ///< Task depth of cdd_apply_par()
+    uint32_t epoch;            ///< Number of garbage collection runs, see cdd_survived()
+    uint32_t epochbase;        ///< Epoch of the last full garbage collection
+    int32_t saturated;         ///< Number of nodes with a saturated reference count
+    LevelInfo* levelinfo;      ///< Information about each level
+    int32_t* diff2level;       ///< Maps clock differences to levels
+    int32_t* level2var;        ///< Maps levels to the level their variable was declared at
+    int32_t* var2level;        ///< Maps declared levels of variables to their levels
+    int32_t reorderlimit;      ///< BDD nodes in use above which cdd_gbc() reorders, or 0
+    CddOpState* ops;           ///< Operator caches
+    CddThread owner;           ///< State of the thread selecting the manager
+
+    void (*pregbc_handler)(void);                ///< Pre-gbc handler
+    void (*postgbc_handler)(CddGbcStat*);        ///< Post-gbc handler
+    void (*prerehash_handler)(void);             ///< Pre-rehash handler
+    void (*postrehash_handler)(CddRehashStat*);  ///< Post-rehash handler
+
+#ifdef MULTI_TERMINAL
+    ddNode** extra_terminals;    ///< Extra terminal nodes
+    int32_t nb_extra_terminals;  ///< Number of extra terminals
+#endif
+};
+
+/** The manager used by the calling thread. */
+extern CDD_THREAD_LOCAL cdd_manager* cdd_current;
+
+/** The state of the calling thread. */
+extern CDD_THREAD_LOCAL CddThread* cdd_thread;
+
+#define cdd_errorcond    (cdd_thread->errorcond)
+#define cdd_backoffcnt   (cdd_thread->backoffcnt)
+#define cdd_diff2level   (cdd_current->diff2level)
+#define cdd_level2var    (cdd_current->level2var)
+#define cdd_var2level    (cdd_current->var2level)
+#define cdd_refchunk     (cdd_thread->refchunk)
+#define cdd_refstacktop  (cdd_thread->refstacktop)
+#define cdd_refstacksize (cdd_thread->refstacksize)
+#define cdd_maxcddsize   (cdd_current->maxcddsize)
+#define cdd_clocknum     (cdd_current->clocknum)
+#define cdd_varnum       (cdd_current->varnum)
+#define cdd_levelcnt     (cdd_current->levelcnt)
+#define cdd_levelinfo    (cdd_current->levelinfo)
+#define cdd_parcutoff    (cdd_current->parcutoff)
+#define cdd_epoch        (cdd_current->epoch)
+
+/** True if the current manager is shared between threads. */
+#define cdd_shared (__atomic_load_n(&cdd_current->shared, __ATOMIC_RELAXED))
+
+/** Maximum number of epochs between two full garbage collections,
+ *  which move the cache entries and surviving nodes to the current
+ *  epoch, see cdd_survived(). */
+#define CDD_EPOCHS 128
+
+/**
+ * True if \a node was neither freed nor reallocated since the epoch
+ * \a e, i.e. if a pointer to it taken in that epoch is still valid.
+ * The garbage collector starts a new epoch on each run and stamps
+ * the nodes it frees; allocation stamps the current epoch. A full
+ * collection also stamps the nodes it keeps and the cache entries
+ * which are still valid, so neither is older than the last full
+ * collection. Epochs are compared modulo 256, which is sound as the
+ * epochs since then are fewer than \c CDD_EPOCHS.
+ */
+#define cdd_survived(node, e) \
+    (cdd_rglr(node)->level == MAXLEVEL || (int8_t)((uint8_t)cdd_rglr(node)->epoch - (uint8_t)(e)) <= 0)
+
+/**
+ * Accounts for \a node becoming referenced in a shared manager and
+ * references its children.
+ */
+extern void cdd_revive(ddNode* node);
+
+/**
+ * Accounts for \a node losing its last reference and recursively
+ * dereferences its children.
+ */
+extern void cdd_release(ddNode* node);
+
+/**
+ * Accounts for a reference counter reaching \c MAXREF. The node is
+ * kept until \c cdd_done() from then on.
+ */
+extern void cdd_saturate();
+
+/**
+ * Atomically increments the counter \a ref unless it is saturated.
+ * @return the value before the increment
+ */
+static inline uint32_t cdd_atomic_satinc(uint32_t* ref)
+{
+    uint32_t old = __atomic_load_n(ref, __ATOMIC_RELAXED);
+    while (old != MAXREF &&
+           !__atomic_compare_exchange_n(ref, &old, old + 1, 1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {}
+    return old;
+}
+
+/**
+ * Atomically decrements the counter \a ref unless it is saturated
+ * or zero.
+ * @return the value before the decrement
+ */
+static inline uint32_t cdd_atomic_satdec(uint32_t* ref)
+{
+    uint32_t old = __atomic_load_n(ref, __ATOMIC_RELAXED);
+    while (old != MAXREF && old != 0 &&
+           !__atomic_compare_exchange_n(ref, &old, old - 1, 1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {}
+    return old;
+}
+
+/**
+ * Increments references on \a node. In a shared manager the children
+ * of a node are referenced exactly while the node itself is, so the
+ * first reference revives them.
+ * @return the reference count before the increment
+ */
+static inline uint32_t cdd_refinc(ddNode* node)
+{
+    uint32_t* ref = &cdd_rglr(node)->ref;
+    uint32_t old;
+    if (cdd_shared) {
+        if ((old = cdd_atomic_satinc(ref)) == 0) {
+            cdd_revive(node);
+        }
+    } else {
+        old = *ref;
+        cdd_satinc(*ref);
+    }
+    if (old == MAXREF - 1) {
+        cdd_saturate();
+    }
+    return old;
+}
+
+/**
+ * Decrements references on \a node. A counter which is zero is left
+ * untouched. In a shared manager the last reference releases the
+ * children, see \c cdd_refinc().
+ * @return the reference count before the decrement
+ */
+static inline uint32_t cdd_refdec(ddNode* node)
+{
+    uint32_t* ref = &cdd_rglr(node)->ref;
+    uint32_t old;
+    if (cdd_shared) {
+        if ((old = cdd_atomic_satdec(ref)) == 1) {
+            cdd_release(node);
+        }
+    } else {
+        old = *ref;
+        if (old != 0) {
+            cdd_satdec(*ref);
+        }
+    }
+    return old;
+}
+
+/** @} */
+
+/**
+ * Moves the top of the reference stack to a chunk with room for \a n
+ * elements, reusing or allocating one above the current chunk. Used
+ * by cdd_refstack_reserve().
+ */
+extern void cdd_refstack_grow(size_t n);
+
+/**
+ * Makes room for a run of \a n elements at the top of the reference
+ * stack. The run starts at \c cdd_refstacktop after the call, which
+ * is in a new chunk if the current one is too small, so the returned
+ * top, not the start of the run, must be restored when the run is
+ * popped. Elements on the stack are never moved.
+ * @return the top of the stack before the call
+ */
+static inline Elem* cdd_refstack_reserve(size_t n)
+{
+    Elem* top = cdd_refstacktop;
+    uintptr_t t = (uintptr_t)top;
+    uintptr_t end = (uintptr_t)cdd_refchunk->end;
+
+    // The top may have been restored to a chunk below the current one
+    if (t < (uintptr_t)cdd_refchunk_base(cdd_refchunk) || t > end || end - t < n * sizeof(Elem)) {
+        cdd_refstack_grow(n);
+    }
+    return top;
+}
+
+/**
+ * Pushes a node and its upper bound on the reference stack. The room
+ * must have been reserved with cdd_refstack_reserve().
+ */
+#define cdd_push(node, bound)                        \
+    do {                                             \
+        cdd_refstacktop->child = cdd_tohandle(node); \
+        cdd_refstacktop->bnd = (bound);              \
+        cdd_refstacktop++;                           \
     } while (0)
 
 /* From kernel.c */
@@ -442,6 +834,16 @@ int32_t cdd_error(int32_t error);
 extern ddNode* cdd_upper_from_level(int32_t, raw_t);
 extern ddNode* cdd_interval_from_level(int32_t, raw_t, raw_t);
 
+/**
+ * Prepares the creation of \a n nodes of \a size children on \a level,
+ * where a \a size of 0 means BDD nodes. The free nodes are allocated
+ * and the subtable of the level, if \a level is not negative, is
+ * resized beforehand, so creating the nodes neither rehashes nor
+ * collects all garbage. Does nothing while the manager is shared.
+ * @return 0 on success, or \c CDD_MEMORY
+ */
+extern int32_t cdd_reserve(int32_t level, int32_t size, int32_t n);
+
 /**
  * Initialise operator cache.
  * @param cachsize size of caches.
@@ -466,6 +868,24 @@ void cdd_operator_reset();
  */
 void cdd_operator_flush();
 
+/**
+ * Moves the valid entries of all operator caches to the current
+ * epoch and drops the others.
+ * @see CddCache_rebase()
+ */
+void cdd_operator_rebase();
+
+/**
+ * Returns the number of bytes used by the operator caches.
+ */
+size_t cdd_operator_memory();
+
+/**
+ * Limits the operator caches to their share of a memory budget of \a
+ * bytes. Caches which are larger are cleared and shrunk.
+ */
+void cdd_operator_budget(size_t bytes);
+
 /**
  * @name CDD Iterator
  * @{
@@ -479,16 +899,16 @@ typedef struct
 
 #define cdd_it_init(it, node) (it).low = -INF, (it).neg = cdd_mask(node), (it).p = cdd_node(node)->elem
 #define cdd_it_lower(it)      ((it).low)
-#define cdd_it_child(it)      (cdd_neg_cond((it).p->child, (it).neg))
+#define cdd_it_child(it)      (cdd_neg_cond(cdd_elem_child((it).p), (it).neg))
 #define cdd_it_upper(it)      ((it).p->bnd)
 #define cdd_it_atend(it)      ((it).low == INF)
 #define cdd_it_next(it)       (it).low = cdd_it_upper(it), (it).p++
 
 /** Returns the low child of a BDD node \a node */
-#define bdd_low(node) (cdd_neg_cond(bdd_node(node)->low, cdd_mask(node)))
+#define bdd_low(node) (cdd_neg_cond(bdd_node_low(node), cdd_mask(node)))
 
 /** Returns the high child of a BDD node \a node */
-#define bdd_high(node) (cdd_neg_cond(bdd_node(node)->high, cdd_mask(node)))
+#define bdd_high(node) (cdd_neg_cond(bdd_node_high(node), cdd_mask(node)))
 
 /** @} */
 
@@ -14,19 +14,25 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-int CddCache_init(CddCache* cache, size_t size)
+/** Hit rate in percent below which a thrashing cache grows. */
+#define CACHE_MINHIT 50
+
+int CddCache_init(CddCache* cache, size_t size, size_t maxsize)
 {
-    size_t n;
+    size = (size + CDD_CACHE_WAYS - 1) / CDD_CACHE_WAYS * CDD_CACHE_WAYS;
+    if (size == 0) {
+        size = CDD_CACHE_WAYS;
+    }
 
-    if ((cache->table = (CddCacheData*)malloc(sizeof(CddCacheData) * size)) == NULL) {
+    if ((cache->table = (CddCacheData*)calloc(size, sizeof(CddCacheData))) == NULL) {
         return cdd_error(CDD_MEMORY);
     }
 
-    for (n = 0; n < size; n++) {
-        cache->table[n].a = NULL;
-        cache->table[n].b = NULL;
-    }
     cache->tablesize = size;
+    cache->maxsize = maxsize < size ? size : maxsize;
+    cache->lookups = cache->hits = cache->overwrites = 0;
+    cache->checklookups = cache->checkhits = cache->checkwrites = 0;
+    cache->resizes = 0;
 
     return 0;
 }
@@ -46,6 +52,52 @@ void CddCache_flush(CddCache* cache)
     for (n = cache->table + cache->tablesize - 1; n >= cache->table; n--) {
         if (n->a && (!cdd_rglr(n->a)->ref || !cdd_rglr(n->res)->ref || (n->b && !cdd_rglr(n->b)->ref))) {
             n->a = n->b = NULL;
+            n->age = 0;
+        }
+    }
+}
+
+void CddCache_rebase(CddCache* cache)
+{
+    CddCacheData* n;
+    for (n = cache->table + cache->tablesize - 1; n >= cache->table; n--) {
+        if (n->a == NULL) {
+            continue;
+        }
+        if (!cdd_rglr(n->a)->ref || !cdd_rglr(n->res)->ref || (n->b && !cdd_rglr(n->b)->ref) ||
+            !CddCache_valid(n->a, n->b, n->res, n->epoch)) {
+            n->a = n->b = NULL;
+            n->age = 0;
+        } else {
+            n->epoch = (uint8_t)cdd_epoch;
         }
     }
 }
+
+void CddCache_adjust(CddCache* cache)
+{
+    CddCacheData* table;
+    size_t lookups = cache->lookups - cache->checklookups;
+    size_t hits = cache->hits - cache->checkhits;
+    size_t writes = cache->overwrites - cache->checkwrites;
+
+    // Judge the hit rate over at least one table's worth of lookups
+    if (lookups < cache->tablesize) {
+        return;
+    }
+    cache->checklookups = cache->lookups;
+    cache->checkhits = cache->hits;
+    cache->checkwrites = cache->overwrites;
+
+    if (100 * hits >= CACHE_MINHIT * lookups || 2 * writes < cache->tablesize || 2 * cache->tablesize > cache->maxsize) {
+        return;
+    }
+
+    if ((table = (CddCacheData*)calloc(2 * cache->tablesize, sizeof(CddCacheData))) == NULL) {
+        return;
+    }
+    free(cache->table);
+    cache->table = table;
+    cache->tablesize *= 2;
+    cache->resizes++;
+}
@@ -9,36 +9,57 @@
  * Private header file for the operation cache.
  */
 
+/** Number of entries in each set of a \c CddCache. */
+#define CDD_CACHE_WAYS 2
+
 /**
  * An entry in a \c CddCache cache structure. It contains the
- * arguments and the result of a binary operation.
+ * arguments and the result of a binary operation. The sequence number
+ * is odd while a thread of a shared manager writes the entry. The
+ * epoch is the garbage collection epoch in which the nodes of the
+ * entry were last known to be alive.
  */
 typedef struct
 {
     ddNode* res;   /**< The result of the operation */
     ddNode *a, *b; /**< The arguments of the operation */
     int c;         /**< The operation */
+    uint16_t seq;  /**< Sequence number of the entry */
+    uint8_t age;   /**< Non-zero if the entry was used last in its set */
+    uint8_t epoch; /**< Epoch in which the entry was validated */
 } CddCacheData;
 
 /**
  * A cache structure. Used as an operation cache by the library. The
- * cache is a hash table without collision lists (it will overwrite
- * entries which hash to the same bucket).
+ * cache is a hash table of sets of \c CDD_CACHE_WAYS entries without
+ * collision lists: when a set is full, the least recently used entry
+ * is overwritten. The table grows when the hit rate drops, up to a
+ * maximum size.
  */
 typedef struct
 {
     CddCacheData* table; /**< The hash table */
-    size_t tablesize;    /**< The size of the hash table */
+    size_t tablesize;    /**< The number of entries in the hash table */
+    size_t maxsize;      /**< The number of entries the table may grow to */
+    size_t lookups;      /**< Number of lookups */
+    size_t hits;         /**< Number of lookups which found the result */
+    size_t overwrites;   /**< Number of entries overwritten */
+    size_t checklookups; /**< Lookups at the last check for growth */
+    size_t checkhits;    /**< Hits at the last check for growth */
+    size_t checkwrites;  /**< Overwrites at the last check for growth */
+    int32_t resizes;     /**< Number of times the table has grown */
 } CddCache;
 
 /**
  * Initialise a cache structure. A hash table with \a size elements
- * will be allocated.
+ * will be allocated, rounded up to whole sets. The table may grow to
+ * \a maxsize elements.
  * @param cache An uninitialized cache structure
  * @param size The size of the hash table to allocate
+ * @param maxsize The maximum size of the hash table
  * @return An error code
  */
-extern int CddCache_init(CddCache* cache, size_t size);
+extern int CddCache_init(CddCache* cache, size_t size, size_t maxsize);
 
 /**
  * Clears all entries in the cache.
@@ -57,20 +78,182 @@ extern void CddCache_done(CddCache* cache);
  * Removes all entries with a dead decision tree. This function removes
  * all those entries from the cache where one or more of the argument or
  * the result decision trees has a reference counter with value zero.
- * This is used after a garbage collection run to avoid references to
- * garbage collected nodes.
+ * The garbage collector does not need this, as entries referring to
+ * collected nodes are rejected by \c CddCache_match(). Releasing a
+ * chunk does, as the nodes in it must not be read afterwards.
  * @param cache A cache structure
  */
 extern void CddCache_flush(CddCache* cache);
 
 /**
- * Returns the entry in the cache for the given hash value. A
- * reference to the entry is returned, so you can assign to it.
+ * Moves the entries to the current epoch. Entries which are no longer
+ * valid, see \c CddCache_valid(), or which have a dead decision tree
+ * are removed. A full garbage collection does this before it stamps
+ * the surviving nodes, so that entries and nodes do not grow too far
+ * apart, see \c cdd_survived().
+ * @param cache A cache structure
+ */
+extern void CddCache_rebase(CddCache* cache);
+
+/**
+ * Doubles the hash table if the hit rate since the last call is low
+ * while entries are being overwritten, i.e. if the cache thrashes.
+ * The contents of the cache are lost when it grows. Must not be
+ * called while any entry is in use, i.e. only at the start of an
+ * operation, and not while the manager is shared.
+ * @param cache A cache structure
+ */
+extern void CddCache_adjust(CddCache* cache);
+
+/**
+ * Returns the set in the cache for the given hash value. The set is
+ * passed to \c CddCache_match() and \c CddCache_write().
  * @param cache A cache structure
  * @param hash A 32-bit hash value
- * @return The entry for this hash value
+ * @return The first entry of the set for this hash value
  */
-#define CddCache_lookup(cache, hash) (&(cache)->table[(hash) % (cache)->tablesize])
+#define CddCache_lookup(cache, hash) \
+    (&(cache)->table[((hash) % ((cache)->tablesize / CDD_CACHE_WAYS)) * CDD_CACHE_WAYS])
+
+/**
+ * Returns true if the nodes of an entry written or validated in the
+ * epoch \a epoch were not garbage collected since. An entry of the
+ * current epoch is valid without looking at its nodes. Otherwise the
+ * result must also be referenced: the children of a dead node are not
+ * accounted for, so they may have been collected even if the node
+ * itself was not. The arguments are held by the caller.
+ */
+static inline int CddCache_valid(ddNode* a, ddNode* b, ddNode* res, uint8_t epoch)
+{
+    return epoch == (uint8_t)cdd_epoch ||
+           (cdd_survived(a, epoch) && (b == NULL || cdd_survived(b, epoch)) && cdd_survived(res, epoch) &&
+            __atomic_load_n(&cdd_rglr(res)->ref, __ATOMIC_RELAXED) != 0);
+}
+
+/**
+ * Matches the entries of a set against the arguments of an operation.
+ * Entries whose nodes have been garbage collected since they were
+ * written never match, see \c cdd_survived().
+ * In a shared manager an entry is read optimistically and the match
+ * is rejected if a write overlapped the read; the statistics are then
+ * not updated either.
+ * @param cache The cache of the set
+ * @param set A set returned by \c CddCache_lookup()
+ * @param a The first argument
+ * @param b The second argument
+ * @param c The operation
+ * @param res Receives the cached result on a match
+ * @return True if the set holds the result of the operation
+ */
+static inline int CddCache_match(CddCache* cache, CddCacheData* set, ddNode* a, ddNode* b, int c, ddNode** res)
+{
+    CddCacheData* entry;
+    uint16_t seq;
+    uint8_t epoch;
+    int i, hit;
+
+    if (!cdd_shared) {
+        cache->lookups++;
+        for (i = 0; i < CDD_CACHE_WAYS; i++) {
+            entry = set + i;
+            if (entry->a == a && entry->b == b && entry->c == c) {
+                if (!CddCache_valid(a, b, entry->res, entry->epoch)) {
+                    // Free the entry for the result about to be written
+                    entry->a = entry->b = NULL;
+                    entry->age = 0;
+                    continue;
+                }
+                entry->epoch = (uint8_t)cdd_epoch;
+                *res = entry->res;
+                if (!entry->age) {
+                    for (i = 0; i < CDD_CACHE_WAYS; i++) {
+                        set[i].age = 0;
+                    }
+                    entry->age = 1;
+                }
+                cache->hits++;
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    for (i = 0; i < CDD_CACHE_WAYS; i++) {
+        entry = set + i;
+        seq = __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE);
+        hit = !(seq & 1) && __atomic_load_n(&entry->a, __ATOMIC_RELAXED) == a &&
+              __atomic_load_n(&entry->b, __ATOMIC_RELAXED) == b && __atomic_load_n(&entry->c, __ATOMIC_RELAXED) == c;
+        *res = __atomic_load_n(&entry->res, __ATOMIC_RELAXED);
+        epoch = __atomic_load_n(&entry->epoch, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        // No collection runs while shared, so the epochs of the nodes are stable
+        if (hit && __atomic_load_n(&entry->seq, __ATOMIC_RELAXED) == seq && CddCache_valid(a, b, *res, epoch)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Stores the result of an operation in a set, replacing an empty or
+ * the least recently used entry. In a shared manager the write is
+ * skipped if another thread is writing the entry. Nothing is stored
+ * while operations back off after an error, as results are wrong.
+ * @param cache The cache of the set
+ * @param set A set returned by \c CddCache_lookup()
+ * @param res The result
+ * @param a The first argument
+ * @param b The second argument
+ * @param c The operation
+ */
+static inline void CddCache_write(CddCache* cache, CddCacheData* set, ddNode* res, ddNode* a, ddNode* b, int c)
+{
+    CddCacheData* entry = set;
+    uint16_t seq;
+    int i;
+
+    if (cdd_errorcond) {
+        return;
+    }
+
+    // Pick an empty entry, or else one not used last
+    for (i = 0; i < CDD_CACHE_WAYS; i++) {
+        if (__atomic_load_n(&set[i].a, __ATOMIC_RELAXED) == NULL) {
+            entry = set + i;
+            break;
+        }
+        if (!__atomic_load_n(&set[i].age, __ATOMIC_RELAXED)) {
+            entry = set + i;
+        }
+    }
+
+    if (!cdd_shared) {
+        cache->overwrites += (entry->a != NULL);
+        for (i = 0; i < CDD_CACHE_WAYS; i++) {
+            set[i].age = 0;
+        }
+        entry->res = res;
+        entry->a = a;
+        entry->b = b;
+        entry->c = c;
+        entry->age = 1;
+        entry->epoch = (uint8_t)cdd_epoch;
+        return;
+    }
+
+    seq = __atomic_load_n(&entry->seq, __ATOMIC_RELAXED);
+    if ((seq & 1) || !__atomic_compare_exchange_n(&entry->seq, &seq, (uint16_t)(seq + 1), 0, __ATOMIC_RELAXED,
+                                                  __ATOMIC_RELAXED)) {
+        return;
+    }
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&entry->res, res, __ATOMIC_RELAXED);
+    __atomic_store_n(&entry->a, a, __ATOMIC_RELAXED);
+    __atomic_store_n(&entry->b, b, __ATOMIC_RELAXED);
+    __atomic_store_n(&entry->c, c, __ATOMIC_RELAXED);
+    __atomic_store_n(&entry->epoch, (uint8_t)cdd_epoch, __ATOMIC_RELAXED);
+    __atomic_store_n(&entry->seq, (uint16_t)(seq + 2), __ATOMIC_RELEASE);
+}
 
 /**
  * Returns the size of the hash table of a cache.
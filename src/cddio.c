@@ -0,0 +1,720 @@
+// -*- mode: C++; c-file-style: "stroustrup"; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+///////////////////////////////////////////////////////////////////////////////
+//
+// This file is a part of the UPPAAL toolkit.
+// Copyright (c) 1995 - 2004, Uppsala University and Aalborg University.
+// All right reserved.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "cdd/kernel.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+ * File format. All numbers are unsigned varints: seven bits per byte,
+ * least significant first, with the high bit set on all bytes but the
+ * last.
+ *
+ *   file   ::= "CDDB" version n level{n} record* 0
+ *   level  ::= 0                         a boolean variable
+ *            | clock1 clock2             the difference clock1 - clock2
+ *   record ::= 1 ref                     a root
+ *            | 2+v low high              a BDD node of declared level v
+ *            | 2+v m bound{m-1} ref{m}   a CDD node of declared level v
+ *            | 2+n id                    an extra terminal
+ *
+ * The level table describes the levels in the order they were
+ * declared, so records do not depend on the variable order. Nodes are
+ * numbered from 1 in the order of their records, 0 being cddfalse, and
+ * follow their children. A ref to node i in a record read when node j
+ * is next is ((j - i) << 1) | negated. The first bound of a CDD node
+ * is zigzag encoded and the others are increments; the last one is
+ * INF and not stored.
+ */
+
+#define FILE_MAGIC   "CDDB"
+#define FILE_VERSION 1
+
+#define TAG_END  0 /**< End of the records */
+#define TAG_ROOT 1 /**< A root */
+#define TAG_NODE 2 /**< A node of declared level tag - TAG_NODE */
+
+struct cdd_writer_
+{
+    FILE* ofile;       ///< File written to
+    int32_t levels;    ///< Levels declared when the writer was created
+    int32_t error;     ///< First error, or 0
+    uint32_t next;     ///< Number of the next node
+    uint32_t mask;     ///< Size of the node table minus one
+    ddNode** keys;     ///< Written nodes, hashed on their address
+    uint32_t* index;   ///< Number of each written node
+    ddNode** stack;    ///< Nodes to visit
+    size_t stacksize;  ///< Size of the stack
+    ddNode** roots;    ///< Added roots, referenced until the writer is closed
+    size_t rootcnt;    ///< Number of roots
+    size_t rootsize;   ///< Size of the root array
+};
+
+/** Returns the slot of the regular node \a node in the node table of \a w. */
+static uint32_t cdd_writer_slot(const cdd_writer* w, ddNode* node)
+{
+    uint32_t h = (uint32_t)((uintptr_t)node >> 3) * 2654435761u;
+    uint32_t i = (h ^ (h >> 16)) & w->mask;
+    while (w->keys[i] != NULL && w->keys[i] != node) {
+        i = (i + 1) & w->mask;
+    }
+    return i;
+}
+
+/** Returns true if the regular node \a node has been written. */
+static bool cdd_writer_written(const cdd_writer* w, ddNode* node)
+{
+    return node == cddfalse || w->keys[cdd_writer_slot(w, node)] != NULL;
+}
+
+/** Doubles the node table of \a w. */
+static int32_t cdd_writer_grow(cdd_writer* w)
+{
+    uint32_t i, slot, size = w->mask + 1;
+    ddNode** keys = w->keys;
+    uint32_t* index = w->index;
+
+    w->keys = (ddNode**)calloc(2 * size, sizeof(ddNode*));
+    w->index = (uint32_t*)malloc(2 * size * sizeof(uint32_t));
+    if (w->keys == NULL || w->index == NULL) {
+        free(w->keys);
+        free(w->index);
+        w->keys = keys;
+        w->index = index;
+        return CDD_MEMORY;
+    }
+    w->mask = 2 * size - 1;
+    for (i = 0; i < size; i++) {
+        if (keys[i] != NULL) {
+            slot = cdd_writer_slot(w, keys[i]);
+            w->keys[slot] = keys[i];
+            w->index[slot] = index[i];
+        }
+    }
+    free(keys);
+    free(index);
+    return 0;
+}
+
+static void cdd_writer_put(cdd_writer* w, uint64_t v)
+{
+    while (v >= 0x80) {
+        putc((int)(v & 0x7f) | 0x80, w->ofile);
+        v >>= 7;
+    }
+    putc((int)v, w->ofile);
+}
+
+/** Writes a reference to the written node \a node. */
+static void cdd_writer_ref(cdd_writer* w, ddNode* node)
+{
+    ddNode* r = cdd_rglr(node);
+    uint32_t i = r == cddfalse ? 0 : w->index[cdd_writer_slot(w, r)];
+    cdd_writer_put(w, ((uint64_t)(w->next - i) << 1) | (cdd_mask(node) ? 1 : 0));
+}
+
+/** Writes the record of the regular node \a node, whose children have been written. */
+static void cdd_writer_node(cdd_writer* w, ddNode* node)
+{
+    Elem* e;
+    int32_t i, m, var;
+
+    if (2 * (uint64_t)w->next > w->mask && (w->error = cdd_writer_grow(w)) != 0) {
+        return;
+    }
+
+#ifdef MULTI_TERMINAL
+    if (cdd_is_extra_terminal(node)) {
+        cdd_writer_put(w, TAG_NODE + w->levels);
+        cdd_writer_put(w, cdd_get_tautology_id(node));
+    } else
+#endif
+    {
+        var = cdd_level2var[node->level];
+        if (var >= w->levels) {
+            w->error = CDD_VAR;
+            return;
+        }
+        cdd_writer_put(w, TAG_NODE + var);
+        if (cdd_info(node)->type == TYPE_BDD) {
+            cdd_writer_ref(w, bdd_node_low(node));
+            cdd_writer_ref(w, bdd_node_high(node));
+        } else {
+            e = cdd_node(node)->elem;
+            for (m = 1; e[m - 1].bnd < INF; m++) {}
+            cdd_writer_put(w, m);
+            cdd_writer_put(w, ((uint64_t)e[0].bnd << 1) ^ (uint64_t)(e[0].bnd < 0 ? -1 : 0));
+            for (i = 1; i < m - 1; i++) {
+                cdd_writer_put(w, (uint64_t)((int64_t)e[i].bnd - e[i - 1].bnd));
+            }
+            for (i = 0; i < m; i++) {
+                cdd_writer_ref(w, cdd_elem_child(e + i));
+            }
+        }
+    }
+
+    i = cdd_writer_slot(w, node);
+    w->keys[i] = node;
+    w->index[i] = w->next++;
+}
+
+cdd_writer* cdd_writer_create(FILE* ofile)
+{
+    LevelInfo* info;
+    int32_t var;
+    cdd_writer* w = (cdd_writer*)calloc(1, sizeof(cdd_writer));
+
+    if (w == NULL) {
+        return NULL;
+    }
+    w->mask = 255;
+    w->keys = (ddNode**)calloc(w->mask + 1, sizeof(ddNode*));
+    w->index = (uint32_t*)malloc((w->mask + 1) * sizeof(uint32_t));
+    if (w->keys == NULL || w->index == NULL) {
+        free(w->keys);
+        free(w->index);
+        free(w);
+        return NULL;
+    }
+    w->ofile = ofile;
+    w->levels = cdd_levelcnt;
+    w->next = 1;
+
+    fputs(FILE_MAGIC, ofile);
+    cdd_writer_put(w, FILE_VERSION);
+    cdd_writer_put(w, w->levels);
+    for (var = 0; var < w->levels; var++) {
+        info = cdd_levelinfo + cdd_var2level[var];
+        if (info->type == TYPE_BDD) {
+            cdd_writer_put(w, 0);
+        } else {
+            cdd_writer_put(w, info->clock1);
+            cdd_writer_put(w, info->clock2);
+        }
+    }
+    return w;
+}
+
+/** Makes room for \a n more nodes above \a top on the stack of \a w. */
+static int32_t cdd_writer_room(cdd_writer* w, size_t top, size_t n)
+{
+    ddNode** stack;
+    size_t size;
+
+    if (w->stacksize - top < n) {
+        size = 2 * w->stacksize + n;
+        if ((stack = (ddNode**)realloc(w->stack, size * sizeof(ddNode*))) == NULL) {
+            return CDD_MEMORY;
+        }
+        w->stack = stack;
+        w->stacksize = size;
+    }
+    return 0;
+}
+
+int32_t cdd_writer_add(cdd_writer* w, ddNode* cdd)
+{
+    ddNode** roots;
+    ddNode *node, *child;
+    size_t top = 0, mark, size;
+    Elem* e;
+
+    if (w->error) {
+        return w->error;
+    }
+
+    // The roots keep the written nodes, and thereby their numbers, alive
+    if (w->rootcnt == w->rootsize) {
+        size = 2 * w->rootsize + 16;
+        if ((roots = (ddNode**)realloc(w->roots, size * sizeof(ddNode*))) == NULL) {
+            return w->error = cdd_error(CDD_MEMORY);
+        }
+        w->roots = roots;
+        w->rootsize = size;
+    }
+    cdd_ref(cdd);
+    w->roots[w->rootcnt++] = cdd;
+
+    // Diagrams may be deep, so nodes are visited with an explicit stack.
+    // A node is written when it is on top again after its children.
+    if ((w->error = cdd_writer_room(w, 0, 1)) == 0) {
+        w->stack[top++] = cdd_rglr(cdd);
+    }
+    while (top > 0 && !w->error) {
+        node = w->stack[top - 1];
+        if (cdd_writer_written(w, node)) {
+            top--;
+            continue;
+        }
+        if ((w->error = cdd_writer_room(w, top, (size_t)cdd_maxcddsize + 2)) != 0) {
+            break;
+        }
+        mark = top;
+        if (cdd_isterminal(node)) {
+            // Extra terminals have no children
+        } else if (cdd_info(node)->type == TYPE_BDD) {
+            if (!cdd_writer_written(w, child = cdd_rglr(bdd_node_low(node)))) {
+                w->stack[top++] = child;
+            }
+            if (!cdd_writer_written(w, child = cdd_rglr(bdd_node_high(node)))) {
+                w->stack[top++] = child;
+            }
+        } else {
+            e = cdd_node(node)->elem;
+            do {
+                if (!cdd_writer_written(w, child = cdd_rglr(cdd_elem_child(e)))) {
+                    w->stack[top++] = child;
+                }
+            } while ((e++)->bnd < INF);
+        }
+        if (top == mark) {
+            cdd_writer_node(w, node);
+            top--;
+        }
+    }
+
+    if (!w->error) {
+        cdd_writer_put(w, TAG_ROOT);
+        cdd_writer_ref(w, cdd);
+        if (ferror(w->ofile)) {
+            w->error = CDD_FILE;
+        }
+    }
+    return w->error ? cdd_error(w->error) : 0;
+}
+
+int32_t cdd_writer_close(cdd_writer* w)
+{
+    int32_t res = w->error;
+    size_t i;
+
+    if (res == 0) {
+        cdd_writer_put(w, TAG_END);
+        if (fflush(w->ofile) != 0 || ferror(w->ofile)) {
+            res = cdd_error(CDD_FILE);
+        }
+    }
+    for (i = 0; i < w->rootcnt; i++) {
+        cdd_rec_deref(w->roots[i]);
+    }
+    free(w->roots);
+    free(w->stack);
+    free(w->keys);
+    free(w->index);
+    free(w);
+    return res;
+}
+
+int32_t cdd_save(FILE* ofile, ddNode* const* roots, int32_t n)
+{
+    int32_t i, res = 0;
+    cdd_writer* w = cdd_writer_create(ofile);
+
+    if (w == NULL) {
+        return cdd_error(CDD_MEMORY);
+    }
+    for (i = 0; i < n && res == 0; i++) {
+        res = cdd_writer_add(w, roots[i]);
+    }
+    return cdd_writer_close(w);
+}
+
+/**
+ * State of a loader. The records are read twice: the first pass checks
+ * them and counts the nodes, so the second pass, which builds them,
+ * cannot fail on a malformed file.
+ */
+typedef struct
+{
+    const uint8_t* p;    ///< Next byte
+    const uint8_t* end;  ///< End of the data
+    int32_t error;       ///< First error of the pass, or 0
+    int32_t levels;      ///< Number of declared levels in the file
+    int32_t* level;      ///< Level in this manager of each declared level of the file
+    int32_t nodecnt;     ///< Number of nodes read
+    int32_t rootcnt;     ///< Number of roots read
+    int32_t* levelcnt;   ///< Number of BDD nodes on each level
+    int32_t* sizecnt;    ///< Number of CDD nodes of each size
+    ddNode** nodes;      ///< Node of each number, NULL in the first pass
+    ddNode** roots;      ///< Roots read in the second pass
+} CddReader;
+
+static uint64_t cdd_reader_get(CddReader* r)
+{
+    uint64_t v = 0;
+    int32_t shift;
+
+    for (shift = 0; shift < 64 && r->p < r->end; shift += 7) {
+        v |= (uint64_t)(*r->p & 0x7f) << shift;
+        if ((*r->p++ & 0x80) == 0) {
+            return v;
+        }
+    }
+    r->error = CDD_FORMAT;
+    return 0;
+}
+
+/** Reads a reference to a node read before, which is returned in the second pass. */
+static ddNode* cdd_reader_ref(CddReader* r)
+{
+    uint64_t v = cdd_reader_get(r);
+    uint64_t next = (uint64_t)r->nodecnt + 1;
+
+    if (r->error || (v >> 1) == 0 || (v >> 1) > next) {
+        r->error = CDD_FORMAT;
+        return cddfalse;
+    }
+    return r->nodes ? cdd_neg_cond(r->nodes[next - (v >> 1)], v & 1) : cddfalse;
+}
+
+/** Reads the level table. */
+static int32_t cdd_reader_levels(CddReader* r)
+{
+    uint64_t n, clock1, clock2;
+    int32_t var;
+
+    if (r->end - r->p < 4 || memcmp(r->p, FILE_MAGIC, 4) != 0) {
+        return CDD_FORMAT;
+    }
+    r->p += 4;
+    if (cdd_reader_get(r) != FILE_VERSION || (n = cdd_reader_get(r)) > (uint64_t)(r->end - r->p)) {
+        return CDD_FORMAT;
+    }
+    r->levels = (int32_t)n;
+    if ((r->level = (int32_t*)malloc((n + 1) * sizeof(int32_t))) == NULL) {
+        return CDD_MEMORY;
+    }
+    for (var = 0; var < r->levels; var++) {
+        clock1 = cdd_reader_get(r);
+        clock2 = clock1 ? cdd_reader_get(r) : 0;
+        if (r->error) {
+            return r->error;
+        }
+        if (clock1 == 0) {
+            // Boolean variables are identified by their declared level
+            if (var >= cdd_levelcnt || cdd_levelinfo[cdd_var2level[var]].type != TYPE_BDD) {
+                return CDD_VAR;
+            }
+            r->level[var] = cdd_var2level[var];
+        } else {
+            if (clock1 >= (uint64_t)cdd_clocknum || clock2 >= clock1) {
+                return CDD_VAR;
+            }
+            r->level[var] = cdd_diff2level[cdd_difference((int32_t)clock1, (int32_t)clock2)];
+        }
+    }
+    return 0;
+}
+
+/**
+ * Builds the CDD node on \a level with the \a m elements at \a first.
+ * The node is built directly if it is above its children, and else as
+ * a disjunction of its intervals, which happens if the file was saved
+ * in another variable order.
+ * @return the referenced node, which is incomplete if a memory limit
+ *         was reached, see \c cdd_errorcond
+ */
+static ddNode* cdd_reader_cdd_node(int32_t level, Elem* first, int32_t m)
+{
+    ddNode *node, *child, *interval, *piece;
+    int32_t i, k;
+    raw_t low;
+    bool neg;
+
+    for (i = 0; i < m && cdd_rglr(cdd_elem_child(first + i))->level > level; i++) {}
+    if (i == m) {
+        // Normalise and merge children that became equal
+        neg = cdd_mask(cdd_elem_child(first)) != 0;
+        for (i = 0, k = 0; i < m; i++) {
+            child = cdd_neg_cond(cdd_elem_child(first + i), neg);
+            if (k > 0 && cdd_elem_child(first + k - 1) == child) {
+                first[k - 1].bnd = first[i].bnd;
+            } else {
+                first[k].child = cdd_tohandle(child);
+                first[k].bnd = first[i].bnd;
+                k++;
+            }
+        }
+        node = cdd_neg_cond(cdd_make_cdd_node(level, first, k), neg);
+        cdd_ref(node);
+        return node;
+    }
+
+    node = cddfalse;
+    low = -INF;
+    for (i = 0; i < m; i++) {
+        interval = cdd_interval_from_level(level, low, first[i].bnd);
+        cdd_ref(interval);
+        piece = cdd_apply(interval, cdd_elem_child(first + i), cddop_and);
+        if (piece == NULL) {
+            cdd_rec_deref(interval);
+            break;
+        }
+        cdd_ref(piece);
+        cdd_rec_deref(interval);
+        child = cdd_apply(node, piece, cddop_or);
+        if (child == NULL) {
+            cdd_rec_deref(piece);
+            break;
+        }
+        cdd_ref(child);
+        cdd_rec_deref(piece);
+        cdd_rec_deref(node);
+        node = child;
+        low = first[i].bnd;
+    }
+    return node;
+}
+
+/** Reads the node record of \a tag, and builds the referenced node in the second pass. */
+static ddNode* cdd_reader_node(CddReader* r, uint64_t tag)
+{
+    ddNode *node = cddfalse, *low, *high, *var;
+    Elem *top, *first;
+    int64_t bnd;
+    uint64_t v, m, i;
+    int32_t level;
+
+    if (tag - TAG_NODE == (uint64_t)r->levels) {
+        v = cdd_reader_get(r);
+#ifdef MULTI_TERMINAL
+        if (v < (uint64_t)cdd_current->nb_extra_terminals) {
+            node = cdd_current->extra_terminals[v];
+            cdd_ref(node);
+            return node;
+        }
+#endif
+        r->error = CDD_FORMAT;
+        return cddfalse;
+    }
+
+    level = r->level[tag - TAG_NODE];
+    if (cdd_levelinfo[level].type == TYPE_BDD) {
+        low = cdd_reader_ref(r);
+        high = cdd_reader_ref(r);
+        if (r->nodes == NULL) {
+            r->levelcnt[level]++;
+        } else if (cdd_rglr(low)->level > level && cdd_rglr(high)->level > level) {
+            node = cdd_make_bdd_node(level, low, high);
+            cdd_ref(node);
+        } else {
+            // Saved in another variable order
+            var = cdd_make_bdd_node(level, cddfalse, cddtrue);
+            cdd_ref(var);
+            // The error condition is checked by the caller
+            if ((node = cdd_ite(var, high, low)) == NULL) {
+                node = cddfalse;
+            }
+            cdd_ref(node);
+            cdd_rec_deref(var);
+        }
+        return node;
+    }
+
+    m = cdd_reader_get(r);
+    if (m < 2 || m > (uint64_t)cdd_maxcddsize) {
+        r->error = r->error ? r->error : m < 2 ? CDD_FORMAT : CDD_MAXSIZE;
+        return cddfalse;
+    }
+    top = cdd_refstack_reserve(m);
+    first = cdd_refstacktop;
+    cdd_refstacktop += m;
+
+    // Bounds increase strictly from above -INF to INF
+    v = cdd_reader_get(r);
+    bnd = (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+    for (i = 0; i < m - 1 && !r->error; i++) {
+        if (i > 0) {
+            v = cdd_reader_get(r);
+            bnd = v == 0 || v > UINT32_MAX ? INF : bnd + (int64_t)v;
+        }
+        if (bnd <= -INF || bnd >= INF) {
+            r->error = CDD_FORMAT;
+        }
+        first[i].bnd = (raw_t)bnd;
+    }
+    first[m - 1].bnd = INF;
+    for (i = 0; i < m && !r->error; i++) {
+        low = cdd_reader_ref(r);
+        first[i].child = cdd_tohandle(low);
+    }
+
+    if (r->error == 0) {
+        if (r->nodes == NULL) {
+            r->sizecnt[m]++;
+        } else {
+            node = cdd_reader_cdd_node(level, first, (int32_t)m);
+        }
+    }
+    cdd_refstacktop = top;
+    return node;
+}
+
+/** Reads the records, building the nodes if \c r->nodes is set. */
+static int32_t cdd_reader_records(CddReader* r)
+{
+    ddNode* node;
+    uint64_t tag;
+
+    while (!r->error && (tag = cdd_reader_get(r)) != TAG_END) {
+        if (tag == TAG_ROOT) {
+            node = cdd_reader_ref(r);
+            if (r->nodes) {
+                cdd_ref(node);
+                r->roots[r->rootcnt] = node;
+            }
+            r->rootcnt++;
+        } else if (tag - TAG_NODE <= (uint64_t)r->levels && r->nodecnt < INT32_MAX - 1) {
+            node = cdd_reader_node(r, tag);
+            if (r->nodes) {
+                r->nodes[r->nodecnt + 1] = node;
+                if (cdd_errorcond) {
+                    r->nodecnt++;
+                    return cdd_errorcond;
+                }
+            }
+            r->nodecnt++;
+        } else {
+            r->error = CDD_FORMAT;
+        }
+    }
+    if (r->error == 0 && r->p != r->end) {
+        r->error = CDD_FORMAT;
+    }
+    return r->error;
+}
+
+int32_t cdd_load(const void* data, size_t size, ddNode*** roots)
+{
+    CddReader r;
+    const uint8_t* records;
+    int32_t i, res;
+
+    memset(&r, 0, sizeof(r));
+    r.p = (const uint8_t*)data;
+    r.end = r.p + size;
+    *roots = NULL;
+
+    r.levelcnt = (int32_t*)calloc(cdd_levelcnt + 1, sizeof(int32_t));
+    r.sizecnt = (int32_t*)calloc(cdd_maxcddsize + 1, sizeof(int32_t));
+    if (r.levelcnt == NULL || r.sizecnt == NULL) {
+        res = CDD_MEMORY;
+        goto done;
+    }
+    if ((res = cdd_reader_levels(&r)) != 0) {
+        goto done;
+    }
+    records = r.p;
+    if ((res = cdd_reader_records(&r)) != 0) {
+        goto done;
+    }
+
+    // Reserving is only an optimisation, so it may fail
+    for (i = 0; i < cdd_levelcnt; i++) {
+        if (r.levelcnt[i] > 0) {
+            cdd_reserve(i, 0, r.levelcnt[i]);
+        }
+    }
+    cdd_reserve(-1, 0, r.nodecnt);
+    for (i = 2; i <= cdd_maxcddsize; i++) {
+        cdd_reserve(-1, i, r.sizecnt[i]);
+    }
+
+    r.nodes = (ddNode**)malloc((r.nodecnt + 1) * sizeof(ddNode*));
+    r.roots = (ddNode**)malloc((r.rootcnt + 1) * sizeof(ddNode*));
+    if (r.nodes == NULL || r.roots == NULL) {
+        res = CDD_MEMORY;
+        goto done;
+    }
+    r.nodes[0] = cddfalse;
+    r.p = records;
+    r.nodecnt = r.rootcnt = 0;
+    res = cdd_reader_records(&r);
+
+    // The nodes are kept by their parents and the roots
+    for (i = 1; i <= r.nodecnt; i++) {
+        cdd_rec_deref(r.nodes[i]);
+    }
+    if (res != 0) {
+        for (i = 0; i < r.rootcnt; i++) {
+            cdd_rec_deref(r.roots[i]);
+        }
+    } else {
+        *roots = r.roots;
+        r.roots = NULL;
+        res = r.rootcnt;
+    }
+
+done:
+    free(r.level);
+    free(r.levelcnt);
+    free(r.sizecnt);
+    free(r.nodes);
+    free(r.roots);
+    return res < 0 ? cdd_error(res) : res;
+}
+
+int32_t cdd_fnload(const char* filename, ddNode*** roots)
+{
+    int32_t res;
+#ifndef WIN32
+    struct stat st;
+    void* data;
+    int fd;
+
+    *roots = NULL;
+    if ((fd = open(filename, O_RDONLY)) < 0) {
+        return cdd_error(CDD_FILE);
+    }
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return cdd_error(CDD_FILE);
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return cdd_error(CDD_FORMAT);
+    }
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return cdd_error(CDD_FILE);
+    }
+    res = cdd_load(data, st.st_size, roots);
+    munmap(data, st.st_size);
+#else
+    FILE* ifile;
+    char* data = NULL;
+    size_t size = 0, n;
+
+    *roots = NULL;
+    if ((ifile = fopen(filename, "rb")) == NULL) {
+        return cdd_error(CDD_FILE);
+    }
+    do {
+        if ((data = (char*)realloc(data, size + 65536)) == NULL) {
+            fclose(ifile);
+            return cdd_error(CDD_MEMORY);
+        }
+        size += n = fread(data + size, 1, 65536, ifile);
+    } while (n == 65536);
+    res = ferror(ifile) ? cdd_error(CDD_FILE) : cdd_load(data, size, roots);
+    fclose(ifile);
+    free(data);
+#endif
+    return res;
+}
@@ -19,7 +19,9 @@
 #include "cdd/kernel.h"
 #include "base/bitstring.h"
 #include "base/intutils.h"
+#include "hash/compute.h"
 
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -30,7 +32,12 @@
 #include "relax.h"
 #endif
 
-#define EX
+#define CACHEGROWTH 8  /**< Default factor by which the operation caches may grow. */
+#define CACHESHARE  25 /**< Percentage of a memory budget the operation caches may use. */
+#define RELATIONDIV 4  /**< Size of the other operation caches relative to the relation cache. */
+#define OPKEYS      32 /**< Number of argument vectors interned as operation identifiers. */
+#define OPREWIND    (INT32_MAX / 2) /**< Operation identifier from which the identifiers restart. */
+#define CONTAINSBITS 7 /**< Log2 of the number of entries of the memo of cdd_contains_many(). */
 
 #define P1 12582917
 #define P2 4256249
@@ -45,9 +52,10 @@
 #define RELAXHASH(n, l, c1, c2, u) (cdd_triple((uintptr_t)(node), cdd_pair((l), (c1)), cdd_pair((c2), (u))))
 #endif
 
-// #define cdd_and(l,r) cdd_apply_reduce((l), (r), cddop_and)
-#define cdd_and(l, r) cdd_apply((l), (r), cddop_and)
-#define cdd_xor(l, r) cdd_apply((l), (r), cddop_xor)
+// The operations below back off while a memory limit is reported;
+// the public entry points then return NULL, see cdd_checked()
+#define cdd_and(l, r) cdd_apply_op((l), (r), cddop_and)
+#define cdd_xor(l, r) cdd_apply_op((l), (r), cddop_xor)
 #define cdd_or(l, r)  cdd_neg(cdd_and(cdd_neg(l), cdd_neg(r)))
 
 inline static int32_t maximum(int32_t a, int32_t b) __attribute__((const));
@@ -66,37 +74,76 @@ inline static int32_t minimum(int32_t a, int32_t b) { return a < b ? a : b; }
 #endif
 
 /*=== INTERNAL VARIABLES ===============================================*/
-static CddCache applycache; /* Cache for apply results */
-static CddCache quantcache;
-static CddCache replacecache;
+/** An argument vector interned by \c cdd_operator_id(). */
+typedef struct
+{
+    uintptr_t hash;
+    int32_t id;
+    int32_t size; /**< Number of entries of \a vec */
+    int32_t* vec;
+} CddOpKey;
+
+/**
+ * Operator state of a manager. The caches are owned by the manager
+ * and allocated by \c cdd_operator_init().
+ */
+struct cdd_opstate_
+{
+    CddCache applycache; /**< Cache for apply results */
+    CddCache quantcache;
+    CddCache replacecache;
+    CddCache relationcache; /**< Cache for answers of relational queries */
+#ifdef RELAXCACHE
+    CddRelaxCache relaxcache;
+#endif
+    CddOpKey opkeys[OPKEYS]; /**< Interned argument vectors */
+    int32_t opkeycnt;        /**< Number of vectors interned so far */
+    uint32_t opseq;          /**< Last operation identifier handed out, at most INT32_MAX */
+    int32_t opid;            /**< Identifier of the running replacement */
+    int32_t rcid;            /**< Identifier of the constraints removed by the running quantification */
+};
+
+#define applycache    (cdd_current->ops->applycache)
+#define quantcache    (cdd_current->ops->quantcache)
+#define replacecache  (cdd_current->ops->replacecache)
+#define relationcache (cdd_current->ops->relationcache)
 #ifdef RELAXCACHE
-static CddRelaxCache relaxcache;
+#define relaxcache (cdd_current->ops->relaxcache)
 #endif
-static int32_t applyop;
-static int32_t opid;
+#define opkeys   (cdd_current->ops->opkeys)
+#define opkeycnt (cdd_current->ops->opkeycnt)
+#define opseq    (cdd_current->ops->opseq)
+#define opid     (cdd_current->ops->opid)
+#define rcid     (cdd_current->ops->rcid)
 
 /*=== TEMP EXTERNAL PROTOTYPE ==========================================*/
 void cdd2Dot(char* fname, ddNode* node, char* name);
 
 /*=== INTERNAL PROTOTYPES ==============================================*/
-static int32_t cdd_contains_rec(ddNode*, raw_t*, int32_t dim);
-static ddNode* cdd_apply_rec(ddNode*, ddNode*);
-#ifdef EX
+static ddNode* cdd_apply_op(ddNode*, ddNode*, int32_t);
+static ddNode* cdd_and_rec(ddNode*, ddNode*);
+static ddNode* cdd_xor_rec(ddNode*, ddNode*);
 static ddNode* cdd_exist_rec(ddNode* node, int32_t*, int32_t*, raw_t*);
-#else
-static ddNode* cdd_exist_rec(ddNode*, int32_t*, ddNode*);
-#endif
+static ddNode* cdd_and_exist_rec(ddNode*, ddNode*, int32_t*, int32_t*, raw_t*);
 static ddNode* cdd_replace_rec(ddNode*, int32_t*, int32_t*);
+static ddNode* cdd_relation_terminal(ddNode*, ddNode*, int32_t);
+static ddNode* cdd_reduce_op(ddNode*);
 
 int32_t cdd_operator_init(size_t cachesize)
 {
-    if (CddCache_init(&applycache, cachesize) < 0) {
+    if ((cdd_current->ops = (CddOpState*)calloc(1, sizeof(CddOpState))) == NULL) {
         return cdd_error(CDD_MEMORY);
     }
-    if (CddCache_init(&quantcache, cachesize) < 0) {
+    if (CddCache_init(&applycache, cachesize, CACHEGROWTH * cachesize) < 0) {
         return cdd_error(CDD_MEMORY);
     }
-    if (CddCache_init(&replacecache, cachesize) < 0) {
+    if (CddCache_init(&quantcache, cachesize, CACHEGROWTH * cachesize) < 0) {
+        return cdd_error(CDD_MEMORY);
+    }
+    if (CddCache_init(&replacecache, cachesize, CACHEGROWTH * cachesize) < 0) {
+        return cdd_error(CDD_MEMORY);
+    }
+    if (CddCache_init(&relationcache, cachesize / RELATIONDIV, CACHEGROWTH * cachesize / RELATIONDIV) < 0) {
         return cdd_error(CDD_MEMORY);
     }
 #ifdef RELAXCACHE
@@ -110,12 +157,23 @@ int32_t cdd_operator_init(size_t cachesize)
 
 void cdd_operator_done()
 {
+    int32_t i;
+
+    if (cdd_current->ops == NULL) {
+        return;
+    }
+    for (i = 0; i < OPKEYS; i++) {
+        free(opkeys[i].vec);
+    }
     CddCache_done(&applycache);
     CddCache_done(&quantcache);
     CddCache_done(&replacecache);
+    CddCache_done(&relationcache);
 #ifdef RELAXCACHE
     CddRelaxCache_done(&relaxcache);
 #endif
+    free(cdd_current->ops);
+    cdd_current->ops = NULL;
 }
 
 void cdd_operator_reset()
@@ -123,6 +181,7 @@ void cdd_operator_reset()
     CddCache_reset(&applycache);
     CddCache_reset(&quantcache);
     CddCache_reset(&replacecache);
+    CddCache_reset(&relationcache);
 #ifdef RELAXCACHE
     CddRelaxCache_reset(&relaxcache);
 #endif
@@ -133,16 +192,222 @@ void cdd_operator_flush()
     CddCache_flush(&applycache);
     CddCache_flush(&quantcache);
     CddCache_flush(&replacecache);
+    CddCache_flush(&relationcache);
 #ifdef RELAXCACHE
-    CddRelaxCache_reset(&relaxcache);
+    CddRelaxCache_flush(&relaxcache);
 #endif
 }
 
-ddNode* cdd_apply(ddNode* l, ddNode* h, int32_t op)
+void cdd_operator_rebase()
+{
+    CddCache_rebase(&applycache);
+    CddCache_rebase(&quantcache);
+    CddCache_rebase(&replacecache);
+    CddCache_rebase(&relationcache);
+#ifdef RELAXCACHE
+    CddRelaxCache_rebase(&relaxcache);
+#endif
+}
+
+/**
+ * Returns a fresh operation identifier. The identifiers are keys of
+ * the caches and must not wrap around; if they run out, the operation
+ * backs off as for a memory limit.
+ */
+static int32_t cdd_operator_fresh()
+{
+    if (opseq == INT32_MAX) {
+        cdd_errorcond = cdd_error(CDD_MEMORY);
+        return INT32_MAX;
+    }
+    return (int32_t)++opseq;
+}
+
+/**
+ * Restarts the operation identifiers. The cache entries and interned
+ * vectors keyed on them are dropped, so no identifier is mistaken for
+ * an earlier one.
+ */
+static void cdd_operator_rewind()
+{
+    int32_t i;
+
+    CddCache_reset(&quantcache);
+    CddCache_reset(&replacecache);
+    for (i = 0; i < OPKEYS; i++) {
+        free(opkeys[i].vec);
+        opkeys[i].vec = NULL;
+    }
+    opkeycnt = 0;
+    opseq = 0;
+}
+
+/**
+ * Returns the operation identifier for the argument vector \a vec of
+ * \a size entries. Equal vectors get the same identifier as long as
+ * they stay interned, so cache entries keyed on the identifier stay
+ * valid across calls. The oldest vector is dropped when the table is
+ * full; its identifier is not handed out again until the identifiers
+ * restart from \c OPREWIND on, which leaves the running operation the
+ * rest of them. A fresh identifier is returned while the manager is
+ * shared or if memory is short.
+ */
+static int32_t cdd_operator_id(const int32_t* vec, int32_t size)
+{
+    CddOpKey* key;
+    uintptr_t hash = size;
+    int32_t* copy;
+    int32_t i;
+
+    if (cdd_shared) {
+        return cdd_operator_fresh();
+    }
+    if (opseq >= OPREWIND) {
+        cdd_operator_rewind();
+    }
+
+    for (i = 0; i < size; i++) {
+        hash = (hash + (uint32_t)vec[i]) * P1;
+    }
+    for (i = 0; i < OPKEYS; i++) {
+        key = opkeys + i;
+        if (key->vec != NULL && key->hash == hash && key->size == size &&
+            memcmp(key->vec, vec, size * sizeof(int32_t)) == 0) {
+            return key->id;
+        }
+    }
+
+    if ((copy = (int32_t*)malloc((size + 1) * sizeof(int32_t))) == NULL) {
+        return cdd_operator_fresh();
+    }
+    memcpy(copy, vec, size * sizeof(int32_t));
+    key = opkeys + opkeycnt++ % OPKEYS;
+    free(key->vec);
+    key->hash = hash;
+    key->id = cdd_operator_fresh();
+    key->size = size;
+    key->vec = copy;
+    return key->id;
+}
+
+/** Returns the operation cache with the identifier \a cache, or NULL. */
+static CddCache* cdd_operator_cache(int32_t cache)
+{
+    switch (cache) {
+    case CDD_APPLYCACHE: return &applycache;
+    case CDD_QUANTCACHE: return &quantcache;
+    case CDD_REPLACECACHE: return &replacecache;
+    default: return NULL;
+    }
+}
+
+/** Replaces \a c by an empty cache of \a size entries, which may grow to \a maxsize entries. */
+static int32_t cdd_operator_resize(CddCache* c, size_t size, size_t maxsize)
+{
+    CddCache tmp;
+
+    if (CddCache_init(&tmp, size, maxsize) < 0) {
+        return CDD_MEMORY;
+    }
+    CddCache_done(c);
+    *c = tmp;
+    return 0;
+}
+
+/** Limits \a c to \a entries entries. */
+static void cdd_operator_limit(CddCache* c, size_t entries)
+{
+    if (c->maxsize > entries) {
+        c->maxsize = entries;
+    }
+    // Tables which already are too large are replaced
+    if (c->tablesize > entries) {
+        cdd_operator_resize(c, entries, entries);
+    }
+}
+
+int32_t cdd_setcachesize(int32_t cache, size_t size, size_t maxsize)
+{
+    CddCache* c = cdd_operator_cache(cache);
+
+    if (c == NULL) {
+        return cdd_error(CDD_RANGE);
+    }
+    return cdd_operator_resize(c, size, maxsize);
+}
+
+size_t cdd_operator_memory()
+{
+    size_t bytes = (CddCache_size(&applycache) + CddCache_size(&quantcache) + CddCache_size(&replacecache) +
+                    CddCache_size(&relationcache)) *
+                   sizeof(CddCacheData);
+#ifdef RELAXCACHE
+    bytes += relaxcache.tablesize * sizeof(CddRelaxCacheData);
+#endif
+    return bytes;
+}
+
+void cdd_operator_budget(size_t bytes)
+{
+    // The relation cache counts as a fraction of the other caches
+    size_t entries = bytes / 100 * CACHESHARE * RELATIONDIV / (3 * RELATIONDIV + 1) / sizeof(CddCacheData);
+    int32_t i;
+
+    for (i = CDD_APPLYCACHE; i <= CDD_REPLACECACHE; i++) {
+        cdd_operator_limit(cdd_operator_cache(i), entries);
+    }
+    cdd_operator_limit(&relationcache, entries / RELATIONDIV);
+}
+
+int32_t cdd_cachestats(int32_t cache, CddCacheStat* stat)
+{
+    CddCache* c = cdd_operator_cache(cache);
+
+    if (c == NULL) {
+        return cdd_error(CDD_RANGE);
+    }
+    stat->size = c->tablesize;
+    stat->maxsize = c->maxsize;
+    stat->lookups = c->lookups;
+    stat->hits = c->hits;
+    stat->overwrites = c->overwrites;
+    stat->resizes = c->resizes;
+    return 0;
+}
+
+/**
+ * Rewrites the operation \a op on \a l and \a r as one of the two
+ * apply kernels. With negated edges a disjunction, set minus or
+ * implication is a conjunction of possibly negated operands.
+ * @return the mask to apply to the result of the kernel
+ */
+static inline uintptr_t cdd_apply_normalise(ddNode** l, ddNode** r, int32_t* op)
+{
+    switch (*op) {
+    case cddop_or:
+        *l = cdd_neg(*l);
+        *r = cdd_neg(*r);
+        *op = cddop_and;
+        return 1;
+    case cddop_diff:
+        *r = cdd_neg(*r);
+        *op = cddop_and;
+        return 0;
+    case cddop_implies:
+        *r = cdd_neg(*r);
+        *op = cddop_and;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Returns \a res, or NULL if the error condition is set. The result of
+ * an operation which backed off because of a memory limit is not
+ * meaningful, so callers must be able to tell it apart.
+ */
+static inline ddNode* cdd_checked(ddNode* res)
 {
-    ddNode* res;
-    applyop = op;
-    res = cdd_apply_rec(l, h);
     if (cdd_errorcond) {
         cdd_error(cdd_errorcond);
         return NULL;
@@ -150,69 +415,145 @@ ddNode* cdd_apply(ddNode* l, ddNode* h, int32_t op)
     return res;
 }
 
-static ddNode* cdd_apply_rec(ddNode* l, ddNode* r)
+ddNode* cdd_apply(ddNode* l, ddNode* r, int32_t op) { return cdd_checked(cdd_apply_op(l, r, op)); }
+
+/**
+ * \c cdd_apply() for the operations of this file. It backs off with
+ * some diagram rather than NULL, which the public entry points report.
+ */
+static ddNode* cdd_apply_op(ddNode* l, ddNode* r, int32_t op)
 {
+    uintptr_t mask = cdd_apply_normalise(&l, &r, &op);
+
+    if (!cdd_shared) {
+        CddCache_adjust(&applycache);
+    }
+    switch (op) {
+    case cddop_and: return cdd_neg_cond(cdd_and_rec(l, r), mask);
+    case cddop_xor: return cdd_xor_rec(l, r);
+    }
+    cdd_error(CDD_OP);
+    return cddfalse;
+}
+
+/** What the result of the call above a frame of the iterative apply is for. */
+enum { APPLY_FIRST, APPLY_NEXT, APPLY_LOW, APPLY_HIGH };
+
+/**
+ * A pending call of the iterative apply. For a CDD node the children
+ * built so far are on the reference stack from \a first; for a BDD
+ * node \a prev holds the low branch while the high branch is built.
+ */
+typedef struct
+{
+    ddNode* l;           /**< Left operand, regular */
+    ddNode* r;           /**< Right operand, regular */
+    CddCacheData* entry; /**< Cache entry to update with the result */
+    Elem* top;           /**< Reference stack top to restore */
+    Elem* first;         /**< First child of the node being built */
+    Elem* lp;            /**< Current child of l */
+    Elem* rp;            /**< Current child of r */
+    ddNode* prev;        /**< Last child built */
+    raw_t bnd;           /**< Upper bound of the current child */
+    int32_t lmask;       /**< Negation of l */
+    int32_t rmask;       /**< Negation of r */
+    int32_t mask;        /**< Negation pushed out of the node */
+    int32_t state;       /**< One of APPLY_FIRST, APPLY_NEXT, APPLY_LOW and APPLY_HIGH */
+} ApplyFrame;
+
+/**
+ * Makes room for \a n frames of the iterative apply.
+ * @return false if out of memory, which is reported in \c cdd_errorcond
+ */
+static bool cdd_apply_frames(size_t n)
+{
+    CddThread* t = cdd_thread;
+    void* frames;
+    size_t size = t->framestacksize < 32 ? 64 : 2 * t->framestacksize;
+
+    size = size > n ? size : n;
+    if ((frames = realloc(t->framestack, sizeof(ApplyFrame) * size)) == NULL) {
+        cdd_errorcond = cdd_error(CDD_MEMORY);
+        return false;
+    }
+    t->framestack = frames;
+    t->framestacksize = size;
+    return true;
+}
+
+/**
+ * The apply of \a op, which is \c cddop_and or \c cddop_xor. It is
+ * inlined into one function per operation, so that the terminal cases
+ * and the cache key of each are resolved at compile time. The
+ * recursion over the operands is unfolded into frames on a stack of
+ * the thread, which grows on demand, so the depth of the diagrams is
+ * not limited by the C stack.
+ */
+static inline __attribute__((always_inline)) ddNode* cdd_apply_kernel(ddNode* l, ddNode* r, const int32_t op)
+{
+    CddThread* t = cdd_thread;
+    size_t base = t->framedepth;
     CddCacheData* entry;
-    int32_t lmask;
-    int32_t rmask;
-    int32_t mask;
-    Elem* top;
-    Elem* lp;
-    Elem* rp;
-    Elem* first;
-    ddNode* ll;
-    ddNode* lh;
-    ddNode* rl;
-    ddNode* rh;
-    ddNode* n;
-    ddNode* prev;
-    raw_t bnd;
+    ApplyFrame* f;
+    Elem* p;
+    ddNode* res;
 
+call:
     /* Back off in case of error */
     if (cdd_errorcond) {
-        return 0;
+        res = cddfalse;
+        goto done;
     }
 
     /* Termination conditons */
-    switch (applyop) {
+    switch (op) {
     case cddop_and:
         if (l == r || r == cddtrue) {
-            return l;
+            res = l;
+            goto done;
         }
         if (l == cddfalse || r == cddfalse || l == cdd_neg(r)) {
-            return cddfalse;
+            res = cddfalse;
+            goto done;
         }
         if (l == cddtrue) {
-            return r;
+            res = r;
+            goto done;
         }
         break;
     case cddop_xor:
         if (l == r) {
-            return cddfalse;
+            res = cddfalse;
+            goto done;
         }
         if (l == cdd_neg(r)) {
-            return cddtrue;
+            res = cddtrue;
+            goto done;
         }
         if (l == cddfalse) {
-            return r;
+            res = r;
+            goto done;
         }
         if (r == cddfalse) {
-            return l;
+            res = l;
+            goto done;
         }
         if (l == cddtrue) {
-            return cdd_neg(r);
+            res = cdd_neg(r);
+            goto done;
         }
         if (r == cddtrue) {
-            return cdd_neg(l);
+            res = cdd_neg(l);
+            goto done;
         }
         break;
     }
 
     /* The operation is symmetric; normalise for better cache performance */
     if (l > r) {
-        n = l;
+        res = l;
         l = r;
-        r = n;
+        r = res;
     }
 
     if (cdd_isterminal(l) && cdd_isterminal(r)) {
@@ -224,113 +565,440 @@ static ddNode* cdd_apply_rec(ddNode* l, ddNode* r)
 #endif
         if (l != r) {
             fprintf(stderr, "Diagram is wrong: '%s' between extra terminal nodes.\n",
-                    applyop == cddop_and ? "and" : "xor");
+                    op == cddop_and ? "and" : "xor");
         }
-        return l;
+        res = l;
+        goto done;
     }
 
     /* Do cache lookup */
-    //    fprintf(stderr, "%u\n", APPLYHASH(l, r, applyop) % 10000);
-    entry = CddCache_lookup(&applycache, APPLYHASH(l, r, applyop));
-    if (entry->a == l && entry->b == r && entry->c == applyop) {
-        if (cdd_rglr(entry->res)->ref == 0) {
-            cdd_reclaim(entry->res);
+    entry = CddCache_lookup(&applycache, APPLYHASH(l, r, op));
+    if (CddCache_match(&applycache, entry, l, r, op, &res)) {
+        if (!cdd_shared && cdd_rglr(res)->ref == 0) {
+            cdd_reclaim(res);
         }
-        return entry->res;
+        goto done;
     }
 
-    /* Generate masks to 'push down' the negation bit */
-    lmask = cdd_mask(l);
-    rmask = cdd_mask(r);
-    l = cdd_rglr(l);
-    r = cdd_rglr(r);
-
-    switch (cdd_levelinfo[minimum(l->level, r->level)].type) {
-    case TYPE_CDD:
+    /* Push a frame; the masks 'push down' the negation bit */
+    if (t->framedepth == t->framestacksize && !cdd_apply_frames(t->framedepth + 1)) {
+        res = cddfalse;
+        goto done;
+    }
+    f = (ApplyFrame*)t->framestack + t->framedepth++;
+    f->entry = entry;
+    f->lmask = cdd_mask(l);
+    f->rmask = cdd_mask(r);
+    f->l = cdd_rglr(l);
+    f->r = cdd_rglr(r);
+
+    if (cdd_levelinfo[minimum(f->l->level, f->r->level)].type == TYPE_CDD) {
         /* Prepare for recursion */
-        top = cdd_refstacktop;
-        if (l->level <= r->level) {
-            lp = cdd_node(l)->elem;
+        f->top = cdd_refstack_reserve(2 * cdd_maxcddsize + 1);
+        if (f->l->level <= f->r->level) {
+            f->lp = cdd_node(f->l)->elem;
         } else {
-            lp = cdd_refstacktop;
-            cdd_push(l, INF);
+            f->lp = cdd_refstacktop;
+            cdd_push(f->l, INF);
         }
 
-        if (l->level >= r->level) {
-            rp = cdd_node(r)->elem;
+        if (f->l->level >= f->r->level) {
+            f->rp = cdd_node(f->r)->elem;
         } else {
-            rp = cdd_refstacktop;
-            cdd_push(r, INF);
+            f->rp = cdd_refstacktop;
+            cdd_push(f->r, INF);
         }
+        f->first = cdd_refstacktop;
 
-        /*
-         * Do recursion
+        /* Do first recursion - check whether first edge is negated */
+        f->state = APPLY_FIRST;
+        l = cdd_neg_cond(cdd_elem_child(f->lp), f->lmask);
+        r = cdd_neg_cond(cdd_elem_child(f->rp), f->rmask);
+    } else {
+        f->state = APPLY_LOW;
+        l = cdd_neg_cond(f->l->level <= f->r->level ? bdd_node_low(f->l) : f->l, f->lmask);
+        r = cdd_neg_cond(f->l->level >= f->r->level ? bdd_node_low(f->r) : f->r, f->rmask);
+    }
+    goto call;
+
+done:
+    /* Return \a res to the pending calls until one needs another child */
+    while (t->framedepth > base) {
+        f = (ApplyFrame*)t->framestack + t->framedepth - 1;
+        switch (f->state) {
+        case APPLY_FIRST:
+        case APPLY_NEXT:
+            if (f->state == APPLY_FIRST) {
+                f->prev = res;
+                cdd_ref(f->prev);
+                f->mask = cdd_mask(f->prev);
+            } else if (res != f->prev) {
+                cdd_push(cdd_neg_cond(f->prev, f->mask), f->bnd);
+                f->prev = res;
+                cdd_ref(f->prev);
+            }
+
+            /* Continue */
+            f->bnd = minimum(f->lp->bnd, f->rp->bnd);
+            if (f->bnd < INF) {
+                f->lp += (f->lp->bnd == f->bnd);
+                f->rp += (f->rp->bnd == f->bnd);
+                f->state = APPLY_NEXT;
+                l = cdd_neg_cond(cdd_elem_child(f->lp), f->lmask);
+                r = cdd_neg_cond(cdd_elem_child(f->rp), f->rmask);
+                goto call;
+            }
+            cdd_push(cdd_neg_cond(f->prev, f->mask), INF);
+
+            /* Create node */
+            res = cdd_make_cdd_node(minimum(f->l->level, f->r->level), f->first, cdd_refstacktop - f->first);
+            res = cdd_neg_cond(res, f->mask);
+
+            /* Remove references */
+            for (p = f->first; p < cdd_refstacktop; p++) {
+                cdd_deref(cdd_elem_child(p));
+            }
+
+            /* Restore stacktop */
+            cdd_refstacktop = f->top;
+            break;
+        case APPLY_LOW:
+            f->prev = res;
+            cdd_ref(f->prev);
+            f->state = APPLY_HIGH;
+            l = cdd_neg_cond(f->l->level <= f->r->level ? bdd_node_high(f->l) : f->l, f->lmask);
+            r = cdd_neg_cond(f->l->level >= f->r->level ? bdd_node_high(f->r) : f->r, f->rmask);
+            goto call;
+        case APPLY_HIGH:
+            res = cdd_make_bdd_node(minimum(f->l->level, f->r->level), f->prev, res);
+            cdd_deref(f->prev);
+            break;
+        }
+
+        /* Update cache entry */
+        CddCache_write(&applycache, f->entry, res, cdd_neg_cond(f->l, f->lmask), cdd_neg_cond(f->r, f->rmask), op);
+        t->framedepth--;
+    }
+    return res;
+}
+
+/** The apply recursion of conjunctions. */
+static ddNode* cdd_and_rec(ddNode* l, ddNode* r) { return cdd_apply_kernel(l, r, cddop_and); }
+
+/** The apply recursion of exclusive ors. */
+static ddNode* cdd_xor_rec(ddNode* l, ddNode* r) { return cdd_apply_kernel(l, r, cddop_xor); }
+
+///////////////////////////////////////////////////////////////////////////
+
+/** Entry of \c ApplyNMemo; empty if \a n is 0. */
+typedef struct
+{
+    uintptr_t hash;
+    size_t key; /**< Offset of the operands in the key array */
+    size_t n;   /**< Number of operands */
+    ddNode* res;
+} ApplyNEntry;
+
+/**
+ * Results of \c cdd_apply_n() for more than two operands. Pairs of
+ * operands use the apply cache; larger sets are only reused within
+ * one call and do not displace entries of the apply cache. Results
+ * are referenced until the end of the call.
+ */
+typedef struct
+{
+    ApplyNEntry* table;
+    size_t tablesize; /**< Number of entries, a power of 2 */
+    size_t count;
+    ddNode** keys;
+    size_t keysize;
+    size_t keycap;
+} ApplyNMemo;
+
+static int cdd_node_cmp(const void* a, const void* b)
+{
+    uintptr_t x = (uintptr_t) * (ddNode* const*)a;
+    uintptr_t y = (uintptr_t) * (ddNode* const*)b;
+    return (x > y) - (x < y);
+}
+
+static uintptr_t cdd_apply_n_hash(ddNode** args, size_t n)
+{
+    uintptr_t hash = n;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        hash = (hash + (uintptr_t)args[i]) * P1;
+    }
+    return hash * P2;
+}
+
+/** Returns the entry for \a args, which is empty if the operands are not memoised. */
+static ApplyNEntry* cdd_apply_n_lookup(ApplyNMemo* memo, ddNode** args, size_t n, uintptr_t hash)
+{
+    ApplyNEntry* entry;
+    size_t i;
+
+    for (i = hash & (memo->tablesize - 1);; i = (i + 1) & (memo->tablesize - 1)) {
+        entry = memo->table + i;
+        if (entry->n == 0 || (entry->hash == hash && entry->n == n &&
+                              memcmp(memo->keys + entry->key, args, n * sizeof(ddNode*)) == 0)) {
+            return entry;
+        }
+    }
+}
+
+/** Memoises \a res for \a args. Nothing is memoised if memory is short or after an error. */
+static void cdd_apply_n_insert(ApplyNMemo* memo, ddNode** args, size_t n, uintptr_t hash, ddNode* res)
+{
+    ApplyNMemo old = *memo;
+    ApplyNEntry* entry;
+    ddNode** keys;
+    size_t i;
+
+    if (cdd_errorcond) {
+        return;
+    }
+
+    if (memo->keysize + n > memo->keycap) {
+        if ((keys = (ddNode**)realloc(memo->keys, 2 * (memo->keycap + n) * sizeof(ddNode*))) == NULL) {
+            return;
+        }
+        memo->keys = keys;
+        memo->keycap = 2 * (memo->keycap + n);
+    }
+
+    // The table is kept at most half full
+    if (2 * (memo->count + 1) > memo->tablesize) {
+        if ((memo->table = (ApplyNEntry*)calloc(2 * old.tablesize, sizeof(ApplyNEntry))) == NULL) {
+            memo->table = old.table;
+            return;
+        }
+        memo->tablesize = 2 * old.tablesize;
+        for (i = 0; i < old.tablesize; i++) {
+            if (old.table[i].n > 0) {
+                *cdd_apply_n_lookup(memo, memo->keys + old.table[i].key, old.table[i].n, old.table[i].hash) =
+                    old.table[i];
+            }
+        }
+        free(old.table);
+    }
+
+    entry = cdd_apply_n_lookup(memo, args, n, hash);
+    entry->hash = hash;
+    entry->key = memo->keysize;
+    entry->n = n;
+    entry->res = res;
+    memcpy(memo->keys + memo->keysize, args, n * sizeof(ddNode*));
+    memo->keysize += n;
+    memo->count++;
+    cdd_ref(res);
+}
+
+/**
+ * Brings the operands of a conjunction into a canonical order, and
+ * removes duplicates and true operands.
+ * @return the result if it follows without recursion, or NULL
+ */
+static ddNode* cdd_and_n_normalise(ddNode** args, size_t* n)
+{
+    size_t i;
+    size_t m = 0;
+
+    // Sorting places a node next to its negation
+    qsort(args, *n, sizeof(ddNode*), cdd_node_cmp);
+    for (i = 0; i < *n; i++) {
+        if (args[i] == cddtrue || (m > 0 && args[m - 1] == args[i])) {
+            continue;
+        }
+        if (args[i] == cddfalse || (m > 0 && args[m - 1] == cdd_neg(args[i]))) {
+            return cddfalse;
+        }
+        args[m++] = args[i];
+    }
+    *n = m;
+    return m == 0 ? cddtrue : m == 1 ? args[0] : NULL;
+}
+
+/**
+ * Conjunction of \a n operands. The operands in \a args are reordered
+ * in place. All operands are merged level by level as \c
+ * cdd_and_rec() merges two; two remaining operands are passed on to
+ * \c cdd_and_rec().
+ */
+static ddNode* cdd_and_n_rec(ddNode** args, size_t n, ApplyNMemo* memo)
+{
+    ApplyNEntry* entry;
+    ddNode** child;
+    Elem** pos;
+    Elem* top;
+    Elem* first;
+    ddNode* prev;
+    ddNode* lo;
+    ddNode* res;
+    uintptr_t hash;
+    int32_t level;
+    int32_t mask;
+    raw_t bnd;
+    raw_t next;
+    size_t i;
+
+    /* Back off in case of error */
+    if (cdd_errorcond) {
+        return cddfalse;
+    }
+
+    if ((res = cdd_and_n_normalise(args, &n)) != NULL) {
+        return res;
+    }
+    if (n == 2) {
+        return cdd_and_rec(args[0], args[1]);
+    }
+
+    hash = cdd_apply_n_hash(args, n);
+    entry = cdd_apply_n_lookup(memo, args, n, hash);
+    if (entry->n > 0) {
+        return entry->res;
+    }
+
+    level = cdd_rglr(args[0])->level;
+    for (i = 1; i < n; i++) {
+        level = minimum(level, cdd_rglr(args[i])->level);
+    }
+
+    /* Only extra terminals are left; they are combined pairwise */
+    if (level == cdd_rglr(cddfalse)->level) {
+        res = args[0];
+        for (i = 1; i < n; i++) {
+            res = cdd_and_rec(res, args[i]);
+        }
+        return res;
+    }
+
+    if ((pos = (Elem**)malloc(n * (sizeof(Elem*) + sizeof(ddNode*)))) == NULL) {
+        cdd_error(CDD_MEMORY);
+        return cddfalse;
+    }
+    child = (ddNode**)(pos + n);
+
+    if (cdd_levelinfo[level].type == TYPE_CDD) {
+        /* Operands on lower levels act as a node with a single child,
+         * marked by a NULL position.
          */
+        bnd = INF;
+        for (i = 0; i < n; i++) {
+            pos[i] = cdd_rglr(args[i])->level == level ? cdd_node(cdd_rglr(args[i]))->elem : NULL;
+            child[i] = pos[i] ? cdd_neg_cond(cdd_elem_child(pos[i]), cdd_mask(args[i])) : args[i];
+            bnd = pos[i] ? minimum(bnd, pos[i]->bnd) : bnd;
+        }
 
+        top = cdd_refstack_reserve(n * cdd_maxcddsize);
         first = cdd_refstacktop;
-
-        /* Do first recursion - check whether first edge is negated */
-        prev = cdd_apply_rec(cdd_neg_cond(lp->child, lmask), cdd_neg_cond(rp->child, rmask));
+        prev = cdd_and_n_rec(child, n, memo);
         cdd_ref(prev);
         mask = cdd_mask(prev);
-        bnd = minimum(lp->bnd, rp->bnd);
-
-        /* Continue */
         while (bnd < INF) {
-            lp += (lp->bnd == bnd);
-            rp += (rp->bnd == bnd);
-            n = cdd_apply_rec(cdd_neg_cond(lp->child, lmask), cdd_neg_cond(rp->child, rmask));
-            if (n != prev) {
+            next = INF;
+            for (i = 0; i < n; i++) {
+                if (pos[i]) {
+                    pos[i] += (pos[i]->bnd == bnd);
+                    child[i] = cdd_neg_cond(cdd_elem_child(pos[i]), cdd_mask(args[i]));
+                    next = minimum(next, pos[i]->bnd);
+                } else {
+                    child[i] = args[i];
+                }
+            }
+            res = cdd_and_n_rec(child, n, memo);
+            if (res != prev) {
                 cdd_push(cdd_neg_cond(prev, mask), bnd);
-                prev = n;
+                prev = res;
                 cdd_ref(prev);
             }
-            bnd = minimum(lp->bnd, rp->bnd);
+            bnd = next;
         }
         cdd_push(cdd_neg_cond(prev, mask), INF);
 
-        /* Create node */
-        entry->res = cdd_neg_cond(cdd_make_cdd_node(minimum(l->level, r->level), first, cdd_refstacktop - first), mask);
+        res = cdd_neg_cond(cdd_make_cdd_node(level, first, cdd_refstacktop - first), mask);
 
         /* Remove references */
-        for (; first < cdd_refstacktop; first++) {
-            cdd_deref(first->child);
+        while (cdd_refstacktop > first) {
+            cdd_refstacktop--;
+            cdd_deref(cdd_elem_child(cdd_refstacktop));
         }
-
-        /* Restore stacktop */
         cdd_refstacktop = top;
+    } else {
+        for (i = 0; i < n; i++) {
+            child[i] = cdd_rglr(args[i])->level == level ? cdd_neg_cond(bdd_node_low(args[i]), cdd_mask(args[i]))
+                                                         : args[i];
+        }
+        lo = cdd_and_n_rec(child, n, memo);
+        cdd_ref(lo);
+        for (i = 0; i < n; i++) {
+            child[i] = cdd_rglr(args[i])->level == level ? cdd_neg_cond(bdd_node_high(args[i]), cdd_mask(args[i]))
+                                                         : args[i];
+        }
+        res = cdd_make_bdd_node(level, lo, cdd_and_n_rec(child, n, memo));
+        cdd_deref(lo);
+    }
+    free(pos);
 
-        break;
-    case TYPE_BDD:
-        if (l->level <= r->level) {
-            ll = bdd_node(l)->low;
-            lh = bdd_node(l)->high;
-        } else {
-            ll = lh = l;
-        }
+    cdd_apply_n_insert(memo, args, n, hash, res);
+    return res;
+}
 
-        if (l->level >= r->level) {
-            rl = bdd_node(r)->low;
-            rh = bdd_node(r)->high;
-        } else {
-            rl = rh = r;
+/** \c cdd_apply_n() for the operations of this file, see \c cdd_apply_op(). */
+static ddNode* cdd_apply_n_op(ddNode* const* args, size_t n, int32_t op)
+{
+    ApplyNMemo memo = {NULL, 16, 0, NULL, 0, 0};
+    ddNode** ops;
+    ddNode* prev;
+    ddNode* res;
+    size_t i;
+
+    if (op != cddop_and && op != cddop_or) {
+        /* No n-ary recursion for other operations */
+        res = n > 0 ? args[0] : cddfalse;
+        for (i = 1; i < n; i++) {
+            prev = res;
+            cdd_ref(prev);
+            res = cdd_apply_op(prev, args[i], op);
+            cdd_deref(prev);
         }
+        return res;
+    }
 
-        n = cdd_apply_rec(cdd_neg_cond(ll, lmask), cdd_neg_cond(rl, rmask));
-        cdd_ref(n);
-        entry->res = cdd_make_bdd_node(minimum(l->level, r->level), n,
-                                       cdd_apply_rec(cdd_neg_cond(lh, lmask), cdd_neg_cond(rh, rmask)));
-        cdd_deref(n);
+    if ((ops = (ddNode**)malloc((n + 1) * sizeof(ddNode*))) == NULL ||
+        (memo.table = (ApplyNEntry*)calloc(memo.tablesize, sizeof(ApplyNEntry))) == NULL) {
+        free(ops);
+        cdd_errorcond = cdd_error(CDD_MEMORY);
+        return cddfalse;
     }
 
-    /* Update cache entry */
-    entry->a = cdd_neg_cond(l, lmask);
-    entry->b = cdd_neg_cond(r, rmask);
-    entry->c = applyop;
+    /* A disjunction is the negated conjunction of the negated operands */
+    for (i = 0; i < n; i++) {
+        ops[i] = cdd_neg_cond(args[i], op == cddop_or);
+    }
+
+    if (!cdd_shared) {
+        CddCache_adjust(&applycache);
+    }
+    res = cdd_and_n_rec(ops, n, &memo);
 
-    return entry->res;
+    cdd_ref(res);
+    for (i = 0; i < memo.tablesize; i++) {
+        if (memo.table[i].n > 0) {
+            cdd_deref(memo.table[i].res);
+        }
+    }
+    cdd_deref(res);
+    free(memo.table);
+    free(memo.keys);
+    free(ops);
+    return cdd_neg_cond(res, op == cddop_or);
 }
 
+ddNode* cdd_apply_n(ddNode* const* args, size_t n, int32_t op) { return cdd_checked(cdd_apply_n_op(args, n, op)); }
+
 ///////////////////////////////////////////////////////////////////////////
 
 static bool cdd_constrain2(raw_t* dbm, uint32_t dim, uint32_t i, uint32_t j, raw_t lower, raw_t upper)
@@ -341,7 +1009,8 @@ static bool cdd_constrain2(raw_t* dbm, uint32_t dim, uint32_t i, uint32_t j, raw
 
 ///////////////////////////////////////////////////////////////////////////
 
-ddNode* cdd_ite(ddNode* f, ddNode* g, ddNode* h)
+/** \c cdd_ite() for the operations of this file, see \c cdd_apply_op(). */
+static ddNode* cdd_ite_op(ddNode* f, ddNode* g, ddNode* h)
 {
     g = cdd_and(f, g);
     cdd_ref(g);
@@ -355,17 +1024,45 @@ ddNode* cdd_ite(ddNode* f, ddNode* g, ddNode* h)
     return f;
 }
 
-int32_t cdd_contains(ddNode* node, raw_t* dbm, int32_t dim)
-{
-    assert(dbm_isValid(dbm, dim));
-    return cdd_contains_rec(node, dbm, dim);
-}
+ddNode* cdd_ite(ddNode* f, ddNode* g, ddNode* h) { return cdd_checked(cdd_ite_op(f, g, h)); }
 
-static int32_t cdd_contains_rec(ddNode* node, raw_t* d, int32_t dim)
+/** Entry of the memo of a containment test; its zone is kept in \c ContainsState. */
+typedef struct
+{
+    ddNode* node;  /**< NULL if the entry is empty */
+    uint32_t hash; /**< Hash of the zone */
+    int32_t res;
+} ContainsEntry;
+
+/**
+ * State of a containment test. A child only gets a zone of its own
+ * where its interval tightens the zone of the parent, so the zones of
+ * a path are kept in a stack with room for one per level. Results are
+ * memoised per node and zone for all zones of a batch.
+ */
+typedef struct
 {
-    raw_t* tmp;
+    int32_t dim;
+    raw_t* dbms;          /**< The zone stack */
+    raw_t* zones;         /**< The zones of the memo entries */
+    uint32_t* hashes;     /**< The hash of each zone of the stack */
+    ContainsEntry* memo;  /**< Direct mapped memo of 2^CONTAINSBITS entries */
+} ContainsState;
+
+static int32_t cdd_contains_rec(ContainsState* s, ddNode* node, int32_t depth)
+{
+    int32_t dim = s->dim;
+    size_t size = (size_t)dim * dim;
+    raw_t* d = s->dbms + depth * size;
+    raw_t* next = d + size;
+    uint32_t slot;
+    uint32_t c1, c2;
+    ContainsEntry* entry;
     cdd_iterator it;
     LevelInfo* info;
+    ddNode* child;
+    raw_t lower, upper;
+    int32_t res = 1;
 
     /* Check termination conditions */
     if (node == cddtrue)
@@ -379,6 +1076,12 @@ static int32_t cdd_contains_rec(ddNode* node, raw_t* d, int32_t dim)
     }
 #endif
 
+    slot = (uint32_t)(((uintptr_t)node >> 3) * P1 + s->hashes[depth]) * P2 >> (32 - CONTAINSBITS);
+    entry = s->memo + slot;
+    if (entry->node == node && entry->hash == s->hashes[depth] && dbm_areEqual(s->zones + slot * size, d, dim)) {
+        return entry->res;
+    }
+
     info = cdd_info(node);
     switch (info->type) {
     case TYPE_CDD:
@@ -390,29 +1093,110 @@ static int32_t cdd_contains_rec(ddNode* node, raw_t* d, int32_t dim)
             return 0;
         }
 
-        /* Allocate space for copy */
-        tmp = malloc(dim * dim * sizeof(raw_t));
-        /* Iterate over children */
-        for (cdd_it_init(it, node); !cdd_it_atend(it); cdd_it_next(it)) {
-            if (!IS_TRUE(cdd_it_child(it))) {
-                dbm_copy(tmp, d, dim);
-                if (cdd_constrain2(tmp, dim, info->clock1, info->clock2, cdd_it_lower(it), cdd_it_upper(it)) &&
-                    !cdd_contains_rec(cdd_it_child(it), tmp, dim)) {
-                    free(tmp);
-                    return 0;
-                }
+        /* Iterate over the children whose intervals meet the zone */
+        c1 = info->clock1;
+        c2 = info->clock2;
+        for (cdd_it_init(it, node); res && !cdd_it_atend(it); cdd_it_next(it)) {
+            child = cdd_it_child(it);
+            lower = bnd_l2u(cdd_it_lower(it));
+            upper = cdd_it_upper(it);
+            if (dbm_addRawRaw(upper, d[c2 * dim + c1]) < dbm_LE_ZERO) {
+                continue;
+            }
+            if (dbm_addRawRaw(lower, d[c1 * dim + c2]) < dbm_LE_ZERO) {
+                break;
+            }
+            if (IS_TRUE(child)) {
+                continue;
+            }
+            if (upper >= d[c1 * dim + c2] && lower >= d[c2 * dim + c1]) {
+                // The zone lies within this interval and meets no other
+                res = cdd_contains_rec(s, child, depth);
+                break;
+            }
+            dbm_copy(next, d, dim);
+            if (cdd_constrain2(next, dim, c1, c2, cdd_it_lower(it), upper)) {
+                s->hashes[depth + 1] = hash_computeU32((const uint32_t*)next, size, 0);
+                res = cdd_contains_rec(s, child, depth + 1);
             }
         }
-        free(tmp);
         break;
     case TYPE_BDD:
-        if (!cdd_contains_rec(bdd_node(node)->low, d, dim))
-            return 0;
-        if (!cdd_contains_rec(bdd_node(node)->high, d, dim))
-            return 0;
+        res = cdd_contains_rec(s, bdd_node_low(node), depth) && cdd_contains_rec(s, bdd_node_high(node), depth);
         break;
     }
-    return 1;
+
+    entry->node = node;
+    entry->hash = s->hashes[depth];
+    entry->res = res;
+    dbm_copy(s->zones + slot * size, d, dim);
+    return res;
+}
+
+int32_t cdd_contains_many(ddNode* node, const raw_t* const* dbms, size_t n, int32_t dim)
+{
+    ContainsState s;
+    size_t size = (size_t)dim * dim;
+    size_t i;
+    int32_t res = 1;
+
+    // A path tightens the zone once per level at most
+    s.dim = dim;
+    s.dbms = (raw_t*)malloc(((cdd_levelcnt + 1) + ((size_t)1 << CONTAINSBITS)) * size * sizeof(raw_t));
+    s.hashes = (uint32_t*)malloc((cdd_levelcnt + 1) * sizeof(uint32_t));
+    s.memo = (ContainsEntry*)calloc((size_t)1 << CONTAINSBITS, sizeof(ContainsEntry));
+    if (s.dbms == NULL || s.hashes == NULL || s.memo == NULL) {
+        free(s.dbms);
+        free(s.hashes);
+        free(s.memo);
+        cdd_error(CDD_MEMORY);
+        return 0;
+    }
+    s.zones = s.dbms + (cdd_levelcnt + 1) * size;
+
+    for (i = 0; res && i < n; i++) {
+        assert(dbm_isValid(dbms[i], dim));
+        dbm_copy(s.dbms, dbms[i], dim);
+        s.hashes[0] = hash_computeU32((const uint32_t*)s.dbms, size, 0);
+        res = cdd_contains_rec(&s, node, 0);
+    }
+
+    free(s.dbms);
+    free(s.hashes);
+    free(s.memo);
+    return res;
+}
+
+int32_t cdd_contains(ddNode* node, raw_t* dbm, int32_t dim)
+{
+    const raw_t* zone = dbm;
+    return cdd_contains_many(node, &zone, 1, dim);
+}
+
+int32_t cdd_eval_point(ddNode* node, const int32_t* clocks, const bool* vars)
+{
+    LevelInfo* info;
+    Elem* p;
+    raw_t v;
+    uintptr_t neg = 0;
+
+    while (!cdd_isterminal(node)) {
+        neg ^= cdd_mask(node);
+        info = cdd_info(node);
+        if (info->type == TYPE_CDD) {
+            // The intervals are ordered and the last one is unbounded
+            v = dbm_bound2raw(clocks[info->clock1] - clocks[info->clock2], dbm_WEAK);
+            for (p = cdd_node(node)->elem; p->bnd < v; p++) {}
+            node = cdd_elem_child(p);
+        } else {
+            node = vars[cdd_level2var[cdd_rglr(node)->level]] ? bdd_node_high(node) : bdd_node_low(node);
+        }
+    }
+#ifdef MULTI_TERMINAL
+    return cdd_eval_true(cdd_neg_cond(node, neg));
+#else
+    return cdd_neg_cond(node, neg) == cddtrue;
+#endif
 }
 
 int32_t cdd_edgecount(ddNode* node)
@@ -428,28 +1212,52 @@ int32_t cdd_edgecount(ddNode* node)
     return num;
 }
 
-/* Existentially quantify clocks in a CDD.
+/**
+ * Prepares a quantification of \a levels and \a clocks: no constraint
+ * has been removed yet. Relaxed and quantified nodes depend on the
+ * constraints removed above them, so they are cached under \c rcid,
+ * which is renewed whenever a constraint is removed and restored with
+ * it. Until then it identifies the quantified levels and clocks, so
+ * repeated quantifications of the same sets share cache entries.
  */
-#ifdef EX
-ddNode* cdd_exist(ddNode* node, int32_t* levels, int32_t* clocks)
+static void cdd_exist_init(int32_t* levels, int32_t* clocks, raw_t* rc)
 {
+    int32_t vec[cdd_levelcnt + cdd_clocknum];
     int32_t i, j;
-    raw_t removed_constraint[cdd_clocknum * cdd_clocknum];
+
     for (i = 0; i < cdd_clocknum; i++) {
         for (j = 0; j < cdd_clocknum; j++) {
-            removed_constraint[i * cdd_clocknum + j] = INF;
+            rc[i * cdd_clocknum + j] = INF;
         }
     }
-    opid++;
-    return cdd_exist_rec(node, levels, clocks, removed_constraint);
+    if (!cdd_shared) {
+        CddCache_adjust(&quantcache);
+    }
+
+    for (i = 0; i < cdd_levelcnt; i++) {
+        vec[i] = levels[i] != 0;
+    }
+    for (i = 0; i < cdd_clocknum; i++) {
+        vec[cdd_levelcnt + i] = clocks[i] != 0;
+    }
+    rcid = cdd_operator_id(vec, cdd_levelcnt + cdd_clocknum);
 }
-#else
-ddNode* cdd_exist(ddNode* node, int32_t* levels)
+
+ddNode* cdd_exist(ddNode* node, int32_t* levels, int32_t* clocks)
 {
-    opid++;
-    return cdd_exist_rec(node, levels, cddtrue);
+    raw_t removed_constraint[cdd_clocknum * cdd_clocknum];
+
+    cdd_exist_init(levels, clocks, removed_constraint);
+    return cdd_checked(cdd_exist_rec(node, levels, clocks, removed_constraint));
+}
+
+ddNode* cdd_and_exist(ddNode* l, ddNode* r, int32_t* levels, int32_t* clocks)
+{
+    raw_t removed_constraint[cdd_clocknum * cdd_clocknum];
+
+    cdd_exist_init(levels, clocks, removed_constraint);
+    return cdd_checked(cdd_and_exist_rec(l, r, levels, clocks, removed_constraint));
 }
-#endif
 
 /* // unused
 static void cdd_check(ddNode *node)
@@ -471,171 +1279,132 @@ static void cdd_check(ddNode *node)
         }
         break;
     case TYPE_BDD:
-        if (cdd_rglr(bdd_node(node)->low)->ref == 0) {
+        if (cdd_rglr(bdd_node_low(node))->ref == 0) {
             fprintf(stderr, "Invalid CDD\n");
             return;
         }
-        if (cdd_rglr(bdd_node(node)->high)->ref == 0) {
+        if (cdd_rglr(bdd_node_high(node))->ref == 0) {
             fprintf(stderr, "Invalid CDD\n");
             return;
         }
-        cdd_check(bdd_node(node)->low);
-        cdd_check(bdd_node(node)->high);
+        cdd_check(bdd_node_low(node));
+        cdd_check(bdd_node_high(node));
     }
 }
 */
 
-#ifndef EX
-static DBM cdd2dbm(ddNode* node)
+/**
+ * Combines the children on the reference stack above \a top into a
+ * diagram over the intervals of CDD level \a level, each child with
+ * its upper bound. The children are referenced by the caller; the
+ * references are released and the stack restored to \a top. If all
+ * children lie below \a level, the node is built directly. Otherwise
+ * each child is constrained to its interval and the results are
+ * joined in one disjunction.
+ */
+static ddNode* cdd_join_intervals(int32_t level, Elem* top)
 {
-    cdd_iterator it;
-    DBM d = old_dbm_blank(old_dbm_alloc(cdd_clocknum));
-    LevelInfo* info;
-
-    while (!cdd_isterminal(node)) {
-        cdd_it_init(it, node);
-        while (cdd_it_child(it) == cddfalse) {
-            cdd_it_next(it);
-        }
+    Elem* end = cdd_refstacktop;
+    Elem* p;
+    Elem* q;
+    ddNode* args[end - top];
+    ddNode* tmp;
+    ddNode* res;
+    int32_t below = 1;
+    int32_t mask;
+    raw_t lower;
+    int32_t i;
 
-        info = cdd_info(node);
-        old_dbm_tighten_interval(d, info->clock1, info->clock2, cdd_it_lower(it), cdd_it_upper(it));
-        node = cdd_it_child(it);
+    for (p = top; p < end; p++) {
+        below &= cdd_rglr(cdd_elem_child(p))->level > level;
     }
-    return d;
-}
 
-static ddNode* translate(ddNode* node, int32_t* levels)
-{
-    ddNode* res;
-    int32_t i;
-    int32_t j;
-    DBM d;
-
-    //     d = cdd2dbm(cdd_reduce(node));
-    d = cdd2dbm(node);
-    old_dbm_close(d);
-    for (i = 1; i < old_dbm_get_size(d); i++) {
-        for (j = 0; j < i; j++) {
-            if (levels[cdd_diff2level[cdd_difference(i, j)]]) {
-                old_dbm_set_bound(d, i, j, INF);
-                old_dbm_set_bound(d, j, i, INF);
+    if (below) {
+        /* Merge adjacent equal children and push the negation of the
+         * first child out of the node.
+         */
+        mask = cdd_mask(cdd_elem_child(top));
+        for (p = q = top; p < end; p++) {
+            if (q > top && cdd_elem_child(q - 1) == cdd_neg_cond(cdd_elem_child(p), mask)) {
+                q[-1].bnd = p->bnd;
+                cdd_deref(cdd_elem_child(p));
+            } else {
+                q->child = cdd_tohandle(cdd_neg_cond(cdd_elem_child(p), mask));
+                q->bnd = p->bnd;
+                q++;
             }
         }
+        res = cdd_neg_cond(cdd_make_cdd_node(level, top, q - top), mask);
+        for (p = top; p < q; p++) {
+            cdd_deref(cdd_elem_child(p));
+        }
+    } else {
+        lower = -INF;
+        for (p = top, i = 0; p < end; p++, i++) {
+            tmp = cdd_interval_from_level(level, lower, p->bnd);
+            cdd_ref(tmp);
+            args[i] = cdd_and(tmp, cdd_elem_child(p));
+            cdd_ref(args[i]);
+            cdd_rec_deref(tmp);
+            lower = p->bnd;
+        }
+        res = cdd_apply_n_op(args, i, cddop_or);
+        cdd_ref(res);
+        for (p = top, i = 0; p < end; p++, i++) {
+            cdd_rec_deref(args[i]);
+            cdd_rec_deref(cdd_elem_child(p));
+        }
+        cdd_deref(res);
     }
-    res = cdd_from_dbm(d);
-    old_dbm_destroy(d);
+    cdd_refstacktop = top;
     return res;
 }
 
-static ddNode* cdd_exist_rec(ddNode* node, int32_t* levels, ddNode* c)
+/**
+ * Joins the children on the reference stack above \a top in one
+ * disjunction. The references are released and the stack restored to
+ * \a top.
+ */
+static ddNode* cdd_join_children(Elem* top)
 {
-    int32_t level;
-    CddCacheData* entry;
-    cdd_iterator it;
+    Elem* end = cdd_refstacktop;
+    Elem* p;
+    ddNode* args[end - top];
     ddNode* res;
-    ddNode* tmp1;
-    ddNode* tmp2;
-    ddNode* tmp3;
-
-    if (node == cddfalse)
-        return cddfalse;
-    if (node == cddtrue)
-        return translate(c, levels);
-
-#ifdef MULTI_TERMINAL
-    if (cdd_is_extra_terminal(node)) {
-        return cdd_mask(node) ? node : translate(c, levels);
-    }
-#endif
+    int32_t i;
 
-    entry = CddCache_lookup(&quantcache, EXISTHASH(node, c, opid));
-    if (entry->a == node && entry->b == c && entry->c == opid) {
-        if (cdd_rglr(entry->res)->ref == 0) {
-            cdd_reclaim(entry->res);
-        }
-        return entry->res;
+    for (p = top, i = 0; p < end; p++, i++) {
+        args[i] = cdd_elem_child(p);
     }
-
-    level = cdd_rglr(node)->level;
-    res = NULL;
-    if (levels[level]) {
-        switch (cdd_info(node)->type) {
-        case TYPE_CDD:
-            res = cddfalse;
-            for (cdd_it_init(it, node); !cdd_it_atend(it); cdd_it_next(it)) {
-                tmp1 = cdd_interval_from_level(level, cdd_it_lower(it), cdd_it_upper(it));
-                cdd_ref(tmp1);
-                tmp2 = cdd_and(c, tmp1);
-                cdd_ref(tmp2);
-                cdd_rec_deref(tmp1);
-                tmp1 = cdd_exist_rec(cdd_it_child(it), levels, tmp2);
-                cdd_ref(tmp1);
-                cdd_rec_deref(tmp2);
-                tmp2 = cdd_or(tmp1, res);
-                cdd_ref(tmp2);
-                cdd_rec_deref(tmp1);
-                cdd_rec_deref(res);
-                res = tmp2;
-            }
-            cdd_deref(res);
-            break;
-        case TYPE_BDD:
-            tmp1 = cdd_exist_rec(bdd_low(node), levels, c);
-            cdd_ref(tmp1);
-            tmp2 = cdd_exist_rec(bdd_high(node), levels, c);
-            cdd_ref(tmp2);
-            res = cdd_or(tmp1, tmp2);
-            cdd_ref(res);
-            cdd_rec_deref(tmp1);
-            cdd_rec_deref(tmp2);
-            cdd_deref(res);
-        }
-    } else {
-        switch (cdd_info(node)->type) {
-        case TYPE_CDD:
-            res = cddfalse;
-            for (cdd_it_init(it, node); !cdd_it_atend(it); cdd_it_next(it)) {
-                tmp1 = cdd_interval_from_level(level, cdd_it_lower(it), cdd_it_upper(it));
-                cdd_ref(tmp1);
-                tmp2 = cdd_exist_rec(cdd_it_child(it), levels, c);
-                cdd_ref(tmp2);
-                tmp3 = cdd_and(tmp1, tmp2);
-                cdd_ref(tmp3);
-                cdd_rec_deref(tmp1);
-                cdd_rec_deref(tmp2);
-                tmp1 = cdd_or(res, tmp3);
-                cdd_ref(tmp1);
-                cdd_rec_deref(res);
-                cdd_rec_deref(tmp3);
-                res = tmp1;
-            }
-            cdd_deref(res);
-            break;
-        case TYPE_BDD:
-            tmp1 = cdd_bddvar(level);
-            cdd_ref(tmp1);
-            tmp2 = cdd_exist_rec(bdd_low(node), levels, c);
-            cdd_ref(tmp2);
-            tmp3 = cdd_exist_rec(bdd_high(node), levels, c);
-            cdd_ref(tmp3);
-            res = cdd_ite(tmp1, tmp3, tmp2);
-            cdd_ref(res);
-            cdd_rec_deref(tmp1);
-            cdd_rec_deref(tmp2);
-            cdd_rec_deref(tmp3);
-            cdd_deref(res);
-        }
+    res = cdd_apply_n_op(args, i, cddop_or);
+    cdd_ref(res);
+    for (i = 0; i < end - top; i++) {
+        cdd_rec_deref(args[i]);
     }
+    cdd_deref(res);
+    cdd_refstacktop = top;
+    return res;
+}
 
-    entry->a = node;
-    entry->b = c;
-    entry->c = opid;
-    entry->res = res;
+/**
+ * Returns the BDD node of \a level with the branches \a low and \a
+ * high, which lie below \a level or are combined with the variable.
+ */
+static ddNode* cdd_join_branches(int32_t level, ddNode* low, ddNode* high)
+{
+    ddNode* var;
+    ddNode* res;
 
+    if (cdd_rglr(low)->level > level && cdd_rglr(high)->level > level) {
+        return cdd_make_bdd_node(level, low, high);
+    }
+    var = cdd_make_bdd_node(level, cddfalse, cddtrue);
+    cdd_ref(var);
+    res = cdd_ite_op(var, high, low);
+    cdd_rec_deref(var);
     return res;
 }
-#else
+
 static ddNode* relax(ddNode* node, int32_t* clocks, raw_t lower, int32_t clock1, int32_t clock2, raw_t upper, raw_t* rc)
 {
     LevelInfo* info;
@@ -645,7 +1414,8 @@ static ddNode* relax(ddNode* node, int32_t* clocks, raw_t lower, int32_t clock1,
     ddNode* tmp2;
     ddNode* tmp3;
     ddNode* tmp4;
-    ddNode* tmp5;
+    Elem* top;
+    Elem* first;
     int32_t pos;
     int32_t neg;
     raw_t l;
@@ -659,9 +1429,9 @@ static ddNode* relax(ddNode* node, int32_t* clocks, raw_t lower, int32_t clock1,
     }
 
 #ifdef RELAXCACHE
-    entry = CddCache_lookup(&relaxcache, RELAXHASH(node, lower, clock1, clock2, upper));
+    entry = CddRelaxCache_lookup(&relaxcache, RELAXHASH(node, lower, clock1, clock2, upper));
     if (entry->node == node && entry->lower == lower && entry->upper == upper && entry->clock1 == clock1 &&
-        entry->clock2 == clock2 && entry->op == opid) {
+        entry->clock2 == clock2 && entry->op == rcid && CddCache_valid(node, NULL, entry->res, entry->epoch)) {
         if (cdd_rglr(entry->res)->ref == 0) {
             cdd_reclaim(entry->res);
         }
@@ -674,7 +1444,8 @@ static ddNode* relax(ddNode* node, int32_t* clocks, raw_t lower, int32_t clock1,
     res = cddfalse;
     switch (info->type) {
     case TYPE_CDD:
-        res = cddfalse;
+        top = cdd_refstack_reserve(cdd_maxcddsize);
+        first = cdd_refstacktop;
         cdd_it_init(it, node);
         while (!cdd_it_atend(it)) {
             // Detect consequences
@@ -724,24 +1495,12 @@ static ddNode* relax(ddNode* node, int32_t* clocks, raw_t lower, int32_t clock1,
                 }
             }
 
-            // Rebuild CDD by adding constraints from node
-            tmp3 = cdd_interval_from_level(cdd_rglr(node)->level, cdd_it_lower(it), cdd_it_upper(it));
-            cdd_ref(tmp3);
-
-            tmp4 = cdd_and(tmp2, tmp3);
-            cdd_ref(tmp4);
-
-            tmp5 = cdd_or(res, tmp4);
-            cdd_ref(tmp5);
-
-            cdd_rec_deref(tmp2);
-            cdd_rec_deref(tmp3);
-            cdd_rec_deref(tmp4);
-            cdd_rec_deref(res);
-
-            res = tmp5;
+            // Rebuild CDD with the constraints from node
+            cdd_push(tmp2, cdd_it_upper(it));
             cdd_it_next(it);
         }
+        res = cdd_join_intervals(cdd_rglr(node)->level, first);
+        cdd_refstacktop = top;
         break;
     case TYPE_BDD:
         tmp1 = relax(bdd_low(node), clocks, lower, clock1, clock2, upper, rc);
@@ -750,25 +1509,25 @@ static ddNode* relax(ddNode* node, int32_t* clocks, raw_t lower, int32_t clock1,
         tmp2 = relax(bdd_high(node), clocks, lower, clock1, clock2, upper, rc);
         cdd_ref(tmp2);
 
-        tmp3 = cdd_bddvar(cdd_rglr(node)->level);
-        cdd_ref(tmp3);
-
-        res = cdd_ite(tmp3, tmp2, tmp1);
+        res = cdd_join_branches(cdd_rglr(node)->level, tmp1, tmp2);
         cdd_ref(res);
         cdd_rec_deref(tmp1);
         cdd_rec_deref(tmp2);
-        cdd_rec_deref(tmp3);
         cdd_deref(res);
     }
 
 #ifdef RELAXCACHE
+    if (cdd_errorcond) {
+        return res;
+    }
     entry->node = node;
     entry->lower = lower;
     entry->upper = upper;
     entry->clock1 = clock1;
     entry->clock2 = clock2;
-    entry->op = opid;
+    entry->op = rcid;
     entry->res = res;
+    entry->epoch = (uint8_t)cdd_epoch;
 #endif
 
     return res;
@@ -779,122 +1538,277 @@ static ddNode* cdd_exist_rec(ddNode* node, int32_t* levels, int32_t* clocks, raw
     LevelInfo* info;
     CddCacheData* entry;
     cdd_iterator it;
+    Elem* top;
+    Elem* first;
     ddNode* res;
     ddNode* tmp1;
     ddNode* tmp2;
-    ddNode* tmp3;
-    ddNode* tmp4;
     raw_t old_lower, old_upper;
+    int32_t old_rcid;
 
     if (cdd_isterminal(node)) {
         return node;
     }
 
-    //    cdd2Dot("debug.dot", node, "InEx");
+    /* Back off in case of error */
+    if (cdd_errorcond) {
+        return cddfalse;
+    }
+
     entry = CddCache_lookup(&quantcache, EXISTHASH(node));
-    if (entry->a == node && entry->c == opid) {
-        if (cdd_rglr(entry->res)->ref == 0)
-            cdd_reclaim(entry->res);
-        return entry->res;
+    if (CddCache_match(&quantcache, entry, node, NULL, rcid, &res)) {
+        if (cdd_rglr(res)->ref == 0)
+            cdd_reclaim(res);
+        return res;
     }
 
     info = cdd_info(node);
     res = NULL;
     switch (info->type) {
     case TYPE_CDD:
-        res = cddfalse;
+        top = cdd_refstack_reserve(cdd_maxcddsize);
+        first = cdd_refstacktop;
         cdd_it_init(it, node);
         if (clocks[info->clock1] || clocks[info->clock2]) {
-            while (!cdd_it_atend(it)) {
-                // Here we add the constraint32_t to rc - we save the old
+            /* Eliminate the clock: the constraint of each edge is
+             * removed after its consequences have been added along
+             * the paths below it, and the results are joined.
+             */
+            do {
+                // Here we add the constraint to rc - we save the old
                 // constraints so they can be restored.
                 old_lower = rc[info->clock2 * cdd_clocknum + info->clock1];
                 old_upper = rc[info->clock1 * cdd_clocknum + info->clock2];
+                old_rcid = rcid;
 
                 rc[info->clock2 * cdd_clocknum + info->clock1] = bnd_l2u(cdd_it_lower(it));
                 rc[info->clock1 * cdd_clocknum + info->clock2] = cdd_it_upper(it);
+                rcid = cdd_operator_fresh();
 
                 tmp1 =
                     relax(cdd_it_child(it), clocks, cdd_it_lower(it), info->clock1, info->clock2, cdd_it_upper(it), rc);
-
                 cdd_ref(tmp1);
 
                 tmp2 = cdd_exist_rec(tmp1, levels, clocks, rc);
                 cdd_ref(tmp2);
-
-                tmp3 = cdd_or(res, tmp2);
-                cdd_ref(tmp3);
-
-                cdd_rec_deref(res);
                 cdd_rec_deref(tmp1);
-                cdd_rec_deref(tmp2);
-                res = tmp3;
+                cdd_push(tmp2, INF);
 
                 // Here we restore the constraint
                 rc[info->clock2 * cdd_clocknum + info->clock1] = old_lower;
                 rc[info->clock1 * cdd_clocknum + info->clock2] = old_upper;
+                rcid = old_rcid;
 
                 cdd_it_next(it);
-            }
+            } while (!cdd_it_atend(it) && tmp2 != cddtrue);
+            res = cdd_join_children(first);
         } else {
             while (!cdd_it_atend(it)) {
-                tmp1 = cdd_interval_from_level(cdd_rglr(node)->level, cdd_it_lower(it), cdd_it_upper(it));
+                tmp1 = cdd_exist_rec(cdd_it_child(it), levels, clocks, rc);
+                cdd_ref(tmp1);
+                cdd_push(tmp1, cdd_it_upper(it));
+                cdd_it_next(it);
+            }
+            res = cdd_join_intervals(cdd_rglr(node)->level, first);
+        }
+        cdd_refstacktop = top;
+        break;
+    case TYPE_BDD:
+        tmp1 = cdd_exist_rec(bdd_low(node), levels, clocks, rc);
+        cdd_ref(tmp1);
+
+        /* The high branch adds nothing to a true low branch */
+        if (levels[cdd_level2var[cdd_rglr(node)->level]] && tmp1 == cddtrue) {
+            res = tmp1;
+            break;
+        }
+
+        tmp2 = cdd_exist_rec(bdd_high(node), levels, clocks, rc);
+        cdd_ref(tmp2);
+
+        if (levels[cdd_level2var[cdd_rglr(node)->level]]) {
+            res = cdd_or(tmp1, tmp2);
+        } else {
+            res = cdd_join_branches(cdd_rglr(node)->level, tmp1, tmp2);
+        }
+        cdd_ref(res);
+        cdd_rec_deref(tmp1);
+        cdd_rec_deref(tmp2);
+        cdd_deref(res);
+    }
+
+    CddCache_write(&quantcache, entry, res, node, NULL, rcid);
+
+    return res;
+}
+
+/* Existential quantification of a conjunction, the relational product
+ * of BDD packages. Follows cdd_exist_rec(), but on the pairs of
+ * children cdd_and_rec() would visit for the conjunction, so the
+ * conjunction is never built. The constraint removed at a level of a
+ * quantified clock is relaxed into both operands separately, which is
+ * the same as relaxing it into their conjunction, as each consequence
+ * combines it with a single constraint. Entries in the quantification
+ * cache have both operands, which keeps them apart from those of
+ * cdd_exist_rec().
+ */
+static ddNode* cdd_and_exist_rec(ddNode* l, ddNode* r, int32_t* levels, int32_t* clocks, raw_t* rc)
+{
+    LevelInfo* info;
+    CddCacheData* entry;
+    int32_t lmask;
+    int32_t rmask;
+    int32_t level;
+    Elem lself;
+    Elem rself;
+    Elem* lp;
+    Elem* rp;
+    ddNode* ll;
+    ddNode* lh;
+    ddNode* rl;
+    ddNode* rh;
+    ddNode* res;
+    ddNode* tmp1;
+    ddNode* tmp2;
+    ddNode* tmp3;
+    Elem* top;
+    Elem* first;
+    int32_t quant;
+    raw_t lower, bnd;
+    raw_t old_lower, old_upper;
+    int32_t old_rcid;
+
+    /* Back off in case of error */
+    if (cdd_errorcond) {
+        return cddfalse;
+    }
+
+    if ((res = cdd_relation_terminal(l, r, cddop_and)) != NULL) {
+        return cdd_exist_rec(res, levels, clocks, rc);
+    }
+
+    /* The operation is symmetric; normalise for better cache performance */
+    if (l > r) {
+        res = l;
+        l = r;
+        r = res;
+    }
+
+    entry = CddCache_lookup(&quantcache, APPLYHASH(l, r, rcid));
+    if (CddCache_match(&quantcache, entry, l, r, rcid, &res)) {
+        if (!cdd_shared && cdd_rglr(res)->ref == 0) {
+            cdd_reclaim(res);
+        }
+        return res;
+    }
+
+    lmask = cdd_mask(l);
+    rmask = cdd_mask(r);
+    ll = cdd_rglr(l);
+    rl = cdd_rglr(r);
+    level = minimum(ll->level, rl->level);
+    info = cdd_levelinfo + level;
+    res = NULL;
+    switch (info->type) {
+    case TYPE_CDD:
+        /* A node on a lower level is a fake node with a single child */
+        lself.child = cdd_tohandle(ll);
+        lself.bnd = INF;
+        rself.child = cdd_tohandle(rl);
+        rself.bnd = INF;
+        lp = ll->level == level ? cdd_node(ll)->elem : &lself;
+        rp = rl->level == level ? cdd_node(rl)->elem : &rself;
+
+        top = cdd_refstack_reserve(2 * cdd_maxcddsize);
+        first = cdd_refstacktop;
+        quant = clocks[info->clock1] || clocks[info->clock2];
+        lower = -INF;
+        do {
+            bnd = minimum(lp->bnd, rp->bnd);
+            if (quant) {
+                // Add the constraint to rc, as in cdd_exist_rec()
+                old_lower = rc[info->clock2 * cdd_clocknum + info->clock1];
+                old_upper = rc[info->clock1 * cdd_clocknum + info->clock2];
+                old_rcid = rcid;
+
+                rc[info->clock2 * cdd_clocknum + info->clock1] = bnd_l2u(lower);
+                rc[info->clock1 * cdd_clocknum + info->clock2] = bnd;
+                rcid = cdd_operator_fresh();
+
+                tmp1 = relax(cdd_neg_cond(cdd_elem_child(lp), lmask), clocks, lower, info->clock1, info->clock2, bnd, rc);
                 cdd_ref(tmp1);
 
-                tmp2 = cdd_exist_rec(cdd_it_child(it), levels, clocks, rc);
+                tmp2 = relax(cdd_neg_cond(cdd_elem_child(rp), rmask), clocks, lower, info->clock1, info->clock2, bnd, rc);
                 cdd_ref(tmp2);
 
-                tmp3 = cdd_and(tmp1, tmp2);
+                tmp3 = cdd_and_exist_rec(tmp1, tmp2, levels, clocks, rc);
                 cdd_ref(tmp3);
 
-                tmp4 = cdd_or(res, tmp3);
-                cdd_ref(tmp4);
-
-                cdd_rec_deref(res);
                 cdd_rec_deref(tmp1);
                 cdd_rec_deref(tmp2);
-                cdd_rec_deref(tmp3);
-                res = tmp4;
-                cdd_it_next(it);
+
+                rc[info->clock2 * cdd_clocknum + info->clock1] = old_lower;
+                rc[info->clock1 * cdd_clocknum + info->clock2] = old_upper;
+                rcid = old_rcid;
+            } else {
+                tmp3 = cdd_and_exist_rec(cdd_neg_cond(cdd_elem_child(lp), lmask), cdd_neg_cond(cdd_elem_child(rp), rmask), levels,
+                                         clocks, rc);
+                cdd_ref(tmp3);
             }
-        }
-        cdd_deref(res);
+            cdd_push(tmp3, bnd);
+
+            lp += (lp->bnd == bnd);
+            rp += (rp->bnd == bnd);
+            lower = bnd;
+        } while (bnd < INF && !(quant && tmp3 == cddtrue));
+        res = quant ? cdd_join_children(first) : cdd_join_intervals(level, first);
+        cdd_refstacktop = top;
         break;
     case TYPE_BDD:
-        tmp1 = cdd_exist_rec(bdd_low(node), levels, clocks, rc);
+        lh = ll->level == level ? bdd_node_high(ll) : ll;
+        ll = ll->level == level ? bdd_node_low(ll) : ll;
+        rh = rl->level == level ? bdd_node_high(rl) : rl;
+        rl = rl->level == level ? bdd_node_low(rl) : rl;
+
+        tmp1 = cdd_and_exist_rec(cdd_neg_cond(ll, lmask), cdd_neg_cond(rl, rmask), levels, clocks, rc);
         cdd_ref(tmp1);
 
-        tmp2 = cdd_exist_rec(bdd_high(node), levels, clocks, rc);
+        /* The high branch adds nothing to a true low branch */
+        if (levels[cdd_level2var[level]] && tmp1 == cddtrue) {
+            res = tmp1;
+            break;
+        }
+
+        tmp2 = cdd_and_exist_rec(cdd_neg_cond(lh, lmask), cdd_neg_cond(rh, rmask), levels, clocks, rc);
         cdd_ref(tmp2);
 
-        if (levels[cdd_rglr(node)->level]) {
+        if (levels[cdd_level2var[level]]) {
             res = cdd_or(tmp1, tmp2);
-            cdd_ref(res);
         } else {
-            tmp3 = cdd_bddvar(cdd_rglr(node)->level);
-            cdd_ref(tmp3);
-            res = cdd_ite(tmp3, tmp2, tmp1);
-            cdd_ref(res);
-            cdd_rec_deref(tmp3);
+            res = cdd_join_branches(level, tmp1, tmp2);
         }
-
+        cdd_ref(res);
         cdd_rec_deref(tmp1);
         cdd_rec_deref(tmp2);
         cdd_deref(res);
     }
 
-    entry->a = node;
-    entry->c = opid;
-    entry->res = res;
+    CddCache_write(&quantcache, entry, res, l, r, rcid);
 
     return res;
 }
-#endif
 
 ddNode* cdd_replace(ddNode* node, int32_t* levels, int32_t* clocks)
 {
-    opid++;
-    return cdd_replace_rec(node, levels, clocks);
+    int32_t vec[cdd_levelcnt + cdd_clocknum];
+
+    if (!cdd_shared) {
+        CddCache_adjust(&replacecache);
+    }
+    memcpy(vec, levels, cdd_levelcnt * sizeof(int32_t));
+    memcpy(vec + cdd_levelcnt, clocks, cdd_clocknum * sizeof(int32_t));
+    opid = cdd_operator_id(vec, cdd_levelcnt + cdd_clocknum);
+    return cdd_checked(cdd_replace_rec(node, levels, clocks));
 }
 
 static ddNode* cdd_replace_rec(ddNode* node, int32_t* levels, int32_t* clocks)
@@ -911,24 +1825,29 @@ static ddNode* cdd_replace_rec(ddNode* node, int32_t* levels, int32_t* clocks)
         return node;
     }
 
+    /* Back off in case of error */
+    if (cdd_errorcond) {
+        return cddfalse;
+    }
+
     entry = CddCache_lookup(&replacecache, REPLACEHASH(node));
-    if (entry->a == node && entry->c == opid) {
-        if (cdd_rglr(entry->res)->ref == 0)
-            cdd_reclaim(entry->res);
-        return entry->res;
+    if (CddCache_match(&replacecache, entry, node, NULL, opid, &res)) {
+        if (cdd_rglr(res)->ref == 0)
+            cdd_reclaim(res);
+        return res;
     }
 
     info = cdd_info(node);
     res = NULL;
     switch (info->type) {
     case TYPE_BDD:
-        tmp1 = cdd_bddvar(levels[cdd_rglr(node)->level]);
+        tmp1 = cdd_bddvar(levels[cdd_level2var[cdd_rglr(node)->level]]);
         cdd_ref(tmp1);
         tmp2 = cdd_replace_rec(bdd_low(node), levels, clocks);
         cdd_ref(tmp2);
         tmp3 = cdd_replace_rec(bdd_high(node), levels, clocks);
         cdd_ref(tmp3);
-        res = cdd_ite(tmp1, tmp3, tmp2);
+        res = cdd_ite_op(tmp1, tmp3, tmp2);
         cdd_ref(res);
         cdd_rec_deref(tmp1);
         cdd_rec_deref(tmp2);
@@ -955,9 +1874,7 @@ static ddNode* cdd_replace_rec(ddNode* node, int32_t* levels, int32_t* clocks)
         cdd_deref(res);
     }
 
-    entry->a = node;
-    entry->c = opid;
-    entry->res = res;
+    CddCache_write(&replacecache, entry, res, node, NULL, opid);
 
     return res;
 }
@@ -970,6 +1887,7 @@ ddNode* cdd_from_dbm(const raw_t* dbm, int32_t size)
     uint32_t ok[bits2intsize(size * size)];
     int32_t lo, hi;
     Elem* top;
+    Elem* first;
     ddNode* c;
     ddNode* tmp;
     LevelInfo* info;
@@ -1008,7 +1926,8 @@ ddNode* cdd_from_dbm(const raw_t* dbm, int32_t size)
         hi = base_getOneBit(ok, i * size + j);
 
         if (lo || hi) {
-            top = cdd_refstacktop;
+            top = cdd_refstack_reserve(3);
+            first = cdd_refstacktop;
             tmp = c;
             if (lo) {
                 cdd_push(cddfalse, bnd_u2l(dbm[j * size + i]));
@@ -1019,11 +1938,11 @@ ddNode* cdd_from_dbm(const raw_t* dbm, int32_t size)
                     cdd_push(c, INF);
                 }
 
-                c = cdd_make_cdd_node(k, top, cdd_refstacktop - top);
+                c = cdd_make_cdd_node(k, first, cdd_refstacktop - first);
             } else {
                 cdd_push(cdd_rglr(c), dbm[i * size + j]);
                 cdd_push(cdd_neg_cond(cddfalse, cdd_mask(c)), INF);
-                c = cdd_neg_cond(cdd_make_cdd_node(k, top, cdd_refstacktop - top), cdd_mask(c));
+                c = cdd_neg_cond(cdd_make_cdd_node(k, first, cdd_refstacktop - first), cdd_mask(c));
             }
             cdd_ref(c);
             cdd_deref(tmp);
@@ -1042,6 +1961,7 @@ ddNode* cdd_from_dbm(const raw_t* dbm, int32_t size)
     int32_t k;
     int32_t lo, hi;
     Elem* top;
+    Elem* first;
     ddNode* c;
     LevelInfo* info;
 
@@ -1074,7 +1994,8 @@ ddNode* cdd_from_dbm(const raw_t* dbm, int32_t size)
         hi = dbm[i * size + j] < dbm_LS_INFINITY;
 
         if (lo || hi) {
-            top = cdd_refstacktop;
+            top = cdd_refstack_reserve(3);
+            first = cdd_refstacktop;
             if (lo) {
                 cdd_push(cddfalse, bnd_u2l(dbm[j * size + i]));
                 if (hi) {
@@ -1084,11 +2005,11 @@ ddNode* cdd_from_dbm(const raw_t* dbm, int32_t size)
                     cdd_push(c, INF);
                 }
 
-                c = cdd_make_cdd_node(k, top, cdd_refstacktop - top);
+                c = cdd_make_cdd_node(k, first, cdd_refstacktop - first);
             } else {
                 cdd_push(cdd_rglr(c), dbm[i * size + j]);
                 cdd_push(cdd_neg_cond(cddfalse, cdd_mask(c)), INF);
-                c = cdd_neg_cond(cdd_make_cdd_node(k, top, cdd_refstacktop - top), cdd_mask(c));
+                c = cdd_neg_cond(cdd_make_cdd_node(k, first, cdd_refstacktop - first), cdd_mask(c));
             }
             cdd_refstacktop = top;
         }
@@ -1098,13 +2019,50 @@ ddNode* cdd_from_dbm(const raw_t* dbm, int32_t size)
 }
 #endif
 
+ddNode* cdd_from_dbms(const raw_t* const* dbms, size_t n, int32_t size)
+{
+    // The union of 2^k zones is kept in slot k until a union of equal
+    // size is merged into it, so operands of each union are balanced
+    ddNode* slot[sizeof(size_t) * CHAR_BIT];
+    ddNode *c, *tmp;
+    size_t i, used = 0;
+    int32_t k;
+
+    for (i = 0; i < n; i++) {
+        c = cdd_from_dbm(dbms[i], size);
+        cdd_ref(c);
+        for (k = 0; (used >> k) & 1; k++) {
+            tmp = cdd_or(slot[k], c);
+            cdd_ref(tmp);
+            cdd_rec_deref(slot[k]);
+            cdd_rec_deref(c);
+            c = tmp;
+        }
+        slot[k] = c;
+        used++;
+    }
+
+    c = cddfalse;
+    for (k = 0; used >> k; k++) {
+        if ((used >> k) & 1) {
+            tmp = cdd_or(slot[k], c);
+            cdd_ref(tmp);
+            cdd_rec_deref(slot[k]);
+            cdd_rec_deref(c);
+            c = tmp;
+        }
+    }
+    cdd_deref(c);
+    return cdd_checked(c);
+}
+
 ddNode* cdd_remove_negative(ddNode* cdd)
 {
     ddNode* result = cdd;
     for (int i = 1; i < cdd_clocknum; i++) {
-        result = cdd_apply(result, cdd_interval(i, 0, 0, dbm_LS_INFINITY), cddop_and);
+        result = cdd_and(result, cdd_interval(i, 0, 0, dbm_LS_INFINITY));
     }
-    return result;
+    return cdd_checked(result);
 }
 
 ddNode* cdd_extract_dbm(ddNode* cdd, raw_t* dbm, int32_t size)
@@ -1126,39 +2084,367 @@ ddNode* cdd_extract_dbm(ddNode* cdd, raw_t* dbm, int32_t size)
     while (!cdd_isterminal(node)) {
         info = cdd_info(node);
 
-        assert(info->clock1 < size);
-        assert(info->clock2 < size);
+        assert(info->clock1 < size);
+        assert(info->clock2 < size);
+
+        cdd_it_init(it, node);
+        if (IS_FALSE(cdd_it_child(it))) {
+            cdd_it_next(it);
+        }
+
+        assert(cdd_it_child(it) != cddfalse);
+
+        /*printf("%d %d %d %d\n",
+               info->clock1, info->clock2,
+               bnd_l2u(cdd_it_lower(it)), cdd_it_upper(it));*/
+
+        dbm_constrain(dbm, size, info->clock2, info->clock1, bnd_l2u(cdd_it_lower(it)), touched);
+
+        dbm_constrain(dbm, size, info->clock1, info->clock2, cdd_it_upper(it), touched);
+
+        node = cdd_it_child(it);
+    }
+
+    dbm_closex(dbm, size, touched);
+    assert(dbm_isValid(dbm, size));
+
+    zone = cdd_from_dbm(dbm, size);
+    cdd_ref(zone);
+
+    result = cdd_and(cdd, cdd_neg(zone));
+    cdd_deref(zone);
+
+    return cdd_checked(result);
+}
+
+/** A node on the path of a zone enumeration, and the next child to visit. */
+typedef struct
+{
+    ddNode* node;
+    cdd_iterator it; /**< Next interval of a CDD node */
+    int32_t branch;  /**< Number of branches of a BDD node visited */
+} ZoneFrame;
+
+struct cdd_enumerator_
+{
+    int32_t dim;
+    int32_t depth;       /**< Top of the path, or -1 when all zones were visited */
+    raw_t* dbms;         /**< The zone of the path up to each frame */
+    ZoneFrame frames[];  /**< The path from the root */
+};
+
+cdd_enumerator* cdd_enumerator_create(ddNode* cdd, int32_t dim)
+{
+    // A path visits each level once, followed by the terminal
+    cdd_enumerator* e = (cdd_enumerator*)malloc(sizeof(cdd_enumerator) + (cdd_levelcnt + 1) * sizeof(ZoneFrame));
+    raw_t* dbms = (raw_t*)malloc((size_t)(cdd_levelcnt + 2) * dim * dim * sizeof(raw_t));
+
+    if (e == NULL || dbms == NULL) {
+        free(e);
+        free(dbms);
+        cdd_error(CDD_MEMORY);
+        return NULL;
+    }
+
+    e->dim = dim;
+    e->depth = 0;
+    e->dbms = dbms;
+    e->frames[0].node = cdd;
+    e->frames[0].branch = 0;
+    if (!cdd_isterminal(cdd) && cdd_info(cdd)->type == TYPE_CDD) {
+        cdd_it_init(e->frames[0].it, cdd);
+    }
+    dbm_init(dbms, dim);
+    return e;
+}
+
+const raw_t* cdd_enumerator_next(cdd_enumerator* e)
+{
+    ZoneFrame* f;
+    LevelInfo* info;
+    ddNode* child;
+    raw_t *dbm, *next;
+    raw_t lo, hi;
+    int32_t dim = e->dim;
+
+    while (e->depth >= 0) {
+        f = e->frames + e->depth;
+        dbm = e->dbms + (size_t)e->depth * dim * dim;
+        next = dbm + dim * dim;
+
+        // Only the root can be a terminal
+        if (cdd_isterminal(f->node)) {
+            e->depth = -1;
+            return IS_FALSE(f->node) ? NULL : dbm;
+        }
+
+        info = cdd_info(f->node);
+        if (info->type == TYPE_CDD) {
+            if (cdd_it_atend(f->it)) {
+                e->depth--;
+                continue;
+            }
+            child = cdd_it_child(f->it);
+            lo = cdd_it_lower(f->it);
+            hi = cdd_it_upper(f->it);
+            cdd_it_next(f->it);
+            if (IS_FALSE(child)) {
+                continue;
+            }
+
+            // Paths which are inconsistent contribute no zone
+            assert(info->clock1 < dim && info->clock2 < dim);
+            dbm_copy(next, dbm, dim);
+            if ((lo != -INF && !dbm_constrain1(next, dim, info->clock2, info->clock1, bnd_l2u(lo))) ||
+                (hi != INF && !dbm_constrain1(next, dim, info->clock1, info->clock2, hi))) {
+                continue;
+            }
+        } else {
+            if (f->branch == 2) {
+                e->depth--;
+                continue;
+            }
+            child = f->branch++ ? bdd_high(f->node) : bdd_low(f->node);
+            if (IS_FALSE(child)) {
+                continue;
+            }
+            dbm_copy(next, dbm, dim);
+        }
+
+        if (cdd_isterminal(child)) {
+            return next;
+        }
+
+        f++;
+        f->node = child;
+        f->branch = 0;
+        if (cdd_info(child)->type == TYPE_CDD) {
+            cdd_it_init(f->it, child);
+        }
+        e->depth++;
+    }
+    return NULL;
+}
+
+void cdd_enumerator_destroy(cdd_enumerator* e)
+{
+    if (e != NULL) {
+        free(e->dbms);
+        free(e);
+    }
+}
+
+int32_t cdd_foreach_zone(ddNode* cdd, int32_t dim, int32_t (*func)(const raw_t* dbm, int32_t dim, void* arg),
+                         void* arg)
+{
+    cdd_enumerator* e = cdd_enumerator_create(cdd, dim);
+    const raw_t* dbm;
+    int32_t cnt = 0;
+
+    if (e == NULL) {
+        return CDD_MEMORY;
+    }
+    while ((dbm = cdd_enumerator_next(e)) != NULL) {
+        cnt++;
+        if (func(dbm, dim, arg) != 0) {
+            break;
+        }
+    }
+    cdd_enumerator_destroy(e);
+    return cnt;
+}
+
+/** A node of a frozen CDD. */
+typedef struct
+{
+    int32_t clock1; /**< First clock of a CDD node, -1 for a BDD node or -2 for a terminal */
+    int32_t clock2; /**< Second clock of a CDD node, variable of a BDD node, or -1 or tautology id of a terminal */
+    uint32_t edge;  /**< Index of the first edge of the node */
+} FrozenNode;
 
-        cdd_it_init(it, node);
-        if (IS_FALSE(cdd_it_child(it))) {
-            cdd_it_next(it);
-        }
+/** An edge of a frozen CDD; a BDD node has its low and then its high edge. */
+typedef struct
+{
+    raw_t bnd;      /**< Upper bound of the interval of the edge */
+    uint32_t child; /**< Twice the index of the child, plus one if the edge is negated */
+} FrozenEdge;
+
+/**
+ * A frozen CDD is one block of memory without pointers, so it can be
+ * copied as it is. The nodes are in the order of a depth-first
+ * traversal from the root, which is node 0 unless the CDD is a
+ * terminal, and are followed by their edges.
+ */
+struct cdd_frozen_
+{
+    uint32_t size;      /**< Size of the block in bytes */
+    uint32_t nodecnt;   /**< Number of nodes */
+    uint32_t edgecnt;   /**< Number of edges */
+    uint32_t root;      /**< Twice the index of the root, plus one if it is negated */
+    FrozenNode nodes[]; /**< The nodes, followed by the edges */
+};
+
+/** Indices given to the nodes of a CDD being frozen. */
+typedef struct
+{
+    ddNode** keys;    /**< Open addressed table of regular nodes, NULL if empty */
+    uint32_t* index;  /**< Index of each node of the table */
+    size_t tablesize; /**< A power of 2 */
+    ddNode** order;   /**< The nodes by index */
+    uint32_t nodecnt;
+} FreezeMap;
+
+/** Returns the slot of \a node in \a map, which is empty if the node has no index yet. */
+static size_t cdd_freeze_lookup(FreezeMap* map, ddNode* node)
+{
+    size_t i;
 
-        assert(cdd_it_child(it) != cddfalse);
+    for (i = ((uintptr_t)node >> 3) * P1 & (map->tablesize - 1); map->keys[i] != NULL && map->keys[i] != node;
+         i = (i + 1) & (map->tablesize - 1)) {}
+    return i;
+}
 
-        /*printf("%d %d %d %d\n",
-               info->clock1, info->clock2,
-               bnd_l2u(cdd_it_lower(it)), cdd_it_upper(it));*/
+/** Gives an index to each node below \a node in depth-first order, and returns the handle of \a node. */
+static uint32_t cdd_freeze_rec(FreezeMap* map, ddNode* node)
+{
+    ddNode* r = cdd_rglr(node);
+    size_t i = cdd_freeze_lookup(map, r);
+    cdd_iterator it;
 
-        dbm_constrain(dbm, size, info->clock2, info->clock1, bnd_l2u(cdd_it_lower(it)), touched);
+    if (map->keys[i] == NULL) {
+        map->keys[i] = r;
+        map->index[i] = map->nodecnt;
+        map->order[map->nodecnt++] = r;
+        if (!cdd_isterminal(r)) {
+            if (cdd_info(r)->type == TYPE_CDD) {
+                for (cdd_it_init(it, r); !cdd_it_atend(it); cdd_it_next(it)) {
+                    cdd_freeze_rec(map, cdd_it_child(it));
+                }
+            } else {
+                cdd_freeze_rec(map, bdd_low(r));
+                cdd_freeze_rec(map, bdd_high(r));
+            }
+        }
+    }
+    return (map->index[i] << 1) | (uint32_t)cdd_mask(node);
+}
 
-        dbm_constrain(dbm, size, info->clock1, info->clock2, cdd_it_upper(it), touched);
+cdd_frozen* cdd_freeze(ddNode* cdd)
+{
+    FreezeMap map;
+    cdd_frozen* f = NULL;
+    FrozenEdge* e;
+    FrozenNode* n;
+    LevelInfo* info;
+    ddNode* node;
+    Elem* p;
+    size_t size = 0;
+    uint32_t i, root = 0;
+    int32_t cnt = cdd_nodecount(cdd) + 1;
+    int32_t edgecnt = cdd_edgecount(cdd);
 
-        node = cdd_it_child(it);
+#ifdef MULTI_TERMINAL
+    cnt += cdd_get_number_of_tautologies();
+#endif
+    for (map.tablesize = 1; map.tablesize < 2 * (size_t)cnt; map.tablesize <<= 1) {}
+    map.keys = (ddNode**)calloc(map.tablesize, sizeof(ddNode*));
+    map.index = (uint32_t*)malloc(map.tablesize * sizeof(uint32_t));
+    map.order = (ddNode**)malloc(cnt * sizeof(ddNode*));
+    map.nodecnt = 0;
+    if (map.keys != NULL && map.index != NULL && map.order != NULL) {
+        root = cdd_freeze_rec(&map, cdd);
+        size = sizeof(cdd_frozen) + map.nodecnt * sizeof(FrozenNode) + edgecnt * sizeof(FrozenEdge);
+        f = (cdd_frozen*)malloc(size);
+    }
+    if (f == NULL) {
+        free(map.keys);
+        free(map.index);
+        free(map.order);
+        cdd_error(CDD_MEMORY);
+        return NULL;
     }
 
-    dbm_closex(dbm, size, touched);
-    assert(dbm_isValid(dbm, size));
+    f->size = (uint32_t)size;
+    f->nodecnt = map.nodecnt;
+    f->edgecnt = (uint32_t)edgecnt;
+    f->root = root;
+    e = (FrozenEdge*)(f->nodes + f->nodecnt);
+    for (i = 0; i < map.nodecnt; i++) {
+        node = map.order[i];
+        n = f->nodes + i;
+        n->edge = (uint32_t)(e - (FrozenEdge*)(f->nodes + f->nodecnt));
+        if (cdd_isterminal(node)) {
+            n->clock1 = -2;
+#ifdef MULTI_TERMINAL
+            n->clock2 = node == cddfalse ? -1 : cdd_get_tautology_id(node);
+#else
+            n->clock2 = -1;
+#endif
+            continue;
+        }
+        info = cdd_info(node);
+        if (info->type == TYPE_CDD) {
+            n->clock1 = info->clock1;
+            n->clock2 = info->clock2;
+            p = cdd_node(node)->elem;
+            do {
+                e->bnd = p->bnd;
+                e->child = (map.index[cdd_freeze_lookup(&map, cdd_rglr(cdd_elem_child(p)))] << 1) |
+                           (uint32_t)cdd_mask(cdd_elem_child(p));
+                e++;
+            } while (p++->bnd < INF);
+        } else {
+            n->clock1 = -1;
+            n->clock2 = cdd_level2var[node->level];
+            e[0].bnd = INF;
+            e[0].child = (map.index[cdd_freeze_lookup(&map, cdd_rglr(bdd_low(node)))] << 1) |
+                         (uint32_t)cdd_mask(bdd_low(node));
+            e[1].bnd = INF;
+            e[1].child = (map.index[cdd_freeze_lookup(&map, cdd_rglr(bdd_high(node)))] << 1) |
+                         (uint32_t)cdd_mask(bdd_high(node));
+            e += 2;
+        }
+    }
+    assert(e == (FrozenEdge*)(f->nodes + f->nodecnt) + f->edgecnt);
 
-    zone = cdd_from_dbm(dbm, size);
-    cdd_ref(zone);
+    free(map.keys);
+    free(map.index);
+    free(map.order);
+    return f;
+}
 
-    result = cdd_and(cdd, cdd_neg(zone));
-    cdd_deref(zone);
+size_t cdd_frozen_size(const cdd_frozen* f) { return f->size; }
 
-    return result;
+int32_t cdd_frozen_eval(const cdd_frozen* f, const int32_t* clocks, const bool* vars)
+{
+    const FrozenEdge* edges = (const FrozenEdge*)(f->nodes + f->nodecnt);
+    const FrozenNode* n;
+    const FrozenEdge* e;
+    uint32_t h = f->root;
+    uint32_t neg = 0;
+    raw_t v;
+
+    for (;;) {
+        n = f->nodes + (h >> 1);
+        neg ^= h & 1;
+        e = edges + n->edge;
+        if (n->clock1 >= 0) {
+            v = dbm_bound2raw(clocks[n->clock1] - clocks[n->clock2], dbm_WEAK);
+            while (e->bnd < v) {
+                e++;
+            }
+        } else if (n->clock1 == -1) {
+            e += vars[n->clock2];
+        } else {
+            // Extra terminals are true unless negated
+            return (n->clock2 >= 0) ^ neg;
+        }
+        h = e->child;
+    }
 }
 
+void cdd_frozen_destroy(cdd_frozen* f) { free(f); }
+
 void cdd_mark_clock(int32_t* vec, int32_t c)
 {
     int32_t n;
@@ -1206,7 +2492,7 @@ static int32_t equiv(ddNode* c, ddNode* d)
     tmp1 = cdd_xor(c, d);
     cdd_ref(tmp1);
 
-    tmp2 = cdd_reduce(tmp1);
+    tmp2 = cdd_reduce_op(tmp1);
     cdd_ref(tmp2);
 
     cdd_rec_deref(tmp1);
@@ -1231,6 +2517,11 @@ static ddNode* cdd_reduce2_rec(ddNode* node)
         return node;
     }
 
+    /* Back off in case of error */
+    if (cdd_errorcond) {
+        return cddfalse;
+    }
+
     info = cdd_info(node);
     switch (info->type) {
     case TYPE_CDD:
@@ -1323,16 +2614,31 @@ static ddNode* cdd_reduce2_rec(ddNode* node)
     return res;
 }
 
-ddNode* cdd_reduce2(ddNode* node) { return cdd_reduce2_rec(node); }
+ddNode* cdd_reduce2(ddNode* node) { return cdd_checked(cdd_reduce2_rec(node)); }
 
 ///////////////////////////////////////////////////////////////////////////
 
+/**
+ * Flags \a node, which was reduced under the constraints of \a graph,
+ * as reduced if there are none. Reduced nodes are then returned as
+ * they are by later reductions. The flag shares a word with fields
+ * other threads may write, so it is left alone while the manager is
+ * shared.
+ */
+static void cdd_reduced(ddNode* node, struct tarjan* graph)
+{
+    if (graph->edgecnt == 0 && !cdd_shared && !cdd_errorcond && !cdd_isterminal(node)) {
+        cdd_setreduced(node);
+    }
+}
+
 static ddNode* cdd_tarjan_reduce_rec(ddNode* node, struct tarjan* graph)
 {
     raw_t bnd;
     int32_t mask;
     int32_t modified;
     Elem* top;
+    Elem* first;
     cdd_iterator it;
     ddNode* m;
     ddNode* n;
@@ -1342,13 +2648,21 @@ static ddNode* cdd_tarjan_reduce_rec(ddNode* node, struct tarjan* graph)
     if (cdd_isterminal(node))
         return node;
 
+    /* Back off in case of error */
+    if (cdd_errorcond)
+        return cddfalse;
+
+    /* Without constraints above it a reduced node stays as it is */
+    if (graph->edgecnt == 0 && cdd_isreduced(node))
+        return node;
+
     info = cdd_info(node);
     switch (info->type) {
     case TYPE_BDD:
-        n = cdd_tarjan_reduce_rec(cdd_neg_cond(bdd_node(node)->low, cdd_mask(node)), graph);
+        n = cdd_tarjan_reduce_rec(cdd_neg_cond(bdd_node_low(node), cdd_mask(node)), graph);
         cdd_ref(n);
         m = cdd_make_bdd_node(cdd_rglr(node)->level, n,
-                              cdd_tarjan_reduce_rec(cdd_neg_cond(bdd_node(node)->high, cdd_mask(node)), graph));
+                              cdd_tarjan_reduce_rec(cdd_neg_cond(bdd_node_high(node), cdd_mask(node)), graph));
         cdd_deref(n);
         break;
 
@@ -1386,7 +2700,8 @@ static ddNode* cdd_tarjan_reduce_rec(ddNode* node, struct tarjan* graph)
 
         /* Repeat until next inconsistent bound or the last bound.
          */
-        top = cdd_refstacktop;
+        top = cdd_refstack_reserve(cdd_maxcddsize);
+        first = cdd_refstacktop;
         for (cdd_it_next(it); !cdd_it_atend(it); cdd_it_next(it)) {
             cdd_tarjan_push(graph, info->clock2, info->clock1, bnd_l2u(cdd_it_lower(it)));
             if (!cdd_tarjan_consistent(graph)) {
@@ -1416,23 +2731,25 @@ static ddNode* cdd_tarjan_reduce_rec(ddNode* node, struct tarjan* graph)
 
         /* Create node */
         if (modified) {
-            m = cdd_neg_cond(cdd_make_cdd_node(cdd_rglr(node)->level, top, cdd_refstacktop - top), mask);
+            m = cdd_neg_cond(cdd_make_cdd_node(cdd_rglr(node)->level, first, cdd_refstacktop - first), mask);
         } else {
             m = node;
         }
 
         /* Remove references */
-        while (cdd_refstacktop > top) {
+        while (cdd_refstacktop > first) {
             cdd_refstacktop--;
-            cdd_deref(cdd_refstacktop->child);
+            cdd_deref(cdd_elem_child(cdd_refstacktop));
         }
+        cdd_refstacktop = top;
         break;
     default: m = NULL;
     }
+    cdd_reduced(m, graph);
     return m;
 }
 
-ddNode* cdd_reduce(ddNode* node)
+static ddNode* cdd_reduce_op(ddNode* node)
 {
     struct tarjan graph;
     struct distance dist[cdd_clocknum];
@@ -1445,9 +2762,11 @@ ddNode* cdd_reduce(ddNode* node)
     return cdd_tarjan_reduce_rec(node, &graph);
 }
 
+ddNode* cdd_reduce(ddNode* node) { return cdd_checked(cdd_reduce_op(node)); }
+
 ///////////////////////////////////////////////////////////////////////////
 
-static ddNode* cdd_apply_reduce_rec(ddNode* l, ddNode* r, struct tarjan* graph)
+static ddNode* cdd_apply_reduce_rec(ddNode* l, ddNode* r, const int32_t op, struct tarjan* graph)
 {
     assert(cdd_tarjan_consistent(graph));
 
@@ -1473,12 +2792,12 @@ static ddNode* cdd_apply_reduce_rec(ddNode* l, ddNode* r, struct tarjan* graph)
     /* Back off in case of error.
      */
     if (cdd_errorcond) {
-        return 0;
+        return cddfalse;
     }
 
     /* Termination conditons.
      */
-    switch (applyop) {
+    switch (op) {
     case cddop_and:
         if (l == r || r == cddtrue) {
             return cdd_tarjan_reduce_rec(l, graph);
@@ -1538,14 +2857,14 @@ static ddNode* cdd_apply_reduce_rec(ddNode* l, ddNode* r, struct tarjan* graph)
 
     /* Do cache lookup.
      */
-    entry = CddCache_lookup(&applycache, APPLYHASH(l, r, applyop));
-    if (entry->a == l && entry->b == r && entry->c == applyop) {
-        if (cdd_rglr(entry->res)->ref == 0) {
-            cdd_reclaim(entry->res);
+    entry = CddCache_lookup(&applycache, APPLYHASH(l, r, op));
+    if (CddCache_match(&applycache, entry, l, r, op, &n)) {
+        if (!cdd_shared && cdd_rglr(n)->ref == 0) {
+            cdd_reclaim(n);
         }
-        cdd_ref(entry->res);
-        res = cdd_tarjan_reduce_rec(entry->res, graph);
-        cdd_rec_deref(entry->res);
+        cdd_ref(n);
+        res = cdd_tarjan_reduce_rec(n, graph);
+        cdd_rec_deref(n);
         return res;
     }
 
@@ -1562,7 +2881,7 @@ static ddNode* cdd_apply_reduce_rec(ddNode* l, ddNode* r, struct tarjan* graph)
         /* Prepare for recursion: In case the two nodes do not have
          * the same level we create a fake intermediate node.
          */
-        top = cdd_refstacktop;
+        top = cdd_refstack_reserve(2 * cdd_maxcddsize + 1);
         if (l->level <= r->level) {
             lp = cdd_node(l)->elem;
         } else {
@@ -1596,14 +2915,16 @@ static ddNode* cdd_apply_reduce_rec(ddNode* l, ddNode* r, struct tarjan* graph)
             bnd = minimum(lp->bnd, rp->bnd);
             if (bnd == dbm_LS_INFINITY) {
                 cdd_refstacktop = top;
-                return cdd_apply_reduce_rec(cdd_neg_cond(lp->child, lmask), cdd_neg_cond(rp->child, rmask), graph);
+                return cdd_apply_reduce_rec(cdd_neg_cond(cdd_elem_child(lp), lmask),
+                                            cdd_neg_cond(cdd_elem_child(rp), rmask), op, graph);
             }
             cdd_tarjan_push(graph, info->clock1, info->clock2, bnd);
         }
 
         /* Do first recursion - check whether first edge is negated.
          */
-        prev = cdd_apply_reduce_rec(cdd_neg_cond(lp->child, lmask), cdd_neg_cond(rp->child, rmask), graph);
+        prev = cdd_apply_reduce_rec(cdd_neg_cond(cdd_elem_child(lp), lmask),
+                                    cdd_neg_cond(cdd_elem_child(rp), rmask), op, graph);
         cdd_ref(prev);
         mask = cdd_mask(prev);
         cdd_tarjan_pop(graph, info->clock1);
@@ -1621,7 +2942,8 @@ static ddNode* cdd_apply_reduce_rec(ddNode* l, ddNode* r, struct tarjan* graph)
         cdd_tarjan_push(graph, info->clock2, info->clock1, bnd_l2u(lower));
         while (bnd < INF && cdd_tarjan_consistent(graph)) {
             cdd_tarjan_push(graph, info->clock1, info->clock2, bnd);
-            n = cdd_apply_reduce_rec(cdd_neg_cond(lp->child, lmask), cdd_neg_cond(rp->child, rmask), graph);
+            n = cdd_apply_reduce_rec(cdd_neg_cond(cdd_elem_child(lp), lmask),
+                                     cdd_neg_cond(cdd_elem_child(rp), rmask), op, graph);
             cdd_tarjan_pop(graph, info->clock1);
             cdd_tarjan_pop(graph, info->clock2);
 
@@ -1643,7 +2965,8 @@ static ddNode* cdd_apply_reduce_rec(ddNode* l, ddNode* r, struct tarjan* graph)
          * only if the path is consistent.
          */
         if (bnd == INF && cdd_tarjan_consistent(graph)) {
-            n = cdd_apply_reduce_rec(cdd_neg_cond(lp->child, lmask), cdd_neg_cond(rp->child, rmask), graph);
+            n = cdd_apply_reduce_rec(cdd_neg_cond(cdd_elem_child(lp), lmask),
+                                     cdd_neg_cond(cdd_elem_child(rp), rmask), op, graph);
             if (n != prev) {
                 cdd_push(cdd_neg_cond(prev, mask), lower);
                 prev = n;
@@ -1664,7 +2987,7 @@ static ddNode* cdd_apply_reduce_rec(ddNode* l, ddNode* r, struct tarjan* graph)
          */
         do {
             cdd_refstacktop--;
-            cdd_deref(cdd_refstacktop->child);
+            cdd_deref(cdd_elem_child(cdd_refstacktop));
         } while (cdd_refstacktop > first);
 
         /* Restore stacktop.
@@ -1673,33 +2996,32 @@ static ddNode* cdd_apply_reduce_rec(ddNode* l, ddNode* r, struct tarjan* graph)
         break;
     case TYPE_BDD:
         if (l->level <= r->level) {
-            ll = bdd_node(l)->low;
-            lh = bdd_node(l)->high;
+            ll = bdd_node_low(l);
+            lh = bdd_node_high(l);
         } else {
             ll = lh = l;
         }
 
         if (l->level >= r->level) {
-            rl = bdd_node(r)->low;
-            rh = bdd_node(r)->high;
+            rl = bdd_node_low(r);
+            rh = bdd_node_high(r);
         } else {
             rl = rh = r;
         }
 
-        n = cdd_apply_reduce_rec(cdd_neg_cond(ll, lmask), cdd_neg_cond(rl, rmask), graph);
+        n = cdd_apply_reduce_rec(cdd_neg_cond(ll, lmask), cdd_neg_cond(rl, rmask), op, graph);
         cdd_ref(n);
         res = cdd_make_bdd_node(minimum(l->level, r->level), n,
-                                cdd_apply_reduce_rec(cdd_neg_cond(lh, lmask), cdd_neg_cond(rh, rmask), graph));
+                                cdd_apply_reduce_rec(cdd_neg_cond(lh, lmask), cdd_neg_cond(rh, rmask), op, graph));
         cdd_deref(n);
     }
 
+    cdd_reduced(res, graph);
     return res;
 }
 
 ddNode* cdd_apply_reduce(ddNode* l, ddNode* h, int32_t op)
 {
-    ddNode* res;
-
     /* Data structures needed for running Tarjans algoritm.
      */
     struct tarjan graph;
@@ -1709,13 +3031,296 @@ ddNode* cdd_apply_reduce(ddNode* l, ddNode* h, int32_t op)
     struct node fifo[cdd_clocknum + 1];
     uint32_t queued[bits2intsize(cdd_clocknum)];
 
+    uintptr_t mask = cdd_apply_normalise(&l, &h, &op);
+
+    if (op != cddop_and && op != cddop_xor) {
+        cdd_error(CDD_OP);
+        return cddfalse;
+    }
+
     cdd_tarjan_init(&graph, cdd_clocknum, dist, count, edges, fifo, queued);
 
-    applyop = op;
-    res = cdd_apply_reduce_rec(l, h, &graph);
-    if (cdd_errorcond) {
-        cdd_error(cdd_errorcond);
-        return NULL;
+    if (!cdd_shared) {
+        CddCache_adjust(&applycache);
+    }
+    return cdd_checked(cdd_neg_cond(cdd_apply_reduce_rec(l, h, op, &graph), mask));
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+/* Relational queries ask whether cdd_apply_reduce(l, r, op) is not
+ * cddfalse for op being cddop_and (the sets intersect) or cddop_xor
+ * (the sets differ), without building the result. The recursion
+ * follows cdd_apply_reduce_rec() and stops at the first consistent
+ * path to a true terminal.
+ */
+
+/** Returns the result of \c cdd_apply() on \a l and \a r if it is found without recursion, or NULL. */
+static ddNode* cdd_relation_terminal(ddNode* l, ddNode* r, int32_t op)
+{
+    switch (op) {
+    case cddop_and:
+        if (l == r || r == cddtrue) {
+            return l;
+        }
+        if (l == cddfalse || r == cddfalse || l == cdd_neg(r)) {
+            return cddfalse;
+        }
+        if (l == cddtrue) {
+            return r;
+        }
+        break;
+    case cddop_xor:
+        if (l == r) {
+            return cddfalse;
+        }
+        if (l == cdd_neg(r)) {
+            return cddtrue;
+        }
+        if (l == cddfalse) {
+            return r;
+        }
+        if (r == cddfalse) {
+            return l;
+        }
+        if (l == cddtrue) {
+            return cdd_neg(r);
+        }
+        if (r == cddtrue) {
+            return cdd_neg(l);
+        }
+        break;
+    }
+    if (cdd_isterminal(l) && cdd_isterminal(r)) {
+        return l;
+    }
+    return NULL;
+}
+
+/**
+ * Returns true if \c cdd_apply() on \a l and \a r is not \c cddfalse.
+ * Inconsistent paths are not excluded, so a negative answer is exact
+ * while a positive answer must be confirmed on the clock constraints.
+ * Answers are kept in the relation cache.
+ */
+static int32_t cdd_relation_rec(ddNode* l, ddNode* r, int32_t op)
+{
+    CddCacheData* entry;
+    int32_t lmask;
+    int32_t rmask;
+    Elem lself;
+    Elem rself;
+    Elem* lp;
+    Elem* rp;
+    ddNode* ll;
+    ddNode* lh;
+    ddNode* rl;
+    ddNode* rh;
+    ddNode* n;
+    int32_t level;
+    int32_t res = 0;
+    raw_t bnd;
+
+    if ((n = cdd_relation_terminal(l, r, op)) != NULL) {
+        return n != cddfalse;
+    }
+
+    /* The operation is symmetric; normalise for better cache performance */
+    if (l > r) {
+        n = l;
+        l = r;
+        r = n;
+    }
+
+    entry = CddCache_lookup(&relationcache, APPLYHASH(l, r, op));
+    if (CddCache_match(&relationcache, entry, l, r, op, &n)) {
+        return n == cddtrue;
+    }
+
+    lmask = cdd_mask(l);
+    rmask = cdd_mask(r);
+    ll = cdd_rglr(l);
+    rl = cdd_rglr(r);
+    level = minimum(ll->level, rl->level);
+    if (cdd_levelinfo[level].type == TYPE_CDD) {
+        /* A node on a lower level is a fake node with a single child */
+        lself.child = cdd_tohandle(ll);
+        lself.bnd = INF;
+        rself.child = cdd_tohandle(rl);
+        rself.bnd = INF;
+        lp = ll->level == level ? cdd_node(ll)->elem : &lself;
+        rp = rl->level == level ? cdd_node(rl)->elem : &rself;
+        do {
+            bnd = minimum(lp->bnd, rp->bnd);
+            res = cdd_relation_rec(cdd_neg_cond(cdd_elem_child(lp), lmask), cdd_neg_cond(cdd_elem_child(rp), rmask), op);
+            lp += (lp->bnd == bnd);
+            rp += (rp->bnd == bnd);
+        } while (!res && bnd < INF);
+    } else {
+        lh = ll->level == level ? bdd_node_high(ll) : ll;
+        ll = ll->level == level ? bdd_node_low(ll) : ll;
+        rh = rl->level == level ? bdd_node_high(rl) : rl;
+        rl = rl->level == level ? bdd_node_low(rl) : rl;
+        res = cdd_relation_rec(cdd_neg_cond(ll, lmask), cdd_neg_cond(rl, rmask), op) ||
+              cdd_relation_rec(cdd_neg_cond(lh, lmask), cdd_neg_cond(rh, rmask), op);
     }
+
+    CddCache_write(&relationcache, entry, res ? cddtrue : cddfalse, l, r, op);
     return res;
 }
+
+/**
+ * Returns true if \a node has a path to a true terminal which is
+ * consistent with the constraints in \a graph. Follows \c
+ * cdd_tarjan_reduce_rec().
+ */
+static int32_t cdd_sat_rec(ddNode* node, struct tarjan* graph)
+{
+    cdd_iterator it;
+    LevelInfo* info;
+    raw_t bnd;
+    int32_t res;
+
+    if (cdd_isterminal(node)) {
+        return !IS_FALSE(node);
+    }
+
+    info = cdd_info(node);
+    if (info->type == TYPE_BDD) {
+        return cdd_sat_rec(cdd_neg_cond(bdd_node_low(node), cdd_mask(node)), graph) ||
+               cdd_sat_rec(cdd_neg_cond(bdd_node_high(node), cdd_mask(node)), graph);
+    }
+
+    for (cdd_it_init(it, node); !cdd_it_atend(it); cdd_it_next(it)) {
+        /* Once a lower bound is inconsistent, so are all following ones */
+        if (cdd_it_lower(it) != -INF) {
+            cdd_tarjan_push(graph, info->clock2, info->clock1, bnd_l2u(cdd_it_lower(it)));
+            if (!cdd_tarjan_consistent(graph)) {
+                cdd_tarjan_pop(graph, info->clock2);
+                return 0;
+            }
+        }
+        bnd = cdd_it_upper(it);
+        if (bnd < INF) {
+            cdd_tarjan_push(graph, info->clock1, info->clock2, bnd);
+            res = cdd_tarjan_consistent(graph) && cdd_sat_rec(cdd_it_child(it), graph);
+            cdd_tarjan_pop(graph, info->clock1);
+        } else {
+            res = cdd_sat_rec(cdd_it_child(it), graph);
+        }
+        if (cdd_it_lower(it) != -INF) {
+            cdd_tarjan_pop(graph, info->clock2);
+        }
+        if (res) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Returns true if \c cdd_apply_reduce() on \a l and \a r is not \c
+ * cddfalse. Pairs without a structural witness are skipped using \c
+ * cdd_relation_rec().
+ */
+static int32_t cdd_witness_rec(ddNode* l, ddNode* r, int32_t op, struct tarjan* graph)
+{
+    int32_t lmask;
+    int32_t rmask;
+    Elem lself;
+    Elem rself;
+    Elem* lp;
+    Elem* rp;
+    ddNode* ll;
+    ddNode* lh;
+    ddNode* rl;
+    ddNode* rh;
+    ddNode* n;
+    LevelInfo* info;
+    int32_t level;
+    raw_t lower;
+    raw_t bnd;
+    int32_t res;
+
+    if ((n = cdd_relation_terminal(l, r, op)) != NULL) {
+        return n != cddfalse && cdd_sat_rec(n, graph);
+    }
+    if (!cdd_relation_rec(l, r, op)) {
+        return 0;
+    }
+
+    lmask = cdd_mask(l);
+    rmask = cdd_mask(r);
+    ll = cdd_rglr(l);
+    rl = cdd_rglr(r);
+    level = minimum(ll->level, rl->level);
+    info = cdd_levelinfo + level;
+    if (info->type == TYPE_BDD) {
+        lh = ll->level == level ? bdd_node_high(ll) : ll;
+        ll = ll->level == level ? bdd_node_low(ll) : ll;
+        rh = rl->level == level ? bdd_node_high(rl) : rl;
+        rl = rl->level == level ? bdd_node_low(rl) : rl;
+        return cdd_witness_rec(cdd_neg_cond(ll, lmask), cdd_neg_cond(rl, rmask), op, graph) ||
+               cdd_witness_rec(cdd_neg_cond(lh, lmask), cdd_neg_cond(rh, rmask), op, graph);
+    }
+
+    lself.child = cdd_tohandle(ll);
+    lself.bnd = INF;
+    rself.child = cdd_tohandle(rl);
+    rself.bnd = INF;
+    lp = ll->level == level ? cdd_node(ll)->elem : &lself;
+    rp = rl->level == level ? cdd_node(rl)->elem : &rself;
+    lower = -INF;
+    do {
+        /* Once a lower bound is inconsistent, so are all following ones */
+        if (lower != -INF) {
+            cdd_tarjan_push(graph, info->clock2, info->clock1, bnd_l2u(lower));
+            if (!cdd_tarjan_consistent(graph)) {
+                cdd_tarjan_pop(graph, info->clock2);
+                return 0;
+            }
+        }
+        bnd = minimum(lp->bnd, rp->bnd);
+        if (bnd < INF) {
+            cdd_tarjan_push(graph, info->clock1, info->clock2, bnd);
+            res = cdd_tarjan_consistent(graph) &&
+                  cdd_witness_rec(cdd_neg_cond(cdd_elem_child(lp), lmask), cdd_neg_cond(cdd_elem_child(rp), rmask), op, graph);
+            cdd_tarjan_pop(graph, info->clock1);
+        } else {
+            res = cdd_witness_rec(cdd_neg_cond(cdd_elem_child(lp), lmask), cdd_neg_cond(cdd_elem_child(rp), rmask), op, graph);
+        }
+        if (lower != -INF) {
+            cdd_tarjan_pop(graph, info->clock2);
+        }
+        if (res) {
+            return 1;
+        }
+        lp += (lp->bnd == bnd);
+        rp += (rp->bnd == bnd);
+        lower = bnd;
+    } while (bnd < INF);
+    return 0;
+}
+
+static int32_t cdd_witness(ddNode* l, ddNode* r, int32_t op)
+{
+    struct tarjan graph;
+    struct distance dist[cdd_clocknum];
+    uint32_t count[cdd_clocknum];
+    struct edge edges[cdd_clocknum * cdd_clocknum - cdd_clocknum];
+    struct node fifo[cdd_clocknum + 1];
+    uint32_t queued[bits2intsize(cdd_clocknum)];
+
+    cdd_tarjan_init(&graph, cdd_clocknum, dist, count, edges, fifo, queued);
+
+    if (!cdd_shared) {
+        CddCache_adjust(&relationcache);
+    }
+    return cdd_witness_rec(l, r, op, &graph);
+}
+
+int32_t cdd_intersects(ddNode* l, ddNode* r) { return cdd_witness(l, r, cddop_and); }
+
+int32_t cdd_subset(ddNode* l, ddNode* r) { return !cdd_witness(l, cdd_neg(r), cddop_and); }
+
+int32_t cdd_equiv(ddNode* l, ddNode* r) { return !cdd_witness(l, r, cddop_xor); }
@@ -1 +1,5 @@
 #cmakedefine MULTI_TERMINAL @MULTI_TERMINAL@
+#cmakedefine WIDEREF
+#cmakedefine HUGEPAGES
+#cmakedefine COMPACT
+#cmakedefine CHUNKSIZE @CHUNKSIZE@
@@ -11,6 +11,34 @@
 
 #include "cdd/kernel.h"
 
+#include <dbm/fed.h>
+
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+cdd_context::cdd_context(int32_t maxsize, int32_t cs, size_t stacksize)
+{
+    man = cdd_manager_create(maxsize, cs, stacksize);
+    if (man == nullptr)
+        throw std::bad_alloc();
+    prev = cdd_manager_select(man);
+}
+
+cdd_context::~cdd_context()
+{
+    cdd_manager_destroy(man);
+    cdd_manager_select(prev);
+}
+
+cdd_worker::cdd_worker(cdd_manager* man, size_t stacksize)
+{
+    if (cdd_manager_attach(man, stacksize) != 0)
+        throw std::bad_alloc();
+}
+
+cdd_worker::~cdd_worker() { cdd_manager_detach(); }
+
 cdd::cdd(const cdd& r)
 {
     assert(cdd_isrunning());
@@ -26,9 +54,53 @@ cdd::cdd(const raw_t* dbm, uint32_t dim)
     cdd_ref(root);
 }
 
+cdd::cdd(const dbm::fed_t& fed)
+{
+    assert(cdd_isrunning());
+    std::vector<const raw_t*> dbms;
+    dbms.reserve(fed.size());
+    for (auto i = fed.begin(); i != fed.end(); ++i)
+        dbms.push_back(i->const_dbm());
+    root = cdd_from_dbms(dbms.data(), dbms.size(), fed.getDimension());
+    if (root == nullptr)
+        throw std::bad_alloc();
+    cdd_ref(root);
+}
+
+bool cdd_contains(const cdd& c, const dbm::fed_t& fed)
+{
+    std::vector<const raw_t*> dbms;
+    dbms.reserve(fed.size());
+    for (auto i = fed.begin(); i != fed.end(); ++i)
+        dbms.push_back(i->const_dbm());
+    return cdd_contains_many(c.handle(), dbms.data(), dbms.size(), fed.getDimension());
+}
+
+int32_t cdd_fnload(const char* filename, std::vector<cdd>& roots)
+{
+    ddNode** nodes;
+    int32_t n = cdd_fnload(filename, &nodes);
+    for (int32_t i = 0; i < n; i++) {
+        roots.emplace_back(nodes[i]);
+        cdd_rec_deref(nodes[i]);
+    }
+    free(nodes);
+    return n;
+}
+
+cdd_zone_iterator::cdd_zone_iterator(const cdd& c, int32_t dim): root(c)
+{
+    zones.reset(cdd_enumerator_create(root.handle(), dim), cdd_enumerator_destroy);
+    if (zones == nullptr)
+        throw std::bad_alloc();
+    dbm = cdd_enumerator_next(zones.get());
+}
+
 cdd::cdd(ddNode* r)
 {
-    assert(cdd_isrunning() && r);
+    assert(cdd_isrunning());
+    if (r == nullptr)
+        throw std::bad_alloc();
     root = r;
     cdd_ref(r);
 }
@@ -45,12 +117,16 @@ cdd& cdd::operator=(const cdd& r)
     return *this;
 }
 
-cdd cdd::operator=(ddNode* node)
+cdd& cdd::operator=(ddNode* node)
 {
+    if (node == nullptr)
+        throw std::bad_alloc();
+
+    // The node may be below the old root, so it is referenced first
     if (root != node) {
+        cdd_ref(node);
         cdd_rec_deref(root);
         root = node;
-        cdd_ref(root);
     }
     return *this;
 }
@@ -18,6 +18,7 @@ static ddNode* cdd_bf_reduce_rec(ddNode* node, struct bellmanford* graph)
     raw_t bnd;
     int mask;
     Elem* top;
+    Elem* first;
     cdd_iterator it;
     ddNode* prev;
     ddNode* n;
@@ -32,10 +33,10 @@ static ddNode* cdd_bf_reduce_rec(ddNode* node, struct bellmanford* graph)
     info = cdd_info(node);
     switch (info->type) {
     case TYPE_BDD:
-        n = cdd_bf_reduce_rec(cdd_neg_cond(bdd_node(node)->low, cdd_mask(node)), graph);
+        n = cdd_bf_reduce_rec(cdd_neg_cond(bdd_node_low(node), cdd_mask(node)), graph);
         cdd_ref(n);
         res = cdd_make_bdd_node(cdd_rglr(node)->level, n,
-                                cdd_bf_reduce_rec(cdd_neg_cond(bdd_node(node)->high, cdd_mask(node)), graph));
+                                cdd_bf_reduce_rec(cdd_neg_cond(bdd_node_high(node), cdd_mask(node)), graph));
         cdd_deref(n);
         break;
 
@@ -69,7 +70,8 @@ static ddNode* cdd_bf_reduce_rec(ddNode* node, struct bellmanford* graph)
 
         /* Repeat until next inconsistent bound or the last bound.
          */
-        top = cdd_refstacktop;
+        top = cdd_refstack_reserve(cdd_maxcddsize);
+        first = cdd_refstacktop;
         for (cdd_it_next(it); !cdd_it_atend(it); cdd_it_next(it)) {
             cdd_bf_pop(graph);
             cdd_bf_push(graph, info->clock2, info->clock1, bnd_l2u(cdd_it_lower(it)));
@@ -96,13 +98,14 @@ static ddNode* cdd_bf_reduce_rec(ddNode* node, struct bellmanford* graph)
         cdd_push(cdd_neg_cond(prev, mask), INF);
 
         /* Create node */
-        res = cdd_neg_cond(cdd_make_cdd_node(cdd_rglr(node)->level, top, cdd_refstacktop - top), mask);
+        res = cdd_neg_cond(cdd_make_cdd_node(cdd_rglr(node)->level, first, cdd_refstacktop - first), mask);
 
         /* Remove references */
-        while (cdd_refstacktop > top) {
+        while (cdd_refstacktop > first) {
             cdd_refstacktop--;
-            cdd_deref(cdd_refstacktop->child);
+            cdd_deref(cdd_elem_child(cdd_refstacktop));
         }
+        cdd_refstacktop = top;
     }
     return res;
 }
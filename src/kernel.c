@@ -15,6 +15,7 @@
 #include "hash/compute.h"
 
 #include <assert.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -30,28 +31,63 @@
 #include <windows.h>
 #endif
 
-#if defined(__APPLE__) && defined(__MACH__)
-#define ARCH_APPLE_DARWIN
+// Elements are compared as vectors where the target has them. On
+// 64-bit targets an element takes 16 bytes: a child, a bound and
+// padding.
+#if defined(COMPACT)
+// Elements of handles have no padding
+#elif UINTPTR_MAX == UINT64_MAX && defined(__AVX2__)
+#include <immintrin.h>
+#define ELEM_AVX2
+#elif UINTPTR_MAX == UINT64_MAX && defined(__SSE2__)
+#include <emmintrin.h>
+#define ELEM_SSE2
+#elif UINTPTR_MAX == UINT64_MAX && defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define ELEM_NEON
 #endif
 
 #define JIT_GBC
 
 #define HASH_DENSITY  4  /**< Max. density of hash table. */
+#define REHASH_STEP   4  /**< Entries of a table being resized migrated per node added. */
 #define THRESHOLD     5  /**< Free nodes in percent for when to GBC. */
-#define MINFREE       20 /**< Minimum free nodes in percent. */
+#define MINFREE       20 /**< Default minimum free nodes in percent. */
+#define PARCUTOFF     6  /**< Default task depth of cdd_apply_par(). */
+#define TRIMKEEP      100 /**< Free nodes kept after GBC in percent of used nodes. */
+#define BACKOFF       0x40000 /**< Bytes of nodes allocated past a memory limit for operations to back off. */
+#define NURSERY       0x4000 /**< Default number of young nodes tracked per node manager. */
+#define MAXGROWTH     120 /**< Nodes in percent of the best order at which sifting turns. */
 #define SIZEOF_INT    4  /**< Size of integer in bytes. */
 #define SIZEOF_VOID_P 4  /**< Size of void pointer in bytes. */
 
-#if defined(WIN32)
-#define CHUNKSIZE 0x10000 /* Size of chunk in bytes */
-#elif defined(ARCH_APPLE_DARWIN)
-#include <mach/mach_init.h>
-#include <mach/vm_map.h>
-#define CHUNKSIZE 0x1000 /* Size of chunk in bytes */
-#else
-#include <malloc.h>
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
+
+#ifndef CHUNKSIZE
 #define CHUNKSIZE 0x10000 /* Size of chunk in bytes */
 #endif
+#if CHUNKSIZE < 0x1000 || (CHUNKSIZE & (CHUNKSIZE - 1)) != 0
+#error "CHUNKSIZE must be a power of two of at least 4KB"
+#endif
+
+/** Size of an arena in bytes: a 2MB huge page, or one chunk if larger. */
+#define ARENASIZE (CHUNKSIZE > 0x200000 ? CHUNKSIZE : 0x200000)
+
+#ifdef COMPACT
+#if UINTPTR_MAX == UINT32_MAX
+#error "COMPACT requires a 64-bit target"
+#endif
+/** Size of the node region: handles address 16GB in steps of 8 bytes. */
+#define REGIONSIZE ((uintptr_t)1 << 34)
+
+/** Number of arenas in the node region; the first holds the terminals. */
+#define REGIONARENAS (REGIONSIZE / ARENASIZE)
+#endif
+
+/** Number of chunks in an arena. */
+#define ARENACHUNKS (ARENASIZE / CHUNKSIZE)
 
 /** Returns a chunk in which \a node is allocated. */
 #define cdd_node2chunk(node) ((Chunk*)((uintptr_t)(node) & ~(CHUNKSIZE - 1)))
@@ -59,44 +95,78 @@
 /**
  * The terminal node. Since we can negate nodes by toggling a single
  * bit on the pointer to the node, we only need one terminal (the true
- * node).
+ * node). The terminal is shared by all managers; its reference count
+ * is saturated, so it is never modified.
+ */
+static ddNode cdd_terminal = {NULL, MAXLEVEL, 0, 0, MAXREF};
+
+/*** KERNEL VARIABLES ***********************************************/
+CDD_THREAD_LOCAL cdd_manager* cdd_current;              /**< Current manager. */
+CDD_THREAD_LOCAL CddThread* cdd_thread;                 /**< Current thread state. */
+#ifdef COMPACT
+ddNode* cddfalse; /**< True terminal, placed in the node region by cdd_region_init(). */
+ddNode* cddtrue;  /**< False terminal (negated true). */
+
+/*** NODE REGION ****************************************************/
+/*
+ * With handles all nodes of all managers are allocated in one region
+ * of reserved address space. Its first arena holds the terminals;
+ * the others are committed when a manager maps them and decommitted
+ * when it returns them.
  */
-static ddNode cdd_terminal;
+char* cdd_nodebase;                                 /**< Start of the node region. */
+static int32_t cdd_regionlock;                      /**< Protects the region. */
+static uint32_t cdd_regiontop;                      /**< Number of arenas handed out so far. */
+static uint32_t cdd_regionfreecnt;                  /**< Number of returned arenas. */
+static uint32_t cdd_regionfree[REGIONARENAS];       /**< Indices of the returned arenas. */
+static uint32_t cdd_termtop;                        /**< Bytes of the first arena in use. */
+static xtermNode* cdd_termfree;                     /**< Free extra terminals. */
+#else
+ddNode* cddfalse = &cdd_terminal;                       /**< True terminal. */
+ddNode* cddtrue = (ddNode*)((char*)&cdd_terminal + 1);  /**< False terminal (negated true). */
+#endif
 
+/*** MANAGER VARIABLES **********************************************/
+#define bddmanager         (cdd_current->bddmanager)         /**< BDD Node manager. */
+#define cddmanager         (cdd_current->cddmanager)         /**< Array of CDD Node managers. */
+#define cdd_gbcclock       (cdd_current->gbcclock)           /**< Acc. time used for garbage collection. */
+#define cdd_gbccnt         (cdd_current->gbccnt)             /**< Number of times we have run GBC. */
+#define cdd_rehashclock    (cdd_current->rehashclock)        /**< Acc. time used for rehashing. */
+#define cdd_rehashcnt      (cdd_current->rehashcnt)          /**< Number of times we have rehashed. */
+#define cdd_maxcddused     (cdd_current->maxcddused)         /**< Max. arity of an allocated node. */
+#define cdd_chunkcnt       (cdd_current->chunkcnt)           /**< Total number of chunks allocated. */
+#define cdd_arenacnt       (cdd_current->arenacnt)           /**< Number of arenas mapped. */
+#define cdd_arenas         (cdd_current->arenas)             /**< Arenas, those with free chunks first. */
+#define cdd_nodecnt        (cdd_current->nodecnt)            /**< Number of nodes in allocated chunks. */
+#define cdd_maxnodenum     (cdd_current->maxnodenum)         /**< Max. number of nodes, or 0. */
+#define cdd_minfree        (cdd_current->minfree)            /**< Minimum free nodes in percent. */
+#define cdd_membudget      (cdd_current->membudget)          /**< Max. bytes of nodes and caches, or 0. */
+#define cdd_nurserysize    (cdd_current->nurserysize)        /**< Young nodes tracked per node manager. */
+#define cdd_epochbase      (cdd_current->epochbase)          /**< Epoch of the last full GBC. */
+#define cdd_reorderlimit   (cdd_current->reorderlimit)       /**< BDD nodes in use which trigger reordering. */
+#define pregbc_handler     (cdd_current->pregbc_handler)     /**< Pre-gbc handler */
+#define postgbc_handler    (cdd_current->postgbc_handler)    /**< Post-gbc handler */
+#define prerehash_handler  (cdd_current->prerehash_handler)  /**< Pre-rehash handler */
+#define postrehash_handler (cdd_current->postrehash_handler) /**< Post-rehash handler */
 #ifdef MULTI_TERMINAL
-static ddNode** extra_terminals = NULL;
-static int32_t nb_extra_terminals = 0;
+#define extra_terminals    (cdd_current->extra_terminals)
+#define nb_extra_terminals (cdd_current->nb_extra_terminals)
 #endif
 
-/*** KERNEL VARIABLES ***********************************************/
-NodeManager* bddmanager;  /**< BDD Node manager. */
-NodeManager** cddmanager; /**< Array of CDD Node managers. */
-int32_t cdd_levelcnt;     /**< Number of levels allocated. */
-int32_t cdd_gbcclock;     /**< Acc. time used for garbage collection. */
-int32_t cdd_gbccnt;       /**< Number of times we have run GBC. */
-int32_t cdd_rehashclock;  /**< Acc. time used for rehashing. */
-int32_t cdd_rehashcnt;    /**< Number of times we have rehashed. */
-int32_t cdd_maxcddsize;   /**< Max. arity of a node. */
-int32_t cdd_maxcddused;   /**< Max. nodes the library may allocate. */
-int32_t cdd_chunkcnt;     /**< Total number of chunks allocated. */
-int32_t cdd_clocknum;     /**< Number of clocks allocated. */
-int32_t cdd_varnum;       /**< Number of BDD variables allocated. */
-LevelInfo* cdd_levelinfo;
-int32_t* cdd_diff2level;
-int32_t cdd_running;   /**< True if library has been initialised. */
-int32_t cdd_errorcond; /**< Last error code. */
-ddNode* cddfalse;      /**< True terminal. */
-ddNode* cddtrue;       /**< False terminal (negated true). */
-
-Elem* cdd_refstack;      /**< Base address of stack. */
-Elem* cdd_refstacktop;   /**< Top of stack. */
-size_t cdd_refstacksize; /**< Size of stack. */
-
-/*** STATIC KERNEL VARIABLES ***************************************/
-static void (*pregbc_handler)(void);               /**< Pre-gbc handler */
-static void (*postgbc_handler)(CddGbcStat*);       /**< Post-gbc handler */
-static void (*prerehash_handler)(void);            /**< Pre-rehash handler */
-static void (*postrehash_handler)(CddRehashStat*); /**< Post-rehash handler */
+/** Adds \a d to the counter \a x; atomically if the manager is shared. */
+#define cdd_counter_add(x, d) \
+    (cdd_shared ? (void)__atomic_fetch_add(&(x), (d), __ATOMIC_RELAXED) : (void)((x) += (d)))
+
+/** Acquires a spin lock. */
+static inline void cdd_lock(int32_t* lock)
+{
+    while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE)) {
+        while (__atomic_load_n(lock, __ATOMIC_RELAXED)) {}
+    }
+}
+
+/** Releases a spin lock. */
+static inline void cdd_unlock(int32_t* lock) { __atomic_store_n(lock, 0, __ATOMIC_RELEASE); }
 
 /** Allocate a new subtable. */
 static SubTable* cdd_alloc_subtable(NodeManager*, int);
@@ -110,18 +180,44 @@ static NodeManager* cdd_alloc_nodemanager(int, NodeHashFunc);
 /** Deallocate a node manager. */
 static void cdd_dealloc_nodemanager(NodeManager*);
 
-/** Garbage collect a node manager */
-static void cdd_gbc_nodemanager(NodeManager*);
+/** Allocate and publish the node manager of CDD nodes with a given number of children. */
+static NodeManager* cdd_alloc_cddmanager(int32_t);
+
+/** Free the dead nodes of a node manager. */
+static int64_t cdd_sweep_nodemanager(NodeManager*);
+
+/** Garbage collect all node managers. */
+static void cdd_gbc_full();
 
 /** Allocate a chunk. */
 static void cdd_alloc_chunk(NodeManager*);
 
-/** Dealloate a chunk. */
+/** Release free chunks of a node manager. */
+static int64_t cdd_trim_nodemanager(NodeManager*, int32_t);
+
+/** Allocate a node. */
 static ddNode* cdd_alloc_node(NodeManager*);
 
-/** Rehash a subtable, doubling the size of it. */
+/** Return a node which was never published to the free list. */
+static void cdd_free_node(NodeManager*, ddNode*);
+
+/** Start doubling the size of a subtable, see cdd_rehash_step(). */
 static void cdd_rehash(NodeManager*, SubTable*);
 
+/** Migrate entries of a subtable being resized to the new table. */
+static void cdd_rehash_step(NodeManager*, SubTable*, int32_t);
+
+#ifdef COMPACT
+/** Reserve the node region and place the terminal in it. */
+static int32_t cdd_region_init();
+
+/** Allocate a terminal in the node region. */
+static xtermNode* cdd_alloc_terminal();
+
+/** Return a terminal to the node region. */
+static void cdd_free_terminal(xtermNode*);
+#endif
+
 /**
  * @name Hash functions
  * @{
@@ -135,12 +231,82 @@ static void cdd_rehash(NodeManager*, SubTable*);
 /**
  * Hash function used to pair two DD nodes.
  */
-#define bddHash(f, g) ((uint32_t)(((uint32_t)(f)*DD_P1 + (uint32_t)(g)) * DD_P2))
+#define bddHash(f, g) ((uint32_t)(((uint32_t)(uintptr_t)(f)*DD_P1 + (uint32_t)(uintptr_t)(g)) * DD_P2))
 
 /**
  * Hash function over an array of \a len Elem elements.
  */
-#define cddHash(elem, len) (hash_computeU32((uint32_t*)(elem), (len) * (sizeof(Elem) >> 2), (len)))
+#define cddHash(elem, len) (cdd_elem_hash((elem), (len)))
+
+/**
+ * Hashes the fields of \a len elements. The elements are copied to a
+ * packed buffer first, since on 64-bit targets an Elem of pointers
+ * contains padding which is not initialised.
+ */
+static uint32_t cdd_elem_hash(const Elem* elem, int32_t len)
+{
+#ifdef COMPACT
+    return hash_computeU32((const uint32_t*)elem, 2 * len, len);
+#else
+    uint32_t buf[3 * len];
+    int32_t i;
+    for (i = 0; i < len; i++) {
+        buf[3 * i] = (uint32_t)(uintptr_t)elem[i].child;
+        buf[3 * i + 1] = (uint32_t)((uint64_t)(uintptr_t)elem[i].child >> 32);
+        buf[3 * i + 2] = (uint32_t)elem[i].bnd;
+    }
+    return hash_computeU32(buf, 3 * len, len);
+#endif
+}
+
+/**
+ * Returns true if the \a len elements of \a a and \a b are equal.
+ * Vector compares mask out the padding of the elements, which is not
+ * initialised; 32-bit elements have none and are compared as memory.
+ */
+static inline int32_t cdd_elem_equal(const Elem* a, const Elem* b, int32_t len)
+{
+#if UINTPTR_MAX == UINT32_MAX || defined(COMPACT)
+    return memcmp(a, b, sizeof(Elem) * len) == 0;
+#else
+    int32_t i = 0;
+#if defined(ELEM_AVX2)
+    for (; i + 2 <= len; i += 2) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+        if ((_mm256_movemask_epi8(_mm256_cmpeq_epi32(x, y)) & 0x0FFF0FFF) != 0x0FFF0FFF) {
+            return 0;
+        }
+    }
+#endif
+#if defined(ELEM_AVX2) || defined(ELEM_SSE2)
+    for (; i < len; i++) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i y = _mm_loadu_si128((const __m128i*)(b + i));
+        if ((_mm_movemask_epi8(_mm_cmpeq_epi32(x, y)) & 0x0FFF) != 0x0FFF) {
+            return 0;
+        }
+    }
+    return 1;
+#elif defined(ELEM_NEON)
+    const uint32x4_t pad = {0, 0, 0, UINT32_MAX};
+    for (; i < len; i++) {
+        uint32x4_t eq = vceqq_u32(vld1q_u32((const uint32_t*)(a + i)), vld1q_u32((const uint32_t*)(b + i)));
+        if (vminvq_u32(vorrq_u32(eq, pad)) != UINT32_MAX) {
+            return 0;
+        }
+    }
+    return 1;
+#else
+    for (; i < len; i++) {
+        if (a[i].child != b[i].child || a[i].bnd != b[i].bnd) {
+            return 0;
+        }
+    }
+    return 1;
+#endif
+#endif
+}
 
 static uint32_t cdd_hash_func(NodeManager*, ddNode*);
 static uint32_t bdd_hash_func(NodeManager*, ddNode*);
@@ -153,63 +319,279 @@ int32_t cdd_error(int32_t e)
     return e;
 }
 
-int32_t cdd_init(int32_t maxsize, int32_t cs, size_t stacksize)
+/** Allocates a reference stack chunk of \a n elements above \a prev. */
+static RefChunk* cdd_refchunk_alloc(RefChunk* prev, size_t n)
 {
-    int32_t err;
+    RefChunk* chunk = (RefChunk*)malloc(sizeof(RefChunk) + sizeof(Elem) * n);
+    if (chunk) {
+        chunk->prev = prev;
+        chunk->next = NULL;
+        chunk->end = cdd_refchunk_base(chunk) + n;
+    }
+    return chunk;
+}
 
-    if (cdd_running) {
-        return cdd_error(CDD_RUNNING);
+/** Frees the reference stack chunk \a chunk and the chunks above it. */
+static void cdd_refchunk_free(RefChunk* chunk)
+{
+    RefChunk* next;
+    for (; chunk; chunk = next) {
+        next = chunk->next;
+        free(chunk);
+    }
+}
+
+/** Initialises the state of a thread with a reference stack of \a stacksize entries. */
+static int32_t cdd_thread_init(CddThread* t, cdd_manager* man, size_t stacksize)
+{
+    memset(t, 0, sizeof(CddThread));
+    if ((t->refchunk = cdd_refchunk_alloc(NULL, stacksize)) == NULL) {
+        return -1;
+    }
+    t->man = man;
+    t->refstacktop = cdd_refchunk_base(t->refchunk);
+    t->refstacksize = stacksize;
+    return 0;
+}
+
+/** Frees the stacks of the thread state \a t. */
+static void cdd_thread_done(CddThread* t)
+{
+    RefChunk* chunk = t->refchunk;
+    while (chunk && chunk->prev) {
+        chunk = chunk->prev;
+    }
+    cdd_refchunk_free(chunk);
+    free(t->nodestack);
+    free(t->framestack);
+    t->refchunk = NULL;
+    t->nodestack = NULL;
+    t->framestack = NULL;
+}
+
+void cdd_refstack_grow(size_t n)
+{
+    RefChunk* chunk = cdd_refchunk;
+    RefChunk* next;
+    uintptr_t top = (uintptr_t)cdd_refstacktop;
+    size_t size;
+
+    // Find the chunk holding the top; the chunks above it are free
+    while (top < (uintptr_t)cdd_refchunk_base(chunk) || top > (uintptr_t)chunk->end) {
+        chunk = chunk->prev;
+        assert(chunk);
+    }
+    if ((uintptr_t)chunk->end - top >= n * sizeof(Elem)) {
+        cdd_refchunk = chunk;
+        return;
+    }
+
+    // A run must be contiguous, so it starts in the next chunk
+    next = chunk->next;
+    if (next == NULL || (size_t)(next->end - cdd_refchunk_base(next)) < n) {
+        cdd_refchunk_free(next);
+        size = 2 * (size_t)(chunk->end - cdd_refchunk_base(chunk));
+        if ((next = cdd_refchunk_alloc(chunk, size > n ? size : n)) == NULL) {
+            // A run cannot be abandoned half built
+            cdd_error(CDD_STACKOVERFLOW);
+            abort();
+        }
+        chunk->next = next;
+    }
+    cdd_refchunk = next;
+    cdd_refstacktop = cdd_refchunk_base(next);
+}
+
+/**
+ * Makes room for \a n more nodes above the first \a used ones in the
+ * work list of cdd_release() and cdd_revive().
+ * @return the work list, which may have moved
+ */
+static ddNode** cdd_nodestack_reserve(size_t used, size_t n)
+{
+    CddThread* t = cdd_thread;
+    ddNode** stack;
+    size_t size;
+
+    if (used + n > t->nodestacksize) {
+        size = 2 * t->nodestacksize > used + n ? 2 * t->nodestacksize : used + n;
+        if ((stack = (ddNode**)realloc(t->nodestack, sizeof(ddNode*) * size)) == NULL) {
+            // The reference counts would be left inconsistent
+            cdd_error(CDD_STACKOVERFLOW);
+            abort();
+        }
+        t->nodestack = stack;
+        t->nodestacksize = size;
     }
+    return t->nodestack;
+}
 
-    cdd_terminal.next = NULL;
-    cdd_terminal.ref = MAXREF;
-    cdd_terminal.level = MAXLEVEL;
-    cdd_terminal.flag = 0;
-    cddfalse = &cdd_terminal;
-    cddtrue = cdd_neg(cddfalse);
+cdd_manager* cdd_manager_create(int32_t maxsize, int32_t cs, size_t stacksize)
+{
+    cdd_manager* prev = cdd_current;
+    CddThread* prevthread = cdd_thread;
+    cdd_manager* man = (cdd_manager*)calloc(1, sizeof(cdd_manager));
 
+    if (man == NULL) {
+        cdd_error(CDD_MEMORY);
+        return NULL;
+    }
+#ifdef COMPACT
+    if (cdd_region_init() != 0) {
+        cdd_error(CDD_MEMORY);
+        free(man);
+        return NULL;
+    }
+#endif
+
+    if (cdd_thread_init(&man->owner, man, stacksize) != 0) {
+        cdd_error(CDD_MEMORY);
+        free(man);
+        return NULL;
+    }
+
+    // Build the manager while it is current
+    cdd_current = man;
+    cdd_thread = &man->owner;
     cdd_maxcddsize = maxsize;
-    cdd_maxcddused = 0;
-    cdd_levelcnt = cdd_chunkcnt = 0;
-    cdd_gbcclock = 0;
-    cdd_gbccnt = 0;
-    postgbc_handler = NULL;
-    pregbc_handler = NULL;
-    prerehash_handler = NULL;
-    postrehash_handler = NULL;
-    cdd_refstack = NULL;
-    cddmanager = NULL;
-    bddmanager = NULL;
-    cdd_levelinfo = NULL;
-    cdd_diff2level = NULL;
-    cdd_clocknum = 0;
-    cdd_varnum = 0;
+    cdd_parcutoff = PARCUTOFF;
+    cdd_minfree = MINFREE;
+    cdd_nurserysize = NURSERY;
     cdd_postgbc_hook(cdd_default_gbhandler);
     cdd_postrehash_hook(cdd_default_rehashhandler);
 
-    if ((err = cdd_operator_init(cs)) < 0) {
-        cdd_done();
-        return err;
+    if (cdd_operator_init(cs) < 0) {
+        cdd_manager_destroy(man);
+        cdd_current = prev;
+        cdd_thread = prevthread;
+        return NULL;
     }
 
-    cdd_refstacksize = stacksize;
-    cdd_refstack = cdd_refstacktop = (Elem*)malloc(sizeof(Elem) * stacksize);
     cddmanager = (NodeManager**)calloc(maxsize + 1, sizeof(NodeManager*));
     bddmanager = cdd_alloc_nodemanager(sizeof(bddNode), bdd_hash_func);
 
-    if (cdd_refstack == NULL || cddmanager == NULL || bddmanager == NULL) {
-        cdd_done();
+    if (cddmanager == NULL || bddmanager == NULL) {
+        cdd_error(CDD_MEMORY);
+        cdd_manager_destroy(man);
+        cdd_current = prev;
+        cdd_thread = prevthread;
+        return NULL;
+    }
+
+    cdd_current = prev;
+    cdd_thread = prevthread;
+    return man;
+}
+
+void cdd_manager_destroy(cdd_manager* man)
+{
+    cdd_manager* prev = cdd_current;
+    CddThread* prevthread = cdd_thread;
+    int32_t i;
+
+    if (man == NULL) {
+        return;
+    }
+
+    cdd_current = man;
+    cdd_thread = &man->owner;
+    cdd_operator_done();
+    cdd_dealloc_nodemanager(bddmanager);
+    if (cddmanager) {
+        for (i = 0; i <= cdd_maxcddsize; i++) {
+            cdd_dealloc_nodemanager(cddmanager[i]);
+        }
+    }
+    assert(cdd_arenas == NULL);
+    free(cddmanager);
+    cdd_thread_done(&man->owner);
+    free(cdd_levelinfo);
+    free(cdd_diff2level);
+    free(cdd_level2var);
+    free(cdd_var2level);
+#ifdef MULTI_TERMINAL
+    for (i = 0; i < nb_extra_terminals; ++i) {
+#ifdef COMPACT
+        cdd_free_terminal((xtermNode*)extra_terminals[i]);
+#else
+        free(extra_terminals[i]);
+#endif
+    }
+    free(extra_terminals);
+#endif /* MULTI_TERMINAL */
+    free(man);
+
+    if (prev == man) {
+        cdd_current = NULL;
+        cdd_thread = NULL;
+    } else {
+        cdd_current = prev;
+        cdd_thread = prevthread;
+    }
+}
+
+cdd_manager* cdd_manager_select(cdd_manager* man)
+{
+    cdd_manager* prev = cdd_current;
+    cdd_current = man;
+    cdd_thread = man ? &man->owner : NULL;
+    return prev;
+}
+
+cdd_manager* cdd_manager_current() { return cdd_current; }
+
+int32_t cdd_manager_attach(cdd_manager* man, size_t stacksize)
+{
+    CddThread* t = (CddThread*)malloc(sizeof(CddThread));
+
+    if (t == NULL || cdd_thread_init(t, man, stacksize) != 0) {
+        free(t);
         return cdd_error(CDD_MEMORY);
     }
 
-    cdd_running = 1;
+    t->prevman = cdd_current;
+    t->prevthread = cdd_thread;
+    __atomic_fetch_add(&man->shared, 1, __ATOMIC_SEQ_CST);
+
+    cdd_current = man;
+    cdd_thread = t;
+
+    return 0;
+}
+
+void cdd_manager_detach()
+{
+    CddThread* t = cdd_thread;
+
+    assert(t && t != &t->man->owner);
+
+    __atomic_fetch_sub(&t->man->shared, 1, __ATOMIC_SEQ_CST);
+    cdd_current = t->prevman;
+    cdd_thread = t->prevthread;
+    cdd_thread_done(t);
+    free(t);
+}
+
+int32_t cdd_init(int32_t maxsize, int32_t cs, size_t stacksize)
+{
+    cdd_manager* man;
+
+    if (cdd_current) {
+        return cdd_error(CDD_RUNNING);
+    }
+
+    if ((man = cdd_manager_create(maxsize, cs, stacksize)) == NULL) {
+        return CDD_MEMORY;
+    }
+
+    cdd_manager_select(man);
 
     return 0;
 }
 
 void cdd_ensure_running()
 {
-    if (!cdd_running) {
+    if (!cdd_current) {
         cdd_init(64, 10000, 10000);
         cdd_pregbc_hook(NULL);
         cdd_postgbc_hook(NULL);
@@ -231,12 +613,17 @@ void cdd_add_tautologies(int32_t n)
     // FIXME: NULL.
 
     for (i = oldn; i < newn; ++i) {
+#ifdef COMPACT
+        xtermNode* node = cdd_alloc_terminal();
+#else
         xtermNode* node = (xtermNode*)malloc(sizeof(xtermNode));
+#endif
         // FIXME: NULL.
         node->next = NULL;
         node->ref = MAXREF;
         node->level = MAXLEVEL;
         node->flag = 0;
+        node->epoch = 0;
         node->id = i;
         extra_terminals[i] = (ddNode*)node;
     }
@@ -266,58 +653,283 @@ int32_t cdd_get_number_of_tautologies() { return nb_extra_terminals; }
 
 #endif
 
-int32_t cdd_isrunning() { return cdd_running; }
+int32_t cdd_isrunning() { return cdd_current != NULL; }
 
 void cdd_done()
 {
-    int32_t i;
+    if (cdd_current) {
+        cdd_manager_destroy(cdd_current);
+    }
+}
 
-    if (!cdd_running) {
-        return;
+#ifdef COMPACT
+/** Commits the \a size bytes at \a mem of the node region. */
+static int32_t cdd_region_commit(char* mem, size_t size)
+{
+#if defined(WIN32)
+    return VirtualAlloc(mem, size, MEM_COMMIT, PAGE_READWRITE) != NULL;
+#else
+    return mprotect(mem, size, PROT_READ | PROT_WRITE) == 0;
+#endif
+}
+
+/** Returns the \a size bytes at \a mem of the node region to the operating system. */
+static void cdd_region_decommit(char* mem, size_t size)
+{
+#if defined(WIN32)
+    VirtualFree(mem, size, MEM_DECOMMIT);
+#else
+    mmap(mem, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+#endif
+}
+
+/**
+ * Reserves the node region on first use and places the terminal at
+ * its start.
+ * @return 0 if successful, an error code otherwise
+ */
+static int32_t cdd_region_init()
+{
+    char* mem;
+    uintptr_t base;
+
+    cdd_lock(&cdd_regionlock);
+    if (cdd_nodebase == NULL) {
+#if defined(WIN32)
+        mem = (char*)VirtualAlloc(0, REGIONSIZE + ARENASIZE, MEM_RESERVE, PAGE_READWRITE);
+#else
+        mem = (char*)mmap(NULL, REGIONSIZE + ARENASIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (mem == MAP_FAILED) {
+            mem = NULL;
+        }
+#endif
+        base = ((uintptr_t)mem + ARENASIZE - 1) & ~(uintptr_t)(ARENASIZE - 1);
+        if (mem == NULL || !cdd_region_commit((char*)base, ARENASIZE)) {
+            cdd_unlock(&cdd_regionlock);
+            return CDD_MEMORY;
+        }
+        *(ddNode*)base = cdd_terminal;
+        cdd_termtop = sizeof(ddNode);
+        cdd_regiontop = 1;
+        cddfalse = (ddNode*)base;
+        cddtrue = (ddNode*)(base + 1);
+        __atomic_store_n(&cdd_nodebase, (char*)base, __ATOMIC_RELEASE);
     }
+    cdd_unlock(&cdd_regionlock);
+    return 0;
+}
 
-    cdd_operator_done();
-    cdd_dealloc_nodemanager(bddmanager);
-    for (i = 0; i <= cdd_maxcddsize; i++) {
-        cdd_dealloc_nodemanager(cddmanager[i]);
+/** Allocates an extra terminal in the first arena of the node region. */
+static xtermNode* cdd_alloc_terminal()
+{
+    xtermNode* node = NULL;
+
+    cdd_lock(&cdd_regionlock);
+    if (cdd_termfree != NULL) {
+        node = cdd_termfree;
+        cdd_termfree = (xtermNode*)node->next;
+    } else if (cdd_termtop + sizeof(xtermNode) <= ARENASIZE) {
+        node = (xtermNode*)(cdd_nodebase + cdd_termtop);
+        cdd_termtop += sizeof(xtermNode);
     }
-    free(cddmanager);
-    free(cdd_refstack);
-    free(cdd_levelinfo);
-    free(cdd_diff2level);
-#ifdef MULTI_TERMINAL
-    for (i = 0; i < nb_extra_terminals; ++i) {
-        free(extra_terminals[i]);
+    cdd_unlock(&cdd_regionlock);
+    return node;
+}
+
+/** Frees an extra terminal allocated by cdd_alloc_terminal(). */
+static void cdd_free_terminal(xtermNode* node)
+{
+    cdd_lock(&cdd_regionlock);
+    node->next = (ddNode*)cdd_termfree;
+    cdd_termfree = node;
+    cdd_unlock(&cdd_regionlock);
+}
+#endif
+
+/**
+ * Maps an arena from the operating system. The mapping is twice the
+ * arena size so that an aligned arena can be cut from it. With
+ * handles the arena is committed in the node region instead.
+ */
+static Arena* cdd_alloc_arena()
+{
+    Arena* arena = (Arena*)malloc(sizeof(Arena) + ARENACHUNKS * sizeof(uint16_t));
+    uintptr_t base;
+
+    if (arena == NULL) {
+        return NULL;
     }
-    nb_extra_terminals = 0;
-    free(extra_terminals);
-    extra_terminals = NULL;
-#endif /* MULTI_TERMINAL */
-    cdd_running = 0;
+#if defined(COMPACT)
+    cdd_lock(&cdd_regionlock);
+    if (cdd_regionfreecnt > 0) {
+        base = (uintptr_t)cdd_nodebase + (uintptr_t)cdd_regionfree[--cdd_regionfreecnt] * ARENASIZE;
+    } else if (cdd_regiontop < REGIONARENAS) {
+        base = (uintptr_t)cdd_nodebase + (uintptr_t)cdd_regiontop++ * ARENASIZE;
+    } else {
+        base = 0;
+    }
+    cdd_unlock(&cdd_regionlock);
+    if (base == 0 || !cdd_region_commit((char*)base, ARENASIZE)) {
+        if (base != 0) {
+            cdd_lock(&cdd_regionlock);
+            cdd_regionfree[cdd_regionfreecnt++] = (uint32_t)((base - (uintptr_t)cdd_nodebase) / ARENASIZE);
+            cdd_unlock(&cdd_regionlock);
+        }
+        free(arena);
+        return NULL;
+    }
+    arena->mem = (void*)base;
+#if defined(HUGEPAGES) && defined(MADV_HUGEPAGE)
+    madvise(arena->mem, ARENASIZE, MADV_HUGEPAGE);
+#endif
+#elif defined(WIN32)
+    arena->mem = VirtualAlloc(0, 2 * ARENASIZE, MEM_RESERVE, PAGE_READWRITE);
+    if (arena->mem == NULL) {
+        free(arena);
+        return NULL;
+    }
+    base = ((uintptr_t)arena->mem + ARENASIZE - 1) & ~(uintptr_t)(ARENASIZE - 1);
+    if (VirtualAlloc((void*)base, ARENASIZE, MEM_COMMIT, PAGE_READWRITE) == NULL) {
+        VirtualFree(arena->mem, 0, MEM_RELEASE);
+        free(arena);
+        return NULL;
+    }
+#else
+    char* mem = (char*)mmap(NULL, 2 * ARENASIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        free(arena);
+        return NULL;
+    }
+    // Unmap what lies outside the aligned arena
+    base = ((uintptr_t)mem + ARENASIZE - 1) & ~(uintptr_t)(ARENASIZE - 1);
+    if (base > (uintptr_t)mem) {
+        munmap(mem, base - (uintptr_t)mem);
+    }
+    munmap((char*)base + ARENASIZE, (uintptr_t)mem + ARENASIZE - base);
+    arena->mem = (void*)base;
+#if defined(HUGEPAGES) && defined(MADV_HUGEPAGE)
+    madvise(arena->mem, ARENASIZE, MADV_HUGEPAGE);
+#endif
+#endif
+
+    arena->base = (char*)base;
+    arena->carved = 0;
+    arena->used = 0;
+    arena->freecnt = 0;
+    cdd_arenacnt++;
+    return arena;
 }
 
+/** Returns an arena to the operating system. */
+static void cdd_dealloc_arena(Arena* arena)
+{
+#if defined(COMPACT)
+    cdd_region_decommit((char*)arena->mem, ARENASIZE);
+    cdd_lock(&cdd_regionlock);
+    cdd_regionfree[cdd_regionfreecnt++] = (uint32_t)(((char*)arena->mem - cdd_nodebase) / ARENASIZE);
+    cdd_unlock(&cdd_regionlock);
+#elif defined(WIN32)
+    VirtualFree(arena->mem, 0, MEM_RELEASE);
+#else
+    munmap(arena->mem, ARENASIZE);
+#endif
+    free(arena);
+    cdd_arenacnt--;
+}
+
+/** True if no more chunks can be taken from \a arena. */
+#define cdd_arena_full(arena) ((arena)->freecnt == 0 && (arena)->carved == ARENACHUNKS)
+
+/** Removes \a arena from the list of arenas. */
+static void cdd_unlink_arena(Arena* arena)
+{
+    if (arena->next == arena) {
+        cdd_arenas = NULL;
+        return;
+    }
+    arena->prev->next = arena->next;
+    arena->next->prev = arena->prev;
+    if (cdd_arenas == arena) {
+        cdd_arenas = arena->next;
+    }
+}
+
+/** Inserts \a arena at the front of the list of arenas. */
+static void cdd_push_arena(Arena* arena)
+{
+    if (cdd_arenas == NULL) {
+        arena->next = arena->prev = arena;
+    } else {
+        arena->next = cdd_arenas;
+        arena->prev = cdd_arenas->prev;
+        arena->prev->next = arena;
+        cdd_arenas->prev = arena;
+    }
+    cdd_arenas = arena;
+}
+
+/** Takes a chunk from the first arena, mapping a new arena if all are full. */
 static Chunk* cdd_allocate_chunk_from_os()
 {
+    Arena* arena;
+    Chunk* chunk;
+
+    cdd_lock(&cdd_current->arenalock);
+    arena = cdd_arenas;
+    if (arena == NULL || cdd_arena_full(arena)) {
+        if ((arena = cdd_alloc_arena()) == NULL) {
+            cdd_unlock(&cdd_current->arenalock);
+            return NULL;
+        }
+        cdd_push_arena(arena);
+    }
+
+    if (arena->freecnt > 0) {
+        chunk = (Chunk*)(arena->base + (size_t)arena->freeidx[--arena->freecnt] * CHUNKSIZE);
 #if defined(WIN32)
-    return (Chunk*)VirtualAlloc(0, CHUNKSIZE, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
-#elif defined(ARCH_APPLE_DARWIN)
-    vm_address_t address;
-    vm_allocate(mach_task_self(), &address, CHUNKSIZE, true);
-    return (Chunk*)address;
-#else
-    return (Chunk*)memalign(CHUNKSIZE, CHUNKSIZE);
+        VirtualAlloc(chunk, CHUNKSIZE, MEM_COMMIT, PAGE_READWRITE);
 #endif
+    } else {
+        chunk = (Chunk*)(arena->base + (size_t)arena->carved++ * CHUNKSIZE);
+    }
+    chunk->arena = arena;
+    arena->used++;
+
+    // Full arenas move to the back
+    if (cdd_arena_full(arena)) {
+        cdd_arenas = arena->next;
+    }
+    cdd_unlock(&cdd_current->arenalock);
+    return chunk;
 }
 
+/**
+ * Returns a chunk to its arena and its pages to the OS, and the arena
+ * to the OS when it is empty.
+ */
 static void cdd_deallocate_chunk_to_os(Chunk* chunk)
 {
+    Arena* arena = chunk->arena;
+    int32_t full;
+
+    cdd_lock(&cdd_current->arenalock);
+    full = cdd_arena_full(arena);
+    if (--arena->used == 0) {
+        cdd_unlink_arena(arena);
+        cdd_dealloc_arena(arena);
+    } else {
+        arena->freeidx[arena->freecnt++] = (uint16_t)(((char*)chunk - arena->base) / CHUNKSIZE);
 #if defined(WIN32)
-    VirtualFree(chunk, CHUNKSIZE, MEM_DECOMMIT | MEM_RELEASE);
-#elif defined(ARCH_APPLE_DARWIN)
-    vm_deallocate(mach_task_self(), (vm_address_t)chunk, CHUNKSIZE);
-#else
-    free(chunk);
+        VirtualFree(chunk, CHUNKSIZE, MEM_DECOMMIT);
+#elif defined(MADV_DONTNEED)
+        madvise(chunk, CHUNKSIZE, MADV_DONTNEED);
 #endif
+        if (full) {
+            cdd_unlink_arena(arena);
+            cdd_push_arena(arena);
+        }
+    }
+    cdd_unlock(&cdd_current->arenalock);
 }
 
 static SubTable* cdd_alloc_subtable(NodeManager* man, int32_t level)
@@ -330,11 +942,24 @@ static SubTable* cdd_alloc_subtable(NodeManager* man, int32_t level)
     tbl->buckets = 256;
     tbl->keys = 0;
     tbl->maxkeys = tbl->buckets * HASH_DENSITY;
+    tbl->oldhash = NULL;
+    tbl->migrated = 0;
     tbl->hash = (ddNode**)malloc(tbl->buckets * sizeof(ddNode*));
     for (i = 0; i < tbl->buckets; i++) {
         tbl->hash[i] = man->sentinel;
     }
-    man->subtables[level] = tbl;
+
+    // Another thread may publish the sub table first
+    if (cdd_shared) {
+        SubTable* other = NULL;
+        if (!__atomic_compare_exchange_n(&man->subtables[level], &other, tbl, 0, __ATOMIC_ACQ_REL,
+                                         __ATOMIC_ACQUIRE)) {
+            cdd_dealloc_subtable(tbl);
+            return other;
+        }
+    } else {
+        man->subtables[level] = tbl;
+    }
     return tbl;
 }
 
@@ -342,10 +967,21 @@ static void cdd_dealloc_subtable(SubTable* tbl)
 {
     if (tbl) {
         free(tbl->hash);
+        free(tbl->oldhash);
         free(tbl);
     }
 }
 
+/** Returns the entry of \a hash in \a tbl, which is in the old table while that entry has not been migrated. */
+static inline ddNode** cdd_bucket(SubTable* tbl, uint32_t hash)
+{
+    uint32_t old;
+    if (tbl->oldhash && (old = hash >> (tbl->shift + 1)) >= (uint32_t)tbl->migrated) {
+        return &(tbl->oldhash[old]);
+    }
+    return &(tbl->hash[hash >> tbl->shift]);
+}
+
 static NodeManager* cdd_alloc_nodemanager(int32_t size, NodeHashFunc hashfunc)
 {
     NodeManager* man;
@@ -359,10 +995,21 @@ static NodeManager* cdd_alloc_nodemanager(int32_t size, NodeHashFunc hashfunc)
     man->deadcnt = 0;
     man->gbccnt = 0;
     man->gbcclock = 0;
+    man->lock = 0;
     man->free = NULL;
     man->nodes = NULL;
+    man->nursery = NULL;
+    man->youngcnt = 0;
     man->hashfunc = hashfunc;
     man->subtables = calloc(cdd_levelcnt, sizeof(SubTable*));
+
+    // The sentinel is taken from a first chunk outside the limits
+    cdd_alloc_chunk(man);
+    if (man->free == NULL) {
+        free(man->subtables);
+        free(man);
+        return NULL;
+    }
     man->sentinel = cdd_alloc_node(man);
     memset(man->sentinel, 0, size);
 
@@ -389,6 +1036,7 @@ static void cdd_dealloc_nodemanager(NodeManager* man)
         }
 
         /* Free node manager */
+        free(man->nursery);
         free(man->subtables);
         free(man);
     }
@@ -401,6 +1049,11 @@ static void cdd_alloc_chunk(NodeManager* man)
     int32_t nodes = (CHUNKSIZE - sizeof(Chunk)) / man->nodesize;
     Chunk* chunk = cdd_allocate_chunk_from_os();
 
+    if (chunk == NULL) {
+        cdd_error(CDD_MEMORY);
+        return;
+    }
+
     // Add node to chunk chain
     chunk->man = man;
     chunk->next = man->nodes;
@@ -418,12 +1071,103 @@ static void cdd_alloc_chunk(NodeManager* man)
     man->freecnt += nodes;
     man->chunkcnt++;
     man->alloccnt += nodes;
-    cdd_chunkcnt++;
+    cdd_counter_add(cdd_chunkcnt, 1);
+    cdd_counter_add(cdd_nodecnt, nodes);
+}
+
+/**
+ * Releases the chunks of \a man in which all nodes are free, as long
+ * as at least \a keep free nodes remain.
+ * @return the number of bytes released
+ */
+static int64_t cdd_trim_nodemanager(NodeManager* man, int32_t keep)
+{
+    int32_t nodes = (CHUNKSIZE - sizeof(Chunk)) / man->nodesize;
+    int32_t released = 0;
+    Chunk *chunk, **c;
+    ddNode *node, **p;
+
+    if (man->freecnt - nodes < keep) {
+        return 0;
+    }
+
+    // Count the free nodes of each chunk
+    for (chunk = man->nodes; chunk != NULL; chunk = chunk->next) {
+        chunk->freecnt = 0;
+    }
+    for (node = man->free; node != NULL; node = node->next) {
+        cdd_node2chunk(node)->freecnt++;
+    }
+
+    // Only chunks to release keep a non-zero count
+    for (chunk = man->nodes; chunk != NULL; chunk = chunk->next) {
+        if (chunk->freecnt == nodes && man->freecnt - (released + 1) * nodes >= keep) {
+            released++;
+        } else {
+            chunk->freecnt = 0;
+        }
+    }
+    if (released == 0) {
+        return 0;
+    }
+
+    // Unlink their nodes from the free list
+    p = &man->free;
+    for (node = man->free; node != NULL; node = node->next) {
+        if (cdd_node2chunk(node)->freecnt == 0) {
+            *p = node;
+            p = &node->next;
+        }
+    }
+    *p = NULL;
+
+    // The caches may point into the released chunks, which can be
+    // reused by other node managers or unmapped. Their nodes are free,
+    // so this drops those entries and keeps the ones of live nodes.
+    cdd_operator_flush();
+
+    c = &man->nodes;
+    while ((chunk = *c) != NULL) {
+        if (chunk->freecnt != 0) {
+            *c = chunk->next;
+            cdd_deallocate_chunk_to_os(chunk);
+        } else {
+            c = &chunk->next;
+        }
+    }
+
+    man->freecnt -= released * nodes;
+    man->alloccnt -= released * nodes;
+    man->chunkcnt -= released;
+    cdd_chunkcnt -= released;
+    cdd_nodecnt -= released * nodes;
+
+    return (int64_t)released * CHUNKSIZE;
+}
+
+int64_t cdd_trim()
+{
+    int64_t bytes;
+    int32_t i;
+
+    // Nodes may be in use by other threads
+    if (cdd_shared) {
+        return 0;
+    }
+
+    bytes = cdd_trim_nodemanager(bddmanager, 0);
+    for (i = 2; i <= cdd_maxcddused; i++) {
+        if (cddmanager[i]) {
+            bytes += cdd_trim_nodemanager(cddmanager[i], 0);
+        }
+    }
+    return bytes;
 }
 
 static uint32_t cdd_hash_func(NodeManager* man, ddNode* node)
 {
-    return cddHash(cdd_node(node)->elem, (man->nodesize - sizeof(cddNode)) / sizeof(Elem));
+    (void)man;
+    return cdd_node(node)->hash;
 }
 
 static uint32_t bdd_hash_func(NodeManager* man, ddNode* node)
@@ -431,99 +1175,180 @@ static uint32_t bdd_hash_func(NodeManager* man, ddNode* node)
     return bddHash(bdd_node(node)->low, bdd_node(node)->high);
 }
 
+/** Increments the counter \a ref, returning the old value. */
+static inline uint32_t cdd_count_inc(uint32_t* ref)
+{
+    uint32_t old;
+    if (cdd_shared) {
+        old = cdd_atomic_satinc(ref);
+    } else {
+        old = *ref;
+        cdd_satinc(*ref);
+    }
+    if (old == MAXREF - 1) {
+        cdd_saturate();
+    }
+    return old;
+}
+
+/** Decrements the counter \a ref unless zero, returning the old value. */
+static inline uint32_t cdd_count_dec(uint32_t* ref)
+{
+    uint32_t old;
+    if (cdd_shared) {
+        return cdd_atomic_satdec(ref);
+    }
+    old = *ref;
+    if (old != 0) {
+        cdd_satdec(*ref);
+    }
+    return old;
+}
+
+void cdd_saturate() { cdd_counter_add(cdd_current->saturated, 1); }
+
 void cdd_rec_deref(ddNode* node)
+{
+    uint32_t old = cdd_count_dec(&cdd_rglr(node)->ref);
+    if (old == 0) {
+        cdd_error(CDD_DEREF);
+    } else if (old == 1) {
+        cdd_release(node);
+    }
+}
+
+void cdd_release(ddNode* node)
 {
     cdd_iterator it;
-    ddNode** top = (ddNode**)cdd_refstacktop;
-    *(top++) = cdd_rglr(node);
+    NodeManager* man;
+    uint32_t old;
+    ddNode** stack = cdd_nodestack_reserve(0, 1);
+    size_t top = 0;
+    stack[top++] = cdd_rglr(node);
 
     do {
-        node = cdd_rglr(*(--top));
-        if (node->ref == 0) {
-            cdd_error(CDD_DEREF);
-            return;
+        node = cdd_rglr(stack[--top]);
+        man = cdd_node2chunk(node)->man;
+        cdd_counter_add(man->usedcnt, -1);
+        cdd_counter_add(man->deadcnt, 1);
+        cdd_counter_add(man->subtables[node->level]->deadcnt, 1);
+        switch (cdd_info(node)->type) {
+        case TYPE_BDD:
+            stack = cdd_nodestack_reserve(top, 2);
+            stack[top++] = bdd_node_low(node);
+            stack[top++] = bdd_node_high(node);
+            break;
+        case TYPE_CDD:
+            stack = cdd_nodestack_reserve(top, cdd_maxcddsize);
+            cdd_it_init(it, node);
+            while (!cdd_it_atend(it)) {
+                stack[top++] = cdd_it_child(it);
+                cdd_it_next(it);
+            }
         }
-        cdd_deref(node);
-        if (node->ref == 0) {
-            cdd_node2chunk(node)->man->usedcnt--;
-            cdd_node2chunk(node)->man->deadcnt++;
-            cdd_node2chunk(node)->man->subtables[node->level]->deadcnt++;
-            switch (cdd_info(node)->type) {
-            case TYPE_BDD:
-                *(top++) = bdd_node(node)->low;
-                *(top++) = bdd_node(node)->high;
+
+        // Keep the children which still are referenced
+        while (top > 0) {
+            old = cdd_count_dec(&cdd_rglr(stack[top - 1])->ref);
+            if (old == 0) {
+                cdd_error(CDD_DEREF);
+                return;
+            }
+            if (old == 1) {
                 break;
-            case TYPE_CDD:
-                cdd_it_init(it, node);
-                while (!cdd_it_atend(it)) {
-                    *(top++) = cdd_it_child(it);
-                    cdd_it_next(it);
-                }
             }
+            top--;
         }
-    } while (top > (ddNode**)cdd_refstacktop);
+    } while (top > 0);
 }
 
 void cdd_reclaim(ddNode* node)
+{
+    // In a shared manager nodes are revived when referenced
+    if (!cdd_shared) {
+        cdd_revive(node);
+    }
+}
+
+void cdd_revive(ddNode* node)
 {
     cdd_iterator it;
-    ddNode** top = (ddNode**)cdd_refstacktop;
-    *(top++) = cdd_rglr(node);
+    NodeManager* man;
+    ddNode** stack = cdd_nodestack_reserve(0, 1);
+    size_t top = 0;
+    stack[top++] = cdd_rglr(node);
 
     do {
-        node = cdd_rglr(*(--top));
-        cdd_node2chunk(node)->man->usedcnt++;
-        cdd_node2chunk(node)->man->deadcnt--;
-        cdd_node2chunk(node)->man->subtables[node->level]->deadcnt--;
+        node = cdd_rglr(stack[--top]);
+        man = cdd_node2chunk(node)->man;
+        cdd_counter_add(man->usedcnt, 1);
+        cdd_counter_add(man->deadcnt, -1);
+        cdd_counter_add(man->subtables[node->level]->deadcnt, -1);
         switch (cdd_info(node)->type) {
         case TYPE_CDD:
+            stack = cdd_nodestack_reserve(top, cdd_maxcddsize);
             cdd_it_init(it, node);
             while (!cdd_it_atend(it)) {
-                if (cdd_rglr(cdd_it_child(it))->ref == 0)
-                    *(top++) = cdd_it_child(it);
-                cdd_ref(cdd_it_child(it));
+                if (cdd_count_inc(&cdd_rglr(cdd_it_child(it))->ref) == 0) {
+                    stack[top++] = cdd_it_child(it);
+                }
                 cdd_it_next(it);
             }
             break;
         case TYPE_BDD:
-            if (cdd_rglr(bdd_node(node)->low)->ref == 0) {
-                *(top++) = bdd_node(node)->low;
+            stack = cdd_nodestack_reserve(top, 2);
+            if (cdd_count_inc(&cdd_rglr(bdd_node_low(node))->ref) == 0) {
+                stack[top++] = bdd_node_low(node);
             }
-            if (cdd_rglr(bdd_node(node)->high)->ref == 0) {
-                *(top++) = bdd_node(node)->high;
+            if (cdd_count_inc(&cdd_rglr(bdd_node_high(node))->ref) == 0) {
+                stack[top++] = bdd_node_high(node);
             }
-            cdd_ref(bdd_node(node)->low);
-            cdd_ref(bdd_node(node)->high);
         }
-    } while (top > (ddNode**)cdd_refstacktop);
+    } while (top > 0);
 }
 
-static void cdd_gbc_nodemanager(NodeManager* man)
+/**
+ * Starts a new GC epoch. Cache entries of earlier epochs are checked
+ * against the stamps of the nodes they point to, see cdd_survived().
+ */
+static void cdd_next_epoch() { cdd_epoch++; }
+
+/**
+ * Frees the dead nodes of \a man and returns the memory beyond what
+ * the used nodes are likely to need. Every subtable is swept, as the
+ * dead counters are only an estimate. The surviving nodes are stamped
+ * with the current epoch, see cdd_gbc_full().
+ * @return the number of bytes released
+ */
+static int64_t cdd_sweep_nodemanager(NodeManager* man)
 {
     SubTable* tbl;
     ddNode *node, *next, **p;
     int64_t clk = clock();
+    int64_t freedbytes;
     int32_t i;
     int32_t j;
-
-    if (pregbc_handler != NULL) {
-        pregbc_handler();
-    }
+    int32_t freed, total = 0;
 
     for (i = 0; i < cdd_levelcnt; i++) {
         tbl = man->subtables[i];
-        if (tbl == NULL || tbl->deadcnt == 0) {
+        if (tbl == NULL) {
             continue;
         }
+        cdd_rehash_step(man, tbl, INT32_MAX);
+        freed = 0;
         for (j = 0; j < tbl->buckets; j++) {
             p = &(tbl->hash[j]);
             node = *p;
             while (node != man->sentinel) {
                 next = node->next;
                 if (node->ref == 0) {
+                    node->epoch = cdd_epoch;
                     node->next = man->free;
                     man->free = node;
+                    freed++;
                 } else {
+                    node->epoch = cdd_epoch;
                     *p = node;
                     p = &node->next;
                 }
@@ -531,27 +1356,78 @@ static void cdd_gbc_nodemanager(NodeManager* man)
             }
             *p = man->sentinel;
         }
-        tbl->keys -= tbl->deadcnt;
+        tbl->keys -= freed;
         tbl->deadcnt = 0;
+        total += freed;
     }
 
-    clk = clock() - clk;
-
-    man->freecnt += man->deadcnt;
+    // Count the nodes actually freed; the dead counters are only an
+    // estimate for nodes which were never referenced
+    man->freecnt += total;
     man->deadcnt = 0;
+    man->usedcnt = man->alloccnt - man->freecnt;
     man->gbccnt++;
-    man->gbcclock += clk;
 
+    // The surviving nodes are old, so the nursery is complete again
+    man->youngcnt = 0;
+
+    // Return memory beyond what the used nodes are likely to need
+    freedbytes = cdd_trim_nodemanager(man, (int32_t)((int64_t)TRIMKEEP * man->usedcnt / 100));
+
+    man->gbcclock += clock() - clk;
+    return freedbytes;
+}
+
+/**
+ * Full garbage collection: frees the dead nodes of all node managers.
+ * A dead node may be revived by a structural match in the unique
+ * table, after which cached pointers to it are valid again. It must
+ * therefore not outlive its children, which may belong to other node
+ * managers, so all node managers are collected together. The cache
+ * entries which are still valid and the surviving nodes are moved to
+ * the new epoch, so that they keep matching however old they are.
+ */
+static void cdd_gbc_full()
+{
+    int64_t clk = clock();
+    int64_t freedbytes;
+    int32_t i;
+
+    if (pregbc_handler != NULL) {
+        pregbc_handler();
+    }
+
+    cdd_next_epoch();
+    cdd_operator_rebase();
+    cdd_epochbase = cdd_epoch;
+
+    freedbytes = cdd_sweep_nodemanager(bddmanager);
+    for (i = 2; i <= cdd_maxcddused; i++) {
+        if (cddmanager[i]) {
+            freedbytes += cdd_sweep_nodemanager(cddmanager[i]);
+        }
+    }
+
+    clk = clock() - clk;
     cdd_gbcclock += clk;
     cdd_gbccnt++;
 
     if (postgbc_handler != NULL) {
         CddGbcStat s;
-        s.nodes = man->alloccnt;
-        s.freenodes = man->freecnt;
+        s.nodes = bddmanager->alloccnt;
+        s.freenodes = bddmanager->freecnt;
+        for (i = 2; i <= cdd_maxcddused; i++) {
+            if (cddmanager[i]) {
+                s.nodes += cddmanager[i]->alloccnt;
+                s.freenodes += cddmanager[i]->freecnt;
+            }
+        }
         s.time = clk;
         s.sumtime = cdd_gbcclock;
         s.num = cdd_gbccnt;
+        s.saturated = cdd_getsaturated();
+        s.freedbytes = freedbytes;
+        s.young = 0;
         postgbc_handler(&s);
     }
 }
@@ -559,43 +1435,272 @@ static void cdd_gbc_nodemanager(NodeManager* man)
 void cdd_gbc()
 {
     int32_t i;
-    int64_t clk = clock();
 
-    cdd_operator_flush();
+    // Nodes may be in use by other threads
+    if (cdd_shared) {
+        return;
+    }
 
-    cdd_gbcclock += clock() - clk;
+    // Reordering collects the garbage as well
+    if (cdd_reorderlimit > 0 && bddmanager->usedcnt > cdd_reorderlimit) {
+        cdd_reorder();
+        return;
+    }
 
-    // Check BDD manager
+    // Collect if any node manager is short of free nodes
     if (THRESHOLD * bddmanager->alloccnt >= 100 * bddmanager->freecnt &&
-        MINFREE * bddmanager->alloccnt < 100 * bddmanager->deadcnt) {
-        cdd_gbc_nodemanager(bddmanager);
+        cdd_minfree * bddmanager->alloccnt < 100 * bddmanager->deadcnt) {
+        cdd_gbc_full();
+        return;
     }
-
-    // Check CDD managers
     for (i = 2; i <= cdd_maxcddused; i++) {
         if (cddmanager[i] && THRESHOLD * cddmanager[i]->alloccnt >= 100 * cddmanager[i]->freecnt &&
-            MINFREE * cddmanager[i]->alloccnt < 100 * cddmanager[i]->deadcnt) {
-            cdd_gbc_nodemanager(cddmanager[i]);
+            cdd_minfree * cddmanager[i]->alloccnt < 100 * cddmanager[i]->deadcnt) {
+            cdd_gbc_full();
+            return;
         }
     }
 }
 
+/**
+ * Frees the dead nodes in the nursery of \a man. The nodes are
+ * unlinked from their hash chains, where they are near the head as
+ * nodes are added at the front.
+ * @return the number of nodes freed
+ */
+static int32_t cdd_collect_young(NodeManager* man)
+{
+    SubTable* tbl;
+    ddNode *node, **p;
+    int32_t i, freed = 0;
+
+    for (i = 0; i < man->youngcnt; i++) {
+        node = man->nursery[i];
+        if (node->ref != 0) {
+            continue;
+        }
+        tbl = man->subtables[node->level];
+        p = cdd_bucket(tbl, man->hashfunc(man, node));
+        while (*p != node) {
+            p = &(*p)->next;
+        }
+        *p = node->next;
+        node->epoch = cdd_epoch;
+        node->next = man->free;
+        man->free = node;
+        tbl->keys--;
+        if (tbl->deadcnt > 0) {
+            tbl->deadcnt--;
+        }
+        freed++;
+    }
+
+    // As for a full collection the dead counter is only an estimate
+    man->freecnt += freed;
+    man->deadcnt = man->deadcnt > freed ? man->deadcnt - freed : 0;
+    man->usedcnt = man->alloccnt - man->freecnt - man->deadcnt;
+    man->youngcnt = 0;
+    return freed;
+}
+
+/**
+ * Minor garbage collection: frees the dead nodes allocated since the
+ * last collection in all node managers, without sweeping the hash
+ * tables. Since the children of a node are older than the node
+ * itself, a dead young node can only be referenced by other young
+ * nodes, which are collected at the same time. This requires every
+ * young node to be recorded, so nothing is done if a nursery has
+ * overflowed or nodes were allocated while the manager was shared;
+ * the next full collection of that node manager makes it complete
+ * again. A full collection runs instead if the epochs since the last
+ * one would reach \c CDD_EPOCHS.
+ * @return the number of nodes freed, or -1 if no minor collection was
+ *         done
+ */
+static int32_t cdd_gbc_young()
+{
+    int64_t clk = clock();
+    int32_t i, young, freed;
+
+    if (cdd_epoch - cdd_epochbase >= CDD_EPOCHS - 1) {
+        cdd_gbc_full();
+        return -1;
+    }
+
+    if ((young = bddmanager->youngcnt) < 0) {
+        return -1;
+    }
+    for (i = 2; i <= cdd_maxcddused; i++) {
+        if (cddmanager[i]) {
+            if (cddmanager[i]->youngcnt < 0) {
+                return -1;
+            }
+            young += cddmanager[i]->youngcnt;
+        }
+    }
+
+    if (pregbc_handler != NULL) {
+        pregbc_handler();
+    }
+
+    cdd_next_epoch();
+
+    freed = cdd_collect_young(bddmanager);
+    for (i = 2; i <= cdd_maxcddused; i++) {
+        if (cddmanager[i]) {
+            freed += cdd_collect_young(cddmanager[i]);
+        }
+    }
+
+    clk = clock() - clk;
+    cdd_gbcclock += clk;
+    cdd_gbccnt++;
+
+    if (postgbc_handler != NULL) {
+        CddGbcStat s;
+        s.nodes = bddmanager->alloccnt;
+        s.freenodes = bddmanager->freecnt;
+        for (i = 2; i <= cdd_maxcddused; i++) {
+            if (cddmanager[i]) {
+                s.nodes += cddmanager[i]->alloccnt;
+                s.freenodes += cddmanager[i]->freecnt;
+            }
+        }
+        s.time = clk;
+        s.sumtime = cdd_gbcclock;
+        s.num = cdd_gbccnt;
+        s.saturated = cdd_getsaturated();
+        s.freedbytes = 0;
+        s.young = young;
+        postgbc_handler(&s);
+    }
+    return freed;
+}
+
+/**
+ * Empties the nurseries of all node managers without collecting them,
+ * leaving their nodes to full collections. The nurseries are complete
+ * again, as every node allocated from now on is recorded and its
+ * children are older than it; this must be done for all node managers
+ * at once, as the children may belong to other ones.
+ */
+static void cdd_age_young()
+{
+    int32_t i;
+
+    bddmanager->youngcnt = 0;
+    for (i = 2; i <= cdd_maxcddused; i++) {
+        if (cddmanager[i]) {
+            cddmanager[i]->youngcnt = 0;
+        }
+    }
+}
+
+/**
+ * Returns the error to raise if another chunk for \a man would exceed
+ * the limits on nodes or memory, and 0 otherwise.
+ */
+static int32_t cdd_over_budget(NodeManager* man)
+{
+    int32_t nodes = (CHUNKSIZE - sizeof(Chunk)) / man->nodesize;
+
+    if (cdd_maxnodenum > 0 && cdd_nodecnt + nodes > cdd_maxnodenum) {
+        return CDD_NODENUM;
+    }
+    if (cdd_membudget > 0 &&
+        (int64_t)(cdd_chunkcnt + 1) * CHUNKSIZE + (int64_t)cdd_operator_memory() > cdd_membudget) {
+        return CDD_MEMORY;
+    }
+    return 0;
+}
+
+/**
+ * Collects all node managers with dead nodes and returns all free
+ * chunks to stay within the limits. If \a man still has no free nodes
+ * the limit is reported in \c cdd_errorcond; operations then back off
+ * until the error is cleared, for which at most \c BACKOFF more bytes
+ * of chunks are allocated.
+ */
+static void cdd_gbc_budget(NodeManager* man)
+{
+    int32_t err;
+
+    cdd_gbc_full();
+    cdd_trim();
+
+    if (man->free != NULL || (err = cdd_over_budget(man)) == 0) {
+        return;
+    }
+    if (cdd_errorcond == 0) {
+        cdd_errorcond = cdd_error(err);
+    }
+    cdd_backoffcnt = cdd_chunkcnt + (BACKOFF + CHUNKSIZE - 1) / CHUNKSIZE;
+}
+
+/**
+ * Allocates a node of \a man.
+ * @return the node, or NULL once the chunks for backing off a limit
+ *         are used up or none can be allocated, in which case the
+ *         error is stored in \c cdd_errorcond
+ */
+
 static ddNode* cdd_alloc_node(NodeManager* man)
 {
     ddNode* node;
 
+    // Never collect garbage while other threads hold nodes
+    if (cdd_shared) {
+        cdd_lock(&man->lock);
+        man->youngcnt = -1;
+        if (man->free == NULL) {
+            cdd_alloc_chunk(man);
+        }
+        if ((node = man->free) == NULL) {
+            cdd_unlock(&man->lock);
+            if (cdd_errorcond == 0) {
+                cdd_errorcond = CDD_MEMORY;
+            }
+            return NULL;
+        }
+        man->free = node->next;
+        man->freecnt--;
+        cdd_unlock(&man->lock);
+        cdd_counter_add(man->usedcnt, 1);
+        node->flag = 0;
+        node->epoch = cdd_epoch;
+        return node;
+    }
+
+    // Short-lived nodes are collected without a full sweep when free
+    // nodes run short; a nursery filling up before is only emptied
+    if (man->youngcnt > 0 && (man->youngcnt == cdd_nurserysize || man->free == NULL)) {
+        if ((man->free != NULL && THRESHOLD * man->alloccnt < 100 * man->freecnt) || cdd_gbc_young() < 0) {
+            cdd_age_young();
+        }
+    }
+
     // Free nodes left?
     if (man->free == NULL) {
-        if (MINFREE * man->alloccnt < 100 * man->deadcnt) {
+        if (cdd_minfree * man->alloccnt < 100 * man->deadcnt) {
 #ifdef JIT_GBC
-            cdd_operator_flush();
-            cdd_gbc_nodemanager(man);
+            cdd_gbc_full();
 #else
             cdd_gbc();
 #endif
-        } else {
+        }
+        // Once the limit is reported a few chunks are allocated for backing off
+        if (man->free == NULL && cdd_backoffcnt == 0 && cdd_over_budget(man)) {
+            cdd_gbc_budget(man);
+        }
+        if (man->free == NULL && (cdd_backoffcnt == 0 || cdd_chunkcnt < cdd_backoffcnt)) {
             cdd_alloc_chunk(man);
         }
+        if (man->free == NULL) {
+            if (cdd_errorcond == 0) {
+                cdd_errorcond = CDD_MEMORY;
+            }
+            return NULL;
+        }
     }
 
     // Get node from free list
@@ -606,14 +1711,82 @@ static ddNode* cdd_alloc_node(NodeManager* man)
     man->usedcnt++;
     man->freecnt--;
 
+    node->flag = 0;
+    node->epoch = cdd_epoch;
     return node;
 }
 
+static void cdd_free_node(NodeManager* man, ddNode* node)
+{
+    cdd_lock(&man->lock);
+    node->next = man->free;
+    man->free = node;
+    man->freecnt++;
+    cdd_unlock(&man->lock);
+    cdd_counter_add(man->usedcnt, -1);
+}
+
+/**
+ * Inserts \a node at the head of the hash chain \a p, which was read
+ * as \a head. A shared table is updated with a compare-and-swap.
+ * @return false if the chain has changed, in which case \a head is
+ *         updated to the new head of the chain
+ */
+static inline int32_t cdd_insert_node(ddNode** p, ddNode** head, ddNode* node)
+{
+    node->next = *head;
+    if (cdd_shared) {
+        return __atomic_compare_exchange_n(p, head, node, 0, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE);
+    }
+    *p = node;
+    return 1;
+}
+
+/**
+ * Accounts for a new \a node in \a tbl. In a shared manager the node
+ * is born dead: its children are referenced when it is, see \c
+ * cdd_refinc(). Otherwise the node is recorded in the nursery and the
+ * table is rehashed when it is full.
+ */
+static void cdd_add_node(NodeManager* man, SubTable* tbl, ddNode* node)
+{
+    if (cdd_shared) {
+        cdd_counter_add(man->usedcnt, -1);
+        cdd_counter_add(man->deadcnt, 1);
+        cdd_counter_add(tbl->deadcnt, 1);
+        cdd_counter_add(tbl->keys, 1);
+        return;
+    }
+
+    if (man->youngcnt >= 0) {
+        if (man->nursery == NULL && cdd_nurserysize > 0) {
+            man->nursery = (ddNode**)malloc(cdd_nurserysize * sizeof(ddNode*));
+        }
+        if (man->nursery != NULL && man->youngcnt < cdd_nurserysize) {
+            man->nursery[man->youngcnt++] = node;
+        } else {
+            man->youngcnt = -1;
+        }
+    }
+
+    // Check whether max keys has been reached
+    tbl->keys++;
+    if (tbl->oldhash) {
+        cdd_rehash_step(man, tbl, REHASH_STEP);
+    }
+    while (tbl->keys > tbl->maxkeys) {
+        cdd_rehash(man, tbl);
+    }
+}
+
 ddNode* cdd_make_bdd_node(int32_t level, ddNode* low, ddNode* high)
 {
-    bddNode* node;
-    bddNode** p;
-    int32_t bucket, cnt, mask;
+    bddNode* node = NULL;
+    bddNode *p, *head, *stop;
+    ddNode** bucket;
+    ddHandle lowh, highh;
+    int32_t cnt, mask;
+    uint32_t hash;
     SubTable* tbl;
 
     // Eliminate redundant nodes
@@ -625,74 +1798,110 @@ ddNode* cdd_make_bdd_node(int32_t level, ddNode* low, ddNode* high)
     mask = cdd_mask(low);
     low = cdd_rglr(low);
     high = cdd_neg_cond(high, mask);
+    lowh = cdd_tohandle(low);
+    highh = cdd_tohandle(high);
 
     // Find sub table
-    tbl = bddmanager->subtables[level];
+    tbl = __atomic_load_n(&bddmanager->subtables[level], __ATOMIC_ACQUIRE);
     if (tbl == NULL) {
         tbl = cdd_alloc_subtable(bddmanager, level);
     }
 
-    // Look for existing node
-    bucket = bddHash(low, high) >> tbl->shift;
-    p = (bddNode**)&(tbl->hash[bucket]);
-    while (low < (*p)->low) {
-        p = (bddNode**)&((*p)->next);
-    }
-    while (low == (*p)->low && high < (*p)->high) {
-        p = (bddNode**)&((*p)->next);
-    }
-    if (low == (*p)->low && high == (*p)->high) {
-        if ((*p)->ref == 0) {
-            cdd_reclaim((ddNode*)*p);
-        }
-        return cdd_neg_cond((ddNode*)*p, mask);
-    }
+    hash = bddHash(lowh, highh);
+    bucket = cdd_bucket(tbl, hash);
+    head = (bddNode*)__atomic_load_n(bucket, __ATOMIC_ACQUIRE);
+    stop = (bddNode*)bddmanager->sentinel;
 
-    // Increment references
-    cdd_ref(low);
-    cdd_ref(high);
+    for (;;) {
+        // Look for existing node among those added since the last scan
+        for (p = head; p != stop; p = (bddNode*)p->next) {
+            if (p->low == lowh && p->high == highh) {
+                break;
+            }
+        }
+        if (p != stop) {
+            break;
+        }
 
-    // Create new node
-    cnt = cdd_gbccnt;
-    node = (bddNode*)cdd_alloc_node(bddmanager);
+        if (node == NULL) {
+            // Increment references
+            if (!cdd_shared) {
+                cdd_ref(low);
+                cdd_ref(high);
+            }
 
-    // If garbage collection has occured we need to recalc node pos
-    if (cnt != cdd_gbccnt) {
-        p = (bddNode**)&(tbl->hash[bucket]);
-        while (low < (*p)->low) {
-            p = (bddNode**)&((*p)->next);
+            // Create new node
+            cnt = cdd_gbccnt;
+            node = (bddNode*)cdd_alloc_node(bddmanager);
+            if (node == NULL) {
+                if (!cdd_shared) {
+                    cdd_deref(low);
+                    cdd_deref(high);
+                }
+                return cddfalse;
+            }
+            node->ref = 0;
+            node->level = level;
+            node->low = lowh;
+            node->high = highh;
+
+            // If garbage collection has occured we need to reload the chain
+            if (cnt != cdd_gbccnt) {
+                bucket = cdd_bucket(tbl, hash);
+                head = (bddNode*)*bucket;
+            }
         }
-        while (low == (*p)->low && high < (*p)->high) {
-            p = (bddNode**)&((*p)->next);
+
+        // Add node to hash chain
+        if (cdd_insert_node(bucket, (ddNode**)&head, (ddNode*)node)) {
+            cdd_add_node(bddmanager, tbl, (ddNode*)node);
+            return cdd_neg_cond((ddNode*)node, mask);
         }
+        stop = (bddNode*)node->next;
     }
 
-    // Add node to hash chain
-    node->next = (ddNode*)*p;
-    *p = node;
+    // Another thread added the node first
+    if (node != NULL) {
+        cdd_free_node(bddmanager, (ddNode*)node);
+    } else if (!cdd_shared && p->ref == 0) {
+        cdd_reclaim((ddNode*)p);
+    }
+    return cdd_neg_cond((ddNode*)p, mask);
+}
 
-    // Initialise node
-    node->ref = 0;
-    node->level = level;
-    node->low = low;
-    node->high = high;
+static NodeManager* cdd_alloc_cddmanager(int32_t len)
+{
+    NodeManager* other = NULL;
+    NodeManager* man = cdd_alloc_nodemanager(sizeof(cddNode) + sizeof(Elem) * len, cdd_hash_func);
+    int32_t used;
 
-    // Check whether max keys has been reached
-    tbl->keys++;
-    if (tbl->keys > tbl->maxkeys) {
-        cdd_rehash(bddmanager, tbl);
+    if (man == NULL) {
+        return NULL;
     }
-
-    return cdd_neg_cond((ddNode*)node, mask);
+    if (!cdd_shared) {
+        cddmanager[len] = man;
+    } else if (!__atomic_compare_exchange_n(&cddmanager[len], &other, man, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        // Another thread published a manager first
+        cdd_counter_add(cdd_chunkcnt, -man->chunkcnt);
+        cdd_counter_add(cdd_nodecnt, -man->alloccnt);
+        cdd_dealloc_nodemanager(man);
+        man = other;
+    }
+    used = __atomic_load_n(&cdd_maxcddused, __ATOMIC_RELAXED);
+    while (len > used &&
+           !__atomic_compare_exchange_n(&cdd_maxcddused, &used, len, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+    return man;
 }
 
 ddNode* cdd_make_cdd_node(int32_t level, Elem* elem, int32_t len)
 {
     SubTable* tbl;
     NodeManager* man;
-    int32_t bucket, i, size;
-    cddNode* node;
-    cddNode** p;
+    int32_t i;
+    uint32_t hash;
+    cddNode* node = NULL;
+    cddNode *p, *head, *stop;
+    ddNode** bucket;
 
     if (len > cdd_maxcddsize) {
         cdd_error(CDD_MAXSIZE);
@@ -701,69 +1910,84 @@ ddNode* cdd_make_cdd_node(int32_t level, Elem* elem, int32_t len)
 
     // Eliminate redundant nodes
     if (len == 1) {
-        return elem[0].child;
+        return cdd_elem_child(elem);
     }
 
     // Find manager and subtable
-    man = cddmanager[len];
-    if (man == NULL) {
-        size = sizeof(cddNode) + sizeof(Elem) * len;
-        man = cddmanager[len] = cdd_alloc_nodemanager(size, cdd_hash_func);
-        if (len > cdd_maxcddused) {
-            cdd_maxcddused = len;
+    man = __atomic_load_n(&cddmanager[len], __ATOMIC_ACQUIRE);
+    if (man == NULL && (man = cdd_alloc_cddmanager(len)) == NULL) {
+        if (cdd_errorcond == 0) {
+            cdd_errorcond = CDD_MEMORY;
         }
+        return cddfalse;
     }
-    tbl = man->subtables[level];
+    tbl = __atomic_load_n(&man->subtables[level], __ATOMIC_ACQUIRE);
     if (tbl == NULL) {
         tbl = cdd_alloc_subtable(man, level);
     }
 
-    // Look for existing node
-    bucket = cddHash(elem, len) >> tbl->shift;
-    p = (cddNode**)&(tbl->hash[bucket]);
-    while ((i = memcmp(elem, (*p)->elem, len * sizeof(Elem))) < 0) {
-        p = (cddNode**)&((*p)->next);
-    }
-    if (i == 0) {
-        if ((*p)->ref == 0) {
-            cdd_reclaim((ddNode*)*p);
+    hash = cddHash(elem, len);
+    bucket = cdd_bucket(tbl, hash);
+    head = (cddNode*)__atomic_load_n(bucket, __ATOMIC_ACQUIRE);
+    stop = (cddNode*)man->sentinel;
+
+    for (;;) {
+        // Look for existing node among those added since the last scan
+        for (p = head; p != stop; p = (cddNode*)p->next) {
+            if (cdd_elem_equal(elem, p->elem, len)) {
+                break;
+            }
+        }
+        if (p != stop) {
+            break;
         }
-        return (ddNode*)*p;
-    }
 
-    // Increment references
-    for (i = 0; i < len; i++) {
-        cdd_ref(elem[i].child);
-    }
+        if (node == NULL) {
+            // Increment references
+            if (!cdd_shared) {
+                for (i = 0; i < len; i++) {
+                    cdd_ref(cdd_elem_child(elem + i));
+                }
+            }
 
-    // Alloc node
-    i = cdd_gbccnt;
-    node = (cddNode*)cdd_alloc_node(man);
+            // Alloc node
+            i = cdd_gbccnt;
+            node = (cddNode*)cdd_alloc_node(man);
+            if (node == NULL) {
+                if (!cdd_shared) {
+                    for (i = 0; i < len; i++) {
+                        cdd_deref(cdd_elem_child(elem + i));
+                    }
+                }
+                return cddfalse;
+            }
+            node->level = level;
+            node->ref = 0;
+            node->hash = hash;
+            memcpy(node->elem, elem, sizeof(Elem) * len);
+
+            // If garbage collection has occured we need to reload the chain
+            if (i != cdd_gbccnt) {
+                bucket = cdd_bucket(tbl, hash);
+                head = (cddNode*)*bucket;
+            }
+        }
 
-    // If garbage collection has occured we need to recalc the node pos
-    if (i != cdd_gbccnt) {
-        p = (cddNode**)&(tbl->hash[bucket]);
-        while (memcmp(elem, (*p)->elem, len * sizeof(Elem)) < 0) {
-            p = (cddNode**)&((*p)->next);
+        // Add node to hash chain
+        if (cdd_insert_node(bucket, (ddNode**)&head, (ddNode*)node)) {
+            cdd_add_node(man, tbl, (ddNode*)node);
+            return (ddNode*)node;
         }
+        stop = (cddNode*)node->next;
     }
 
-    // Add node to hash chain
-    node->next = (ddNode*)*p;
-    *p = node;
-
-    // Initialise node
-    node->level = level;
-    node->ref = 0;
-    memcpy(node->elem, elem, sizeof(Elem) * len);
-
-    // Check whether max keys has been reached
-    tbl->keys++;
-    if (tbl->keys > tbl->maxkeys) {
-        cdd_rehash(man, tbl);
+    // Another thread added the node first
+    if (node != NULL) {
+        cdd_free_node(man, (ddNode*)node);
+    } else if (!cdd_shared && p->ref == 0) {
+        cdd_reclaim((ddNode*)p);
     }
-
-    return (ddNode*)node;
+    return (ddNode*)p;
 }
 
 void cdd_pregbc_hook(void (*func)(void)) { pregbc_handler = func; }
@@ -785,7 +2009,12 @@ int32_t cdd_versionnum() { return CDD_VERSION; }
 
 void cdd_default_gbhandler(CddGbcStat* s)
 {
-    fprintf(stderr, "Garbage collection #%d: %d nodes / %d free", s->num, s->nodes, s->freenodes);
+    if (s->young > 0) {
+        return;
+    }
+    fprintf(stderr, "Garbage collection #%d: ", s->num);
+    fprintf(stderr, "%d nodes / %d free / %d saturated / %lldKB released", s->nodes, s->freenodes, s->saturated,
+            (long long)(s->freedbytes >> 10));
     fprintf(stderr, " / %.1fs / %.1fs total\n", ((double)s->time) / CLOCKS_PER_SEC,
             ((double)s->sumtime) / CLOCKS_PER_SEC);
 }
@@ -796,44 +2025,36 @@ void cdd_default_rehashhandler(CddRehashStat* s)
             s->buckets, s->keys, s->max, ((double)s->time) / CLOCKS_PER_SEC, ((double)s->sumtime) / CLOCKS_PER_SEC);
 }
 
-/* Doubles the size of the hash table */
+/*
+ * Doubles the size of the hash table. Entry i of the old table is
+ * split into entries 2i and 2i+1 of the new one when it is migrated,
+ * so the new table is only written by cdd_rehash_step().
+ */
 static void cdd_rehash(NodeManager* man, SubTable* tbl)
 {
-    int32_t i, bucket;
-    int32_t oldsize;
-    ddNode **p, **q, *node, **oldhash;
+    ddNode** hash;
     int64_t clk = clock();
 
-    oldsize = tbl->buckets;
-    oldhash = tbl->hash;
+    // A table is resized at most once at a time
+    cdd_rehash_step(man, tbl, INT32_MAX);
+
+    if ((hash = (ddNode**)malloc(2 * tbl->buckets * sizeof(ddNode*))) == NULL) {
+        // Keep the table; chains just get longer
+        tbl->maxkeys = INT32_MAX;
+        return;
+    }
+    tbl->oldhash = tbl->hash;
+    tbl->migrated = 0;
+    tbl->hash = hash;
     tbl->buckets <<= 1;
     tbl->maxkeys <<= 1;
     tbl->shift -= 1;
-    tbl->hash = malloc(tbl->buckets * sizeof(ddNode*));
-
-    for (i = 0; i < oldsize; i++) {
-        p = &(tbl->hash[i << 1]);
-        q = p + 1;
-        for (node = oldhash[i]; node != man->sentinel; node = node->next) {
-            bucket = man->hashfunc(man, node) >> tbl->shift;
-            if (bucket & 0x1) {
-                *q = node;
-                q = &(node->next);
-            } else {
-                *p = node;
-                p = &(node->next);
-            }
-        }
-        *p = *q = man->sentinel;
-    }
-
-    free(oldhash);
 
     clk = clock() - clk;
     cdd_rehashclock += clk;
     cdd_rehashcnt++;
 
-    if (postgbc_handler != NULL) {
+    if (postrehash_handler != NULL) {
         CddRehashStat s;
         s.level = tbl->level;
         s.buckets = tbl->buckets;
@@ -846,38 +2067,80 @@ static void cdd_rehash(NodeManager* man, SubTable* tbl)
     }
 }
 
-ddNode* cdd_bddvar(int32_t level) { return cdd_make_bdd_node(level, cddfalse, cddtrue); }
+/*
+ * Migrates up to \a n entries of the old table of \a tbl. The nodes
+ * keep their order within each chain. The hash values are not
+ * recomputed: CDD nodes keep theirs and those of BDD nodes are cheap.
+ */
+static void cdd_rehash_step(NodeManager* man, SubTable* tbl, int32_t n)
+{
+    int32_t i;
+    int32_t oldsize = tbl->buckets >> 1;
+    ddNode **p, **q, *node;
+
+    if (tbl->oldhash == NULL) {
+        return;
+    }
+
+    for (i = tbl->migrated; i < oldsize && n > 0; i++, n--) {
+        p = &(tbl->hash[i << 1]);
+        q = p + 1;
+        for (node = tbl->oldhash[i]; node != man->sentinel; node = node->next) {
+            if ((man->hashfunc(man, node) >> tbl->shift) & 0x1) {
+                *q = node;
+                q = &(node->next);
+            } else {
+                *p = node;
+                p = &(node->next);
+            }
+        }
+        *p = *q = man->sentinel;
+    }
+    tbl->migrated = i;
+
+    if (i == oldsize) {
+        free(tbl->oldhash);
+        tbl->oldhash = NULL;
+        tbl->migrated = 0;
+    }
+}
+
+ddNode* cdd_bddvar(int32_t level) { return cdd_make_bdd_node(cdd_var2level[level], cddfalse, cddtrue); }
 
 ddNode* cdd_interval_from_level(int32_t level, raw_t low, raw_t high)
 {
-    Elem* top = cdd_refstacktop;
+    Elem* top = cdd_refstack_reserve(3);
+    Elem* first = cdd_refstacktop;
     if (low > -INF) {
         cdd_push(cddfalse, low);
         cdd_push(cddtrue, high);
         if (high < INF)
             cdd_push(cddfalse, INF);
         cdd_refstacktop = top;
-        return cdd_make_cdd_node(level, top, 2 + (high < INF));
+        return cdd_make_cdd_node(level, first, 2 + (high < INF));
     } else {
         cdd_push(cddfalse, high);
         cdd_push(cddtrue, INF);
         cdd_refstacktop = top;
-        return cdd_neg(cdd_make_cdd_node(level, top, 2));
+        return cdd_neg(cdd_make_cdd_node(level, first, 2));
     }
 }
 
 ddNode* cdd_upper_from_level(int32_t level, raw_t bnd)
 {
-    Elem* top = cdd_refstacktop;
+    Elem* top;
+    Elem* first;
     if (bnd == INF) {
         return cddtrue;
     } else if (bnd == -INF) {
         return cddfalse;
     }
+    top = cdd_refstack_reserve(2);
+    first = cdd_refstacktop;
     cdd_push(cddfalse, bnd);
     cdd_push(cddtrue, INF);
     cdd_refstacktop = top;
-    return cdd_neg(cdd_make_cdd_node(level, top, 2));
+    return cdd_neg(cdd_make_cdd_node(level, first, 2));
 }
 
 ddNode* cdd_interval(int32_t i, int32_t j, raw_t low, raw_t high)
@@ -909,7 +2172,7 @@ void cdd_mark(ddNode* node)
         for (cdd_it_init(it, node); !cdd_it_atend(it); cdd_it_next(it))
             cdd_mark(cdd_it_child(it));
         break;
-    case TYPE_BDD: cdd_mark(bdd_node(node)->low); cdd_mark(bdd_node(node)->high);
+    case TYPE_BDD: cdd_mark(bdd_node_low(node)); cdd_mark(bdd_node_high(node));
     }
 }
 
@@ -928,7 +2191,7 @@ void cdd_markcount(ddNode* node, int32_t* cnt)
         for (cdd_it_init(it, node); !cdd_it_atend(it); cdd_it_next(it))
             cdd_markcount(cdd_it_child(it), cnt);
         break;
-    case TYPE_BDD: cdd_markcount(bdd_node(node)->low, cnt); cdd_markcount(bdd_node(node)->high, cnt);
+    case TYPE_BDD: cdd_markcount(bdd_node_low(node), cnt); cdd_markcount(bdd_node_high(node), cnt);
     }
 }
 
@@ -950,8 +2213,8 @@ void cdd_markedgecount(ddNode* node, int32_t* cnt)
         break;
     case TYPE_BDD:
         (*cnt) += 2;
-        cdd_markedgecount(bdd_node(node)->low, cnt);
-        cdd_markedgecount(bdd_node(node)->high, cnt);
+        cdd_markedgecount(bdd_node_low(node), cnt);
+        cdd_markedgecount(bdd_node_high(node), cnt);
     }
 }
 
@@ -975,7 +2238,7 @@ void cdd_unmark(ddNode* node)
         for (cdd_it_init(it, node); !cdd_it_atend(it); cdd_it_next(it))
             cdd_unmark(cdd_it_child(it));
         break;
-    case TYPE_BDD: cdd_unmark(bdd_node(node)->low); cdd_unmark(bdd_node(node)->high);
+    case TYPE_BDD: cdd_unmark(bdd_node_low(node)); cdd_unmark(bdd_node_high(node));
     }
 }
 
@@ -1001,7 +2264,7 @@ void cdd_force_unmark(ddNode* node)
         for (cdd_it_init(it, node); !cdd_it_atend(it); cdd_it_next(it))
             cdd_force_unmark(cdd_it_child(it));
         break;
-    case TYPE_BDD: cdd_force_unmark(bdd_node(node)->low); cdd_force_unmark(bdd_node(node)->high);
+    case TYPE_BDD: cdd_force_unmark(bdd_node_low(node)); cdd_force_unmark(bdd_node_high(node));
     }
 }
 
@@ -1034,6 +2297,14 @@ static void add_levels(int32_t n)
             add_levels_to_nodemanager(cddmanager[i], n);
         }
     }
+
+    // New levels are placed below the levels in use
+    cdd_level2var = realloc(cdd_level2var, (cdd_levelcnt + n) * sizeof(int32_t));
+    cdd_var2level = realloc(cdd_var2level, (cdd_levelcnt + n) * sizeof(int32_t));
+    for (i = cdd_levelcnt; i < cdd_levelcnt + n; i++) {
+        cdd_level2var[i] = i;
+        cdd_var2level[i] = i;
+    }
 }
 
 void cdd_add_clocks(int32_t n)
@@ -1065,6 +2336,92 @@ void cdd_add_clocks(int32_t n)
 
 int32_t cdd_getclocks() { return cdd_clocknum; }
 
+int32_t cdd_setmaxnodenum(int32_t size)
+{
+    int32_t old = cdd_maxnodenum;
+    if (size < 0) {
+        return cdd_error(CDD_RANGE);
+    }
+    cdd_maxnodenum = size;
+    return old;
+}
+
+int32_t cdd_setminfreenodes(int32_t mf)
+{
+    int32_t old = cdd_minfree;
+    if (mf < 0 || mf > 100) {
+        return cdd_error(CDD_RANGE);
+    }
+    cdd_minfree = mf;
+    return old;
+}
+
+/**
+ * Resizes the nursery of \a man to \a size nodes. The recorded nodes
+ * are kept if they fit, otherwise the nursery is incomplete until the
+ * next full collection.
+ */
+static void cdd_resize_nursery(NodeManager* man, int32_t size)
+{
+    ddNode** nursery;
+
+    if (man->youngcnt > size) {
+        man->youngcnt = -1;
+    }
+    if (man->youngcnt > 0) {
+        if ((nursery = (ddNode**)realloc(man->nursery, size * sizeof(ddNode*))) != NULL) {
+            man->nursery = nursery;
+            return;
+        }
+        man->youngcnt = -1;
+    }
+    free(man->nursery);
+    man->nursery = NULL;
+}
+
+int32_t cdd_setnurserysize(int32_t size)
+{
+    int32_t i, old = cdd_nurserysize;
+
+    if (size < 0) {
+        return cdd_error(CDD_RANGE);
+    }
+
+    cdd_nurserysize = size;
+    cdd_resize_nursery(bddmanager, size);
+    for (i = 2; i <= cdd_maxcddsize; i++) {
+        if (cddmanager[i]) {
+            cdd_resize_nursery(cddmanager[i], size);
+        }
+    }
+    return old;
+}
+
+int64_t cdd_setmemorybudget(int64_t bytes)
+{
+    int64_t old = cdd_membudget;
+    if (bytes < 0) {
+        return cdd_error(CDD_RANGE);
+    }
+    cdd_membudget = bytes;
+    if (bytes > 0) {
+        cdd_operator_budget(bytes);
+    }
+    return old;
+}
+
+int64_t cdd_getmemoryused() { return (int64_t)cdd_chunkcnt * CHUNKSIZE + (int64_t)cdd_operator_memory(); }
+
+int32_t cdd_clearerror()
+{
+    int32_t err = cdd_errorcond;
+    cdd_errorcond = 0;
+    cdd_backoffcnt = 0;
+    return err;
+}
+
+int32_t cdd_getsaturated() { return __atomic_load_n(&cdd_current->saturated, __ATOMIC_RELAXED); }
+
 int32_t cdd_add_bddvar(int32_t n)
 {
     int32_t offset = cdd_levelcnt;
@@ -1093,6 +2450,274 @@ int32_t cdd_get_level_count() { return cdd_levelcnt; }
 
 int32_t cdd_get_bdd_level_count() { return cdd_varnum; }
 
+int32_t cdd_get_var_level(int32_t var) { return cdd_var2level[var]; }
+
+int32_t cdd_get_level_var(int32_t level) { return cdd_level2var[level]; }
+
+/**
+ * Adds free nodes to \a man until it has \a n, so that as many nodes
+ * can be allocated without collecting garbage.
+ * @return 0 on success, or \c CDD_MEMORY
+ */
+static int32_t cdd_reserve_nodes(NodeManager* man, int32_t n)
+{
+    int32_t chunks;
+
+    while (man->freecnt < n) {
+        chunks = man->chunkcnt;
+        cdd_alloc_chunk(man);
+        if (man->chunkcnt == chunks) {
+            return CDD_MEMORY;
+        }
+    }
+    return 0;
+}
+
+int32_t cdd_reserve(int32_t level, int32_t size, int32_t n)
+{
+    NodeManager* man;
+    SubTable* tbl;
+
+    // Threads share the free nodes and tables of a shared manager
+    if (cdd_shared || n <= 0) {
+        return 0;
+    }
+    if (size == 0) {
+        man = bddmanager;
+    } else if ((man = cddmanager[size]) == NULL) {
+        man = cdd_alloc_cddmanager(size);
+    }
+
+    if (level >= 0) {
+        if ((tbl = man->subtables[level]) == NULL) {
+            tbl = cdd_alloc_subtable(man, level);
+        }
+        cdd_rehash_step(man, tbl, INT32_MAX);
+        while ((int64_t)tbl->keys + n > tbl->maxkeys && tbl->maxkeys < INT32_MAX) {
+            cdd_rehash(man, tbl);
+            cdd_rehash_step(man, tbl, INT32_MAX);
+        }
+    }
+    return cdd_reserve_nodes(man, n);
+}
+
+int32_t cdd_swap_levels(int32_t level)
+{
+    SubTable* upper;
+    SubTable* lower;
+    LevelInfo info;
+    ddNode *node, *next, **p, *moved = NULL;
+    ddNode *f0, *f1, *g0, *g1;
+    int32_t j, var;
+
+    if (level < 0 || level + 1 >= cdd_levelcnt || cdd_levelinfo[level].type != TYPE_BDD ||
+        cdd_levelinfo[level + 1].type != TYPE_BDD) {
+        return cdd_error(CDD_VAR);
+    }
+    if (cdd_shared) {
+        return cdd_error(CDD_SHARED);
+    }
+
+    upper = bddmanager->subtables[level];
+    lower = bddmanager->subtables[level + 1];
+
+    // A rebuilt node needs at most two new nodes. They must be allocated
+    // without collecting garbage, as the nodes being rebuilt are in no table.
+    if (upper != NULL && cdd_reserve_nodes(bddmanager, 2 * upper->keys) != 0) {
+        return CDD_MEMORY;
+    }
+
+    // Rebuilt nodes get young children but may have old dead parents, so
+    // the nursery is incomplete until the next full collection
+    bddmanager->youngcnt = -1;
+
+    // Take the nodes depending on the lower level out of the upper table,
+    // the others just move down. A dead node is revived while it is rebuilt.
+    if (upper != NULL) {
+        cdd_rehash_step(bddmanager, upper, INT32_MAX);
+        for (j = 0; j < upper->buckets; j++) {
+            p = &(upper->hash[j]);
+            for (node = *p; node != bddmanager->sentinel; node = next) {
+                next = node->next;
+                if (cdd_rglr(bdd_node_low(node))->level == level + 1 ||
+                    cdd_rglr(bdd_node_high(node))->level == level + 1) {
+                    if (node->ref == 0) {
+                        cdd_revive(node);
+                    }
+                    node->next = moved;
+                    moved = node;
+                    upper->keys--;
+                } else {
+                    node->level = level + 1;
+                    *p = node;
+                    p = &node->next;
+                }
+            }
+            *p = bddmanager->sentinel;
+        }
+        upper->level = level + 1;
+    }
+
+    // The nodes of the lower level move up
+    if (lower != NULL) {
+        cdd_rehash_step(bddmanager, lower, INT32_MAX);
+        for (j = 0; j < lower->buckets; j++) {
+            for (node = lower->hash[j]; node != bddmanager->sentinel; node = node->next) {
+                node->level = level;
+            }
+        }
+        lower->level = level;
+    }
+
+    bddmanager->subtables[level] = lower;
+    bddmanager->subtables[level + 1] = upper;
+    info = cdd_levelinfo[level];
+    cdd_levelinfo[level] = cdd_levelinfo[level + 1];
+    cdd_levelinfo[level + 1] = info;
+    var = cdd_level2var[level];
+    cdd_level2var[level] = cdd_level2var[level + 1];
+    cdd_level2var[level + 1] = var;
+    cdd_var2level[cdd_level2var[level]] = level;
+    cdd_var2level[cdd_level2var[level + 1]] = level + 1;
+
+    // Rebuild the taken nodes with the variables swapped. A node keeps its
+    // meaning, so its parents and cache entries referring to it stay valid.
+    for (node = moved; node != NULL; node = next) {
+        next = node->next;
+        f0 = bdd_node_low(node);
+        f1 = bdd_node_high(node);
+        g0 = cdd_make_bdd_node(level + 1, cdd_rglr(f0)->level == level ? bdd_low(f0) : f0,
+                               cdd_rglr(f1)->level == level ? bdd_low(f1) : f1);
+        cdd_ref(g0);
+        g1 = cdd_make_bdd_node(level + 1, cdd_rglr(f0)->level == level ? bdd_high(f0) : f0,
+                               cdd_rglr(f1)->level == level ? bdd_high(f1) : f1);
+        cdd_ref(g1);
+        assert(!cdd_is_negated(g0));
+        bdd_node(node)->low = cdd_tohandle(g0);
+        bdd_node(node)->high = cdd_tohandle(g1);
+        cdd_rec_deref(f0);
+        cdd_rec_deref(f1);
+
+        p = cdd_bucket(lower, bdd_hash_func(bddmanager, node));
+        node->next = *p;
+        *p = node;
+        cdd_add_node(bddmanager, lower, node);
+        if (node->ref == 0) {
+            cdd_release(node);
+        }
+    }
+    return 0;
+}
+
+/** Returns the number of nodes on the BDD level \a level. */
+static int32_t cdd_level_size(int32_t level)
+{
+    SubTable* tbl = bddmanager->subtables[level];
+    return tbl != NULL ? tbl->keys : 0;
+}
+
+/** Orders declared levels of variables by decreasing number of nodes. */
+static int cdd_compare_level_size(const void* a, const void* b)
+{
+    int32_t sa = cdd_level_size(cdd_var2level[*(const int32_t*)a]);
+    int32_t sb = cdd_level_size(cdd_var2level[*(const int32_t*)b]);
+    return (sa < sb) - (sa > sb);
+}
+
+/**
+ * Moves the BDD variable at \a level to the level between \a lo and
+ * \a hi where the fewest BDD nodes are in use. The variable is first
+ * moved to the nearer end of the range and then to the other one,
+ * turning early when the nodes exceed \c MAXGROWTH percent of the
+ * best order seen.
+ * @return 0 on success, or a negative error code
+ */
+static int32_t cdd_sift(int32_t level, int32_t lo, int32_t hi)
+{
+    int32_t best = bddmanager->usedcnt;
+    int32_t bestlevel = level;
+    int32_t dir = level - lo < hi - level ? -1 : 1;
+    int32_t pass, err;
+
+    for (pass = 0; pass < 2; pass++, dir = -dir) {
+        while (dir < 0 ? level > lo : level < hi) {
+            if ((err = cdd_swap_levels(dir < 0 ? level - 1 : level)) != 0) {
+                return err;
+            }
+            level += dir;
+            if (bddmanager->usedcnt < best) {
+                best = bddmanager->usedcnt;
+                bestlevel = level;
+            } else if ((int64_t)100 * bddmanager->usedcnt > (int64_t)MAXGROWTH * best) {
+                break;
+            }
+        }
+    }
+
+    for (; level > bestlevel; level--) {
+        if ((err = cdd_swap_levels(level - 1)) != 0) {
+            return err;
+        }
+    }
+    for (; level < bestlevel; level++) {
+        if ((err = cdd_swap_levels(level)) != 0) {
+            return err;
+        }
+    }
+    return 0;
+}
+
+int32_t cdd_reorder()
+{
+    int32_t* vars;
+    int32_t lo, hi, i, err = 0;
+
+    if (cdd_shared) {
+        return cdd_error(CDD_SHARED);
+    }
+    if ((vars = (int32_t*)malloc((cdd_levelcnt + 1) * sizeof(int32_t))) == NULL) {
+        return cdd_error(CDD_MEMORY);
+    }
+
+    // Dead nodes would be rebuilt for nothing
+    cdd_gbc_full();
+
+    // Sift the variables of each run of BDD levels
+    for (lo = 0; lo < cdd_levelcnt && err == 0; lo = hi + 1) {
+        hi = lo;
+        if (cdd_levelinfo[lo].type != TYPE_BDD) {
+            continue;
+        }
+        while (hi + 1 < cdd_levelcnt && cdd_levelinfo[hi + 1].type == TYPE_BDD) {
+            hi++;
+        }
+        for (i = lo; i <= hi; i++) {
+            vars[i - lo] = cdd_level2var[i];
+        }
+        qsort(vars, hi - lo + 1, sizeof(int32_t), cdd_compare_level_size);
+        for (i = 0; i <= hi - lo && err == 0; i++) {
+            err = cdd_sift(cdd_var2level[vars[i]], lo, hi);
+            cdd_gbc_full();
+        }
+    }
+    free(vars);
+
+    if (cdd_reorderlimit > 0 && cdd_reorderlimit < 2 * bddmanager->usedcnt) {
+        cdd_reorderlimit = 2 * bddmanager->usedcnt;
+    }
+    return err != 0 ? err : bddmanager->usedcnt;
+}
+
+int32_t cdd_setreorderthreshold(int32_t nodes)
+{
+    int32_t old = cdd_reorderlimit;
+    if (nodes < 0) {
+        return cdd_error(CDD_RANGE);
+    }
+    cdd_reorderlimit = nodes;
+    return old;
+}
+
 void cdd_dump_nodes()
 {
     SubTable* tbl;
@@ -1104,6 +2729,7 @@ void cdd_dump_nodes()
     for (i = 0; i < cdd_levelcnt; i++) {
         tbl = bddmanager->subtables[i];
         if (tbl) {
+            cdd_rehash_step(bddmanager, tbl, INT32_MAX);
             for (j = 0; j < tbl->buckets; j++) {
                 p = &(tbl->hash[j]);
                 node = *p;
@@ -1120,6 +2746,7 @@ void cdd_dump_nodes()
             if (cddmanager[k]) {
                 tbl = cddmanager[k]->subtables[i];
                 if (tbl) {
+                    cdd_rehash_step(cddmanager[k], tbl, INT32_MAX);
                     for (j = 0; j < tbl->buckets; j++) {
                         p = &(tbl->hash[j]);
                         node = *p;
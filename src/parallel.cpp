@@ -0,0 +1,325 @@
+// -*- mode: C++; c-file-style: "stroustrup"; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+///////////////////////////////////////////////////////////////////////////////
+//
+// This file is a part of the UPPAAL toolkit.
+// Copyright (c) 1995 - 2003, Uppsala University and Aalborg University.
+// All right reserved.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * @file parallel.cpp
+ *
+ * Parallel apply. The recursion of \c cdd_apply() is unfolded to the
+ * cut-off depth into tasks, which are distributed over work-stealing
+ * queues. Tasks above the cut-off only spawn the tasks for their child
+ * pairs; tasks at the cut-off run \c cdd_apply() on the shared
+ * manager. The result is then assembled top-down from the memoised
+ * task results by the calling thread.
+ */
+
+#include "cdd/kernel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+/** A pair of operands and its depth in the recursion. */
+struct task_t
+{
+    ddNode* l;
+    ddNode* r;
+    int32_t depth;
+};
+
+struct pair_hash
+{
+    size_t operator()(const std::pair<ddNode*, ddNode*>& p) const
+    {
+        return std::hash<uintptr_t>()(cdd_pair((uintptr_t)p.first, (uintptr_t)p.second));
+    }
+};
+
+using pair_set = std::unordered_set<std::pair<ddNode*, ddNode*>, pair_hash>;
+using pair_map = std::unordered_map<std::pair<ddNode*, ddNode*>, ddNode*, pair_hash>;
+
+/** Task queue of one worker. The owner works at the back, thieves steal from the front. */
+class task_queue
+{
+    std::mutex mutex;
+    std::deque<task_t> tasks;
+
+public:
+    void push(const task_t& t)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(t);
+    }
+
+    bool pop(task_t& t)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (tasks.empty())
+            return false;
+        t = tasks.back();
+        tasks.pop_back();
+        return true;
+    }
+
+    bool steal(task_t& t)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (tasks.empty())
+            return false;
+        t = tasks.front();
+        tasks.pop_front();
+        return true;
+    }
+};
+
+/** Set of operand pairs already spawned, split into shards to reduce contention. */
+class spawn_set
+{
+    static constexpr size_t shards = 64;
+    std::mutex mutex[shards];
+    pair_set sets[shards];
+
+public:
+    /** Returns true if the pair was not spawned before. */
+    bool insert(ddNode* l, ddNode* r)
+    {
+        auto p = std::make_pair(l, r);
+        size_t i = pair_hash()(p) % shards;
+        std::lock_guard<std::mutex> lock(mutex[i]);
+        return sets[i].insert(p).second;
+    }
+};
+
+/** Returns true if \c cdd_apply() on \a l and \a r is cheap, i.e. a terminal case. */
+bool is_leaf(ddNode* l, ddNode* r)
+{
+    return cdd_isterminal(l) || cdd_isterminal(r) || l == r || l == cdd_neg(r);
+}
+
+/**
+ * Calls \a f for each pair of children the apply recursion visits for
+ * \a l and \a r, i.e. for each interval of the merged bounds of CDD
+ * nodes and for the low and high branches of BDD nodes.
+ */
+template <typename F>
+void for_each_child_pair(ddNode* l, ddNode* r, F f)
+{
+    int32_t lmask = cdd_mask(l);
+    int32_t rmask = cdd_mask(r);
+    l = cdd_rglr(l);
+    r = cdd_rglr(r);
+    int32_t level = std::min(l->level, r->level);
+
+    if (cdd_levelinfo[level].type == TYPE_CDD) {
+        Elem lself = {cdd_tohandle(l), INF};
+        Elem rself = {cdd_tohandle(r), INF};
+        Elem* lp = l->level == level ? cdd_node(l)->elem : &lself;
+        Elem* rp = r->level == level ? cdd_node(r)->elem : &rself;
+        raw_t bnd;
+        do {
+            bnd = std::min(lp->bnd, rp->bnd);
+            f(cdd_neg_cond(cdd_elem_child(lp), lmask), cdd_neg_cond(cdd_elem_child(rp), rmask), bnd);
+            lp += (lp->bnd == bnd);
+            rp += (rp->bnd == bnd);
+        } while (bnd < INF);
+    } else {
+        ddNode* ll = l->level == level ? bdd_node_low(l) : l;
+        ddNode* lh = l->level == level ? bdd_node_high(l) : l;
+        ddNode* rl = r->level == level ? bdd_node_low(r) : r;
+        ddNode* rh = r->level == level ? bdd_node_high(r) : r;
+        f(cdd_neg_cond(ll, lmask), cdd_neg_cond(rl, rmask), 0);
+        f(cdd_neg_cond(lh, lmask), cdd_neg_cond(rh, rmask), INF);
+    }
+}
+
+/** State of one parallel apply. */
+class par_apply
+{
+    int32_t op;
+    int32_t cutoff;
+    std::vector<task_queue> queues;
+    std::vector<std::vector<std::pair<task_t, ddNode*>>> results;
+    std::atomic<size_t> pending{0};
+    std::atomic<int32_t> error{0};
+    spawn_set spawned;
+    pair_map memo;
+
+    /**
+     * Runs \c cdd_apply() and records the error if it fails, for the
+     * calling thread to report. The false terminal stands in for the
+     * missing result.
+     */
+    ddNode* apply(ddNode* l, ddNode* r)
+    {
+        ddNode* res = cdd_apply(l, r, op);
+        if (res == nullptr) {
+            error.store(cdd_errorcond);
+            return cddfalse;
+        }
+        return res;
+    }
+
+    void spawn(size_t self, ddNode* l, ddNode* r, int32_t depth)
+    {
+        if (is_leaf(l, r) || !spawned.insert(l, r))
+            return;
+        pending.fetch_add(1);
+        queues[self].push({l, r, depth});
+    }
+
+    void run(size_t self, const task_t& t)
+    {
+        if (t.depth < cutoff) {
+            for_each_child_pair(t.l, t.r, [&](ddNode* l, ddNode* r, raw_t) { spawn(self, l, r, t.depth + 1); });
+        } else {
+            ddNode* res = apply(t.l, t.r);
+            cdd_ref(res);
+            results[self].emplace_back(t, res);
+        }
+        pending.fetch_sub(1);
+    }
+
+    bool next(size_t self, task_t& t)
+    {
+        if (queues[self].pop(t))
+            return true;
+        for (size_t i = 1; i < queues.size(); ++i) {
+            if (queues[(self + i) % queues.size()].steal(t))
+                return true;
+        }
+        return false;
+    }
+
+    void work(size_t self)
+    {
+        task_t t;
+        while (pending.load() > 0) {
+            if (next(self, t))
+                run(self, t);
+            else
+                std::this_thread::yield();
+        }
+    }
+
+    /**
+     * Builds the result for \a l and \a r top-down from the task
+     * results. Every other pair met was unfolded into tasks for its
+     * child pairs.
+     */
+    ddNode* assemble(ddNode* l, ddNode* r)
+    {
+        auto it = memo.find({l, r});
+        if (it != memo.end())
+            return it->second;
+        if (is_leaf(l, r))
+            return apply(l, r);
+
+        ddNode* res;
+        int32_t level = std::min(cdd_rglr(l)->level, cdd_rglr(r)->level);
+        if (cdd_levelinfo[level].type == TYPE_CDD) {
+            // Merge adjacent equal children as cdd_apply() does
+            std::vector<Elem> elems;
+            for_each_child_pair(l, r, [&](ddNode* cl, ddNode* cr, raw_t bnd) {
+                ddNode* n = assemble(cl, cr);
+                if (!elems.empty() && cdd_elem_child(&elems.back()) == n)
+                    elems.back().bnd = bnd;
+                else
+                    elems.push_back({cdd_tohandle(n), bnd});
+            });
+            int32_t mask = cdd_mask(cdd_elem_child(&elems.front()));
+            for (Elem& e : elems)
+                e.child = cdd_tohandle(cdd_neg_cond(cdd_elem_child(&e), mask));
+            res = cdd_neg_cond(cdd_make_cdd_node(level, elems.data(), elems.size()), mask);
+        } else {
+            ddNode* children[2];
+            int32_t i = 0;
+            for_each_child_pair(l, r, [&](ddNode* cl, ddNode* cr, raw_t) { children[i++] = assemble(cl, cr); });
+            res = cdd_make_bdd_node(level, children[0], children[1]);
+        }
+        cdd_ref(res);
+        memo.emplace(std::make_pair(l, r), res);
+        return res;
+    }
+
+public:
+    par_apply(int32_t op, int32_t cutoff, size_t nthreads):
+        op(op), cutoff(cutoff), queues(nthreads), results(nthreads)
+    {}
+
+    ddNode* operator()(ddNode* l, ddNode* r)
+    {
+        cdd_manager* man = cdd_current;
+        size_t stacksize = cdd_refstacksize;
+
+        // All workers attach before any node is created, as the
+        // manager changes mode when it becomes shared
+        std::atomic<size_t> ready{0};
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < queues.size(); ++i) {
+            threads.emplace_back([this, man, stacksize, i, &ready] {
+                bool attached = cdd_manager_attach(man, stacksize) == 0;
+                ready.fetch_add(1);
+                if (attached) {
+                    while (ready.load() < queues.size())
+                        std::this_thread::yield();
+                    work(i);
+                    cdd_manager_detach();
+                }
+            });
+        }
+        while (ready.load() < queues.size() - 1)
+            std::this_thread::yield();
+
+        // The calling thread is worker 0
+        spawn(0, l, r, 0);
+        ready.fetch_add(1);
+        work(0);
+        for (auto& t : threads)
+            t.join();
+
+        // Memoised results are referenced while assembling
+        for (auto& rs : results) {
+            for (auto& [t, res] : rs)
+                memo.emplace(std::make_pair(t.l, t.r), res);
+        }
+        ddNode* res = assemble(l, r);
+        cdd_ref(res);
+        for (auto& [p, n] : memo)
+            cdd_rec_deref(n);
+        cdd_deref(res);
+
+        // The error may have been raised by a worker or while assembling
+        if (error.load() != 0 || cdd_errorcond != 0) {
+            if (cdd_errorcond == 0)
+                cdd_errorcond = error.load();
+            return nullptr;
+        }
+        return res;
+    }
+};
+}  // namespace
+
+int32_t cdd_setparcutoff(int32_t depth)
+{
+    int32_t old = cdd_parcutoff;
+    cdd_parcutoff = depth;
+    return old;
+}
+
+ddNode* cdd_apply_par(ddNode* l, ddNode* r, int32_t op, int32_t nthreads)
+{
+    if (nthreads <= 1 || is_leaf(l, r))
+        return cdd_apply(l, r, op);
+    return par_apply(op, cdd_parcutoff, nthreads)(l, r);
+}
@@ -12,6 +12,7 @@
 #include "cdd/kernel.h"
 #include "base/bitstring.h"
 
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -37,214 +38,221 @@ struct infor_
     bool stringFound;
 };
 
-/* Print an interval.
+/* Format an interval into buf, which has room for 32 characters.
  */
-static void printInterval(FILE* ofile, raw_t lower, raw_t upper)
+static void formatInterval(char* buf, raw_t lower, raw_t upper)
 {
+    int n;
+
     if (lower == -dbm_LS_INFINITY) {
-        fprintf(ofile, "]-INF;");
+        n = sprintf(buf, "]-INF;");
     } else {
         lower = bnd_l2u(lower);
-        fprintf(ofile, "%s%d;", dbm_rawIsStrict(lower) ? "]" : "[", -dbm_raw2bound(lower));
+        n = sprintf(buf, "%s%d;", dbm_rawIsStrict(lower) ? "]" : "[", -dbm_raw2bound(lower));
     }
 
     if (upper == dbm_LS_INFINITY) {
-        fprintf(ofile, "INF[");
+        sprintf(buf + n, "INF[");
     } else {
-        fprintf(ofile, "%d%s", dbm_raw2bound(upper), dbm_rawIsStrict(upper) ? "[" : "]");
+        sprintf(buf + n, "%d%s", dbm_raw2bound(upper), dbm_rawIsStrict(upper) ? "[" : "]");
     }
 }
 
-/* Define a dynamic array of strings and its functions, to store pointers of nodes we have already visited
+/* Print an interval.
  */
-typedef struct
+static void printInterval(FILE* ofile, raw_t lower, raw_t upper)
 {
-    size_t used;
-    size_t size;
-    char (*array)[40];
-} Array;
+    char buf[32];
+    formatInterval(buf, lower, upper);
+    fputs(buf, ofile);
+}
 
-int initArray(Array* a, size_t initialSize)
+/* State of the dot printer. A node is printed once for each parity of
+ * the negations it is reached through, so the nodes met are kept as
+ * the node pointer, including its negation, with the parity in bit 1,
+ * which is free as nodes are aligned to four bytes. The nodes are
+ * printed in the order they were met, which is breadth first.
+ */
+typedef struct
 {
-    a->used = 0;
-
-    a->array = malloc(initialSize * sizeof(char[40]));
-    int success = a->array != NULL;
+    FILE* ofile;
+    bool flip_negated; /* Whether to take negated nodes into account */
+    bool failed;       /* Out of memory, so no more nodes are met */
+    uintptr_t* keys;   /* Hash set of the nodes met, 0 for empty entries */
+    uintptr_t* queue;  /* The nodes met, in the order they were met */
+    size_t mask;       /* Size of the hash set minus one */
+    size_t count;      /* Number of nodes met */
+    size_t used;       /* Bytes used of the output buffer */
+    char buf[1 << 16];
+} DotPrinter;
+
+/* Write the output buffer.
+ */
+static void dot_flush(DotPrinter* pr)
+{
+    fwrite(pr->buf, 1, pr->used, pr->ofile);
+    pr->used = 0;
+}
 
-    if (success) {
-        a->size = initialSize;
-    } else {
-        a->size = 0;
+static void dot_printf(DotPrinter* pr, const char* format, ...)
+{
+    va_list ap;
+    size_t room = sizeof(pr->buf) - pr->used;
+    int n;
+
+    va_start(ap, format);
+    n = vsnprintf(pr->buf + pr->used, room, format, ap);
+    va_end(ap);
+    if (n >= 0 && (size_t)n < room) {
+        pr->used += n;
+        return;
     }
 
-    return success;
+    // Print lines not fitting in the rest of the buffer directly
+    dot_flush(pr);
+    va_start(ap, format);
+    vfprintf(pr->ofile, format, ap);
+    va_end(ap);
 }
 
-int insertArray(Array* a, const char* element)
+static size_t dot_slot(const DotPrinter* pr, uintptr_t key)
 {
-    int success = 1;
-
-    if (a->used == a->size) {
-        char(*tmp)[40] = realloc(a->array, 2 * a->size * sizeof(char[40]));
-        if ((success = tmp != NULL)) {
-            a->array = tmp;
-            a->size *= 2;
-        }
-    }
-
-    if (success) {
-        strcpy(a->array[a->used++], element);
+    size_t h = (size_t)key * 2654435761u;
+    size_t i = (h ^ (h >> 15)) & pr->mask;
+    while (pr->keys[i] != 0 && pr->keys[i] != key) {
+        i = (i + 1) & pr->mask;
     }
-
-    return success;
+    return i;
 }
 
-bool contains(Array* a, const char* element)
+/* Double the hash set and the queue.
+ */
+static bool dot_grow(DotPrinter* pr)
 {
-    for (int i = 0; i < a->used; i++) {
-        if (strcmp(a->array[i], element) == 0)
-            return true;
+    size_t i, size = 2 * (pr->mask + 1);
+    uintptr_t* queue = realloc(pr->queue, size * sizeof(uintptr_t));
+    uintptr_t* keys = calloc(size, sizeof(uintptr_t));
+
+    if (queue != NULL) {
+        pr->queue = queue;
+    }
+    if (queue == NULL || keys == NULL) {
+        free(keys);
+        return false;
     }
-    return false;
+    free(pr->keys);
+    pr->keys = keys;
+    pr->mask = size - 1;
+    for (i = 0; i < pr->count; i++) {
+        pr->keys[dot_slot(pr, pr->queue[i])] = pr->queue[i];
+    }
+    return true;
 }
 
-void freeArray(Array* a)
+/* Meet the node r reached through negations of the given parity,
+ * so it is printed later. Terminals are printed beforehand.
+ */
+static void dot_meet(DotPrinter* pr, ddNode* r, bool negated)
 {
-    free(a->array);
-    a->array = NULL;
-    a->used = a->size = 0;
+    uintptr_t key = (uintptr_t)r | ((uintptr_t)negated << 1);
+    size_t i;
+
+    if (cdd_isterminal(r) || pr->failed) {
+        return;
+    }
+    i = dot_slot(pr, key);
+    if (pr->keys[i] == key) {
+        return;
+    }
+    if (2 * (pr->count + 1) > pr->mask) {
+        if (!dot_grow(pr)) {
+            pr->failed = true;
+            return;
+        }
+        i = dot_slot(pr, key);
+    }
+    pr->keys[i] = key;
+    pr->queue[pr->count++] = key;
 }
 
-/*
- * Recursive function to print the nodes and edges of a CDD. A side
- * effect of this function is that all nodes will be marked. All
- * previously marked nodes are ignored.
+/* Print a node and the edges to its children, and meet the children.
  *
- * flip_negated Whether to take negated nodes into account.
  * negated Whether this node is reached by (an odd number of) negated node(s).
- * a Dynamic array keeping track of already printed boolean nodes and it's negation status.
  */
-static void cdd_fprintdot_rec(FILE* ofile, ddNode* r, bool flip_negated, bool negated, Array* a)
+static void cdd_fprintdot_node(DotPrinter* pr, ddNode* r, bool negated)
 {
-    if (cdd_isterminal(r)) {
-        return;
-    }
-
     // Establish color for printing the node.
     char* node_color = "black";
     if (cdd_is_negated(r))
         node_color = "red";
 
+    // We annotate each location in the dot file with a 0 if it was reached with an even number of negations,
+    // and with a 1 if it was reached with an odd number of negations. We do not care about whether the current
+    // node is negated, only about whether it was reached via a negation.
+    char* current_neg_appendix = negated ? "1" : "0";
+
+    // To see if its children are reached via negation, we do need to take the current negation into account.
+    bool child_negated = cdd_is_negated(r) ^ negated;
+
     if (cdd_info(r)->type == TYPE_BDD) {
         bddNode* node = bdd_node(r);
-
-        // We annotate each location in the dot file with a 0 if it was reached with an even number of negations,
-        // and with a 1 if it was reached with an odd number of negations.
-        char* current_neg_appendix = "0";
-        char* high_neg_appendix = "0";
-        char* low_neg_appendix = "0";
-
-        // We do not care about whether the current node is negated, only about whether it was reached via a negation.
-        if (negated)
-            current_neg_appendix = "1";
-        // To see if its children are reached via negation, we do need to take the current negation into account.
-        if (cdd_is_negated(r) ^ negated) {
-            high_neg_appendix = "1";
-            low_neg_appendix = "1";
-        }
+        ddNode* high = cdd_fromhandle(node->high);
+        ddNode* low = cdd_fromhandle(node->low);
 
         // Terminal children nodes don't need the annotation.
-        if (cdd_isterminal((void*)node->high))
-            high_neg_appendix = "";
-        if (cdd_isterminal((void*)node->low))
-            low_neg_appendix = "";
-
-        // Check whether we already reached this node via an array of strings keeping track of the pointers plus
-        // appendix.
-        char buf[40] = {0};
-        snprintf(buf, sizeof buf, "%p%s\n", (void*)r, current_neg_appendix);
-
-        if (!contains(a, buf)) {
-            insertArray(a, buf);
-
-            // Print current node.
-            fprintf(ofile, "\"%p%s\" [shape=circle, color = %s, label=\"b%d\"];\n", (void*)r, current_neg_appendix,
-                    node_color, node->level);
-
-            // Print arrow to high.
-            if (flip_negated && (negated ^ cdd_is_negated(r)) && cdd_isterminal((void*)node->high)) {
-                // Flip arrow to the negated terminal if we had negation.
-                fprintf(ofile, "\"%p%s\" -> \"%p\" [style=\"filled", (void*)r, current_neg_appendix,
-                        cdd_neg((void*)node->high));
-                fprintf(ofile, "\"];\n");
-            } else {
-                // Print normal arrows with annotation for children.
-                fprintf(ofile, "\"%p%s\" -> \"%p%s\" [style=\"filled", (void*)r, current_neg_appendix,
-                        (void*)node->high, high_neg_appendix);
-                fprintf(ofile, "\"];\n");
-            }
-            // Print arrow to low.
-            if (flip_negated && (negated ^ cdd_is_negated(r)) && cdd_isterminal((void*)node->low)) {
-                // Flip arrow to the negated terminal if we had negation.
-                fprintf(ofile, "\"%p%s\" -> \"%p\" [style=\"dashed", (void*)r, current_neg_appendix,
-                        cdd_neg((void*)node->low));
-                fprintf(ofile, "\"];\n");
-            } else {
-                // Print normal arrows with annotation for children.
-                fprintf(ofile, "\"%p%s\" -> \"%p%s\" [style=\"dashed", (void*)r, current_neg_appendix, (void*)node->low,
-                        low_neg_appendix);
-                fprintf(ofile, "\"];\n");
-            }
-
-            cdd_fprintdot_rec(ofile, node->high, flip_negated, negated ^ cdd_is_negated(r), a);
-            cdd_fprintdot_rec(ofile, node->low, flip_negated, negated ^ cdd_is_negated(r), a);
+        char* high_neg_appendix = cdd_isterminal(high) ? "" : child_negated ? "1" : "0";
+        char* low_neg_appendix = cdd_isterminal(low) ? "" : child_negated ? "1" : "0";
+
+        // Print current node.
+        dot_printf(pr, "\"%p%s\" [shape=circle, color = %s, label=\"b%d\"];\n", (void*)r, current_neg_appendix,
+                   node_color, cdd_level2var[node->level]);
+
+        // Print arrow to high.
+        if (pr->flip_negated && child_negated && cdd_isterminal(high)) {
+            // Flip arrow to the negated terminal if we had negation.
+            dot_printf(pr, "\"%p%s\" -> \"%p\" [style=\"filled\"];\n", (void*)r, current_neg_appendix,
+                       (void*)cdd_neg(high));
+        } else {
+            // Print normal arrows with annotation for children.
+            dot_printf(pr, "\"%p%s\" -> \"%p%s\" [style=\"filled\"];\n", (void*)r, current_neg_appendix, (void*)high,
+                       high_neg_appendix);
         }
-
-    } else {
-        // Regularizing before checking whether a node is marked.
-        if (cdd_ismarked(cdd_rglr(r))) {
-            return;
+        // Print arrow to low.
+        if (pr->flip_negated && child_negated && cdd_isterminal(low)) {
+            // Flip arrow to the negated terminal if we had negation.
+            dot_printf(pr, "\"%p%s\" -> \"%p\" [style=\"dashed\"];\n", (void*)r, current_neg_appendix,
+                       (void*)cdd_neg(low));
+        } else {
+            // Print normal arrows with annotation for children.
+            dot_printf(pr, "\"%p%s\" -> \"%p%s\" [style=\"dashed\"];\n", (void*)r, current_neg_appendix, (void*)low,
+                       low_neg_appendix);
         }
 
+        dot_meet(pr, high, child_negated);
+        dot_meet(pr, low, child_negated);
+    } else {
         raw_t bnd = -INF;
         cddNode* node = cdd_node(r);
         Elem* p = node->elem;
+        char interval[32];
 
-        char* current_neg_appendix = "0";
-        char* child_neg_appendix = "0";
-
-        // We do not care about whether the current node is negated, only about whether it was reached via a negation.
-        if (negated)
-            current_neg_appendix = "1";
-        // To see if its children are reached via negation, we do need to take the current one into account.
-        if (cdd_is_negated(r) ^ negated) {
-            child_neg_appendix = "1";
-        }
-
-        fprintf(ofile, "\"%p%s\" [shape=octagon, color = %s, label=\"x%d-x%d\"];\n", (void*)r, current_neg_appendix,
-                node_color, cdd_info(node)->clock1, cdd_info(node)->clock2);
+        dot_printf(pr, "\"%p%s\" [shape=octagon, color = %s, label=\"x%d-x%d\"];\n", (void*)r, current_neg_appendix,
+                   node_color, cdd_info(node)->clock1, cdd_info(node)->clock2);
 
         do {
-            ddNode* child = p->child;
+            ddNode* child = cdd_elem_child(p);
             if (child != cddfalse) {
                 // Terminal children nodes don't need the annotation.
-                if (child == cddtrue) {
-                    child_neg_appendix = "";
-                }
-
-                fprintf(ofile, "\"%p%s\" -> \"%p%s\" [style=%s, label=\"", (void*)r, current_neg_appendix,
-                        (void*)(child), child_neg_appendix, cdd_mask(child) ? "dashed" : "filled");
-                printInterval(ofile, bnd, p->bnd);
-                fprintf(ofile, "\"];\n");
-
-                cdd_fprintdot_rec(ofile, child, flip_negated, negated ^ cdd_is_negated(r), a);
+                formatInterval(interval, bnd, p->bnd);
+                dot_printf(pr, "\"%p%s\" -> \"%p%s\" [style=%s, label=\"%s\"];\n", (void*)r, current_neg_appendix,
+                           (void*)(child), child == cddtrue ? "" : child_negated ? "1" : "0",
+                           cdd_mask(child) ? "dashed" : "filled", interval);
+                dot_meet(pr, child, child_negated);
             }
             bnd = p->bnd;
             p++;
         } while (bnd < INF);
     }
-
-    cdd_setmark(r);
 }
 
 void cdd_print_terminal_node(FILE* ofile, ddNode* r, int label)
@@ -253,28 +261,58 @@ void cdd_print_terminal_node(FILE* ofile, ddNode* r, int label)
 }
 
 // Main print function called from outside.
-void cdd_fprintdot(FILE* ofile, ddNode* r, bool push_negate)
+void cdd_fprintdot(FILE* ofile, ddNode* r, bool push_negate) { cdd_fprintdot_limit(ofile, r, push_negate, 0); }
+
+void cdd_fprintdot_limit(FILE* ofile, ddNode* r, bool push_negate, size_t maxnodes)
 {
-    Array a;
-    initArray(&a, 100);
+    DotPrinter* pr;
+    uintptr_t key;
+    size_t i;
 
     fprintf(ofile, "digraph G {\n");
     bool bit = cdd_is_negated(r);
     if (cdd_isterminal(r)) {
         cdd_print_terminal_node(ofile, r, bit);
-    } else {
-        cdd_print_terminal_node(ofile, cddtrue, 1);
-        cdd_print_terminal_node(ofile, cddfalse, 0);
-        if (push_negate) {
-            cdd_fprintdot_rec(ofile, r, true, false, &a);
+        fprintf(ofile, "}\n");
+        return;
+    }
+    cdd_print_terminal_node(ofile, cddtrue, 1);
+    cdd_print_terminal_node(ofile, cddfalse, 0);
+
+    if ((pr = malloc(sizeof(DotPrinter))) == NULL) {
+        cdd_error(CDD_MEMORY);
+        fprintf(ofile, "}\n");
+        return;
+    }
+    pr->ofile = ofile;
+    pr->flip_negated = push_negate;
+    pr->failed = false;
+    pr->mask = 255;
+    pr->count = 0;
+    pr->used = 0;
+    pr->keys = calloc(pr->mask + 1, sizeof(uintptr_t));
+    pr->queue = malloc((pr->mask + 1) * sizeof(uintptr_t));
+    if (pr->keys == NULL || pr->queue == NULL) {
+        pr->failed = true;
+    }
+
+    dot_meet(pr, r, false);
+    for (i = 0; i < pr->count; i++) {
+        key = pr->queue[i];
+        if (maxnodes == 0 || i < maxnodes) {
+            cdd_fprintdot_node(pr, (ddNode*)(key & ~(uintptr_t)2), key & 2);
         } else {
-            cdd_fprintdot_rec(ofile, r, false, false, &a);
+            // Nodes beyond the limit are printed without their children
+            dot_printf(pr, "\"%p%s\" [shape=plaintext, label=\"...\"];\n", (void*)(key & ~(uintptr_t)2),
+                       key & 2 ? "1" : "0");
         }
     }
-    fprintf(ofile, "}\n");
-    cdd_unmark(r);
+    dot_printf(pr, "}\n");
+    dot_flush(pr);
 
-    freeArray(&a);
+    free(pr->keys);
+    free(pr->queue);
+    free(pr);
 }
 
 void cdd_printdot(ddNode* r, bool push_negate) { cdd_fprintdot(stdout, r, push_negate); }
@@ -341,7 +379,7 @@ static void cdd_freduce_dump_rec(FILE* ofile, int maskSize, ddNode* r, infor* pa
         }
 
         do {
-            ddNode* child = p->child;
+            ddNode* child = cdd_elem_child(p);
             if (child != cddfalse) {
                 cdd_freduce_dump_rec(ofile, maskSize, cdd_rglr(child), NULL, labelPrinter, clockPrinter, data,
                                      dotFormat);
@@ -377,11 +415,11 @@ static void cdd_freduce_dump_rec(FILE* ofile, int maskSize, ddNode* r, infor* pa
         cdd_setmark(r);
     } else {
         bddNode* node = bdd_node(r);
-        if (parentInfo == NULL || (parentInfo->other != node->high && parentInfo->other != node->low)) {
+        if (parentInfo == NULL || (parentInfo->other != cdd_fromhandle(node->high) && parentInfo->other != cdd_fromhandle(node->low))) {
             // No possible reduction, start exploration by low child
             infor myInfo;
-            myInfo.current = node->low;
-            myInfo.other = node->high;
+            myInfo.current = cdd_fromhandle(node->low);
+            myInfo.other = cdd_fromhandle(node->high);
             myInfo.mask = malloc(maskSize * sizeof(uint32_t));
             myInfo.value = malloc(maskSize * sizeof(uint32_t));
             int k;
@@ -389,20 +427,20 @@ static void cdd_freduce_dump_rec(FILE* ofile, int maskSize, ddNode* r, infor* pa
                 myInfo.mask[k] = 0;
                 myInfo.value[k] = 0;
             }
-            base_setOneBit(myInfo.mask, node->level);
+            base_setOneBit(myInfo.mask, cdd_level2var[node->level]);
             myInfo.stringFound = false;
-            cdd_freduce_dump_rec(ofile, maskSize, node->low, &myInfo, labelPrinter, clockPrinter, data, dotFormat);
+            cdd_freduce_dump_rec(ofile, maskSize, cdd_fromhandle(node->low), &myInfo, labelPrinter, clockPrinter, data, dotFormat);
 
             // Exploration of high child
             if (myInfo.stringFound) {
                 // Do not search for any string in high child
-                cdd_freduce_dump_rec(ofile, maskSize, node->high, NULL, labelPrinter, clockPrinter, data, dotFormat);
+                cdd_freduce_dump_rec(ofile, maskSize, cdd_fromhandle(node->high), NULL, labelPrinter, clockPrinter, data, dotFormat);
             } else {
                 assert(*(myInfo.value) == 0);
-                myInfo.current = node->high;
-                myInfo.other = node->low;
-                base_setOneBit(myInfo.value, node->level);
-                cdd_freduce_dump_rec(ofile, maskSize, node->high, &myInfo, labelPrinter, clockPrinter, data, dotFormat);
+                myInfo.current = cdd_fromhandle(node->high);
+                myInfo.other = cdd_fromhandle(node->low);
+                base_setOneBit(myInfo.value, cdd_level2var[node->level]);
+                cdd_freduce_dump_rec(ofile, maskSize, cdd_fromhandle(node->high), &myInfo, labelPrinter, clockPrinter, data, dotFormat);
             }
 
             // Print node, mask, value, and children
@@ -435,19 +473,19 @@ static void cdd_freduce_dump_rec(FILE* ofile, int maskSize, ddNode* r, infor* pa
             cdd_setmark(r);
         } else {
             parentInfo->stringFound = true;
-            base_setOneBit(parentInfo->mask, node->level);
-            if (parentInfo->other == node->high) {
-                parentInfo->current = node->low;
-                cdd_freduce_dump_rec(ofile, maskSize, node->low, parentInfo, labelPrinter, clockPrinter, data,
+            base_setOneBit(parentInfo->mask, cdd_level2var[node->level]);
+            if (parentInfo->other == cdd_fromhandle(node->high)) {
+                parentInfo->current = cdd_fromhandle(node->low);
+                cdd_freduce_dump_rec(ofile, maskSize, cdd_fromhandle(node->low), parentInfo, labelPrinter, clockPrinter, data,
                                      dotFormat);
-                cdd_freduce_dump_rec(ofile, maskSize, node->high, NULL, labelPrinter, clockPrinter, data, dotFormat);
+                cdd_freduce_dump_rec(ofile, maskSize, cdd_fromhandle(node->high), NULL, labelPrinter, clockPrinter, data, dotFormat);
             } else {
-                assert(parentInfo->other == node->low);
-                parentInfo->current = node->high;
-                base_setOneBit(parentInfo->value, node->level);
-                cdd_freduce_dump_rec(ofile, maskSize, node->high, parentInfo, labelPrinter, clockPrinter, data,
+                assert(parentInfo->other == cdd_fromhandle(node->low));
+                parentInfo->current = cdd_fromhandle(node->high);
+                base_setOneBit(parentInfo->value, cdd_level2var[node->level]);
+                cdd_freduce_dump_rec(ofile, maskSize, cdd_fromhandle(node->high), parentInfo, labelPrinter, clockPrinter, data,
                                      dotFormat);
-                cdd_freduce_dump_rec(ofile, maskSize, node->low, NULL, labelPrinter, clockPrinter, data, dotFormat);
+                cdd_freduce_dump_rec(ofile, maskSize, cdd_fromhandle(node->low), NULL, labelPrinter, clockPrinter, data, dotFormat);
             }
         }
     }
@@ -10,6 +10,7 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "relax.h"
+#include "cache.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -27,6 +28,21 @@ int CddRelaxCache_init(CddRelaxCache* cache, int size)
     return 0;
 }
 
+void CddRelaxCache_rebase(CddRelaxCache* cache)
+{
+    CddRelaxCacheData* n;
+    for (n = cache->table + cache->tablesize - 1; n >= cache->table; n--) {
+        if (n->node == NULL) {
+            continue;
+        }
+        if (!cdd_rglr(n->node)->ref || !cdd_rglr(n->res)->ref || !CddCache_valid(n->node, NULL, n->res, n->epoch)) {
+            n->node = NULL;
+        } else {
+            n->epoch = (uint8_t)cdd_epoch;
+        }
+    }
+}
+
 void CddRelaxCache_done(CddRelaxCache* cache)
 {
     free(cache->table);
@@ -38,3 +54,13 @@ void CddRelaxCache_reset(CddRelaxCache* cache)
 {
     memset(cache->table, 0, cache->tablesize * sizeof(CddRelaxCacheData));
 }
+
+void CddRelaxCache_flush(CddRelaxCache* cache)
+{
+    CddRelaxCacheData* n;
+    for (n = cache->table + cache->tablesize - 1; n >= cache->table; n--) {
+        if (n->node && (!cdd_rglr(n->node)->ref || !cdd_rglr(n->res)->ref)) {
+            n->node = NULL;
+        }
+    }
+}
@@ -12,6 +12,7 @@ typedef struct
     int clock1;
     int clock2;
     int op;
+    uint8_t epoch;
 } CddRelaxCacheData;
 
 typedef struct
@@ -20,8 +21,12 @@ typedef struct
     int tablesize;
 } CddRelaxCache;
 
+#define CddRelaxCache_lookup(cache, hash) (&(cache)->table[(hash) % (cache)->tablesize])
+
 int CddRelaxCache_init(CddRelaxCache*, int);
 void CddRelaxCache_reset(CddRelaxCache*);
+void CddRelaxCache_flush(CddRelaxCache*);
+void CddRelaxCache_rebase(CddRelaxCache*);
 void CddRelaxCache_done(CddRelaxCache*);
 
 #endif
@@ -87,6 +87,7 @@ void cdd_tarjan_init(struct tarjan* graph, uint32_t dim, struct distance* dist,
 {
     assert(dim > 0);
     graph->dim = dim;
+    graph->edgecnt = 0;
     graph->count = count;
     graph->dist = dist;
     graph->edges = edges;
@@ -107,6 +108,7 @@ void cdd_tarjan_push(struct tarjan* graph, cindex_t i, cindex_t j, raw_t value)
     /* Add edge from i to j.
      */
     uint32_t count = graph->count[i]++;
+    graph->edgecnt++;
     uint32_t idx = i * graph->dim - i + count;
     graph->edges[idx].v = j;
     graph->edges[idx].value = value;
@@ -125,6 +127,7 @@ void cdd_tarjan_pop(struct tarjan* graph, cindex_t i)
 {
     assert(graph->count[i] > 0);
     graph->count[i]--;
+    graph->edgecnt--;
 }
 
 /**
@@ -48,6 +48,7 @@ struct node
 struct tarjan
 {
     uint32_t dim;          /**< Number of vertices in graph. */
+    uint32_t edgecnt;      /**< Number of edges in graph. */
     uint32_t* count;       /**< Number of outgoing edges. */
     struct distance* dist; /**< Distance vector. */
     struct edge* edges;    /**< Edges in graph. */
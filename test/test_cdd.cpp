@@ -13,16 +13,24 @@
  */
 
 #include "dbm/dbm.h"
+#include "dbm/fed.h"
 #include "dbm/gen.h"
 #include "dbm/print.h"
 #include "cdd/cdd.h"
 #include "cdd/debug.h"
+#include "cdd/expr.h"
 #include "cdd/kernel.h"
 #include "base/Timer.h"
 #include "debug/macros.h"
 
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <algorithm>
 #include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
 #include <cstdio>
 #include <cstdlib>
 
@@ -320,4 +328,1254 @@ TEST_CASE("Big CDD test")
 
     SUBCASE("size 10") { big_test(10, seed); }
 #endif
-}
\ No newline at end of file
+}
+/** Builds a few constraints in a private manager and checks them. */
+static bool manager_test(int32_t bound)
+{
+    cdd_context ctx(100, 1000, 1000);
+    cdd_add_clocks(3);
+    cdd a = cdd_upper(1, 0, dbm_bound2raw(bound, dbm_WEAK));
+    cdd b = cdd_upper(2, 0, dbm_bound2raw(bound + 1, dbm_STRICT));
+    cdd c = a & b;
+    return cdd_reduce(c - a) == cdd_false() && cdd_reduce(c ^ (b & a)) == cdd_false() &&
+           cdd_reduce(c) != cdd_false();
+}
+
+TEST_CASE("Independent managers")
+{
+    cdd_manager* outer = cdd_manager_current();
+
+    SUBCASE("nested contexts")
+    {
+        cdd_context a(100, 1000, 1000);
+        cdd_add_clocks(2);
+        cdd x = cdd_upper(1, 0, dbm_bound2raw(5, dbm_WEAK));
+        {
+            cdd_context b(100, 1000, 1000);
+            cdd_add_bddvar(3);
+            CHECK(cdd_get_level_count() == 3);
+            CHECK(cdd_getclocks() == 0);
+            CHECK(manager_test(7));
+        }
+        CHECK(cdd_manager_current() == a.handle());
+        CHECK(cdd_get_level_count() == 1);
+        CHECK(cdd_reduce(x & !x) == cdd_false());
+    }
+
+    SUBCASE("one manager per thread")
+    {
+        std::vector<int> results(4, 0);
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < results.size(); ++i)
+            threads.emplace_back([&results, i] {
+                for (int32_t k = 0; k < 50; ++k)
+                    results[i] += manager_test(k);
+            });
+        for (auto& t : threads)
+            t.join();
+        for (int r : results)
+            CHECK(r == 50);
+    }
+
+    CHECK(cdd_manager_current() == outer);
+}
+
+static cdd shared_test(int32_t k, int32_t var)
+{
+    cdd res = cdd_false();
+    for (int32_t i = 1; i < 4; ++i) {
+        cdd a = cdd_interval(i, 0, dbm_bound2raw(-k - i, dbm_WEAK), dbm_bound2raw(k + 2 * i, dbm_STRICT));
+        cdd b = cdd_upper(i, i % 3 + 1, dbm_bound2raw(k % 5, dbm_WEAK)) & cdd_bddvarpp(var + i % 2);
+        res = (res | a) ^ b;
+    }
+    return cdd_reduce(res);
+}
+
+TEST_CASE("Shared manager")
+{
+    cdd_context ctx(100, 1000, 1000);
+    cdd_add_clocks(4);
+    int32_t var = cdd_add_bddvar(2);
+
+    const int32_t n = 40;
+    std::vector<std::vector<cdd>> results(4);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < results.size(); ++i)
+        threads.emplace_back([&ctx, &results, i, var] {
+            cdd_worker worker(ctx.handle(), 1000);
+            for (int32_t k = 0; k < n; ++k)
+                results[i].push_back(shared_test(k, var));
+        });
+    for (auto& t : threads)
+        t.join();
+
+    CHECK(cdd_manager_current() == ctx.handle());
+    for (auto& r : results) {
+        REQUIRE(r.size() == n);
+        for (int32_t k = 0; k < n; ++k) {
+            cdd expected = shared_test(k, var);
+            CHECK(r[k] == expected);
+            CHECK(cdd_reduce(r[k] ^ expected) == cdd_false());
+        }
+    }
+    results.clear();
+    cdd_gbc();
+    CHECK(cdd_manager_current() == ctx.handle());
+}
+
+/** Builds a union of \a n boxes over the clocks 1 to 3. */
+static cdd boxes(int32_t n, int32_t seed)
+{
+    cdd res = cdd_false();
+    for (int32_t k = 0; k < n; ++k) {
+        cdd box = cdd_true();
+        for (int32_t i = 1; i < 4; ++i) {
+            int32_t lo = (seed * 7 + k * 13 + i * 5) % 40;
+            box &= cdd_interval(i, 0, dbm_bound2raw(-lo, dbm_WEAK), dbm_bound2raw(lo + 3 + k % 7, dbm_STRICT));
+        }
+        res |= box & cdd_upper(k % 3 + 1, (k + 1) % 3 + 1, dbm_bound2raw(seed % 11 - 5, dbm_WEAK));
+    }
+    return res;
+}
+
+TEST_CASE("Wide nodes are shared")
+{
+    cdd_context ctx(100, 10000, 10000);
+    cdd_add_clocks(2);
+
+    // Unions of intervals of one clock are canonical, so equal unions
+    // are the same node, also when it has many children
+    auto intervals = [](int32_t n, int32_t last) {
+        cdd res = cdd_false();
+        for (int32_t k = 0; k < n; ++k) {
+            int32_t hi = k + 1 == n ? last : 4 * k + 2;
+            res |= cdd_interval(1, 0, dbm_bound2raw(4 * k, dbm_STRICT), dbm_bound2raw(hi, dbm_WEAK));
+        }
+        return res;
+    };
+    for (int32_t n : {2, 3, 8, 40}) {
+        cdd a = intervals(n, 4 * n);
+        CHECK(cdd_edgecount(a.handle()) == 2 * n + 1);
+        CHECK(intervals(n, 4 * n) == a);
+        CHECK(intervals(n, 4 * n - 1) != a);
+    }
+}
+
+TEST_CASE("Move semantics")
+{
+    cdd_context ctx(100, 10000, 10000);
+    cdd_add_clocks(4);
+    cdd x = boxes(10, 1);
+    cdd y = boxes(10, 2);
+    cdd z = boxes(10, 3);
+    cdd all = (x & y) | z;
+    uint32_t ref = cdd_rglr(all.handle())->ref;
+
+    // Moving takes over the reference and leaves the empty CDD
+    cdd moved = std::move(all);
+    CHECK(all == cdd_false());
+    CHECK(cdd_rglr(moved.handle())->ref == ref);
+    all = std::move(moved);
+    CHECK(cdd_rglr(all.handle())->ref == ref);
+
+    // Compound assignments update the object itself
+    cdd w = x;
+    CHECK(&(w &= y) == &w);
+    CHECK(&(w |= z) == &w);
+    CHECK(w == all);
+    CHECK(&(w -= z) == &w);
+    CHECK(&(w ^= y) == &w);
+    CHECK(w == cdd(cdd_apply(cdd_apply(all.handle(), cdd_neg(z.handle()), cddop_and), y.handle(), cddop_xor)));
+
+    // Temporaries give the same results as named operands
+    cdd xy = x & y;
+    CHECK((cdd(x) & y) == xy);
+    CHECK((cdd(xy) | z) == all);
+    CHECK((cdd(all) - z) == (all - z));
+    CHECK((cdd(all) ^ y) == (all ^ y));
+    CHECK((x & y & z & x) == (xy & z));
+    CHECK(cdd_rglr(all.handle())->ref == ref);
+}
+
+TEST_CASE("Lazy formulas")
+{
+    cdd_context ctx(100, 10000, 10000);
+    int32_t level = cdd_add_bddvar(1);
+    cdd_add_clocks(4);
+    cdd a = boxes(8, 1);
+    cdd b = boxes(8, 2);
+    cdd c = boxes(8, 3);
+    cdd d = boxes(8, 4);
+    cdd e = cdd_bddvarpp(level);
+
+    // Lazy formulas equal the diagrams built one operator at a time
+    auto same = [](const cdd& l, const cdd& r) { return cdd_reduce(l ^ r) == cdd_false(); };
+    CHECK(same((cdd_lazy(a) & b & c) | (d - e), (a & b & c) | (d - e)));
+    CHECK(same(!(cdd_lazy(a) | b | !c), !(a | b | !c)));
+    CHECK(same(cdd_lazy(a) - (b & !(c | d)), a - (b & !(c | d))));
+    CHECK(same((cdd_lazy(a) ^ b) & (c ^ !cdd_lazy(d)), (a ^ b) & (c ^ !d)));
+    CHECK(same(!(cdd_lazy(a) ^ (b | c)), !(a ^ (b | c))));
+    CHECK(same(e | (cdd_lazy(a) & (b | (c & d))), e | (a & (b | (c & d)))));
+    CHECK(same(cdd_lazy(a), a));
+
+    // A conjunction of operands is a single n-ary apply
+    cdd guard = cdd_lazy(a) & b & c & d & e;
+    CHECK(guard == cdd_apply_n({a, b, c, d, e}, cddop_and));
+    cdd any = cdd_lazy(a) | b | c | !d;
+    CHECK(any == cdd_apply_n({a, b, c, !d}, cddop_or));
+}
+
+TEST_CASE("Derived operators")
+{
+    cdd_context ctx(100, 10000, 10000);
+    int32_t level = cdd_add_bddvar(1);
+    cdd_add_clocks(4);
+    cdd b = cdd_bddvarpp(level);
+
+    for (int32_t k = 0; k < 6; ++k) {
+        cdd l = boxes(8, k) | (k % 2 ? b : cdd_false());
+        cdd r = boxes(8, k + 11) & (k % 3 ? !b : cdd_true());
+        CHECK(cdd_apply(l, r, cddop_diff) == (l & !r));
+        CHECK(cdd_apply(l, r, cddop_implies) == ((!l) | r));
+        CHECK(cdd_apply(l, r, cddop_or) == !((!l) & !r));
+        CHECK(cdd_equiv(cdd_apply_reduce(l, r, cddop_diff), l & !r));
+        CHECK(cdd_equiv(cdd_apply_reduce(l, r, cddop_implies), (!l) | r));
+        CHECK(cdd_apply_n({l, r, b}, cddop_diff) == (l & !r & !b));
+    }
+
+    // Unknown operations are reported and yield false
+    CHECK(cdd_apply(b, b, 17) == cdd_false());
+    CHECK(cdd_apply_reduce(b, b, -1) == cdd_false());
+}
+
+TEST_CASE("Growing reference stack")
+{
+    // A stack of two entries is too small for any node
+    cdd_context ctx(100, 10000, 2);
+    cdd_add_clocks(4);
+    cdd x = boxes(12, 3);
+    cdd y = boxes(12, 8);
+    CHECK(cdd_equiv((x & y) | (x - y), x));
+    CHECK(cdd_reduce(x ^ y) == cdd_reduce(cdd_apply_reduce(x, y, cddop_xor)));
+    CHECK(cdd_equiv(cdd_apply_n({x, y, !x}, cddop_or), cdd_true()));
+
+    // Diagrams deeper than the C stack would allow for recursion
+    const int32_t depth = 200000;
+    int32_t level = cdd_add_bddvar(depth);
+    cdd all = cdd_true();
+    cdd parity = cdd_false();
+    for (int32_t i = depth - 1; i >= 0; --i) {
+        all = cdd_bddvarpp(level + i) & all;
+        parity = cdd_bddvarpp(level + i) ^ parity;
+    }
+    cdd odd = all & parity;
+    std::unique_ptr<bool[]> vars(new bool[cdd_levelcnt]);
+    std::fill_n(vars.get(), cdd_levelcnt, true);
+    std::vector<int32_t> clocks(cdd_clocknum, 0);
+    CHECK(cdd_eval_point(odd, clocks.data(), vars.get()) == (depth % 2 == 1));
+    CHECK(cdd_equiv(odd ^ (all - parity), all));
+}
+
+static int32_t rehashes = 0;
+
+TEST_CASE("Incremental rehash")
+{
+    cdd_context ctx(100, 10000, 10000);
+    cdd_add_clocks(2);
+    int32_t level = cdd_add_bddvar(1);
+    rehashes = 0;
+    cdd_postrehash_hook([](CddRehashStat*) { ++rehashes; });
+
+    // Nodes stay unique while their tables are migrated, and when a
+    // garbage collection interrupts the migration
+    auto box = [](int32_t k) {
+        return cdd_intervalpp(1, 0, dbm_bound2raw(-k, dbm_WEAK), dbm_bound2raw(k + 1, dbm_WEAK));
+    };
+    auto var = [&](int32_t k) { return cdd_bddvarpp(level) & box(k); };
+    std::vector<cdd> intervals, vars;
+    int32_t lost = 0;
+    for (int32_t k = 0; k < 6000; ++k) {
+        intervals.push_back(box(k));
+        vars.push_back(var(k));
+        if (k % 1000 == 999) {
+            cdd_gbc();
+        }
+        if (k % 97 == 0) {
+            for (int32_t j = 0; j <= k; j += 13) {
+                lost += box(j) != intervals[j] || var(j) != vars[j];
+            }
+        }
+    }
+    CHECK(lost == 0);
+    CHECK(rehashes >= 4);
+}
+
+TEST_CASE("Variable reordering")
+{
+    cdd_context ctx(100, 10000, 10000);
+    const int32_t n = 8;
+    int32_t var = cdd_add_bddvar(2 * n);
+    cdd_add_clocks(4);
+    int32_t tail = cdd_add_bddvar(2);
+
+    // The pairs are declared far apart, which makes the diagram exponential
+    auto pairs = [&](int32_t from) {
+        cdd res = cdd_false();
+        for (int32_t i = from; i < n; ++i) {
+            res |= cdd_bddvarpp(var + i) & cdd_bddvarpp(var + n + i);
+        }
+        return res;
+    };
+    cdd f = pairs(0);
+    cdd g = (f & boxes(6, 1)) | (cdd_bddvarpp(tail) ^ cdd_bddvarpp(tail + 1));
+    cdd h = f;
+    int32_t size = cdd_nodecount(f);
+
+    // Swapping keeps the meaning of the diagrams held
+    REQUIRE(cdd_swap_levels(var) == 0);
+    CHECK(cdd_get_var_level(var) == var + 1);
+    CHECK(cdd_get_level_var(var) == var + 1);
+    CHECK(pairs(0) == f);
+    CHECK(cdd_swap_levels(var + 2 * n - 1) == CDD_VAR);
+
+    CHECK(cdd_reorder() > 0);
+    CHECK(cdd_nodecount(f) < size / 4);
+    CHECK(pairs(0) == f);
+    CHECK(h == f);
+    CHECK(g == ((pairs(0) & boxes(6, 1)) | (cdd_bddvarpp(tail) ^ cdd_bddvarpp(tail + 1))));
+
+    // Clock differences keep their levels and variables their runs
+    for (int32_t level = 0; level < cdd_levelcnt; ++level) {
+        if (cdd_get_levelinfo(level)->type == TYPE_CDD) {
+            CHECK(cdd_get_level_var(level) == level);
+        }
+        CHECK(cdd_get_var_level(cdd_get_level_var(level)) == level);
+    }
+    CHECK(cdd_get_var_level(tail) >= tail);
+
+    // Variables are still identified by the level they were declared at
+    std::vector<int32_t> levels(cdd_levelcnt, 0);
+    std::vector<int32_t> clocks(cdd_clocknum, 0);
+    levels[var] = 1;
+    CHECK(cdd_exist(f, levels.data(), clocks.data()) == (cdd_bddvarpp(var + n) | pairs(1)));
+    std::unique_ptr<bool[]> vals(new bool[cdd_levelcnt]);
+    std::fill_n(vals.get(), cdd_levelcnt, false);
+    vals[var + 1] = vals[var + n + 1] = true;
+    CHECK(cdd_eval_point(f, clocks.data(), vals.get()));
+    vals[var + n + 1] = false;
+    CHECK(!cdd_eval_point(f, clocks.data(), vals.get()));
+
+    // Garbage collection reorders above the threshold and raises it
+    CHECK(cdd_setreorderthreshold(1) == 0);
+    cdd_gbc();
+    CHECK(cdd_setreorderthreshold(0) > 1);
+    CHECK(pairs(0) == f);
+}
+
+/** Returns the number of nodes in use, dead ones included, in the current manager. */
+static int64_t used_nodes()
+{
+    cdd_manager* man = cdd_manager_current();
+    int64_t used = man->bddmanager->usedcnt;
+    for (int32_t i = 2; i <= man->maxcddused; ++i) {
+        used += man->cddmanager[i] ? man->cddmanager[i]->usedcnt : 0;
+    }
+    return used;
+}
+
+TEST_CASE("Saving and loading")
+{
+    const char* name = "test_cdd_save.bin";
+    cdd_context ctx(100, 10000, 10000);
+    int32_t var = cdd_add_bddvar(3);
+    cdd_add_clocks(4);
+    cdd_add_tautologies(1);
+    auto build = [&] {
+        cdd b = cdd_bddvarpp(var), c = cdd_bddvarpp(var + 1);
+        cdd t(cdd_apply_tautology(boxes(3, 3).handle(), 0));
+        return std::vector<cdd>{(boxes(6, 1) & b) | ((!c) & boxes(4, 2)), b & c, (!(b & c)) | t, cdd_true()};
+    };
+    std::vector<cdd> saved = build();
+
+    FILE* ofile = std::fopen(name, "wb");
+    REQUIRE(ofile != nullptr);
+    cdd_writer* w = cdd_writer_create(ofile);
+    for (const cdd& c : saved) {
+        CHECK(cdd_writer_add(w, c) == 0);
+    }
+
+    // Nodes written before are only referenced
+    long before = std::ftell(ofile);
+    CHECK(cdd_writer_add(w, saved[0]) == 0);
+    CHECK(std::ftell(ofile) - before <= 4);
+    CHECK(cdd_writer_close(w) == 0);
+    long size = std::ftell(ofile);
+    std::fclose(ofile);
+    saved.push_back(saved[0]);
+
+    std::vector<cdd> loaded;
+    CHECK(cdd_fnload(name, loaded) == 5);
+    CHECK(loaded == saved);
+
+    std::vector<char> data(size);
+    ofile = std::fopen(name, "rb");
+    REQUIRE(std::fread(data.data(), 1, size, ofile) == (size_t)size);
+    std::fclose(ofile);
+    ddNode** roots;
+    REQUIRE(cdd_load(data.data(), size, &roots) == 5);
+    for (int32_t i = 0; i < 5; ++i) {
+        CHECK(roots[i] == saved[i].handle());
+        cdd_rec_deref(roots[i]);
+    }
+    std::free(roots);
+
+    // Malformed and truncated files create no nodes
+    CHECK(cdd_load(data.data(), size - 1, &roots) == CDD_FORMAT);
+    CHECK(roots == nullptr);
+    data[0] = 'X';
+    CHECK(cdd_load(data.data(), size, &roots) == CDD_FORMAT);
+
+    // Nodes whose levels were swapped are rebuilt
+    REQUIRE(cdd_swap_levels(var) == 0);
+    loaded.clear();
+    CHECK(cdd_fnload(name, loaded) == 5);
+    CHECK(loaded == saved);
+
+    // Another manager declaring the same variables loads the same diagrams
+    {
+        cdd_context other(100, 10000, 10000);
+        cdd_add_bddvar(3);
+        cdd_add_clocks(4);
+        cdd_add_tautologies(1);
+        build();
+        cdd_gbc();
+        int64_t used = used_nodes();
+        loaded.clear();
+        CHECK(cdd_fnload(name, loaded) == 5);
+        CHECK(loaded[0] == build()[0]);
+        CHECK(loaded[2] == build()[2]);
+
+        // Loaded nodes are only kept by the roots
+        loaded.clear();
+        cdd_gbc();
+        CHECK(used_nodes() == used);
+    }
+    {
+        cdd_context other(100, 10000, 10000);
+        cdd_add_bddvar(3);
+        cdd_add_clocks(3);
+        CHECK(cdd_fnload(name, loaded) == CDD_VAR);
+        CHECK(loaded.empty());
+    }
+    std::remove(name);
+}
+
+/** Prints \a c in dot format and returns the number of nodes printed, checking that all edges have declared ends. */
+static size_t dot_nodes(const cdd& c, bool push_negate, size_t maxnodes, size_t* stubs)
+{
+    FILE* file = std::tmpfile();
+    REQUIRE(file != nullptr);
+    cdd_fprintdot_limit(file, c, push_negate, maxnodes);
+    std::rewind(file);
+
+    std::vector<std::string> declared, targets;
+    size_t nodes = 0;
+    *stubs = 0;
+    char line[512];
+    while (std::fgets(line, sizeof line, file)) {
+        std::string s(line);
+        size_t arrow = s.find("-> \"");
+        if (arrow == std::string::npos) {
+            declared.push_back(s.substr(0, s.find(' ')));
+            nodes += s.find("circle") != std::string::npos || s.find("octagon") != std::string::npos;
+            *stubs += s.find("...") != std::string::npos;
+        } else {
+            targets.push_back(s.substr(arrow + 3, s.find(' ', arrow + 3) - arrow - 3));
+        }
+    }
+    std::fclose(file);
+    std::sort(declared.begin(), declared.end());
+    for (const std::string& t : targets) {
+        CHECK(std::binary_search(declared.begin(), declared.end(), t));
+    }
+    return nodes;
+}
+
+TEST_CASE("Dot export")
+{
+    cdd_context ctx(100, 10000, 10000);
+    int32_t var = cdd_add_bddvar(12);
+    cdd_add_clocks(4);
+    cdd f = boxes(20, 4);
+    for (int32_t i = 0; i < 6; ++i) {
+        f = (f & cdd_bddvarpp(var + i)) ^ (cdd_bddvarpp(var + 6 + i) | boxes(2, i));
+    }
+    size_t stubs;
+
+    // Each node is printed once per parity of the negations above it
+    size_t all = dot_nodes(f, false, 0, &stubs);
+    CHECK(all >= (size_t)cdd_nodecount(f));
+    CHECK(all <= 2 * (size_t)cdd_nodecount(f));
+    CHECK(stubs == 0);
+    CHECK(dot_nodes(f, true, 0, &stubs) == all);
+
+    // A limited export prints the top of the diagram
+    CHECK(dot_nodes(f, false, 10, &stubs) == 10);
+    CHECK(stubs > 0);
+    CHECK(dot_nodes(f, false, all, &stubs) == all);
+    CHECK(stubs == 0);
+}
+
+TEST_CASE("Node handles")
+{
+    cdd_context ctx(100, 10000, 10000);
+    int32_t level = cdd_add_bddvar(1);
+    cdd_add_clocks(4);
+    cdd b = cdd_bddvarpp(level);
+    cdd x = boxes(5, 1);
+    cdd_add_tautologies(1);
+    ddNode* t = cdd_apply_tautology(cddtrue, 0);
+    REQUIRE(cdd_is_extra_terminal(t));
+
+    // Handles of nodes, negated nodes and terminals name the same node
+    for (ddNode* n : {b.handle(), (!b).handle(), x.handle(), (!x).handle(), cddtrue, cddfalse, t}) {
+        CHECK(cdd_fromhandle(cdd_tohandle(n)) == n);
+        CHECK(cdd_mask(cdd_tohandle(n)) == cdd_mask(n));
+    }
+    CHECK(bdd_node_low(b.handle()) == cddfalse);
+    CHECK(bdd_node_high(b.handle()) == cddtrue);
+}
+
+TEST_CASE("Reduced nodes")
+{
+    cdd_context ctx(100, 10000, 10000);
+    int32_t level = cdd_add_bddvar(1);
+    cdd_add_clocks(4);
+    cdd b = cdd_bddvarpp(level);
+    cdd x = boxes(20, 1);
+    cdd y = boxes(20, 2);
+
+    // Reduced results are flagged and returned as they are afterwards
+    cdd rx = cdd_reduce(x);
+    CHECK(cdd_isreduced(rx.handle()));
+    CHECK(cdd(cdd_bf_reduce(rx.handle())) == rx);
+    CHECK(cdd_reduce(rx) == rx);
+
+    // Flagged nodes below BDD nodes are not explored again, while
+    // nodes below constraints are still reduced under them
+    cdd ry = cdd_apply_reduce(y, cdd_true(), cddop_and);
+    CHECK(cdd_isreduced(ry.handle()));
+    cdd z = (b & rx) | ((!b) & ry);
+    cdd rz = cdd_reduce(z);
+    CHECK(rz == z);
+    CHECK(cdd_isreduced(rz.handle()));
+    cdd w = rx & cdd_upper(1, 2, dbm_bound2raw(-3, dbm_WEAK));
+    cdd rw = cdd_reduce(w);
+    CHECK(cdd(cdd_bf_reduce(w.handle())) == rw);
+    CHECK(cdd_reduce(rw ^ cdd_reduce(x & cdd_upper(1, 2, dbm_bound2raw(-3, dbm_WEAK)))) == cdd_false());
+}
+
+TEST_CASE("Parallel apply")
+{
+    cdd_context ctx(100, 10000, 10000);
+    cdd_add_clocks(4);
+    cdd l = boxes(30, 1);
+    cdd r = boxes(30, 2);
+
+    for (int32_t depth : {0, 2, 5}) {
+        cdd_setparcutoff(depth);
+        for (int32_t op : {cddop_and, cddop_xor}) {
+            cdd seq = cdd_apply(l, r, op);
+            CHECK(cdd_apply_par(l, r, op, 4) == seq);
+            CHECK(cdd_apply_par(l, !r, op, 3) == cdd_apply(l, !r, op));
+        }
+    }
+    CHECK(cdd_apply_par(l, r, cddop_and, 1) == (l & r));
+    CHECK(cdd_manager_current() == ctx.handle());
+}
+
+TEST_CASE("Operation cache statistics")
+{
+    cdd_context ctx(100, 64, 1000);
+    cdd_add_clocks(4);
+    CddCacheStat stat;
+
+    REQUIRE(cdd_cachestats(CDD_APPLYCACHE, &stat) == 0);
+    CHECK(stat.size == 64);
+    CHECK(stat.maxsize == 8 * 64);
+    CHECK(stat.lookups == 0);
+    CHECK(cdd_cachestats(3, &stat) == CDD_RANGE);
+
+    // A small cache thrashes and grows to its maximum
+    for (int32_t k = 0; k < 20; ++k) {
+        cdd x = boxes(20, k);
+        cdd y = boxes(20, k + 1);
+        CHECK(cdd_reduce((x & y) ^ (y & x)) == cdd_false());
+    }
+    REQUIRE(cdd_cachestats(CDD_APPLYCACHE, &stat) == 0);
+    CHECK(stat.lookups > stat.hits);
+    CHECK(stat.hits > 0);
+    CHECK(stat.overwrites > 0);
+    CHECK(stat.resizes == 3);
+    CHECK(stat.size == stat.maxsize);
+
+    REQUIRE(cdd_setcachesize(CDD_APPLYCACHE, 1001, 0) == 0);
+    REQUIRE(cdd_cachestats(CDD_APPLYCACHE, &stat) == 0);
+    CHECK(stat.size == 1002);
+    CHECK(stat.maxsize == 1002);
+    CHECK(stat.lookups == 0);
+    cdd x = boxes(10, 3);
+    CHECK((x & x) == x);
+    CHECK(cdd_reduce((x & boxes(10, 4)) - x) == cdd_false());
+}
+
+static int32_t gbc_runs;
+
+static void count_gbc(CddGbcStat*) { ++gbc_runs; }
+
+TEST_CASE("Operation cache across garbage collection")
+{
+    cdd_context ctx(100, 1 << 16, 1000);
+    cdd_add_clocks(4);
+    cdd_postgbc_hook(count_gbc);
+    gbc_runs = 0;
+
+    cdd x = boxes(20, 1);
+    cdd y = boxes(20, 2);
+    cdd z = x & y;
+    CddCacheStat before, after;
+
+    // Entries of live nodes survive a collection of unrelated garbage
+    for (int32_t k = 3; gbc_runs == 0; ++k) {
+        (void)boxes(5, k);
+    }
+    REQUIRE(cdd_cachestats(CDD_APPLYCACHE, &before) == 0);
+    CHECK((x & y) == z);
+    REQUIRE(cdd_cachestats(CDD_APPLYCACHE, &after) == 0);
+    CHECK(after.hits == before.hits + 1);
+
+    // Results stay correct while nodes are collected and reused, also
+    // over more collections than the epoch stamps distinguish
+    for (int32_t k = 0; gbc_runs <= CDD_EPOCHS; ++k) {
+        cdd a = boxes(5, k);
+        cdd b = boxes(5, k + 1);
+        CHECK(cdd_reduce((a & b) ^ (b & a)) == cdd_false());
+        CHECK((a & b) == (b & a));
+        CHECK((x & y) == z);
+    }
+    CHECK(cdd_reduce(z - x) == cdd_false());
+    cdd_postgbc_hook(nullptr);
+}
+
+/** Runs \a runs garbage collections of intervals, which do not use the operation caches. */
+static void collect_intervals(int32_t runs)
+{
+    gbc_runs = 0;
+    for (int32_t k = 0; gbc_runs < runs; ++k) {
+        int32_t lo = k % 1000;
+        (void)cdd_interval(1, 0, dbm_bound2raw(-lo, dbm_WEAK), dbm_bound2raw(lo + 1 + k / 1000 % 1000, dbm_WEAK));
+    }
+}
+
+TEST_CASE("Operation cache of long-lived operands")
+{
+    cdd_context ctx(100, 1000, 1000);
+    cdd_add_clocks(4);
+    cdd_postgbc_hook(count_gbc);
+
+    cdd x = boxes(20, 2);
+    cdd y = boxes(20, 3);
+    cdd z = x & y;
+    CddCacheStat before, after;
+
+    // Entries survive more collections than the epoch stamps distinguish
+    collect_intervals(CDD_EPOCHS + CDD_EPOCHS / 2);
+    REQUIRE(cdd_cachestats(CDD_APPLYCACHE, &before) == 0);
+    CHECK((x & y) == z);
+    REQUIRE(cdd_cachestats(CDD_APPLYCACHE, &after) == 0);
+    CHECK(after.hits == before.hits + 1);
+
+    // Entries written long after their operands were built match too
+    cdd w = x ^ y;
+    collect_intervals(1);
+    REQUIRE(cdd_cachestats(CDD_APPLYCACHE, &before) == 0);
+    CHECK((x ^ y) == w);
+    REQUIRE(cdd_cachestats(CDD_APPLYCACHE, &after) == 0);
+    CHECK(after.hits == before.hits + 1);
+    cdd_postgbc_hook(nullptr);
+}
+
+static int32_t minor_runs;
+static int32_t full_runs;
+
+static void count_minor(CddGbcStat* s) { ++(s->young > 0 ? minor_runs : full_runs); }
+
+TEST_CASE("Minor garbage collection")
+{
+    cdd_context ctx(100, 1000, 1000);
+    cdd_add_clocks(4);
+    cdd_postgbc_hook(count_minor);
+    minor_runs = full_runs = 0;
+
+    CHECK(cdd_setnurserysize(-1) == CDD_RANGE);
+    CHECK(cdd_setnurserysize(512) > 0);
+    cdd x = boxes(20, 1);
+    cdd y = boxes(20, 2);
+    cdd z = x & y;
+
+    // Temporaries are reclaimed by minor collections, keeping the
+    // nodes which are referenced or older
+    for (int32_t k = 0; minor_runs < 20; ++k) {
+        cdd a = boxes(5, k);
+        cdd b = boxes(5, k + 1);
+        CHECK((a & b) == (b & a));
+        CHECK(cdd_reduce((a & b) - a) == cdd_false());
+        CHECK((x & y) == z);
+    }
+    CHECK(cdd_reduce(z - (x & y)) == cdd_false());
+
+    // Full nurseries are only collected when free nodes run short
+    REQUIRE(cdd_reserve(-1, 2, 40000) == 0);
+    REQUIRE(cdd_reserve(-1, 3, 40000) == 0);
+    minor_runs = full_runs = 0;
+    for (int32_t k = 0; k < 20000; ++k) {
+        int32_t lo = k % 1000;
+        (void)cdd_interval(1, 0, dbm_bound2raw(-lo, dbm_WEAK), dbm_bound2raw(lo + 1 + k / 1000, dbm_WEAK));
+    }
+    CHECK(minor_runs == 0);
+    CHECK(full_runs == 0);
+
+    // Without nurseries only full collections run
+    CHECK(cdd_setnurserysize(0) == 512);
+    minor_runs = full_runs = 0;
+    for (int32_t k = 0; full_runs < 3; ++k) {
+        cdd a = boxes(5, k);
+        CHECK((a & y) == (y & a));
+    }
+    CHECK(minor_runs == 0);
+    CHECK((x & y) == z);
+    cdd_postgbc_hook(nullptr);
+}
+
+TEST_CASE("Saturated reference counts")
+{
+    cdd_context ctx(100, 1000, 1000);
+    cdd_add_clocks(4);
+    cdd x = boxes(3, 1);
+    CHECK(cdd_getsaturated() == 0);
+
+    std::vector<cdd> copies(1100, x);
+#ifdef WIDEREF
+    CHECK(cdd_getsaturated() == 0);
+#else
+    CHECK(cdd_getsaturated() == 1);
+#endif
+    // Saturated nodes stay saturated
+    int32_t saturated = cdd_getsaturated();
+    copies.clear();
+    CHECK(cdd_getsaturated() == saturated);
+    CHECK(cdd_reduce(x - boxes(3, 1)) == cdd_false());
+}
+
+static int64_t freed_bytes;
+
+static void count_freed(CddGbcStat* s) { freed_bytes += s->freedbytes; }
+
+TEST_CASE("Node arenas are returned to the system")
+{
+    cdd_context ctx(100, 1000, 1000);
+    cdd_add_clocks(4);
+
+    // Distinct intervals need some megabytes of nodes
+    std::vector<cdd> intervals;
+    for (int32_t i = 1; i < 4; ++i) {
+        for (int32_t lo = 0; lo < 300; ++lo) {
+            for (int32_t hi = lo + 1; hi < 300; ++hi) {
+                intervals.push_back(cdd_interval(i, 0, dbm_bound2raw(-lo, dbm_WEAK), dbm_bound2raw(hi, dbm_WEAK)));
+            }
+        }
+    }
+    size_t k = 0;
+    for (int32_t i = 1; i < 4; ++i) {
+        for (int32_t lo = 0; lo < 300; ++lo) {
+            for (int32_t hi = lo + 1; hi < 300; ++hi) {
+                REQUIRE(intervals[k++] ==
+                        cdd_interval(i, 0, dbm_bound2raw(-lo, dbm_WEAK), dbm_bound2raw(hi, dbm_WEAK)));
+            }
+        }
+    }
+    int32_t arenas = cdd_manager_current()->arenacnt;
+    CHECK(arenas > 1);
+
+    // Memory of the dropped nodes goes back to the system
+    freed_bytes = 0;
+    cdd_postgbc_hook(count_freed);
+    intervals.clear();
+    cdd_gbc();
+    int64_t trimmed = cdd_trim();
+    CHECK(freed_bytes + trimmed > 0);
+    CHECK(cdd_trim() == 0);
+    CHECK(cdd_manager_current()->arenacnt < arenas);
+    CHECK(cdd_reduce(boxes(10, 1) - boxes(10, 1)) == cdd_false());
+    cdd_postgbc_hook(nullptr);
+}
+
+TEST_CASE("Operation cache across releasing chunks")
+{
+    cdd_context ctx(100, 1000, 1000);
+    cdd_add_clocks(4);
+
+    std::vector<cdd> intervals;
+    for (int32_t lo = 0; lo < 300; ++lo) {
+        for (int32_t hi = lo + 1; hi < 300; ++hi) {
+            intervals.push_back(cdd_interval(1, 0, dbm_bound2raw(-lo, dbm_WEAK), dbm_bound2raw(hi, dbm_WEAK)));
+        }
+    }
+    cdd x = boxes(20, 1);
+    cdd y = boxes(20, 2);
+    cdd z = x & y;
+    CddCacheStat before, after;
+    intervals.clear();
+
+    // Entries of live nodes survive a collection releasing chunks
+    freed_bytes = 0;
+    cdd_postgbc_hook(count_freed);
+    for (int32_t hi = 1; freed_bytes == 0 && hi < 100000; ++hi) {
+        intervals.push_back(cdd_interval(2, 0, dbm_bound2raw(0, dbm_WEAK), dbm_bound2raw(hi, dbm_WEAK)));
+    }
+    cdd_postgbc_hook(nullptr);
+    REQUIRE(freed_bytes > 0);
+    REQUIRE(cdd_cachestats(CDD_APPLYCACHE, &before) == 0);
+    CHECK((x & y) == z);
+    REQUIRE(cdd_cachestats(CDD_APPLYCACHE, &after) == 0);
+    CHECK(after.hits == before.hits + 1);
+}
+
+TEST_CASE("Memory budget")
+{
+    cdd_context ctx(100, 1000, 1000);
+    cdd_add_clocks(4);
+    cdd x = boxes(10, 1);
+    cdd y = boxes(10, 2);
+    cdd z = x & y;
+    const int64_t budget = 1 << 20;
+    CddCacheStat stat;
+
+    CHECK(cdd_setmemorybudget(-1) == CDD_RANGE);
+    CHECK(cdd_setmemorybudget(budget) == 0);
+    REQUIRE(cdd_cachestats(CDD_APPLYCACHE, &stat) == 0);
+    CHECK(stat.maxsize * 3 * 32 <= budget / 4);
+    CHECK(cdd_setminfreenodes(101) == CDD_RANGE);
+    CHECK(cdd_setminfreenodes(10) == 20);
+
+    // Live nodes exhaust the budget, which is then reported
+    std::vector<cdd> intervals;
+    auto fill = [&] {
+        for (int32_t lo = 0; lo < 1000 && cdd_errorcond == 0; ++lo) {
+            for (int32_t hi = lo + 1; hi < 1000; hi += 3) {
+                intervals.push_back(cdd_interval(1, 0, dbm_bound2raw(-lo, dbm_WEAK), dbm_bound2raw(hi, dbm_WEAK)));
+            }
+        }
+    };
+    fill();
+    CHECK(cdd_errorcond == CDD_MEMORY);
+    CHECK(cdd_getmemoryused() > budget / 2);
+    CHECK(cdd_getmemoryused() <= budget + 2 * (1 << 16));
+
+    // Operations back off and return NULL while the error is raised
+    CHECK(cdd_apply(x.handle(), y.handle(), cddop_xor) == NULL);
+    CHECK(cdd_apply(x.handle(), cdd_neg(y.handle()), cddop_and) == NULL);
+    CHECK(cdd_apply_reduce(x.handle(), y.handle(), cddop_or) == NULL);
+    CHECK_THROWS_AS(x | y, std::bad_alloc);
+    CHECK_THROWS_AS(x & !y, std::bad_alloc);
+
+    // Constructors allocate at most 256 KiB past the chunk which reached
+    // the limit, and then return the false terminal
+    for (int32_t hi = 1; hi < 20000; ++hi) {
+        intervals.push_back(cdd_interval(2, 0, 0, dbm_bound2raw(hi, dbm_WEAK)));
+    }
+    CHECK(cdd_getmemoryused() <= budget + (1 << 16) + (1 << 18));
+    CHECK(intervals.back() == cdd_false());
+    CHECK(cdd_clearerror() == CDD_MEMORY);
+
+    // An operation reaching the limit again returns NULL
+    CHECK(cdd_apply(x.handle(), y.handle(), cddop_xor) == NULL);
+    CHECK(cdd_clearerror() == CDD_MEMORY);
+
+    // Dropping nodes makes room again
+    intervals.clear();
+    CHECK((x & y) == z);
+    CHECK(cdd_reduce(boxes(10, 3) - boxes(10, 3)) == cdd_false());
+    CHECK(cdd_errorcond == 0);
+    CHECK(cdd_setmemorybudget(0) == budget);
+
+    // A limit on the number of nodes is reported likewise
+    CHECK(cdd_setmaxnodenum(1) == 0);
+    fill();
+    CHECK(cdd_clearerror() == CDD_NODENUM);
+    CHECK(cdd_setmaxnodenum(0) == 1);
+}
+
+TEST_CASE("Federation import")
+{
+    cdd_context ctx(100, 10000, 10000);
+    const cindex_t dim = 4;
+    cdd_add_clocks(dim);
+
+    std::vector<std::vector<raw_t>> zones(37, std::vector<raw_t>(dim * dim));
+    std::vector<const raw_t*> dbms;
+    dbm::fed_t fed(dim);
+    cdd chain = cdd_false();
+    for (auto& z : zones) {
+        dbm_generate(z.data(), dim, RANGE());
+        dbms.push_back(z.data());
+        fed.add(z.data(), dim);
+        chain |= cdd(z.data(), dim);
+    }
+
+    CHECK(cdd(cdd_from_dbms(dbms.data(), 0, dim)) == cdd_false());
+    CHECK(cdd(cdd_from_dbms(dbms.data(), 1, dim)) == cdd(zones[0].data(), dim));
+    cdd batch = cdd(cdd_from_dbms(dbms.data(), dbms.size(), dim));
+    CHECK(cdd_reduce(batch ^ chain) == cdd_false());
+    CHECK(cdd_reduce(cdd(fed) ^ chain) == cdd_false());
+    for (auto& z : zones) {
+        CHECK(cdd_contains(batch, z.data(), dim));
+    }
+}
+
+TEST_CASE("Batched containment")
+{
+    cdd_context ctx(100, 10000, 10000);
+    const cindex_t dim = 4;
+    cdd_add_clocks(dim);
+    cdd c = boxes(30, 5);
+
+    // Containment agrees with the difference of the CDDs, for random
+    // zones and for zones of the CDD which are widened by one
+    std::vector<std::vector<raw_t>> zones;
+    for (int32_t k = 0; k < 100; ++k) {
+        zones.emplace_back(dim * dim);
+        dbm_generate(zones.back().data(), dim, 60);
+    }
+    for (const raw_t* z : cdd_zones(c, dim)) {
+        zones.emplace_back(z, z + dim * dim);
+        zones.emplace_back(z, z + dim * dim);
+        raw_t* w = zones.back().data();
+        w[1 * dim] = dbm_addRawRaw(w[1 * dim], dbm_bound2raw(1, dbm_WEAK));
+        dbm_close(w, dim);
+    }
+    std::vector<const raw_t*> inside;
+    dbm::fed_t fed(dim);
+    for (auto& z : zones) {
+        bool contained = cdd_contains(c, z.data(), dim);
+        CHECK(contained == (cdd_reduce(cdd(z.data(), dim) - c) == cdd_false()));
+        if (contained) {
+            inside.push_back(z.data());
+            fed.add(z.data(), dim);
+        }
+    }
+    REQUIRE(inside.size() > 1);
+    REQUIRE(inside.size() < zones.size());
+
+    // A batch is contained if all of its zones are
+    CHECK(cdd_contains_many(c.handle(), inside.data(), 0, dim));
+    CHECK(cdd_contains_many(c.handle(), inside.data(), inside.size(), dim));
+    CHECK(cdd_contains(c, fed));
+    CHECK(cdd_contains(c | cdd(fed), fed));
+    std::vector<raw_t> all(dim * dim);
+    dbm_init(all.data(), dim);
+    inside.push_back(all.data());
+    CHECK_FALSE(cdd_contains_many(c.handle(), inside.data(), inside.size(), dim));
+    CHECK(cdd_contains_many(cddtrue, inside.data(), inside.size(), dim));
+}
+
+TEST_CASE("Point evaluation")
+{
+    cdd_context ctx(100, 10000, 10000);
+    const cindex_t dim = 4;
+    int32_t level = cdd_add_bddvar(1);
+    cdd_add_clocks(dim);
+    cdd b = cdd_bddvarpp(level);
+    cdd c = (b & boxes(20, 3)) | ((!b) & !boxes(20, 4));
+
+    cdd_frozen* f = cdd_freeze(c);
+    REQUIRE(f != nullptr);
+    std::vector<char> copy((const char*)f, (const char*)f + cdd_frozen_size(f));
+    cdd_frozen_destroy(f);
+    const cdd_frozen* g = (const cdd_frozen*)copy.data();
+
+    // A point satisfies the CDD if its zone meets it
+    std::vector<raw_t> z(dim * dim);
+    int32_t clocks[dim] = {0};
+    bool vars[8] = {false};
+    for (int32_t k = 0; k < 300; ++k) {
+        dbm_init(z.data(), dim);
+        for (cindex_t i = 1; i < dim; ++i) {
+            clocks[i] = rand() % 60;
+            REQUIRE(dbm_constrain1(z.data(), dim, i, 0, dbm_bound2raw(clocks[i], dbm_WEAK)));
+            REQUIRE(dbm_constrain1(z.data(), dim, 0, i, dbm_bound2raw(-clocks[i], dbm_WEAK)));
+        }
+        vars[level] = k % 2;
+        cdd point = cdd(z.data(), dim) & (vars[level] ? b : !b);
+        bool expected = cdd_reduce(c & point) != cdd_false();
+        CHECK(cdd_eval_point(c, clocks, vars) == expected);
+        CHECK(cdd_eval_point(!c, clocks, vars) == !expected);
+        CHECK((bool)cdd_frozen_eval(g, clocks, vars) == expected);
+    }
+
+    // Terminals freeze to a single node
+    for (ddNode* t : {cddtrue, cddfalse}) {
+        cdd_frozen* ft = cdd_freeze(t);
+        CHECK(cdd_frozen_eval(ft, clocks, vars) == (t == cddtrue));
+        CHECK(cdd_eval_point(t, clocks, vars) == (t == cddtrue));
+        cdd_frozen_destroy(ft);
+    }
+}
+
+static int32_t count_zones(const raw_t*, int32_t, void* arg) { return ++*(int32_t*)arg == 3; }
+
+TEST_CASE("Zone enumeration")
+{
+    cdd_context ctx(100, 10000, 10000);
+    const cindex_t dim = 4;
+    cdd_add_clocks(dim);
+
+    // Overlapping boxes, which split into more zones
+    std::vector<raw_t> z(dim * dim);
+    cdd c = cdd_false();
+    for (int32_t k = 0; k < 20; ++k) {
+        dbm_init(z.data(), dim);
+        for (cindex_t i = 1; i < dim; ++i) {
+            int32_t lo = (k * 7 * i) % 50;
+            REQUIRE(dbm_constrain1(z.data(), dim, 0, i, dbm_bound2raw(-lo, dbm_WEAK)));
+            REQUIRE(dbm_constrain1(z.data(), dim, i, 0, dbm_bound2raw(lo + 20, dbm_STRICT)));
+        }
+        c |= cdd(z.data(), dim);
+    }
+    c = cdd_reduce(c);
+
+    // The zones are disjoint and make up the CDD again
+    std::vector<std::vector<raw_t>> zones;
+    cdd rest = c;
+    for (const raw_t* dbm : cdd_zones(c, dim)) {
+        cdd zone(dbm, dim);
+        CHECK(cdd_reduce(zone - rest) == cdd_false());
+        rest -= zone;
+        zones.emplace_back(dbm, dbm + dim * dim);
+    }
+    CHECK(cdd_reduce(rest) == cdd_false());
+    REQUIRE(zones.size() > 1);
+
+    std::vector<const raw_t*> dbms;
+    for (auto& dbm : zones) {
+        dbms.push_back(dbm.data());
+    }
+    CHECK(cdd_reduce(cdd(cdd_from_dbms(dbms.data(), dbms.size(), dim)) ^ c) == cdd_false());
+
+    // The callback may stop the enumeration
+    int32_t cnt = 0;
+    CHECK(cdd_foreach_zone(c.handle(), dim, count_zones, &cnt) == (zones.size() < 3 ? (int32_t)zones.size() : 3));
+
+    // Terminals have the universe or no zone
+    CHECK(std::distance(cdd_zones(cdd_true(), dim).begin(), cdd_zones(cdd_true(), dim).end()) == 1);
+    CHECK(cdd_zones(cdd_false(), dim).begin() == cdd_zones(cdd_false(), dim).end());
+}
+
+TEST_CASE("Relational queries")
+{
+    cdd_context ctx(100, 10000, 10000);
+    cdd_add_clocks(4);
+
+    for (int32_t k = 0; k < 20; ++k) {
+        cdd a = boxes(10, k);
+        cdd b = boxes(10, k + 1);
+        cdd c = a | b;
+        CHECK(cdd_intersects(a, b) == (cdd_reduce(a & b) != cdd_false()));
+        CHECK(cdd_subset(a, b) == (cdd_reduce(a - b) == cdd_false()));
+        CHECK(cdd_equiv(a, b) == (cdd_reduce(a ^ b) == cdd_false()));
+        CHECK(cdd_subset(a, c));
+        CHECK(cdd_subset(a & b, a));
+        CHECK(cdd_intersects(a, c) == (cdd_reduce(a) != cdd_false()));
+        CHECK_FALSE(cdd_intersects(a, !a));
+        CHECK(cdd_equiv(c, b | a));
+        CHECK(cdd_equiv(c, (a - b) | b));
+    }
+
+    // An empty set which only reduction detects: x1 <= 1, x2 >= 0 and x1 - x2 > 3
+    cdd e = cdd_upperpp(1, 0, dbm_bound2raw(1, dbm_WEAK)) & cdd_upperpp(0, 2, dbm_bound2raw(0, dbm_WEAK)) &
+            cdd_lowerpp(1, 2, dbm_bound2raw(3, dbm_WEAK));
+    cdd x = cdd_intervalpp(1, 0, dbm_bound2raw(0, dbm_WEAK), dbm_bound2raw(10, dbm_WEAK));
+    REQUIRE(e != cdd_false());
+    REQUIRE((x | e) != x);
+    CHECK(cdd_equiv(x, x | e));
+    CHECK(cdd_equiv(e, cdd_false()));
+    CHECK_FALSE(cdd_intersects(e, cdd_true()));
+    CHECK(cdd_subset(e, cdd_false()));
+    CHECK(cdd_subset(x | e, x));
+    CHECK(cdd_subset(cdd_false(), x));
+    CHECK(cdd_subset(x, cdd_true()));
+    CHECK_FALSE(cdd_subset(cdd_true(), x));
+    CHECK_FALSE(cdd_equiv(x, cdd_true()));
+}
+
+TEST_CASE("N-ary apply")
+{
+    cdd_context ctx(100, 10000, 10000);
+    cdd_add_clocks(4);
+    int32_t var = cdd_add_bddvar(3);
+
+    // Guards of many constraints on clocks and booleans
+    std::vector<cdd> cs;
+    for (int32_t k = 0; k < 40; ++k) {
+        int32_t i = k % 3 + 1;
+        int32_t j = (k / 3) % 4;
+        if (i == j) {
+            cs.push_back(k % 2 ? cdd_bddvarpp(var + k % 3) : cdd_bddnvarpp(var + k % 3));
+        } else {
+            cs.push_back(cdd_upperpp(i, j, dbm_bound2raw(k % 13 + 1, k % 2 ? dbm_WEAK : dbm_STRICT)));
+        }
+    }
+    cdd conj = cdd_true();
+    cdd disj = cdd_false();
+    cdd par = cdd_false();
+    for (const cdd& c : cs) {
+        conj &= c;
+        disj |= c;
+        par ^= c;
+    }
+    CHECK(cdd_apply_n(cs, cddop_and) == conj);
+    CHECK(cdd_apply_n(cs, cddop_or) == disj);
+    CHECK(cdd_apply_n(cs, cddop_xor) == par);
+
+    // Mixed polarities, duplicates and terminals
+    cdd a = boxes(10, 1);
+    cdd b = boxes(10, 2);
+    cdd c = boxes(10, 3);
+    CHECK(cdd_apply_n({a, b, c}, cddop_and) == (a & b & c));
+    CHECK(cdd_apply_n({a, !b, c, a, cdd_true()}, cddop_and) == ((a - b) & c));
+    CHECK(cdd_apply_n({a, !b, c}, cddop_or) == (a | !b | c));
+    CHECK(cdd_apply_n({a, b, !a}, cddop_and) == cdd_false());
+    CHECK(cdd_apply_n({a, b, !a}, cddop_or) == cdd_true());
+    CHECK(cdd_apply_n({a, cdd_false(), c}, cddop_or) == (a | c));
+    CHECK(cdd_apply_n({a}, cddop_and) == a);
+    CHECK(cdd_apply_n(std::vector<cdd>(), cddop_and) == cdd_true());
+    CHECK(cdd_apply_n(std::vector<cdd>(), cddop_or) == cdd_false());
+    CHECK(cdd_apply(a, b, cddop_or) == (a | b));
+}
+
+TEST_CASE("Fused and-exist")
+{
+    cdd_context ctx(100, 10000, 10000);
+    cdd_add_clocks(4);
+    int32_t var = cdd_add_bddvar(2);
+    std::vector<int32_t> levels(cdd_levelcnt, 0);
+    std::vector<int32_t> clocks(cdd_clocknum, 0);
+
+    for (int32_t k = 0; k < 10; ++k) {
+        cdd state = boxes(8, k) & (k % 2 ? cdd_bddvarpp(var) : cdd_true());
+        cdd trans = (boxes(6, k + 7) & cdd_bddnvarpp(var + 1)) | (cdd_upperpp(2, 3, dbm_bound2raw(k, dbm_WEAK)) &
+                                                                  cdd_bddvarpp(var));
+        for (int32_t q = 0; q < 4; ++q) {
+            std::fill(levels.begin(), levels.end(), 0);
+            std::fill(clocks.begin(), clocks.end(), 0);
+            clocks[q % 3 + 1] = 1;
+            levels[var + q % 2] = q < 2;
+            cdd fused = cdd_and_exist(state, trans, levels.data(), clocks.data());
+            cdd plain = cdd_exist(state & trans, levels.data(), clocks.data());
+            CHECK(cdd_equiv(fused, plain));
+            CHECK(cdd_equiv(cdd_and_exist(trans, state, levels.data(), clocks.data()), plain));
+        }
+    }
+
+    std::fill(clocks.begin(), clocks.end(), 0);
+    std::fill(levels.begin(), levels.end(), 0);
+    clocks[1] = 1;
+    cdd x = boxes(8, 3);
+    CHECK(cdd_equiv(cdd_and_exist(x, cdd_true(), levels.data(), clocks.data()),
+                    cdd_exist(x, levels.data(), clocks.data())));
+    CHECK(cdd_and_exist(x, !x, levels.data(), clocks.data()) == cdd_false());
+}
+
+TEST_CASE("Clock quantification")
+{
+    cdd_context ctx(100, 10000, 10000);
+    const cindex_t dim = 4;
+    cdd_add_clocks(dim);
+    std::vector<int32_t> levels(cdd_levelcnt, 0);
+    std::vector<int32_t> clocks(cdd_clocknum, 0);
+
+    // Zones with diagonal constraints, whose projections are computed on the DBMs
+    std::vector<raw_t> z(dim * dim);
+    for (cindex_t x = 1; x < dim; ++x) {
+        cdd c = cdd_false();
+        cdd expected = cdd_false();
+        for (int32_t k = 0; k < 12; ++k) {
+            dbm_init(z.data(), dim);
+            for (cindex_t i = 1; i < dim; ++i) {
+                int32_t lo = (k * 5 * i) % 30;
+                REQUIRE(dbm_constrain1(z.data(), dim, 0, i, dbm_bound2raw(-lo, dbm_WEAK)));
+                REQUIRE(dbm_constrain1(z.data(), dim, i, 0, dbm_bound2raw(lo + 15, dbm_WEAK)));
+            }
+            if (!dbm_constrain1(z.data(), dim, 1 + k % 3, 1 + (k + 1) % 3, dbm_bound2raw(k % 7, dbm_STRICT))) {
+                continue;
+            }
+            c |= cdd(z.data(), dim);
+            REQUIRE(dbm_close(z.data(), dim));
+            for (cindex_t j = 0; j < dim; ++j) {
+                if (j != x) {
+                    z[x * dim + j] = dbm_LS_INFINITY;
+                    z[j * dim + x] = dbm_LS_INFINITY;
+                }
+            }
+            expected |= cdd(z.data(), dim);
+        }
+        std::fill(clocks.begin(), clocks.end(), 0);
+        clocks[x] = 1;
+        cdd res = cdd_exist(c, levels.data(), clocks.data());
+        CHECK(cdd_equiv(res, expected));
+        CHECK(cdd_equiv(cdd_and_exist(c, cdd_true(), levels.data(), clocks.data()), expected));
+    }
+}
+
+TEST_CASE("Quantification cache across calls")
+{
+    cdd_context ctx(100, 10000, 10000);
+    cdd_add_clocks(4);
+    std::vector<int32_t> levels(cdd_levelcnt, 0);
+    std::vector<int32_t> clocks(cdd_clocknum, 0);
+    CddCacheStat before, after;
+
+    cdd x = boxes(10, 1);
+    clocks[1] = 1;
+    cdd res = cdd_exist(x, levels.data(), clocks.data());
+
+    // Repeating the quantification finds the result of the first call
+    REQUIRE(cdd_cachestats(CDD_QUANTCACHE, &before) == 0);
+    CHECK(cdd_exist(x, levels.data(), clocks.data()) == res);
+    REQUIRE(cdd_cachestats(CDD_QUANTCACHE, &after) == 0);
+    CHECK(after.hits == before.hits + 1);
+
+    // Other sets have their own entries
+    clocks[1] = 0;
+    clocks[2] = 1;
+    cdd other = cdd_exist(x, levels.data(), clocks.data());
+    CHECK(cdd_equiv(other, cdd_exist(x, levels.data(), clocks.data())));
+    CHECK_FALSE(cdd_equiv(other, res));
+    clocks[1] = 1;
+    clocks[2] = 0;
+    CHECK(cdd_exist(x, levels.data(), clocks.data()) == res);
+
+    // The same holds for renamings
+    for (int32_t i = 0; i < cdd_levelcnt; ++i) {
+        levels[i] = i;
+    }
+    for (int32_t i = 0; i < cdd_clocknum; ++i) {
+        clocks[i] = i;
+    }
+    cdd renamed = cdd_replace(x, levels.data(), clocks.data());
+    CHECK(cdd_equiv(renamed, x));
+    REQUIRE(cdd_cachestats(CDD_REPLACECACHE, &before) == 0);
+    CHECK(cdd_replace(x, levels.data(), clocks.data()) == renamed);
+    REQUIRE(cdd_cachestats(CDD_REPLACECACHE, &after) == 0);
+    CHECK(after.hits == before.hits + 1);
+}